@@ -65,6 +65,8 @@ void Player::RegisterObject(Context* context)
 		AM_FILE)
 		// Add meta information to the accessor. In this case a not null constraint.
 		.SetMetadata(DatabaseConstants::META_NOT_NULL, Variant(true))
+		// Players are looked up by name, so the column gets an index.
+		.SetMetadata(DatabaseConstants::META_INDEXED, Variant(true))
 		.SetMetadata(DatabaseConstants::META_WIDGET_MIN_WIDTH, Variant(200));
 
 	URHO3D_ACCESSOR_ATTRIBUTE(
@@ -127,10 +129,16 @@ void HelloUrhoOrm::Start()
 	// All types must inherit from serializable.
 	dbContext_->AddTable(Player::GetTypeInfoStatic());
 
-	if (!GetSubsystem<FileSystem>()->FileExists(file))
+	bool exists = GetSubsystem<FileSystem>()->FileExists(file);
+
+	// Create tables and indices, databases of older versions get the columns
+	// and indices they miss.
+	dbContext_->CreateDatabase();
+
+	if (!exists)
 	{
-		// Database does not exist, so create tables and add some samples
-		dbContext_->CreateDatabase();
+		// Database did not exist, so add some samples in one transaction.
+		dbContext_->BeginUnitOfWork();
 
 		auto object = SharedPtr<Player>(new Player(context_));
 		object->SetPlayerName("John Doe");
@@ -155,6 +163,7 @@ void HelloUrhoOrm::Start()
 		object->SetEMail("mail3@example.de");
 
 		dbContext_->Update(object);
+		dbContext_->Commit();
 	}
 
 	// Select a player object. The argument is the where part of an sql query.
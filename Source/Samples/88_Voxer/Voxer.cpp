@@ -54,9 +54,7 @@
 URHO3D_DEFINE_APPLICATION_MAIN(VoxerSample)
 
 VoxerSample::VoxerSample(Context* context) :
-	Sample(context),
-	batch_1(0),
-	batch_2(0)
+	Sample(context)
 {
 }
 
@@ -70,6 +68,8 @@ void VoxerSample::Start()
 	CreateScene();
 	SetupViewport();
 
+	voxer_->SetViewCamera(cameraNode_->GetComponent<Camera>());
+
 	SubscribeToEvents();
 
 	/// Test the job system first.
@@ -71,6 +71,6 @@ private:
 
 	SharedPtr<VoxerSystem> voxer_;
 
-	std::atomic<int> batch_1;
-	std::atomic<int> batch_2;
+	TaskCounter batch_1;
+	TaskCounter batch_2;
 };
@@ -43,6 +43,7 @@
 #include <Urho3D/Resource/ResourceCache.h>
 #include <Urho3D/Resource/XMLFile.h>
 #include <Urho3D/Scene/Scene.h>
+#include <Urho3D/Toolbox/Mesh/ProceduralMesh.h>
 
 #ifdef WIN32
 #include <windows.h>
@@ -202,6 +203,7 @@ void BuildAndSaveMaterial(aiMaterial* material, HashSet<String>& usedTextures);
 void CopyTextures(const HashSet<String>& usedTextures, const String& sourcePath);
 
 void CombineLods(const PODVector<float>& lodDistances, const Vector<String>& modelNames, const String& outName);
+void GenerateLods(const PODVector<float>& lodDistances, const PODVector<float>& lodRatios, const String& inName, const String& outName);
 
 void GetMeshesUnderNode(Vector<Pair<aiNode*, aiMesh*> >& dest, aiNode* node);
 unsigned GetMeshIndex(aiMesh* mesh);
@@ -270,6 +272,9 @@ void Run(const Vector<String>& arguments)
             "dump        Dump scene node structure. No output file is generated\n"
             "lod         Combine several Urho3D models as LOD levels of the output model\n"
             "            Syntax: lod <dist0> <mdl0> <dist1 <mdl1> ... <output file>\n"
+            "lodgen      Add simplified LOD levels to an Urho3D model\n"
+            "            Syntax: lodgen <mdl> <dist1> <ratio1> <dist2> <ratio2> ... <output file>\n"
+            "            Each ratio is the share of triangles kept, for example 0.5\n"
             "\n"
             "Options:\n"
             "-b          Save scene in binary format, default format is XML\n"
@@ -612,6 +617,33 @@ void Run(const Vector<String>& arguments)
 
         CombineLods(lodDistances, modelNames, outFile);
     }
+    else if (command == "lodgen")
+    {
+        PODVector<float> lodDistances;
+        PODVector<float> lodRatios;
+
+        unsigned numLodArguments = 0;
+        for (unsigned i = 1; i < arguments.Size(); ++i)
+        {
+            if (arguments[i][0] == '-')
+                break;
+            ++numLodArguments;
+        }
+        if (numLodArguments < 4)
+            ErrorExit("Must define at least 1 LOD level");
+        if (numLodArguments & 1u)
+            ErrorExit("No output file defined");
+
+        String inFile = GetInternalPath(arguments[1]);
+        String outFile = GetInternalPath(arguments[numLodArguments]);
+        for (unsigned i = 2; i < numLodArguments; i += 2)
+        {
+            lodDistances.Push(Max(ToFloat(arguments[i]), 0.0f));
+            lodRatios.Push(Clamp(ToFloat(arguments[i + 1]), 0.0f, 1.0f));
+        }
+
+        GenerateLods(lodDistances, lodRatios, inFile, outFile);
+    }
     else
         ErrorExit("Unrecognized command " + command);
 }
@@ -2138,6 +2170,39 @@ void CombineLods(const PODVector<float>& lodDistances, const Vector<String>& mod
     outModel->Save(outFile);
 }
 
+void GenerateLods(const PODVector<float>& lodDistances, const PODVector<float>& lodRatios, const String& inName, const String& outName)
+{
+    PrintLine("Reading model " + inName);
+    File srcFile(context_);
+    if (!srcFile.Open(inName))
+        ErrorExit("Could not open input file " + inName);
+    SharedPtr<Model> model(new Model(context_));
+    if (!model->Load(srcFile))
+        ErrorExit("Could not load input model " + inName);
+
+    // Large geometries are simplified on all cores
+    context_->GetSubsystem<WorkQueue>()->CreateThreads(GetNumPhysicalCPUs() - 1);
+
+    for (unsigned i = 0; i < lodDistances.Size(); ++i)
+        PrintLine("Generating LOD level " + String(i + 1) + ": ratio " + String(lodRatios[i]) + " distance " + String(lodDistances[i]));
+
+    SharedPtr<ProceduralMesh> mesh(new ProceduralMesh(context_));
+    if (!mesh->GenerateLods(model, lodRatios, lodDistances))
+        ErrorExit("Could not generate LOD levels for " + inName);
+
+    for (unsigned i = 0; i < model->GetNumGeometries(); ++i)
+    {
+        if (model->GetNumGeometryLodLevels(i) == 1)
+            PrintLine("Warning: geometry " + String(i) + " was left without LOD levels");
+    }
+
+    PrintLine("Writing output model");
+    File outFile(context_);
+    if (!outFile.Open(outName, FILE_WRITE))
+        ErrorExit("Could not open output file " + outName);
+    model->Save(outFile);
+}
+
 void GetMeshesUnderNode(Vector<Pair<aiNode*, aiMesh*> >& dest, aiNode* node)
 {
     for (unsigned i = 0; i < node->mNumMeshes; ++i)
@@ -0,0 +1,231 @@
+//
+// Copyright (c) 2008-2019 the Urho3D project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#include <Urho3D/Core/Context.h>
+#include <Urho3D/Core/ProcessUtils.h>
+#include <Urho3D/Core/StringUtils.h>
+#include <Urho3D/Core/Timer.h>
+#include <Urho3D/Engine/Engine.h>
+#include <Urho3D/Engine/EngineDefs.h>
+#include <Urho3D/IO/File.h>
+#include <Urho3D/Resource/JSONFile.h>
+#include <Urho3D/Toolbox/VoxelTerrain/VoxerSystem.h>
+
+#ifdef WIN32
+#include <windows.h>
+#endif
+
+#include <Urho3D/DebugNew.h>
+
+using namespace Urho3D;
+
+// Fixed time step of the flight, independent of how long a frame takes
+static const float TIME_STEP = 1.0f / 60.0f;
+
+int main(int argc, char** argv);
+void Run(const Vector<String>& arguments);
+Vector3d GetFlightPosition(float time, float speed, float radius, float height);
+
+int main(int argc, char** argv)
+{
+    Vector<String> arguments;
+
+    #ifdef WIN32
+    arguments = ParseArguments(GetCommandLineW());
+    #else
+    arguments = ParseArguments(argc, argv);
+    #endif
+
+    Run(arguments);
+    return 0;
+}
+
+void Run(const Vector<String>& arguments)
+{
+    int chunks = 2000;
+    int maxFrames = 100000;
+    int threads = -1;
+    int range = 0;
+    float speed = 20.0f;
+    float radius = 256.0f;
+    float height = 16.0f;
+    bool greedy = false;
+    bool headless = false;
+    String outName;
+
+    for (unsigned i = 0; i < arguments.Size(); ++i)
+    {
+        String argument = arguments[i].ToLower();
+        String value = i + 1 < arguments.Size() ? arguments[i + 1] : String::EMPTY;
+        if (argument == "-h" || argument == "-help")
+        {
+            ErrorExit(
+                "Usage: VoxerBenchmark [options]\n"
+                "Generates chunks along a fixed flight path without a GPU and prints\n"
+                "the timings of the voxel terrain as JSON.\n\n"
+                "Options:\n"
+                "-n <chunks>    Stop after this many chunks have been initialized. Default 2000\n"
+                "-f <frames>    Stop after this many frames at the latest. Default 100000\n"
+                "-t <threads>   Number of worker threads. Default one per core\n"
+                "-r <chunks>    View range in chunks along each axis\n"
+                "-s <speed>     Flight speed in units per second. Default 20\n"
+                "-c <radius>    Radius of the circular flight path. Default 256\n"
+                "-y <height>    Height of the flight path. Default 16\n"
+                "-g             Use greedy meshing\n"
+                "-nm            Do not create meshes, like a dedicated server\n"
+                "-o <file>      Write the JSON to a file instead of the standard output\n",
+                EXIT_SUCCESS
+            );
+        }
+        else if (argument == "-n" && !value.Empty())
+        {
+            chunks = Max(ToInt(value), 1);
+            ++i;
+        }
+        else if (argument == "-f" && !value.Empty())
+        {
+            maxFrames = Max(ToInt(value), 1);
+            ++i;
+        }
+        else if (argument == "-t" && !value.Empty())
+        {
+            threads = Max(ToInt(value), 0);
+            ++i;
+        }
+        else if (argument == "-r" && !value.Empty())
+        {
+            range = Max(ToInt(value), 1);
+            ++i;
+        }
+        else if (argument == "-s" && !value.Empty())
+        {
+            speed = ToFloat(value);
+            ++i;
+        }
+        else if (argument == "-c" && !value.Empty())
+        {
+            radius = Max(ToFloat(value), 1.0f);
+            ++i;
+        }
+        else if (argument == "-y" && !value.Empty())
+        {
+            height = ToFloat(value);
+            ++i;
+        }
+        else if (argument == "-g")
+            greedy = true;
+        else if (argument == "-nm")
+            headless = true;
+        else if (argument == "-o" && !value.Empty())
+        {
+            outName = value;
+            ++i;
+        }
+        else
+            ErrorExit("Unrecognized option " + arguments[i]);
+    }
+
+    SharedPtr<Context> context(new Context());
+    SharedPtr<Engine> engine(new Engine(context));
+
+    VariantMap engineParameters;
+    engineParameters[EP_HEADLESS] = true;
+    engineParameters[EP_LOG_QUIET] = true;
+    // An explicit thread count replaces the engine's default one per core
+    engineParameters[EP_WORKER_THREADS] = threads < 0;
+    if (!engine->Initialize(engineParameters))
+        ErrorExit("Could not initialize the engine");
+
+    auto* queue = context->GetSubsystem<WorkQueue>();
+    if (threads > 0)
+        queue->CreateThreads((unsigned)threads);
+
+    // Frames are as fast as the terrain allows
+    engine->SetMaxFps(0);
+
+    SharedPtr<VoxerSystem> voxer(new VoxerSystem(context));
+    VoxerSettings* settings = voxer->GetSettings();
+    settings->SetGreedyMeshing(greedy);
+    settings->SetHeadless(headless);
+    if (range > 0)
+        settings->SetViewRange(Vector3i(range, range, range));
+
+    VoxerHistogram frameTimes;
+    HiresTimer totalTimer;
+    Vector<Vector3d> positions(1);
+    int frames = 0;
+    while (frames < maxFrames && Chunk::Stats->GetInitialized() < chunks)
+    {
+        HiresTimer frameTimer;
+        positions[0] = GetFlightPosition(frames * TIME_STEP, speed, radius, height);
+        voxer->Update(positions);
+        engine->RunFrame();
+        frameTimes.Add((unsigned)Min(frameTimer.GetUSec(false), (long long)M_MAX_UNSIGNED));
+        ++frames;
+    }
+
+    // The chunks in flight are part of the run
+    voxer->GetChunkProvider()->Shutdown();
+    long long totalTime = totalTimer.GetUSec(false);
+
+    if (Chunk::Stats->GetInitialized() < chunks)
+        PrintLine("Warning: stopped after " + String(frames) + " frames with " + String(Chunk::Stats->GetInitialized()) +
+            " of " + String(chunks) + " chunks", true);
+
+    SharedPtr<JSONFile> json(new JSONFile(context));
+    JSONValue& root = json->GetRoot();
+    JSONValue& run = root["run"];
+    run["chunks"] = chunks;
+    run["frames"] = frames;
+    run["threads"] = queue->GetNumThreads();
+    run["speed"] = speed;
+    run["radius"] = radius;
+    run["height"] = height;
+    run["greedy"] = greedy;
+    run["headless"] = headless;
+    run["seconds"] = totalTime / 1000000.0;
+    run["chunksPerSecond"] = totalTime > 0 ? Chunk::Stats->GetInitialized() * 1000000.0 / totalTime : 0.0;
+    frameTimes.ToJSON(root["frame"]);
+    Chunk::Stats->ToJSON(root["voxer"]);
+
+    if (outName.Empty())
+        PrintLine(json->ToString("  "));
+    else
+    {
+        File outFile(context);
+        if (!outFile.Open(outName, FILE_WRITE) || !json->Save(outFile, "  "))
+            ErrorExit("Could not write " + outName);
+    }
+
+    voxer.Reset();
+    engine->Exit();
+}
+
+Vector3d GetFlightPosition(float time, float speed, float radius, float height)
+{
+    // A circle with a slow climb and descent, the same path on every run
+    double angle = time * speed / radius;
+    return Vector3d(
+        radius * cos(angle),
+        height + radius * 0.125 * sin(angle * 3.0),
+        radius * sin(angle));
+}
@@ -31,6 +31,50 @@
 namespace Urho3D
 {
 
+	/// Index of the task queue owned by the calling thread. 0 is the main thread.
+	static thread_local unsigned currentTaskQueue = 0;
+
+	/// Shared state of the work items of a single ParallelFor call.
+	struct ParallelForState
+	{
+		/// First index, that has not been claimed yet.
+		std::atomic<unsigned> next_;
+		/// End of the range.
+		unsigned end_;
+		/// Minimum chunk size.
+		unsigned grain_;
+		/// Number of threads working on the range.
+		unsigned numThreads_;
+		/// Function to call for each chunk.
+		ParallelForFunction function_;
+		/// User data.
+		void* data_;
+	};
+
+	/// Claim chunks of the range until it is exhausted.
+	static void ParallelForWork(const WorkItem* item, unsigned threadIndex)
+	{
+		auto* state = reinterpret_cast<ParallelForState*>(item->aux_);
+
+		for (;;)
+		{
+			unsigned start = state->next_.load();
+			unsigned size = 0;
+
+			do
+			{
+				if (start >= state->end_)
+					return;
+
+				// Guided scheduling: take a share of what is left, but never less than the grain size
+				unsigned remaining = state->end_ - start;
+				size = Min(Max(state->grain_, remaining / (2 * state->numThreads_)), remaining);
+			} while (!state->next_.compare_exchange_weak(start, start + size));
+
+			state->function_(start, start + size, threadIndex, state->data_);
+		}
+	}
+
 	/// Worker thread managed by the work queue.
 	class WorkerThread : public Thread, public RefCounted
 	{
@@ -74,6 +118,8 @@ namespace Urho3D
 	{
 		SubscribeToEvent(E_BEGINFRAME, URHO3D_HANDLER(WorkQueue, HandleBeginFrame));
 		mTaskCount.store(0);
+		mQueuedItems.store(0);
+		mTaskQueues.Push(SharedPtr<TaskDeque>(new TaskDeque()));
 	}
 
 	WorkQueue::~WorkQueue()
@@ -81,9 +127,17 @@ namespace Urho3D
 		// Stop the worker threads. First make sure they are not waiting for work items
 		shutDown_ = true;
 		Resume();
+		NotifyWorkers(true);
 
 		for (unsigned i = 0; i < threads_.Size(); ++i)
 			threads_[i]->Stop();
+
+		// Tasks that never got the chance to run
+		for (unsigned i = 0; i < mTaskQueues.Size(); ++i)
+		{
+			while (Task* t = mTaskQueues[i]->Pop())
+				mTaskPool.Release(t);
+		}
 	}
 
 	void WorkQueue::CreateThreads(unsigned numThreads)
@@ -97,6 +151,10 @@ namespace Urho3D
 		// Start threads in paused mode
 		Pause();
 
+		// Every worker gets its own task queue
+		for (unsigned i = 0; i < numThreads; ++i)
+			mTaskQueues.Push(SharedPtr<TaskDeque>(new TaskDeque()));
+
 		for (unsigned i = 0; i < numThreads; ++i)
 		{
 			SharedPtr<WorkerThread> thread(new WorkerThread(this, i + 1));
@@ -145,6 +203,60 @@ namespace Urho3D
 		if (threads_.Size() && !paused_)
 			queueMutex_.Acquire();
 
+		InsertWorkItem(item);
+
+		if (threads_.Size())
+		{
+			queueMutex_.Release();
+			paused_ = false;
+			NotifyWorkers(false);
+		}
+	}
+
+	void WorkQueue::AddWorkItems(const Vector<SharedPtr<WorkItem> >& items)
+	{
+		if (items.Empty())
+			return;
+
+		for (Vector<SharedPtr<WorkItem> >::ConstIterator i = items.Begin(); i != items.End(); ++i)
+		{
+			if (!*i)
+			{
+				URHO3D_LOGERROR("Null work item submitted to the work queue");
+				return;
+			}
+
+			// Check for duplicate items.
+			assert(!workItems_.Contains(*i));
+		}
+
+		// Push to the main thread list to keep items alive
+		// Clear completed flag in case items are reused
+		for (Vector<SharedPtr<WorkItem> >::ConstIterator i = items.Begin(); i != items.End(); ++i)
+		{
+			workItems_.Push(*i);
+			(*i)->completed_ = false;
+		}
+
+		// Make sure worker threads' list is safe to modify, but only once for all items
+		if (threads_.Size() && !paused_)
+			queueMutex_.Acquire();
+
+		for (Vector<SharedPtr<WorkItem> >::ConstIterator i = items.Begin(); i != items.End(); ++i)
+			InsertWorkItem(*i);
+
+		if (threads_.Size())
+		{
+			queueMutex_.Release();
+			paused_ = false;
+			NotifyWorkers(true);
+		}
+	}
+
+	void WorkQueue::InsertWorkItem(WorkItem* item)
+	{
+		++mQueuedItems;
+
 		// Find position for new item
 		if (queue_.Empty())
 			queue_.Push(item);
@@ -165,12 +277,15 @@ namespace Urho3D
 			if (!inserted)
 				queue_.Push(item);
 		}
+	}
 
-		if (threads_.Size())
-		{
-			queueMutex_.Release();
-			paused_ = false;
-		}
+	WorkItem* WorkQueue::PopWorkItem()
+	{
+		WorkItem* item = queue_.Front();
+		queue_.PopFront();
+		--mQueuedItems;
+
+		return item;
 	}
 
 	bool WorkQueue::RemoveWorkItem(SharedPtr<WorkItem> item)
@@ -188,6 +303,7 @@ namespace Urho3D
 			if (j != workItems_.End())
 			{
 				queue_.Erase(i);
+				--mQueuedItems;
 				ReturnToPool(item);
 				workItems_.Erase(j);
 				return true;
@@ -211,6 +327,7 @@ namespace Urho3D
 				if (k != workItems_.End())
 				{
 					queue_.Erase(j);
+					--mQueuedItems;
 					ReturnToPool(*k);
 					workItems_.Erase(k);
 					++removed;
@@ -240,6 +357,7 @@ namespace Urho3D
 		{
 			queueMutex_.Release();
 			paused_ = false;
+			NotifyWorkers(true);
 		}
 	}
 
@@ -258,8 +376,7 @@ namespace Urho3D
 				queueMutex_.Acquire();
 				if (!queue_.Empty() && queue_.Front()->priority_ >= priority)
 				{
-					WorkItem* item = queue_.Front();
-					queue_.PopFront();
+					WorkItem* item = PopWorkItem();
 					queueMutex_.Release();
 					item->workFunction_(item, 0);
 					item->completed_ = true;
@@ -285,8 +402,7 @@ namespace Urho3D
 			// No worker threads: ensure all high-priority items are completed in the main thread
 			while (!queue_.Empty() && queue_.Front()->priority_ >= priority)
 			{
-				WorkItem* item = queue_.Front();
-				queue_.PopFront();
+				WorkItem* item = PopWorkItem();
 				item->workFunction_(item, 0);
 				item->completed_ = true;
 			}
@@ -296,6 +412,48 @@ namespace Urho3D
 		completing_ = false;
 	}
 
+	void WorkQueue::ParallelFor(unsigned begin, unsigned end, unsigned grain, ParallelForFunction func, void* data)
+	{
+		if (begin >= end)
+			return;
+
+		grain = Max(grain, 1U);
+		unsigned numChunks = (end - begin + grain - 1) / grain;
+		unsigned numItems = Min(threads_.Size() + 1, numChunks); // Worker threads + main thread
+
+		// Not worth distributing
+		if (numItems < 2)
+		{
+			func(begin, end, 0, data);
+			return;
+		}
+
+		ParallelForState state;
+		state.next_.store(begin);
+		state.end_ = end;
+		state.grain_ = grain;
+		state.numThreads_ = numItems;
+		state.function_ = func;
+		state.data_ = data;
+
+		// Only one item per thread, the items claim their chunks themselves
+		parallelForItems_.Clear();
+		for (unsigned i = 0; i < numItems; ++i)
+		{
+			SharedPtr<WorkItem> item = GetFreeItem();
+			item->priority_ = M_MAX_UNSIGNED;
+			item->workFunction_ = ParallelForWork;
+			item->aux_ = &state;
+			parallelForItems_.Push(item);
+		}
+
+		AddWorkItems(parallelForItems_);
+		parallelForItems_.Clear();
+
+		// The state lives on the stack, so wait for all items to finish
+		Complete(M_MAX_UNSIGNED);
+	}
+
 	bool WorkQueue::IsCompleted(unsigned priority) const
 	{
 		for (List<SharedPtr<WorkItem> >::ConstIterator i = workItems_.Begin(); i != workItems_.End(); ++i)
@@ -309,43 +467,37 @@ namespace Urho3D
 
 	void WorkQueue::ProcessItems(unsigned threadIndex)
 	{
-		bool wasActive = false;
+		currentTaskQueue = threadIndex;
 
 		for (;;)
 		{
 			if (shutDown_)
 				return;
 
-			if (pausing_ && !wasActive)
-				Time::Sleep(0);
-			else
+			// Tasks do not depend on the work item queue, so they keep
+			// running while the queue is paused.
+			Task* t = GetNextTask(threadIndex);
+			if (t != nullptr)
 			{
-				Task* t = GetNextTask();
-				if (t != nullptr)
-				{
-					t->Execute();
-					delete t;
-				}
+				ExecuteTask(t, threadIndex);
+				continue;
+			}
 
-				queueMutex_.Acquire();
+			if (!pausing_ && queueMutex_.TryAcquire())
+			{
 				if (!queue_.Empty())
 				{
-					wasActive = true;
-
-					WorkItem* item = queue_.Front();
-					queue_.PopFront();
+					WorkItem* item = PopWorkItem();
 					queueMutex_.Release();
 					item->workFunction_(item, threadIndex);
 					item->completed_ = true;
+					continue;
 				}
-				else
-				{
-					wasActive = false;
 
-					queueMutex_.Release();
-					Time::Sleep(0);
-				}
+				queueMutex_.Release();
 			}
+
+			WaitForWork();
 		}
 	}
 
@@ -419,25 +571,23 @@ namespace Urho3D
 
 			while (!queue_.Empty() && timer.GetUSec(false) < maxNonThreadedWorkMs_ * 1000LL)
 			{
-				WorkItem* item = queue_.Front();
-				queue_.PopFront();
+				WorkItem* item = PopWorkItem();
 				item->workFunction_(item, 0);
 				item->completed_ = true;
 			}
 		}
 
 		/// Work tasks on main thread if there
-		/// are no worker threads.
-		/// Run only one task per Frame (?)
+		/// are no worker threads. Use the same time budget as for work items.
 		if (threads_.Empty())
 		{
-			Task* t = GetNextTask();
-			if (t != nullptr)
-			{
-				t->Execute();
-				delete t;
-				/*t = GetNextTask();*/
-			}
+			URHO3D_PROFILE(CompleteTasksNonthreaded);
+
+			HiresTimer timer;
+			Task* t = nullptr;
+
+			while (timer.GetUSec(false) < maxNonThreadedWorkMs_ * 1000LL && (t = GetNextTask(0)) != nullptr)
+				ExecuteTask(t, 0);
 		}
 
 		// Complete and signal items down to the lowest priority
@@ -445,41 +595,177 @@ namespace Urho3D
 		PurgePool();
 	}
 
-	Task* WorkQueue::GetNextTask()
+	Task* WorkQueue::GetNextTask(unsigned threadIndex)
+	{
+		if (mTaskCount.load() < 1)
+		{
+			return nullptr;
+		}
+
+		unsigned count = mTaskQueues.Size();
+		if (threadIndex >= count)
+		{
+			threadIndex = 0;
+		}
+
+		/// Own queue first, newest task first. Steal the oldest
+		/// task of the other queues afterwards.
+		Task* t = mTaskQueues[threadIndex]->Pop();
+		for (unsigned i = 1; t == nullptr && i < count; i++)
+		{
+			t = mTaskQueues[(threadIndex + i) % count]->Steal();
+		}
+
+		if (t != nullptr)
+		{
+			--mTaskCount;
+		}
+
+		return t;
+	}
+
+	void WorkQueue::ExecuteTask(Task* t, unsigned threadIndex)
 	{
-		Task* t = nullptr;
-		int maxCount = mTaskCount.load();
-		int count = 0;
+		t->Execute();
 
-		//if(maxCount > 0)
-		//	URHO3D_LOGDEBUGF("Tasks: %d", maxCount);
+		TaskCounter* counter = t->GetCounter();
+		mTaskPool.Release(t);
 
-		while (mTasks.try_dequeue(t) && (count < maxCount))
+		if (counter == nullptr)
 		{
-			if (t->CanExecute())
+			return;
+		}
+
+		/// Reused per thread to keep task completion allocation free.
+		static thread_local PODVector<Task*> released;
+		released.Clear();
+
+		if (!counter->Decrement(released))
+		{
+			return;
+		}
+
+		for (unsigned i = 0; i < released.Size(); i++)
+		{
+			if (released[i]->Release())
 			{
-				--mTaskCount;
-				return t;
+				PushTask(released[i], threadIndex);
 			}
-
-			mTasks.enqueue(t);
-			count++;
 		}
 
-		return nullptr;
+		/// Someone might be waiting for this counter.
+		NotifyWorkers(true);
 	}
 
-	void WorkQueue::AddTask(
-		std::function<void(void*)> func,
-		void* userData,
-		std::atomic<int>* batch,
-		std::atomic<int>* dependencies)
+	void WorkQueue::PushTask(Task* t, unsigned threadIndex)
 	{
-		Task* t = new Task(batch, dependencies);
-		t->Function = func;
-		t->Data = userData;
+		if (threadIndex >= mTaskQueues.Size())
+		{
+			threadIndex = 0;
+		}
 
+		mTaskQueues[threadIndex]->Push(t);
 		++mTaskCount;
-		mTasks.enqueue(t);
+
+		NotifyWorkers(false);
+	}
+
+	void WorkQueue::WaitForWork(TaskCounter* counter)
+	{
+		std::unique_lock<std::mutex> lock(mWorkSignalMutex);
+
+		/// Every change of the counters and flags is followed by
+		/// NotifyWorkers, so no wake up is missed and idle threads sleep.
+		mWorkSignal.wait(lock, [this, counter]()
+		{
+			return shutDown_ || mTaskCount.load() > 0 || (!paused_.load() && mQueuedItems.load() > 0) ||
+				(counter != nullptr && counter->IsDone());
+		});
+	}
+
+	void WorkQueue::NotifyWorkers(bool all)
+	{
+		{
+			std::lock_guard<std::mutex> lock(mWorkSignalMutex);
+		}
+
+		if (all)
+			mWorkSignal.notify_all();
+		else
+			mWorkSignal.notify_one();
+	}
+
+	Task* WorkQueue::AcquireTask(TaskCounter* batch)
+	{
+		Task* t = mTaskPool.Acquire();
+		t->Reset(batch);
+
+		return t;
+	}
+
+	void WorkQueue::SubmitTask(Task* t)
+	{
+		if (t == nullptr)
+		{
+			URHO3D_LOGERROR("Null task submitted to the work queue");
+			return;
+		}
+
+		if (t->Release())
+		{
+			PushTask(t, currentTaskQueue);
+		}
+	}
+
+	void WorkQueue::SubmitTasks(const PODVector<Task*>& tasks)
+	{
+		// Collect the runnable ones and push them with a single lock
+		static thread_local PODVector<Task*> runnable;
+		runnable.Clear();
+
+		for (unsigned i = 0; i < tasks.Size(); i++)
+		{
+			if (tasks[i] == nullptr)
+			{
+				URHO3D_LOGERROR("Null task submitted to the work queue");
+				continue;
+			}
+
+			if (tasks[i]->Release())
+			{
+				runnable.Push(tasks[i]);
+			}
+		}
+
+		if (runnable.Empty())
+		{
+			return;
+		}
+
+		unsigned threadIndex = currentTaskQueue < mTaskQueues.Size() ? currentTaskQueue : 0;
+		mTaskQueues[threadIndex]->Push(runnable.Buffer(), runnable.Size());
+		mTaskCount += runnable.Size();
+
+		NotifyWorkers(true);
+	}
+
+	void WorkQueue::WaitForCounter(TaskCounter* counter)
+	{
+		if (counter == nullptr)
+		{
+			return;
+		}
+
+		while (!counter->IsDone())
+		{
+			Task* t = GetNextTask(currentTaskQueue);
+			if (t != nullptr)
+			{
+				ExecuteTask(t, currentTaskQueue);
+				continue;
+			}
+
+			WaitForWork(counter);
+		}
 	}
 }
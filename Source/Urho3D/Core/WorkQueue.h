@@ -27,7 +27,10 @@
 #include "../Core/Object.h"
 
 #include "../Toolbox/VoxelTerrain/Task.h"
-#include "../Container/ConcurentQueue.h"
+
+#include <condition_variable>
+#include <mutex>
+#include <type_traits>
 
 namespace Urho3D
 {
@@ -40,6 +43,9 @@ namespace Urho3D
 
 	class WorkerThread;
 
+	/// Function called by WorkQueue::ParallelFor for each chunk of the range.
+	using ParallelForFunction = void(*)(unsigned start, unsigned end, unsigned threadIndex, void* data);
+
 	/// Work queue item.
 	struct WorkItem : public RefCounted
 	{
@@ -84,6 +90,8 @@ namespace Urho3D
 		SharedPtr<WorkItem> GetFreeItem();
 		/// Add a work item and resume worker threads.
 		void AddWorkItem(const SharedPtr<WorkItem>& item);
+		/// Add a number of work items acquiring the queue mutex only once and resume worker threads.
+		void AddWorkItems(const Vector<SharedPtr<WorkItem> >& items);
 		/// Remove a work item before it has started executing. Return true if successfully removed.
 		bool RemoveWorkItem(SharedPtr<WorkItem> item);
 		/// Remove a number of work items before they have started executing. Return the number of items successfully removed.
@@ -95,6 +103,20 @@ namespace Urho3D
 		/// Finish all queued work which has at least the specified priority. Main thread will also execute priority work. Pause worker threads if no more work remains.
 		void Complete(unsigned priority);
 
+		/// Split the range [begin, end) into chunks of at least grain elements and process them on all threads including the main thread. Chunks start large and get smaller towards the end of the range to balance the load. The function is called as func(start, end, threadIndex) and a thread index is never used by two chunks at once. Blocks until the whole range has been processed. Must be called from the main thread.
+		template<class F>
+		void ParallelFor(unsigned begin, unsigned end, unsigned grain, F&& func)
+		{
+			using Fn = typename std::remove_reference<F>::type;
+			ParallelFor(begin, end, grain, [](unsigned start, unsigned stop, unsigned threadIndex, void* data)
+			{
+				(*reinterpret_cast<Fn*>(data))(start, stop, threadIndex);
+			}, const_cast<void*>(reinterpret_cast<const void*>(&func)));
+		}
+
+		/// Same as above using a plain function and user data.
+		void ParallelFor(unsigned begin, unsigned end, unsigned grain, ParallelForFunction func, void* data);
+
 		/// Set the pool telerance before it starts deleting pool items.
 		void SetTolerance(int tolerance) {
 			tolerance_ = tolerance;
@@ -128,15 +150,50 @@ namespace Urho3D
 			return maxNonThreadedWorkMs_;
 		}
 
-		/// Get the next task to work on
-		Task* GetNextTask();
+		/// Create a task without handing it to the workers yet. Parents can be
+		/// declared using Task::DependsOn before calling SubmitTask.
+		/// The task is taken from a pool and the function is stored inline,
+		/// so this does not allocate once the pool has warmed up.
+		template<class F>
+		Task* CreateTask(
+			F&& func,
+			void* userData,
+			TaskCounter* batch)
+		{
+			Task* t = AcquireTask(batch);
+			t->Function.Set(std::forward<F>(func));
+			t->Data = userData;
+
+			return t;
+		}
+
+		/// Hand a created task to the workers. It is executed as soon as all its parents have finished.
+		void SubmitTask(Task* t);
 
-		/// Add a task
+		/// Hand a number of created tasks to the workers, pushing all runnable ones at once.
+		void SubmitTasks(const PODVector<Task*>& tasks);
+
+		/// Add a task, which runs once the dependency counter has reached zero.
+		template<class F>
 		void AddTask(
-			std::function<void(void*)> func,
+			F&& func,
 			void* userData,
-			std::atomic<int>* batch,
-			std::atomic<int>* dependencies);
+			TaskCounter* batch,
+			TaskCounter* dependency)
+		{
+			Task* t = CreateTask(std::forward<F>(func), userData, batch);
+			t->DependsOn(dependency);
+			SubmitTask(t);
+		}
+
+		/// Return the number of task objects allocated by the pool so far.
+		unsigned GetTaskPoolCapacity() const
+		{
+			return mTaskPool.GetCapacity();
+		}
+
+		/// Block until the counter reaches zero. The calling thread helps executing tasks meanwhile.
+		void WaitForCounter(TaskCounter* counter);
 
 	private:
 		/// Process work items until shut down. Called by the worker threads.
@@ -151,9 +208,34 @@ namespace Urho3D
 		/// Return a work item to the pool.
 		void ReturnToPool(SharedPtr<WorkItem>& item);
 
+		/// Insert a work item into the prioritized queue. The queue mutex must be held if there are worker threads.
+		void InsertWorkItem(WorkItem* item);
+
 		/// Handle frame start event. Purge completed work from the main thread queue, and perform work if no threads at all.
 		void HandleBeginFrame(StringHash eventType, VariantMap& eventData);
 
+		/// Get a recycled task from the pool.
+		Task* AcquireTask(TaskCounter* batch);
+
+		/// Get the next runnable task. Try the threads own queue first, then steal from the others.
+		Task* GetNextTask(unsigned threadIndex);
+
+		/// Execute a task and release the tasks waiting for its batch.
+		void ExecuteTask(Task* t, unsigned threadIndex);
+
+		/// Make a runnable task visible to the workers.
+		void PushTask(Task* t, unsigned threadIndex);
+
+		/// Take the front item of queue_. Caller holds queueMutex_ if there are worker threads.
+		WorkItem* PopWorkItem();
+
+		/// Block the calling thread until there is something to do, or the
+		/// given counter is done.
+		void WaitForWork(TaskCounter* counter = nullptr);
+
+		/// Wake up threads blocked in WaitForWork.
+		void NotifyWorkers(bool all);
+
 		/// Worker threads.
 		Vector<SharedPtr<WorkerThread> > threads_;
 
@@ -166,6 +248,9 @@ namespace Urho3D
 		/// Work item prioritized queue for worker threads. Pointers are guaranteed to be valid (point to workItems.)
 		List<WorkItem*> queue_;
 
+		/// Work items of the running ParallelFor. Reused to avoid allocation.
+		Vector<SharedPtr<WorkItem> > parallelForItems_;
+
 		/// Worker queue mutex.
 		Mutex queueMutex_;
 
@@ -176,7 +261,7 @@ namespace Urho3D
 		volatile bool pausing_;
 
 		/// Paused flag. Indicates the queue mutex being locked to prevent worker threads using up CPU time.
-		bool paused_;
+		std::atomic<bool> paused_;
 
 		/// Completing work in the main thread flag.
 		bool completing_;
@@ -193,8 +278,18 @@ namespace Urho3D
 		/// Tasksystem
 		/// Task are being run on the main thread only if there are no
 		/// worker threads and are meant to handle more complex code.
-		moodycamel::ConcurrentQueue<Task*> mTasks;
+		/// One queue per thread, index 0 belongs to the main thread.
+		Vector<SharedPtr<TaskDeque> > mTaskQueues;
+		/// Recycled task objects.
+		TaskPool mTaskPool;
+		/// Number of runnable tasks in all queues.
 		std::atomic<int> mTaskCount;
+		/// Number of work items in queue_, readable without queueMutex_.
+		std::atomic<int> mQueuedItems;
+
+		/// Signals idle threads that new work has arrived.
+		std::mutex mWorkSignalMutex;
+		std::condition_variable mWorkSignal;
 	};
 
 }
@@ -55,6 +55,9 @@
 namespace Urho3D
 {
 
+/// Minimum number of drawables checked for visibility by one work item.
+static const unsigned DRAWABLES_PER_VISIBILITY_CHUNK = 64;
+
 /// %Frustum octree query for shadowcasters.
 class ShadowCasterOctreeQuery : public FrustumOctreeQuery
 {
@@ -157,11 +160,8 @@ public:
     OcclusionBuffer* buffer_;
 };
 
-void CheckVisibilityWork(const WorkItem* item, unsigned threadIndex)
+void CheckVisibilityWork(View* view, Drawable** start, Drawable** end, unsigned threadIndex)
 {
-    auto* view = reinterpret_cast<View*>(item->aux_);
-    auto** start = reinterpret_cast<Drawable**>(item->start_);
-    auto** end = reinterpret_cast<Drawable**>(item->end_);
     OcclusionBuffer* buffer = view->occlusionBuffer_;
     const Matrix3x4& viewMatrix = view->cullCamera_->GetView();
     Vector3 viewZ = Vector3(viewMatrix.m20_, viewMatrix.m21_, viewMatrix.m22_);
@@ -226,14 +226,6 @@ void CheckVisibilityWork(const WorkItem* item, unsigned threadIndex)
     }
 }
 
-void ProcessLightWork(const WorkItem* item, unsigned threadIndex)
-{
-    auto* view = reinterpret_cast<View*>(item->aux_);
-    auto* query = reinterpret_cast<LightQueryResult*>(item->start_);
-
-    view->ProcessLight(*query, threadIndex);
-}
-
 void UpdateDrawableGeometriesWork(const WorkItem* item, unsigned threadIndex)
 {
     const FrameInfo& frame = *(reinterpret_cast<FrameInfo*>(item->aux_));
@@ -886,30 +878,12 @@ void View::GetDrawables()
             result.maxZ_ = 0.0f;
         }
 
-        int numWorkItems = queue->GetNumThreads() + 1; // Worker threads + main thread
-        int drawablesPerItem = tempDrawables.Size() / numWorkItems;
-
-        PODVector<Drawable*>::Iterator start = tempDrawables.Begin();
-        // Create a work item for each thread
-        for (int i = 0; i < numWorkItems; ++i)
+        // Occlusion tests make the cost per drawable uneven, so let the work queue balance the chunks
+        Drawable** drawables = tempDrawables.Buffer();
+        queue->ParallelFor(0, tempDrawables.Size(), DRAWABLES_PER_VISIBILITY_CHUNK, [this, drawables](unsigned start, unsigned end, unsigned threadIndex)
         {
-            SharedPtr<WorkItem> item = queue->GetFreeItem();
-            item->priority_ = M_MAX_UNSIGNED;
-            item->workFunction_ = CheckVisibilityWork;
-            item->aux_ = this;
-
-            PODVector<Drawable*>::Iterator end = tempDrawables.End();
-            if (i < numWorkItems - 1 && end - start > drawablesPerItem)
-                end = start + drawablesPerItem;
-
-            item->start_ = &(*start);
-            item->end_ = &(*end);
-            queue->AddWorkItem(item);
-
-            start = end;
-        }
-
-        queue->Complete(M_MAX_UNSIGNED);
+            CheckVisibilityWork(this, drawables + start, drawables + end, threadIndex);
+        });
     }
 
     // Combine lights, geometries & scene Z range from the threads
@@ -975,21 +949,14 @@ void View::ProcessLights()
     lightQueryResults_.Resize(lights_.Size());
 
     for (unsigned i = 0; i < lightQueryResults_.Size(); ++i)
-    {
-        SharedPtr<WorkItem> item = queue->GetFreeItem();
-        item->priority_ = M_MAX_UNSIGNED;
-        item->workFunction_ = ProcessLightWork;
-        item->aux_ = this;
-
-        LightQueryResult& query = lightQueryResults_[i];
-        query.light_ = lights_[i];
+        lightQueryResults_[i].light_ = lights_[i];
 
-        item->start_ = &query;
-        queue->AddWorkItem(item);
-    }
-
-    // Ensure all lights have been processed before proceeding
-    queue->Complete(M_MAX_UNSIGNED);
+    // Lights differ a lot in cost, so hand them out one at a time. Returns once all lights have been processed
+    queue->ParallelFor(0, lightQueryResults_.Size(), 1, [this](unsigned start, unsigned end, unsigned threadIndex)
+    {
+        for (unsigned i = start; i < end; ++i)
+            ProcessLight(lightQueryResults_[i], threadIndex);
+    });
 }
 
 void View::GetLightBatches()
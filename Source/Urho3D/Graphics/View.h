@@ -109,8 +109,7 @@ static const unsigned MAX_VIEWPORT_TEXTURES = 2;
 /// Internal structure for 3D rendering work. Created for each backbuffer and texture viewport, but not for shadow cameras.
 class URHO3D_API View : public Object
 {
-    friend void CheckVisibilityWork(const WorkItem* item, unsigned threadIndex);
-    friend void ProcessLightWork(const WorkItem* item, unsigned threadIndex);
+    friend void CheckVisibilityWork(View* view, Drawable** start, Drawable** end, unsigned threadIndex);
 
     URHO3D_OBJECT(View, Object);
 
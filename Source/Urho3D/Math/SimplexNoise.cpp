@@ -24,10 +24,20 @@
  * or copy at http://opensource.org/licenses/MIT)
  */
 
+#ifdef URHO3D_IS_BUILDING
+#include "Urho3D.h"
+#else
+#include <Urho3D/Urho3D.h>
+#endif
+
 #include "SimplexNoise.h"
 
 #include <cstdint>  // int32_t/uint8_t
 
+#ifdef URHO3D_SSE
+#include <emmintrin.h>
+#endif
+
 /**
  * Computes the largest integer value not greater than the float one
  *
@@ -473,3 +483,297 @@ float SimplexNoise::fractal(size_t octaves, float x, float y, float z) const {
 
     return (output / denom);
 }
+
+#ifdef URHO3D_SSE
+
+/**
+ * Four lane versions of the helpers above. They follow the scalar code
+ * operation by operation, so the batched functions return the same values.
+ */
+static inline __m128i fastfloor4(__m128 fp) {
+    const __m128i i = _mm_cvttps_epi32(fp);
+    // Subtract one where the truncation rounded up (negative values); the mask is -1 there
+    return _mm_add_epi32(i, _mm_castps_si128(_mm_cmplt_ps(fp, _mm_cvtepi32_ps(i))));
+}
+
+static inline __m128 select4(__m128 mask, __m128 a, __m128 b) {
+    return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+}
+
+static inline __m128 negate4(__m128i hash, int bit, __m128 value) {
+    const __m128i b = _mm_set1_epi32(bit);
+    const __m128 mask = _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(hash, b), b));
+    return _mm_xor_ps(value, _mm_and_ps(mask, _mm_set1_ps(-0.0f)));
+}
+
+static inline __m128 grad4(__m128i hash, __m128 x, __m128 y) {
+    const __m128i h = _mm_and_si128(hash, _mm_set1_epi32(0x3F));
+    const __m128 lt4 = _mm_castsi128_ps(_mm_cmplt_epi32(h, _mm_set1_epi32(4)));
+    const __m128 u = select4(lt4, x, y);
+    const __m128 v = select4(lt4, y, x);
+    return _mm_add_ps(negate4(h, 1, u), negate4(h, 2, _mm_mul_ps(_mm_set1_ps(2.0f), v)));
+}
+
+static inline __m128 grad4(__m128i hash, __m128 x, __m128 y, __m128 z) {
+    const __m128i h = _mm_and_si128(hash, _mm_set1_epi32(15));
+    const __m128 lt8 = _mm_castsi128_ps(_mm_cmplt_epi32(h, _mm_set1_epi32(8)));
+    const __m128 lt4 = _mm_castsi128_ps(_mm_cmplt_epi32(h, _mm_set1_epi32(4)));
+    const __m128 useX = _mm_castsi128_ps(_mm_or_si128(
+        _mm_cmpeq_epi32(h, _mm_set1_epi32(12)), _mm_cmpeq_epi32(h, _mm_set1_epi32(14))));
+    const __m128 u = select4(lt8, x, y);
+    const __m128 v = select4(lt4, y, select4(useX, x, z));
+    return _mm_add_ps(negate4(h, 1, u), negate4(h, 2, v));
+}
+
+/**
+ * Contribution of one simplex corner, zero outside of its radius
+ */
+static inline __m128 corner4(__m128 radius, __m128 gradient, __m128 x, __m128 y) {
+    __m128 t = _mm_sub_ps(_mm_sub_ps(radius, _mm_mul_ps(x, x)), _mm_mul_ps(y, y));
+    const __m128 inside = _mm_cmpge_ps(t, _mm_setzero_ps());
+    t = _mm_mul_ps(t, t);
+    return _mm_and_ps(inside, _mm_mul_ps(_mm_mul_ps(t, t), gradient));
+}
+
+static inline __m128 corner4(__m128 radius, __m128 gradient, __m128 x, __m128 y, __m128 z) {
+    __m128 t = _mm_sub_ps(_mm_sub_ps(_mm_sub_ps(radius, _mm_mul_ps(x, x)), _mm_mul_ps(y, y)), _mm_mul_ps(z, z));
+    const __m128 inside = _mm_cmpge_ps(t, _mm_setzero_ps());
+    t = _mm_mul_ps(t, t);
+    return _mm_and_ps(inside, _mm_mul_ps(_mm_mul_ps(t, t), gradient));
+}
+
+/**
+ * 2D Perlin simplex noise of four points. SSE2 has no gather, so only the
+ * permutation table lookups are done one lane at a time.
+ */
+static __m128 noise4(__m128 x, __m128 y) {
+    const __m128 F2 = _mm_set1_ps(0.366025403f);
+    const __m128 G2 = _mm_set1_ps(0.211324865f);
+    const __m128 one = _mm_set1_ps(1.0f);
+
+    const __m128 s = _mm_mul_ps(_mm_add_ps(x, y), F2);
+    const __m128i i = fastfloor4(_mm_add_ps(x, s));
+    const __m128i j = fastfloor4(_mm_add_ps(y, s));
+
+    const __m128 t = _mm_mul_ps(_mm_cvtepi32_ps(_mm_add_epi32(i, j)), G2);
+    const __m128 x0 = _mm_sub_ps(x, _mm_sub_ps(_mm_cvtepi32_ps(i), t));
+    const __m128 y0 = _mm_sub_ps(y, _mm_sub_ps(_mm_cvtepi32_ps(j), t));
+
+    // Lower triangle where x0 > y0
+    const __m128i lower = _mm_castps_si128(_mm_cmpgt_ps(x0, y0));
+    const __m128i i1 = _mm_and_si128(lower, _mm_set1_epi32(1));
+    const __m128i j1 = _mm_andnot_si128(lower, _mm_set1_epi32(1));
+
+    const __m128 x1 = _mm_add_ps(_mm_sub_ps(x0, _mm_cvtepi32_ps(i1)), G2);
+    const __m128 y1 = _mm_add_ps(_mm_sub_ps(y0, _mm_cvtepi32_ps(j1)), G2);
+    const __m128 x2 = _mm_add_ps(_mm_sub_ps(x0, one), _mm_mul_ps(_mm_set1_ps(2.0f), G2));
+    const __m128 y2 = _mm_add_ps(_mm_sub_ps(y0, one), _mm_mul_ps(_mm_set1_ps(2.0f), G2));
+
+    alignas(16) int32_t vi[4], vj[4], vi1[4], vj1[4];
+    alignas(16) int32_t gi0[4], gi1[4], gi2[4];
+    _mm_store_si128(reinterpret_cast<__m128i*>(vi), i);
+    _mm_store_si128(reinterpret_cast<__m128i*>(vj), j);
+    _mm_store_si128(reinterpret_cast<__m128i*>(vi1), i1);
+    _mm_store_si128(reinterpret_cast<__m128i*>(vj1), j1);
+    for (int k = 0; k < 4; k++) {
+        gi0[k] = hash(vi[k] + hash(vj[k]));
+        gi1[k] = hash(vi[k] + vi1[k] + hash(vj[k] + vj1[k]));
+        gi2[k] = hash(vi[k] + 1 + hash(vj[k] + 1));
+    }
+
+    const __m128 radius = _mm_set1_ps(0.5f);
+    const __m128 n0 = corner4(radius, grad4(_mm_load_si128(reinterpret_cast<__m128i*>(gi0)), x0, y0), x0, y0);
+    const __m128 n1 = corner4(radius, grad4(_mm_load_si128(reinterpret_cast<__m128i*>(gi1)), x1, y1), x1, y1);
+    const __m128 n2 = corner4(radius, grad4(_mm_load_si128(reinterpret_cast<__m128i*>(gi2)), x2, y2), x2, y2);
+
+    return _mm_mul_ps(_mm_set1_ps(45.23065f), _mm_add_ps(_mm_add_ps(n0, n1), n2));
+}
+
+/**
+ * 3D Perlin simplex noise of four points
+ */
+static __m128 noise4(__m128 x, __m128 y, __m128 z) {
+    const __m128 F3 = _mm_set1_ps(1.0f / 3.0f);
+    const __m128 G3 = _mm_set1_ps(1.0f / 6.0f);
+    const __m128i one = _mm_set1_epi32(1);
+
+    const __m128 s = _mm_mul_ps(_mm_add_ps(_mm_add_ps(x, y), z), F3);
+    const __m128i i = fastfloor4(_mm_add_ps(x, s));
+    const __m128i j = fastfloor4(_mm_add_ps(y, s));
+    const __m128i k = fastfloor4(_mm_add_ps(z, s));
+
+    const __m128 t = _mm_mul_ps(_mm_cvtepi32_ps(_mm_add_epi32(_mm_add_epi32(i, j), k)), G3);
+    const __m128 x0 = _mm_sub_ps(x, _mm_sub_ps(_mm_cvtepi32_ps(i), t));
+    const __m128 y0 = _mm_sub_ps(y, _mm_sub_ps(_mm_cvtepi32_ps(j), t));
+    const __m128 z0 = _mm_sub_ps(z, _mm_sub_ps(_mm_cvtepi32_ps(k), t));
+
+    // Rank ordering of the scalar version, written as masks
+    const __m128i a = _mm_castps_si128(_mm_cmpge_ps(x0, y0));
+    const __m128i b = _mm_castps_si128(_mm_cmpge_ps(y0, z0));
+    const __m128i c = _mm_castps_si128(_mm_cmpge_ps(x0, z0));
+    const __m128i bc = _mm_and_si128(b, c);
+    const __m128i ac = _mm_and_si128(a, c);
+
+    const __m128i i1 = _mm_and_si128(ac, one);
+    const __m128i j1 = _mm_and_si128(_mm_andnot_si128(a, b), one);
+    const __m128i k1 = _mm_andnot_si128(_mm_or_si128(b, ac), one);
+    const __m128i i2 = _mm_and_si128(_mm_or_si128(a, bc), one);
+    const __m128i j2 = _mm_and_si128(_mm_or_si128(_mm_andnot_si128(a, one), b), one);
+    const __m128i k2 = _mm_andnot_si128(bc, one);
+
+    const __m128 G3x2 = _mm_mul_ps(_mm_set1_ps(2.0f), G3);
+    const __m128 G3x3 = _mm_mul_ps(_mm_set1_ps(3.0f), G3);
+    const __m128 one4 = _mm_set1_ps(1.0f);
+    const __m128 x1 = _mm_add_ps(_mm_sub_ps(x0, _mm_cvtepi32_ps(i1)), G3);
+    const __m128 y1 = _mm_add_ps(_mm_sub_ps(y0, _mm_cvtepi32_ps(j1)), G3);
+    const __m128 z1 = _mm_add_ps(_mm_sub_ps(z0, _mm_cvtepi32_ps(k1)), G3);
+    const __m128 x2 = _mm_add_ps(_mm_sub_ps(x0, _mm_cvtepi32_ps(i2)), G3x2);
+    const __m128 y2 = _mm_add_ps(_mm_sub_ps(y0, _mm_cvtepi32_ps(j2)), G3x2);
+    const __m128 z2 = _mm_add_ps(_mm_sub_ps(z0, _mm_cvtepi32_ps(k2)), G3x2);
+    const __m128 x3 = _mm_add_ps(_mm_sub_ps(x0, one4), G3x3);
+    const __m128 y3 = _mm_add_ps(_mm_sub_ps(y0, one4), G3x3);
+    const __m128 z3 = _mm_add_ps(_mm_sub_ps(z0, one4), G3x3);
+
+    alignas(16) int32_t vi[4], vj[4], vk[4];
+    alignas(16) int32_t vi1[4], vj1[4], vk1[4], vi2[4], vj2[4], vk2[4];
+    alignas(16) int32_t gi0[4], gi1[4], gi2[4], gi3[4];
+    _mm_store_si128(reinterpret_cast<__m128i*>(vi), i);
+    _mm_store_si128(reinterpret_cast<__m128i*>(vj), j);
+    _mm_store_si128(reinterpret_cast<__m128i*>(vk), k);
+    _mm_store_si128(reinterpret_cast<__m128i*>(vi1), i1);
+    _mm_store_si128(reinterpret_cast<__m128i*>(vj1), j1);
+    _mm_store_si128(reinterpret_cast<__m128i*>(vk1), k1);
+    _mm_store_si128(reinterpret_cast<__m128i*>(vi2), i2);
+    _mm_store_si128(reinterpret_cast<__m128i*>(vj2), j2);
+    _mm_store_si128(reinterpret_cast<__m128i*>(vk2), k2);
+    for (int l = 0; l < 4; l++) {
+        gi0[l] = hash(vi[l] + hash(vj[l] + hash(vk[l])));
+        gi1[l] = hash(vi[l] + vi1[l] + hash(vj[l] + vj1[l] + hash(vk[l] + vk1[l])));
+        gi2[l] = hash(vi[l] + vi2[l] + hash(vj[l] + vj2[l] + hash(vk[l] + vk2[l])));
+        gi3[l] = hash(vi[l] + 1 + hash(vj[l] + 1 + hash(vk[l] + 1)));
+    }
+
+    const __m128 radius = _mm_set1_ps(0.6f);
+    const __m128 n0 = corner4(radius, grad4(_mm_load_si128(reinterpret_cast<__m128i*>(gi0)), x0, y0, z0), x0, y0, z0);
+    const __m128 n1 = corner4(radius, grad4(_mm_load_si128(reinterpret_cast<__m128i*>(gi1)), x1, y1, z1), x1, y1, z1);
+    const __m128 n2 = corner4(radius, grad4(_mm_load_si128(reinterpret_cast<__m128i*>(gi2)), x2, y2, z2), x2, y2, z2);
+    const __m128 n3 = corner4(radius, grad4(_mm_load_si128(reinterpret_cast<__m128i*>(gi3)), x3, y3, z3), x3, y3, z3);
+
+    return _mm_mul_ps(_mm_set1_ps(32.0f), _mm_add_ps(_mm_add_ps(n0, n1), _mm_add_ps(n2, n3)));
+}
+
+#endif
+
+/**
+ * Batched 2D Perlin simplex noise of arbitrary points
+ *
+ * Uses SSE2 to evaluate four points at once when URHO3D_SSE is enabled,
+ * otherwise falls back to the scalar version.
+ *
+ * @param[out] out  noise values, count elements
+ * @param[in] x     x float coordinates
+ * @param[in] y     y float coordinates
+ * @param[in] count number of points
+ */
+void SimplexNoise::noise(float* out, const float* x, const float* y, size_t count) {
+    size_t i = 0;
+#ifdef URHO3D_SSE
+    for (; i + 4 <= count; i += 4) {
+        _mm_storeu_ps(out + i, noise4(_mm_loadu_ps(x + i), _mm_loadu_ps(y + i)));
+    }
+#endif
+    for (; i < count; i++) {
+        out[i] = noise(x[i], y[i]);
+    }
+}
+
+/**
+ * Batched 3D Perlin simplex noise of arbitrary points
+ *
+ * @param[out] out  noise values, count elements
+ * @param[in] x     x float coordinates
+ * @param[in] y     y float coordinates
+ * @param[in] z     z float coordinates
+ * @param[in] count number of points
+ */
+void SimplexNoise::noise(float* out, const float* x, const float* y, const float* z, size_t count) {
+    size_t i = 0;
+#ifdef URHO3D_SSE
+    for (; i + 4 <= count; i += 4) {
+        _mm_storeu_ps(out + i, noise4(_mm_loadu_ps(x + i), _mm_loadu_ps(y + i), _mm_loadu_ps(z + i)));
+    }
+#endif
+    for (; i < count; i++) {
+        out[i] = noise(x[i], y[i], z[i]);
+    }
+}
+
+/**
+ * Batched 2D Perlin simplex noise of a regular grid
+ *
+ * out[j * countX + i] = noise(x + i * step, y + j * step)
+ *
+ * @param[out] out      noise values, countX * countY elements
+ * @param[in] x         x float coordinate of the first sample
+ * @param[in] y         y float coordinate of the first sample
+ * @param[in] step      distance between two samples
+ * @param[in] countX    number of samples along x
+ * @param[in] countY    number of samples along y
+ */
+void SimplexNoise::noiseGrid(float* out, float x, float y, float step, size_t countX, size_t countY) {
+    for (size_t j = 0; j < countY; j++) {
+        const float py = y + static_cast<float>(j) * step;
+        float* row = out + j * countX;
+        size_t i = 0;
+#ifdef URHO3D_SSE
+        const __m128 vy = _mm_set1_ps(py);
+        const __m128 offsets = _mm_set_ps(3.0f, 2.0f, 1.0f, 0.0f);
+        for (; i + 4 <= countX; i += 4) {
+            const __m128 index = _mm_add_ps(_mm_set1_ps(static_cast<float>(i)), offsets);
+            const __m128 vx = _mm_add_ps(_mm_set1_ps(x), _mm_mul_ps(index, _mm_set1_ps(step)));
+            _mm_storeu_ps(row + i, noise4(vx, vy));
+        }
+#endif
+        for (; i < countX; i++) {
+            row[i] = noise(x + static_cast<float>(i) * step, py);
+        }
+    }
+}
+
+/**
+ * Batched 3D Perlin simplex noise of a regular block
+ *
+ * out[(k * countY + j) * countX + i] = noise(x + i * step, y + j * step, z + k * step)
+ *
+ * @param[out] out      noise values, countX * countY * countZ elements
+ * @param[in] x         x float coordinate of the first sample
+ * @param[in] y         y float coordinate of the first sample
+ * @param[in] z         z float coordinate of the first sample
+ * @param[in] step      distance between two samples
+ * @param[in] countX    number of samples along x
+ * @param[in] countY    number of samples along y
+ * @param[in] countZ    number of samples along z
+ */
+void SimplexNoise::noiseBlock(float* out, float x, float y, float z, float step, size_t countX, size_t countY, size_t countZ) {
+    for (size_t k = 0; k < countZ; k++) {
+        const float pz = z + static_cast<float>(k) * step;
+        for (size_t j = 0; j < countY; j++) {
+            const float py = y + static_cast<float>(j) * step;
+            float* row = out + (k * countY + j) * countX;
+            size_t i = 0;
+#ifdef URHO3D_SSE
+            const __m128 vy = _mm_set1_ps(py);
+            const __m128 vz = _mm_set1_ps(pz);
+            const __m128 offsets = _mm_set_ps(3.0f, 2.0f, 1.0f, 0.0f);
+            for (; i + 4 <= countX; i += 4) {
+                const __m128 index = _mm_add_ps(_mm_set1_ps(static_cast<float>(i)), offsets);
+                const __m128 vx = _mm_add_ps(_mm_set1_ps(x), _mm_mul_ps(index, _mm_set1_ps(step)));
+                _mm_storeu_ps(row + i, noise4(vx, vy, vz));
+            }
+#endif
+            for (; i < countX; i++) {
+                row[i] = noise(x + static_cast<float>(i) * step, py, pz);
+            }
+        }
+    }
+}
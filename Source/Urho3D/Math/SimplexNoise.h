@@ -23,6 +23,15 @@ public:
     // 3D Perlin simplex noise
     static float noise(float x, float y, float z);
 
+    // Batched 2D Perlin simplex noise of arbitrary points
+    static void noise(float* out, const float* x, const float* y, size_t count);
+    // Batched 3D Perlin simplex noise of arbitrary points
+    static void noise(float* out, const float* x, const float* y, const float* z, size_t count);
+    // Batched 2D Perlin simplex noise of a regular grid, x varies fastest
+    static void noiseGrid(float* out, float x, float y, float step, size_t countX, size_t countY);
+    // Batched 3D Perlin simplex noise of a regular block, x varies fastest, then y, then z
+    static void noiseBlock(float* out, float x, float y, float z, float step, size_t countX, size_t countY, size_t countZ);
+
     // Fractal/Fractional Brownian Motion (fBm) noise summation
     float fractal(size_t octaves, float x) const;
     float fractal(size_t octaves, float x, float y) const;
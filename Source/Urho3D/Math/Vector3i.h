@@ -119,7 +119,7 @@ namespace Urho3D
             return
                 x == rhs.x &&
                 y == rhs.y &&
-                z == rhs.x;
+                z == rhs.z;
         }
 
         bool operator!=(const Vector3i& rhs) const
@@ -50,12 +50,30 @@ namespace Urho3D
 		virtual String GetTableSql(const DatabaseTable* table) = 0;
 		virtual String GetSelect(const String& whereClause, const DatabaseTable* table) = 0;
 
+		/// Sql for additive migrations. The columns query returns a row per
+		/// column of the table with its name in a column called name.
+		virtual String GetIndexSql(const DatabaseTable* table, const DatabaseIndex& index) = 0;
+		virtual String GetAddColumnSql(const DatabaseTable* table, const DatabaseColumn* column) = 0;
+		virtual String GetTableColumnsSql(const DatabaseTable* table) = 0;
+
+		/// Sql for prepared statements with a parameter for every value. The
+		/// values follow the order of DatabaseTable::GetColumns without the
+		/// primary key, which is bound last.
+		virtual String GetInsertStatementSql(const DatabaseTable* table) = 0;
+		virtual String GetUpdateStatementSql(const DatabaseTable* table) = 0;
+
+		/// Update of only the given columns, bound in the order given.
+		virtual String GetUpdateStatementSql(const DatabaseTable* table, const PODVector<DatabaseColumn*>& columns) = 0;
+
+		/// Sql returning the largest primary key of the table.
+		virtual String GetMaxIdSql(const DatabaseTable* table) = 0;
+
 		String GetUpdateOrInsertSql(const DatabaseTable* table, const Serializable* data)
 		{
 			auto pk = table->GetPrimaryKey();
 			if (pk)
 			{
-				auto id = pk->Get(data).GetInt();
+				auto id = pk->Get(data).GetInt64();
 				if (id > 0)
 				{
 					return GetUpdateSql(table, data);
@@ -35,6 +35,9 @@ namespace Urho3D
 		primaryKey = InitializePrimaryKey();
 		notNull = InitializeNotNull();
 		unique = InitializeUnique();
+		indexed = InitializeIndexed();
+		indexName_ = InitializeIndexName();
+		indexUnique = InitializeIndexUnique();
 	}
 
 	String DatabaseColumn::InitializeColumnName()
@@ -120,5 +123,68 @@ namespace Urho3D
 
 		return result;
 	}
+
+	bool DatabaseColumn::InitializeIndexed()
+	{
+		auto result = false;
+		auto metaData = attribute_.GetMetadata(DatabaseConstants::META_INDEXED);
+		if (!metaData.IsEmpty())
+		{
+			if (metaData.GetType() != VAR_BOOL)
+			{
+				URHO3D_LOGWARNING(
+					"Found indexed metadata on " + attribute_.name_ +
+					" but it was not of type VAR_BOOL. The provided value will be ignored");
+			}
+			else
+			{
+				result = metaData.GetBool();
+			}
+		}
+
+		return result;
+	}
+
+	String DatabaseColumn::InitializeIndexName()
+	{
+		String result = "";
+		auto metaData = attribute_.GetMetadata(DatabaseConstants::META_INDEX_NAME);
+		if (!metaData.IsEmpty())
+		{
+			if (metaData.GetType() != VAR_STRING)
+			{
+				URHO3D_LOGWARNING(
+					"Found index name metadata on " + attribute_.name_ +
+					" but it was not of type VAR_STRING. The provided value will be ignored");
+			}
+			else
+			{
+				result = metaData.GetString();
+			}
+		}
+
+		return result;
+	}
+
+	bool DatabaseColumn::InitializeIndexUnique()
+	{
+		auto result = false;
+		auto metaData = attribute_.GetMetadata(DatabaseConstants::META_INDEX_UNIQUE);
+		if (!metaData.IsEmpty())
+		{
+			if (metaData.GetType() != VAR_BOOL)
+			{
+				URHO3D_LOGWARNING(
+					"Found unique index metadata on " + attribute_.name_ +
+					" but it was not of type VAR_BOOL. The provided value will be ignored");
+			}
+			else
+			{
+				result = metaData.GetBool();
+			}
+		}
+
+		return result;
+	}
 }
 #endif
\ No newline at end of file
@@ -42,6 +42,15 @@ namespace Urho3D
 		bool IsNotNull() const					{ return notNull; }
 		bool IsUnique() const					{ return unique; }
 
+		/// The column has an index of its own.
+		bool IsIndexed() const					{ return indexed; }
+
+		/// Name of the index shared with other columns, empty if there is none.
+		const String& GetIndexName() const		{ return indexName_; }
+
+		/// The index of the column, own or shared, is unique.
+		bool IsIndexUnique() const				{ return indexUnique; }
+
 		Variant Get(const Serializable* data) const
 		{
 			if (!data)
@@ -154,6 +163,13 @@ namespace Urho3D
 				return;
 			}
 
+			// Values read with the type of the column need no conversion.
+			if (value.GetType() == attribute_.type_)
+			{
+				attribute_.accessor_->Set(data, value);
+				return;
+			}
+
 			switch (attribute_.type_)
 			{
 			case VAR_BOOL: Set(data, value.GetBool()); break;
@@ -176,13 +192,19 @@ namespace Urho3D
 		bool InitializePrimaryKey();
 		bool InitializeNotNull();
 		bool InitializeUnique();
+		bool InitializeIndexed();
+		String InitializeIndexName();
+		bool InitializeIndexUnique();
 
 		AttributeInfo attribute_;
 		String columnName_;
+		String indexName_;
 
 		bool primaryKey;
 		bool notNull;
 		bool unique;
+		bool indexed;
+		bool indexUnique;
 	};
 }
 #endif
\ No newline at end of file
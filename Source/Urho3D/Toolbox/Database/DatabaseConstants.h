@@ -35,6 +35,9 @@ namespace Urho3D
 		static String META_NOT_NULL;			// bool
 		static String META_TABLE_NAME;			// String, Not in use
 		static String META_UNIQUE;				// bool
+		static String META_INDEXED;				// bool
+		static String META_INDEX_NAME;			// String, columns with the same name share one index
+		static String META_INDEX_UNIQUE;		// bool
 
 		static String META_WIDGET_MIN_WIDTH;	// int
 	};
@@ -28,7 +28,8 @@ namespace Urho3D
 	DatabaseContext::DatabaseContext(Context* context, String db_file) :
 		Object(context),
 		connectionString(db_file),
-		connection_(nullptr)
+		connection_(nullptr),
+		transactionDepth_(0)
 	{
 		// TODO: Currently only SQLite is supported.
 		serializer_ = SharedPtr<AbstractDatabaseSerializer>(new SqliteSerializer(context_));
@@ -36,7 +37,10 @@ namespace Urho3D
 
 	DatabaseContext::~DatabaseContext()
 	{
-		Close();
+		if (connection_)
+		{
+			Close();
+		}
 	}
 
 	void DatabaseContext::AddTable(const TypeInfo* t)
@@ -55,14 +59,23 @@ namespace Urho3D
 
 		if (connection_)
 		{
-			URHO3D_LOGWARNING("A database connection has already been established.");
 			return true;
 		}
 
 		URHO3D_LOGDEBUG("Opening database: " + connectionString);
 
 		connection_ = GetSubsystem<Database>()->Connect(connectionString);
-		return connection_ != nullptr;
+		if (!connection_)
+		{
+			return false;
+		}
+
+#ifndef URHO3D_DATABASE_ODBC
+		// Wait for the background writer instead of failing, while it writes.
+		sqlite3_busy_timeout(const_cast<sqlite3*>(connection_->GetConnectionImpl()), DatabaseWriter::BUSY_TIMEOUT_MSEC);
+#endif
+
+		return true;
 	}
 
 	void DatabaseContext::Close()
@@ -73,25 +86,114 @@ namespace Urho3D
 			return;
 		}
 
+		if (transactionDepth_ > 0)
+		{
+			URHO3D_LOGWARNING("Closing the database connection drops the updates of the open unit of work.");
+			transactionDepth_ = 0;
+			DropUnitOfWork();
+		}
+
+#ifndef URHO3D_DATABASE_ODBC
+		StopWriter();
+
+		// SQLite refuses to close a connection with unfinalized statements.
+		FinalizeStatements();
+		nextIds_.Clear();
+#endif
+
 		GetSubsystem<Database>()->Disconnect(connection_);
 		connection_ = nullptr;
 	}
 
 	void DatabaseContext::CreateDatabase()
 	{
-		Open();
+		if (!Open())
+		{
+			return;
+		}
 
 		URHO3D_LOGDEBUG("Creating database:");
+		BeginUnitOfWork();
 		for(auto it = tables_.Begin(); it != tables_.End(); it++)
 		{
 			auto table = it->second_;
-			String sql = serializer_->GetTableSql(table);
+			StringVector existing;
+			GetTableColumns(table, existing);
+			if (existing.Empty())
+			{
+				String sql = serializer_->GetTableSql(table);
+
+				// URHO3D_LOGDEBUG(sql);
+				Execute(sql);
+			}
+			else
+			{
+				// Tables of older versions only get the columns they miss,
+				// nothing is changed or dropped.
+				const auto& columns = table->GetColumns();
+				for (auto c = columns.Begin(); c != columns.End(); c++)
+				{
+					auto column = c->second_;
+					bool found = false;
+					for (unsigned i = 0; i < existing.Size() && !found; i++)
+					{
+						found = existing[i].Compare(column->GetColumnName(), false) == 0;
+					}
 
-			// URHO3D_LOGDEBUG(sql);
-			auto result = connection_->Execute(sql, false);
+					if (!found)
+					{
+						URHO3D_LOGINFO("Adding column " + column->GetColumnName() + " to " + table->GetTableName());
+						Execute(serializer_->GetAddColumnSql(table, column));
+					}
+				}
+			}
+
+			const auto& indices = table->GetIndices();
+			for (unsigned i = 0; i < indices.Size(); i++)
+			{
+				Execute(serializer_->GetIndexSql(table, indices[i]));
+			}
 		}
 
-		Close();
+		Commit();
+	}
+
+	void DatabaseContext::GetTableColumns(DatabaseTable* table, StringVector& names)
+	{
+		String sql = serializer_->GetTableColumnsSql(table);
+
+#ifndef URHO3D_DATABASE_ODBC
+		auto statement = GetStatement(sql);
+		if (!statement)
+		{
+			return;
+		}
+
+		unsigned nameColumn = 0;
+		while (nameColumn < statement->GetNumColumns() && statement->GetColumnName(nameColumn) != "name")
+		{
+			nameColumn++;
+		}
+
+		while (statement->Step())
+		{
+			names.Push(statement->GetColumn(nameColumn, VAR_STRING).GetString());
+		}
+
+		statement->Reset();
+#else
+		auto result = connection_->Execute(sql, false);
+		unsigned nameColumn = 0;
+		while (nameColumn < result.GetNumColumns() && result.GetColumns()[nameColumn] != "name")
+		{
+			nameColumn++;
+		}
+
+		for (unsigned i = 0; i < result.GetNumRows() && nameColumn < result.GetNumColumns(); i++)
+		{
+			names.Push(result.GetRows()[i][nameColumn].GetString());
+		}
+#endif
 	}
 
 	DatabaseTable* DatabaseContext::GetTable(const TypeInfo* t)
@@ -108,7 +210,112 @@ namespace Urho3D
 	void DatabaseContext::Update(Serializable* item)
 	{
 		auto table = GetTable(item->GetTypeInfo());
-		if (!table)
+		if (!table || !Open())
+		{
+			return;
+		}
+
+#ifndef URHO3D_DATABASE_ODBC
+		auto pk = table->GetPrimaryKey();
+		bool update = pk && pk->Get(item).GetInt64() > 0;
+
+		// Rows loaded or saved before only write the columns, that changed.
+		PODVector<DatabaseColumn*> changed;
+		bool partial = update && table->GetChangedColumns(item, changed);
+		if (partial && changed.Empty())
+		{
+			return;
+		}
+
+		DatabaseStatement* statement = partial ?
+			GetStatement(serializer_->GetUpdateStatementSql(table, changed)) :
+			GetTableStatement(table, update);
+		if (!statement)
+		{
+			return;
+		}
+
+		if (!update && pk && !SetPrimaryKey(pk, item, AllocateId(table)))
+		{
+			return;
+		}
+
+		// Same order as the parameters of the statements, the primary key is last.
+		Vector<Variant> values;
+		if (partial)
+		{
+			for (unsigned i = 0; i < changed.Size(); i++)
+			{
+				values.Push(changed[i]->Get(item));
+			}
+		}
+		else
+		{
+			const auto& columns = table->GetColumns();
+			for (auto it = columns.Begin(); it != columns.End(); it++)
+			{
+				auto column = it->second_;
+				if (!column->IsPrimaryKey())
+				{
+					values.Push(column->Get(item));
+				}
+			}
+		}
+
+		if (pk)
+		{
+			values.Push(pk->Get(item));
+		}
+
+		if (writer_)
+		{
+			HandleFinishedWrites();
+
+			// Saved right away, so updating the item again while the write
+			// is queued does not queue the same values twice. Undone by
+			// HandleFinishedWrites, if the writer drops the row.
+			QueuedWrite write;
+			write.id_ = writer_->Queue(statement->GetSql(), values);
+			write.table_ = table;
+			write.item_ = item;
+			write.insert_ = !update;
+			queuedWrites_.Push(write);
+
+			table->SetSaved(item);
+			return;
+		}
+
+		for (unsigned i = 0; i < values.Size(); i++)
+		{
+			statement->Bind(i + 1, values[i]);
+		}
+
+		// Failures are logged by the statement.
+		int changes = statement->Execute();
+		if (changes >= 0)
+		{
+			table->SetSaved(item);
+			if (!update && pk && transactionDepth_ > 0)
+			{
+				InsertedItem inserted;
+				inserted.table_ = table;
+				inserted.item_ = item;
+				insertedItems_.Push(inserted);
+			}
+		}
+		else if (!update && pk)
+		{
+			ResetPrimaryKey(table, item);
+		}
+		else
+		{
+			table->ResetSaved(item);
+		}
+#else
+		// Only unchanged items are skipped, changed ones write all columns.
+		PODVector<DatabaseColumn*> changed;
+		auto pk = table->GetPrimaryKey();
+		if (pk && pk->Get(item).GetInt64() > 0 && table->GetChangedColumns(item, changed) && changed.Empty())
 		{
 			return;
 		}
@@ -116,11 +323,436 @@ namespace Urho3D
 		String sql = serializer_->GetUpdateOrInsertSql(table, item);
 		/*URHO3D_LOGDEBUG(sql);*/
 
-		Open();
 		auto result = connection_->Execute(sql, false);
 		URHO3D_LOGDEBUG("Affected Rows: " + String(result.GetNumAffectedRows()));
-		Close();
+		table->SetSaved(item);
+#endif
+	}
+
+	void DatabaseContext::UpdateBatch(const PODVector<Serializable*>& items)
+	{
+		BeginUnitOfWork();
+		for (unsigned i = 0; i < items.Size(); i++)
+		{
+			Update(items[i]);
+		}
+
+		Commit();
+	}
+
+	bool DatabaseContext::BeginUnitOfWork()
+	{
+		if (!Open())
+		{
+			return false;
+		}
+
+		// The background writer groups its writes itself.
+		bool writer = false;
+#ifndef URHO3D_DATABASE_ODBC
+		writer = writer_ != nullptr;
+#endif
+
+		if (transactionDepth_ == 0 && !writer)
+		{
+			if (!Execute("BEGIN TRANSACTION;"))
+			{
+				return false;
+			}
+		}
+
+		transactionDepth_++;
+		return true;
+	}
+
+	bool DatabaseContext::Commit()
+	{
+		if (transactionDepth_ == 0)
+		{
+			URHO3D_LOGWARNING("Commit without BeginUnitOfWork.");
+			return false;
+		}
+
+		if (--transactionDepth_ > 0)
+		{
+			return true;
+		}
+
+#ifndef URHO3D_DATABASE_ODBC
+		if (writer_)
+		{
+			return true;
+		}
+#endif
+
+		if (!Execute("COMMIT;"))
+		{
+			DropUnitOfWork();
+			return false;
+		}
+
+#ifndef URHO3D_DATABASE_ODBC
+		insertedItems_.Clear();
+#endif
+
+		return true;
+	}
+
+	void DatabaseContext::Rollback()
+	{
+		if (transactionDepth_ == 0)
+		{
+			URHO3D_LOGWARNING("Rollback without BeginUnitOfWork.");
+			return;
+		}
+
+		transactionDepth_ = 0;
+
+#ifndef URHO3D_DATABASE_ODBC
+		if (writer_)
+		{
+			URHO3D_LOGWARNING("Updates queued for the background writer cannot be rolled back.");
+
+			// The saved values may not be in the database anymore.
+			for (auto it = tables_.Begin(); it != tables_.End(); it++)
+			{
+				it->second_->ResetSaved();
+			}
+
+			return;
+		}
+#endif
+
+		DropUnitOfWork();
+	}
+
+	void DatabaseContext::DropUnitOfWork()
+	{
+		Execute("ROLLBACK;");
+
+		// The saved values may not be in the database anymore.
+		for (auto it = tables_.Begin(); it != tables_.End(); it++)
+		{
+			it->second_->ResetSaved();
+		}
+
+#ifndef URHO3D_DATABASE_ODBC
+		// The rows inserted are gone, so are their keys. They are handed
+		// out again, once the largest key is read from the table anew.
+		for (unsigned i = 0; i < insertedItems_.Size(); i++)
+		{
+			const InsertedItem& inserted = insertedItems_[i];
+			if (inserted.item_)
+			{
+				ResetPrimaryKey(inserted.table_, inserted.item_);
+			}
+		}
+
+		insertedItems_.Clear();
+		nextIds_.Clear();
+#endif
+	}
+
+	bool DatabaseContext::Execute(const String& sql)
+	{
+#ifndef URHO3D_DATABASE_ODBC
+		auto statement = GetStatement(sql);
+		return statement && statement->Execute() >= 0;
+#else
+		// Errors are only logged by the connection.
+		connection_->Execute(sql, false);
+		return true;
+#endif
+	}
+
+	bool DatabaseContext::Query(const String& sql, DatabaseTable* table, const String& typeName, Vector<SharedPtr<Serializable>>& items)
+	{
+		if (!Open())
+		{
+			return false;
+		}
+
+#ifndef URHO3D_DATABASE_ODBC
+		auto statement = GetStatement(sql);
+		if (!statement)
+		{
+			return false;
+		}
+
+		DatabaseCursor cursor(context_, statement, table, typeName);
+		while (true)
+		{
+			auto item = cursor.Next();
+			if (!item)
+			{
+				break;
+			}
+
+			items.Push(item);
+		}
+
+		// Stops early only if an object could not be created.
+		return cursor.IsEof();
+#else
+		auto dbResult = connection_->Execute(sql, false);
+		for (unsigned i = 0; i < dbResult.GetRows().Size(); i++)
+		{
+			auto item = CreateItem(typeName);
+			if (!item)
+			{
+				return false;
+			}
+
+			table->Select(dbResult, item.Get(), i);
+			table->SetSaved(item);
+			items.Push(item);
+		}
+
+		return true;
+#endif
+	}
+
+#ifdef URHO3D_DATABASE_ODBC
+	SharedPtr<Serializable> DatabaseContext::CreateItem(const String& typeName)
+	{
+		auto item = context_->CreateObject(typeName);
+		if (!item)
+		{
+			URHO3D_LOGERROR("Could not create object of type " + typeName + ". Did you forget to register a factory with the context?");
+			return SharedPtr<Serializable>();
+		}
+
+		if (!item->GetTypeInfo()->IsTypeOf<Serializable>())
+		{
+			URHO3D_LOGERROR("In order to use Urho3D ORM every object must inherit from Serializable.");
+			return SharedPtr<Serializable>();
+		}
+
+		return SharedPtr<Serializable>(static_cast<Serializable*>(item.Get()));
+	}
+#endif
+
+#ifndef URHO3D_DATABASE_ODBC
+	SharedPtr<DatabaseCursor> DatabaseContext::OpenCursor(const String& sql, DatabaseTable* table, const String& typeName)
+	{
+		if (!Open())
+		{
+			return SharedPtr<DatabaseCursor>();
+		}
+
+		// Not cached, a select could otherwise reset the statement while
+		// the cursor is still reading.
+		SharedPtr<DatabaseStatement> statement(new DatabaseStatement(connection_, sql));
+		if (!statement->IsValid())
+		{
+			return SharedPtr<DatabaseCursor>();
+		}
+
+		for (unsigned i = cursors_.Size(); i-- > 0;)
+		{
+			if (cursors_[i].Expired())
+			{
+				cursors_.Erase(i);
+			}
+		}
+
+		SharedPtr<DatabaseCursor> cursor(new DatabaseCursor(context_, statement, table, typeName));
+		cursors_.Push(WeakPtr<DatabaseCursor>(cursor));
+
+		return cursor;
+	}
+
+	DatabaseStatement* DatabaseContext::GetTableStatement(DatabaseTable* table, bool update)
+	{
+		auto& statements = update ? updateStatements_ : insertStatements_;
+		SharedPtr<DatabaseStatement> statement;
+		if (statements.TryGetValue(table->GetTableName(), statement))
+		{
+			return statement;
+		}
+
+		String sql = update ? serializer_->GetUpdateStatementSql(table) : serializer_->GetInsertStatementSql(table);
+		statement = new DatabaseStatement(connection_, sql);
+		if (!statement->IsValid())
+		{
+			return nullptr;
+		}
+
+		statements[table->GetTableName()] = statement;
+		return statement;
+	}
+
+	DatabaseStatement* DatabaseContext::GetStatement(const String& sql)
+	{
+		SharedPtr<DatabaseStatement> statement;
+		if (statements_.TryGetValue(sql, statement))
+		{
+			return statement;
+		}
+
+		statement = new DatabaseStatement(connection_, sql);
+		if (!statement->IsValid())
+		{
+			return nullptr;
+		}
+
+		if (statements_.Size() >= MAX_CACHED_STATEMENTS)
+		{
+			statements_.Erase(statements_.Begin());
+		}
+
+		statements_[sql] = statement;
+		return statement;
+	}
+
+	bool DatabaseContext::StartWriter()
+	{
+		if (writer_)
+		{
+			return true;
+		}
+
+		if (!Open())
+		{
+			return false;
+		}
+
+		if (transactionDepth_ > 0)
+		{
+			URHO3D_LOGERROR("The background writer cannot be started during a unit of work.");
+			return false;
+		}
+
+		writer_ = new DatabaseWriter(context_, connectionString);
+		if (!writer_->Open())
+		{
+			writer_ = nullptr;
+			return false;
+		}
+
+		return true;
+	}
+
+	void DatabaseContext::StopWriter()
+	{
+		if (writer_)
+		{
+			writer_->Close();
+			HandleFinishedWrites();
+			writer_ = nullptr;
+		}
+	}
+
+	void DatabaseContext::Flush()
+	{
+		if (writer_)
+		{
+			writer_->Flush();
+			HandleFinishedWrites();
+		}
+	}
+
+	void DatabaseContext::HandleFinishedWrites()
+	{
+		PODVector<unsigned long long> failed;
+		unsigned long long finishedId = writer_->GetFinished(failed);
+
+		unsigned numFinished = 0;
+		unsigned nextFailed = 0;
+		while (numFinished < queuedWrites_.Size() && queuedWrites_[numFinished].id_ <= finishedId)
+		{
+			const QueuedWrite& write = queuedWrites_[numFinished++];
+			if (nextFailed < failed.Size() && failed[nextFailed] == write.id_)
+			{
+				nextFailed++;
+				if (!write.item_)
+				{
+					continue;
+				}
+
+				if (write.insert_)
+				{
+					ResetPrimaryKey(write.table_, write.item_);
+				}
+				else
+				{
+					write.table_->ResetSaved(write.item_);
+				}
+			}
+		}
+
+		queuedWrites_.Erase(0, numFinished);
+	}
+
+	long long DatabaseContext::AllocateId(DatabaseTable* table)
+	{
+		auto it = nextIds_.Find(table->GetTableName());
+		if (it == nextIds_.End())
+		{
+			// Rows written before are looked at once, afterwards all keys come from here.
+			long long maxId = 0;
+			auto statement = GetStatement(serializer_->GetMaxIdSql(table));
+			if (statement)
+			{
+				if (statement->Step())
+				{
+					maxId = statement->GetColumn(0, VAR_INT64).GetInt64();
+				}
+
+				statement->Reset();
+			}
+
+			it = nextIds_.Insert(Pair<StringHash, long long>(table->GetTableName(), maxId + 1));
+		}
+
+		return it->second_++;
+	}
+
+	void DatabaseContext::ResetPrimaryKey(DatabaseTable* table, Serializable* item)
+	{
+		auto pk = table->GetPrimaryKey();
+		if (pk)
+		{
+			SetPrimaryKey(pk, item, 0);
+		}
+
+		table->ResetSaved(item);
+	}
+
+	bool DatabaseContext::SetPrimaryKey(DatabaseColumn* pk, Serializable* item, long long id)
+	{
+		if (pk->GetDatabaseType() == VAR_INT64)
+		{
+			pk->Set(item, Variant(id));
+			return true;
+		}
+
+		if (id > M_MAX_INT)
+		{
+			URHO3D_LOGERROR("The key " + String(id) + " does not fit into the column " + pk->GetColumnName() + ", use a 64 bit attribute.");
+			return false;
+		}
+
+		pk->Set(item, (int) id);
+		return true;
+	}
+
+	void DatabaseContext::FinalizeStatements()
+	{
+		for (unsigned i = 0; i < cursors_.Size(); i++)
+		{
+			if (cursors_[i])
+			{
+				cursors_[i]->Close();
+			}
+		}
+
+		cursors_.Clear();
+		insertStatements_.Clear();
+		updateStatements_.Clear();
+		statements_.Clear();
 	}
+#endif
 }
 
 #endif
\ No newline at end of file
@@ -29,6 +29,9 @@
 #include "../../Database/Database.h"
 
 #include "DatabaseTable.h"
+#include "DatabaseCursor.h"
+#include "DatabaseStatement.h"
+#include "DatabaseWriter.h"
 #include "SqliteSerializer.h"
 
 namespace Urho3D
@@ -42,52 +45,76 @@ namespace Urho3D
 		~DatabaseContext();
 
 		void AddTable(const TypeInfo* t);
+
+		/// Create missing tables and indices. Tables, that already exist, get
+		/// the columns they miss, existing columns are never changed.
 		void CreateDatabase();
 
+		/// The connection stays open until Close is called or the context is
+		/// destroyed, so prepared statements can be reused.
 		bool Open();
 		void Close();
+		bool IsOpen() const { return connection_ != nullptr; }
 
+		/// Insert the item, if its primary key is not set yet, otherwise
+		/// update its row. New items get their primary key right away.
+		/// Items loaded or saved through this context before are skipped,
+		/// if nothing changed, and otherwise only write the changed columns.
 		void Update(Serializable* item);
 
+		/// Insert or update all items in one transaction.
+		void UpdateBatch(const PODVector<Serializable*>& items);
+
 		template<class T>
-		Vector<SharedPtr<T>> SelectQuery(const String& query)
+		void UpdateBatch(const Vector<SharedPtr<T>>& items)
 		{
-			Vector<SharedPtr<T>> result;
-			auto type = T::GetTypeInfoStatic();
-			auto table = GetTable(type);
-			if (!table)
+			BeginUnitOfWork();
+			for (unsigned i = 0; i < items.Size(); i++)
 			{
-				return result;
+				Update(items[i]);
 			}
 
-			Open();
-			auto dbResult = connection_->Execute(query, false);
-			Close();
+			Commit();
+		}
+
+		/// Group all updates until Commit into one transaction, instead of
+		/// one per row. Calls nest, the outermost Commit writes.
+		bool BeginUnitOfWork();
+		bool Commit();
 
-			if (dbResult.GetRows().Size() < 1)
+		/// Drop all updates since the outermost BeginUnitOfWork.
+		void Rollback();
+
+#ifndef URHO3D_DATABASE_ODBC
+		/// Write on a background thread from now on. Update and UpdateBatch
+		/// only copy the values and return, all writes keep their order.
+		/// Selects do not see writes, that are still queued, call Flush first.
+		bool StartWriter();
+
+		/// Write everything queued and stop the background thread.
+		void StopWriter();
+
+		/// Block until everything queued is written.
+		void Flush();
+
+		bool IsWriterRunning() const { return writer_ != nullptr; }
+#endif
+
+		template<class T>
+		Vector<SharedPtr<T>> SelectQuery(const String& query)
+		{
+			Vector<SharedPtr<T>> result;
+			auto table = GetTable(T::GetTypeInfoStatic());
+			if (!table)
 			{
 				return result;
 			}
 
-			for (int i = 0; i < dbResult.GetRows().Size(); i++)
+			Vector<SharedPtr<Serializable>> items;
+			Query(query, table, T::GetTypeNameStatic(), items);
+			for (unsigned i = 0; i < items.Size(); i++)
 			{
-				auto item = context_->CreateObject(T::GetTypeNameStatic());
-				if (!item)
-				{
-					URHO3D_LOGERROR("Could not create object of type " + T::GetTypeNameStatic() + ". Did you forget to register a factory with the context?");
-					return result;
-				}
-
-				if (!item->GetTypeInfo()->IsTypeOf<Serializable>())
-				{
-					URHO3D_LOGERROR("In order to use Urho3D ORM every object must inherit from Serializable.");
-					return result;
-				}
-
-				auto deserialized = static_cast<T*>(item.Get());
-				table->Select(dbResult, deserialized, i);
-
-				result.Push(SharedPtr<T>(deserialized));
+				result.Push(SharedPtr<T>(static_cast<T*>(items[i].Get())));
 			}
 
 			return result;
@@ -105,14 +132,124 @@ namespace Urho3D
 			return SelectQuery<T>(serializer_->GetSelect(whereClause, table));
 		}
 
+#ifndef URHO3D_DATABASE_ODBC
+		/// Open a forward only cursor on the rows of a select, to read large
+		/// results row by row or in pages instead of all at once. The cursor
+		/// keeps its own statement until it is destroyed or the connection
+		/// is closed.
+		template<class T>
+		SharedPtr<DatabaseCursor> OpenCursorQuery(const String& query)
+		{
+			auto table = GetTable(T::GetTypeInfoStatic());
+			if (!table)
+			{
+				return SharedPtr<DatabaseCursor>();
+			}
+
+			return OpenCursor(query, table, T::GetTypeNameStatic());
+		}
+
+		template<class T>
+		SharedPtr<DatabaseCursor> OpenCursor(const String& whereClause)
+		{
+			auto table = GetTable(T::GetTypeInfoStatic());
+			if (!table)
+			{
+				return SharedPtr<DatabaseCursor>();
+			}
+
+			return OpenCursor(serializer_->GetSelect(whereClause, table), table, T::GetTypeNameStatic());
+		}
+#endif
+
 	private:
+		/// Statements cached by their sql at most, the oldest one is dropped first.
+		static const unsigned MAX_CACHED_STATEMENTS = 64;
+
 		String connectionString;
 		HashMap<StringHash, SharedPtr<DatabaseTable>> tables_;
 		SharedPtr<AbstractDatabaseSerializer> serializer_;
 
 		SharedPtr<DbConnection> connection_;
 
+		/// Nesting of BeginUnitOfWork.
+		unsigned transactionDepth_;
+
+		/// Roll back the open transaction and forget what it wrote.
+		void DropUnitOfWork();
+
 		DatabaseTable* GetTable(const TypeInfo* t);
+
+		/// Run a select and create an object of the given type for each row.
+		bool Query(const String& sql, DatabaseTable* table, const String& typeName, Vector<SharedPtr<Serializable>>& items);
+
+#ifdef URHO3D_DATABASE_ODBC
+		SharedPtr<Serializable> CreateItem(const String& typeName);
+#endif
+
+		/// Run sql without parameters or results, like BEGIN or COMMIT.
+		bool Execute(const String& sql);
+
+		/// Names of the columns the table has in the database, none if the
+		/// table does not exist yet.
+		void GetTableColumns(DatabaseTable* table, StringVector& names);
+
+#ifndef URHO3D_DATABASE_ODBC
+		/// Statements are compiled on first use and kept until the
+		/// connection is closed.
+		HashMap<StringHash, SharedPtr<DatabaseStatement>> insertStatements_;
+		HashMap<StringHash, SharedPtr<DatabaseStatement>> updateStatements_;
+		HashMap<String, SharedPtr<DatabaseStatement>> statements_;
+
+		DatabaseStatement* GetTableStatement(DatabaseTable* table, bool update);
+		DatabaseStatement* GetStatement(const String& sql);
+		void FinalizeStatements();
+
+		/// Cursors opened, closed before the connection is.
+		Vector<WeakPtr<DatabaseCursor>> cursors_;
+		SharedPtr<DatabaseCursor> OpenCursor(const String& sql, DatabaseTable* table, const String& typeName);
+
+		SharedPtr<DatabaseWriter> writer_;
+
+		/// Update queued for the writer, kept until it is written or dropped.
+		struct QueuedWrite
+		{
+			unsigned long long id_;
+			DatabaseTable* table_;
+			WeakPtr<Serializable> item_;
+			bool insert_;
+		};
+
+		/// In the order they were queued, so by id.
+		Vector<QueuedWrite> queuedWrites_;
+
+		/// Forget the saved values of the items, whose writes were dropped,
+		/// so their next Update writes all columns again.
+		void HandleFinishedWrites();
+
+		/// Next primary key of each table. Keys are handed out here instead
+		/// of by SQLite, so queued inserts know theirs. Assumes no one else
+		/// inserts into the tables meanwhile.
+		HashMap<StringHash, long long> nextIds_;
+		long long AllocateId(DatabaseTable* table);
+
+		/// Item inserted during the open unit of work.
+		struct InsertedItem
+		{
+			DatabaseTable* table_;
+			WeakPtr<Serializable> item_;
+		};
+
+		/// Their keys are taken back, if the unit of work is rolled back.
+		Vector<InsertedItem> insertedItems_;
+
+		/// Take back the key of an item, whose insert was dropped, so its
+		/// next Update inserts it again.
+		void ResetPrimaryKey(DatabaseTable* table, Serializable* item);
+
+		/// Returns false, if the key does not fit into the attribute.
+		bool SetPrimaryKey(DatabaseColumn* pk, Serializable* item, long long id);
+#endif
 	};
 }
 
@@ -0,0 +1,132 @@
+//
+// Copyright (c) 2019-2019, the Urho3D project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+#if defined(URHO3D_DATABASE) && !defined(URHO3D_DATABASE_ODBC)
+
+#include "DatabaseCursor.h"
+
+#include "../../Core/Context.h"
+#include "../../IO/Log.h"
+
+namespace Urho3D
+{
+	DatabaseCursor::DatabaseCursor(Context* context, DatabaseStatement* statement, DatabaseTable* table, const String& typeName) :
+		Object(context),
+		statement_(statement),
+		table_(table),
+		typeName_(typeName),
+		numRead_(0),
+		eof_(false)
+	{
+		// Look the columns up once, not for every row.
+		for (unsigned i = 0; i < statement_->GetNumColumns(); i++)
+		{
+			auto column = table_->GetColumn(statement_->GetColumnName(i));
+			if (!column)
+			{
+				URHO3D_LOGWARNING(table_->GetTableName() + " has no column named " + statement_->GetColumnName(i));
+			}
+
+			columns_.Push(column);
+		}
+	}
+
+	DatabaseCursor::~DatabaseCursor()
+	{
+		Close();
+	}
+
+	void DatabaseCursor::Close()
+	{
+		if (statement_)
+		{
+			// Ends the read, so writers are not blocked by it.
+			statement_->Reset();
+			statement_ = nullptr;
+		}
+
+		eof_ = true;
+	}
+
+	bool DatabaseCursor::Next(Serializable* item)
+	{
+		if (eof_ || !item)
+		{
+			return false;
+		}
+
+		if (!statement_->Step())
+		{
+			Close();
+			return false;
+		}
+
+		for (unsigned i = 0; i < columns_.Size(); i++)
+		{
+			if (columns_[i])
+			{
+				columns_[i]->Set(item, statement_->GetColumn(i, columns_[i]->GetDatabaseType()));
+			}
+		}
+
+		// Updates of the item only write, what changed after this.
+		table_->SetSaved(item);
+
+		numRead_++;
+		return true;
+	}
+
+	SharedPtr<Serializable> DatabaseCursor::Next()
+	{
+		if (eof_)
+		{
+			return SharedPtr<Serializable>();
+		}
+
+		auto item = CreateItem();
+		if (!item || !Next(item))
+		{
+			return SharedPtr<Serializable>();
+		}
+
+		return item;
+	}
+
+	SharedPtr<Serializable> DatabaseCursor::CreateItem()
+	{
+		auto item = context_->CreateObject(typeName_);
+		if (!item)
+		{
+			URHO3D_LOGERROR("Could not create object of type " + typeName_ + ". Did you forget to register a factory with the context?");
+			return SharedPtr<Serializable>();
+		}
+
+		if (!item->GetTypeInfo()->IsTypeOf<Serializable>())
+		{
+			URHO3D_LOGERROR("In order to use Urho3D ORM every object must inherit from Serializable.");
+			return SharedPtr<Serializable>();
+		}
+
+		return SharedPtr<Serializable>(static_cast<Serializable*>(item.Get()));
+	}
+}
+
+#endif
@@ -0,0 +1,110 @@
+//
+// Copyright (c) 2019-2019, the Urho3D project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+#if defined(URHO3D_DATABASE) && !defined(URHO3D_DATABASE_ODBC)
+
+#pragma once
+
+#include "../../Scene/Serializable.h"
+#include "../../Core/Object.h"
+
+#include "DatabaseStatement.h"
+#include "DatabaseTable.h"
+
+namespace Urho3D
+{
+	/// Forward only result of a select. Rows are stepped straight from the
+	/// database and their columns set on the objects, nothing is buffered.
+	class URHO3D_API DatabaseCursor : public Object
+	{
+		URHO3D_OBJECT(DatabaseCursor, Object);
+
+	public:
+		DatabaseCursor(Context* context, DatabaseStatement* statement, DatabaseTable* table, const String& typeName);
+		~DatabaseCursor();
+
+		/// Read the next row into an existing object. Attributes without a
+		/// column in the result keep their values. False at the end.
+		bool Next(Serializable* item);
+
+		/// Read the next row into a new object, null at the end.
+		SharedPtr<Serializable> Next();
+
+		/// Read up to pageSize rows. Objects already in the page are reused
+		/// and overwritten, so a loop over pages does not allocate once the
+		/// first page is read. Returns the number of rows read, the page is
+		/// resized to it.
+		template<class T>
+		unsigned ReadPage(Vector<SharedPtr<T>>& page, unsigned pageSize)
+		{
+			unsigned count = 0;
+			while (count < pageSize)
+			{
+				if (count < page.Size())
+				{
+					if (!Next(page[count]))
+					{
+						break;
+					}
+				}
+				else
+				{
+					auto item = Next();
+					if (!item)
+					{
+						break;
+					}
+
+					page.Push(SharedPtr<T>(static_cast<T*>(item.Get())));
+				}
+
+				count++;
+			}
+
+			page.Resize(count);
+			return count;
+		}
+
+		/// True, once the last row has been read.
+		bool IsEof() const { return eof_; }
+
+		/// Rows read so far.
+		unsigned GetNumRead() const { return numRead_; }
+
+		/// Release the statement. Called by the context before it disconnects.
+		void Close();
+
+	private:
+		SharedPtr<Serializable> CreateItem();
+
+		SharedPtr<DatabaseStatement> statement_;
+		SharedPtr<DatabaseTable> table_;
+		String typeName_;
+
+		/// Table column of each result column, null for unknown ones.
+		PODVector<DatabaseColumn*> columns_;
+
+		unsigned numRead_;
+		bool eof_;
+	};
+}
+
+#endif
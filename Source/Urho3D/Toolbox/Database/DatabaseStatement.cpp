@@ -0,0 +1,201 @@
+//
+// Copyright (c) 2019-2019, the Urho3D project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+#if defined(URHO3D_DATABASE) && !defined(URHO3D_DATABASE_ODBC)
+
+#include "DatabaseStatement.h"
+
+#include "../../IO/Log.h"
+
+namespace Urho3D
+{
+	DatabaseStatement::DatabaseStatement(DbConnection* connection, const String& sql) :
+		connection_(nullptr),
+		statement_(nullptr),
+		sql_(sql)
+	{
+		if (!connection || !connection->IsConnected())
+		{
+			URHO3D_LOGERROR("A database connection is required in order to prepare a statement.");
+			return;
+		}
+
+		// The connection only hands out a const pointer, preparing does not change it.
+		connection_ = const_cast<sqlite3*>(connection->GetConnectionImpl());
+		if (sqlite3_prepare_v2(connection_, sql_.CString(), -1, &statement_, nullptr) != SQLITE_OK)
+		{
+			URHO3D_LOGERRORF("Could not prepare statement: %s\n%s", sqlite3_errmsg(connection_), sql_.CString());
+			sqlite3_finalize(statement_);
+			statement_ = nullptr;
+		}
+	}
+
+	DatabaseStatement::~DatabaseStatement()
+	{
+		if (statement_)
+		{
+			sqlite3_finalize(statement_);
+			statement_ = nullptr;
+		}
+	}
+
+	bool DatabaseStatement::Bind(int index, const Variant& value)
+	{
+		if (!statement_)
+		{
+			return false;
+		}
+
+		int rc = SQLITE_OK;
+		switch (value.GetType())
+		{
+		case VAR_NONE:		rc = sqlite3_bind_null(statement_, index); break;
+		case VAR_BOOL:		rc = sqlite3_bind_int(statement_, index, value.GetBool() ? 1 : 0); break;
+		case VAR_INT:		rc = sqlite3_bind_int(statement_, index, value.GetInt()); break;
+		case VAR_INT64:		rc = sqlite3_bind_int64(statement_, index, value.GetInt64()); break;
+		case VAR_FLOAT:		rc = sqlite3_bind_double(statement_, index, value.GetFloat()); break;
+		case VAR_DOUBLE:	rc = sqlite3_bind_double(statement_, index, value.GetDouble()); break;
+		case VAR_STRING:
+			rc = sqlite3_bind_text(statement_, index, value.GetString().CString(), value.GetString().Length(), SQLITE_TRANSIENT);
+			break;
+
+		default:
+			URHO3D_LOGERROR("Unhandled variant type.");
+			return false;
+		}
+
+		if (rc != SQLITE_OK)
+		{
+			URHO3D_LOGERRORF("Could not bind parameter %d: %s", index, sqlite3_errmsg(connection_));
+			return false;
+		}
+
+		return true;
+	}
+
+	int DatabaseStatement::Execute()
+	{
+		if (!statement_)
+		{
+			return -1;
+		}
+
+		int rc = sqlite3_step(statement_);
+		while (rc == SQLITE_ROW)
+		{
+			rc = sqlite3_step(statement_);
+		}
+
+		int changes = -1;
+		if (rc == SQLITE_DONE)
+		{
+			changes = sqlite3_changes(connection_);
+		}
+		else
+		{
+			URHO3D_LOGERRORF("Could not execute: %s", sqlite3_errmsg(connection_));
+		}
+
+		Reset();
+		return changes;
+	}
+
+	bool DatabaseStatement::Step()
+	{
+		if (!statement_)
+		{
+			return false;
+		}
+
+		int rc = sqlite3_step(statement_);
+		if (rc != SQLITE_ROW && rc != SQLITE_DONE)
+		{
+			URHO3D_LOGERRORF("Could not execute: %s", sqlite3_errmsg(connection_));
+		}
+
+		return rc == SQLITE_ROW;
+	}
+
+	void DatabaseStatement::Reset()
+	{
+		if (statement_)
+		{
+			sqlite3_reset(statement_);
+			sqlite3_clear_bindings(statement_);
+		}
+	}
+
+	unsigned DatabaseStatement::GetNumColumns() const
+	{
+		return statement_ ? (unsigned) sqlite3_column_count(statement_) : 0;
+	}
+
+	String DatabaseStatement::GetColumnName(unsigned index) const
+	{
+		return statement_ ? String(sqlite3_column_name(statement_, index)) : String::EMPTY;
+	}
+
+	Variant DatabaseStatement::GetColumn(unsigned index, VariantType type) const
+	{
+		if (!statement_ || sqlite3_column_type(statement_, index) == SQLITE_NULL)
+		{
+			return Variant::EMPTY;
+		}
+
+		switch (type)
+		{
+		case VAR_BOOL:		return Variant(sqlite3_column_int(statement_, index) != 0);
+		case VAR_INT:		return Variant(sqlite3_column_int(statement_, index));
+		case VAR_INT64:		return Variant((long long) sqlite3_column_int64(statement_, index));
+		case VAR_FLOAT:		return Variant((float) sqlite3_column_double(statement_, index));
+		case VAR_DOUBLE:	return Variant(sqlite3_column_double(statement_, index));
+		case VAR_STRING:	return Variant(String((const char*) sqlite3_column_text(statement_, index)));
+
+		default:
+			return GetColumn(index);
+		}
+	}
+
+	Variant DatabaseStatement::GetColumn(unsigned index) const
+	{
+		if (!statement_)
+		{
+			return Variant::EMPTY;
+		}
+
+		switch (sqlite3_column_type(statement_, index))
+		{
+		case SQLITE_NULL:		return Variant::EMPTY;
+		case SQLITE_INTEGER:	return Variant(sqlite3_column_int(statement_, index));
+		case SQLITE_FLOAT:		return Variant(sqlite3_column_double(statement_, index));
+
+		default:
+			return Variant(String((const char*) sqlite3_column_text(statement_, index)));
+		}
+	}
+
+	long long DatabaseStatement::GetLastInsertId() const
+	{
+		return connection_ ? (long long) sqlite3_last_insert_rowid(connection_) : 0;
+	}
+}
+
+#endif
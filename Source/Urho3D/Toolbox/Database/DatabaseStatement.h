@@ -0,0 +1,77 @@
+//
+// Copyright (c) 2019-2019, the Urho3D project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+#if defined(URHO3D_DATABASE) && !defined(URHO3D_DATABASE_ODBC)
+
+#pragma once
+
+#include "../../Container/RefCounted.h"
+#include "../../Core/Variant.h"
+#include "../../Database/DbConnection.h"
+
+namespace Urho3D
+{
+	/// A prepared SQLite statement, that is compiled once and executed many
+	/// times with different values bound to its parameters.
+	class URHO3D_API DatabaseStatement : public RefCounted
+	{
+	public:
+		DatabaseStatement(DbConnection* connection, const String& sql);
+		~DatabaseStatement();
+
+		/// False, if the sql could not be compiled.
+		bool IsValid() const { return statement_ != nullptr; }
+		const String& GetSql() const { return sql_; }
+
+		/// Bind a value to a parameter, the first one has index 1.
+		bool Bind(int index, const Variant& value);
+
+		/// Run a statement, that does not return rows. Returns the number of
+		/// rows changed, -1 on errors. The statement is reset afterwards.
+		int Execute();
+
+		/// Advance to the next row of the result. False, once there are no
+		/// more rows or on errors.
+		bool Step();
+
+		/// Rewind the statement and clear all bindings.
+		void Reset();
+
+		unsigned GetNumColumns() const;
+		String GetColumnName(unsigned index) const;
+
+		/// Value of a column of the current row, converted to the given type.
+		Variant GetColumn(unsigned index, VariantType type) const;
+
+		/// Value of a column of the current row in the type SQLite stored it.
+		Variant GetColumn(unsigned index) const;
+
+		/// Row id of the last row inserted through the connection.
+		long long GetLastInsertId() const;
+
+	private:
+		sqlite3* connection_;
+		sqlite3_stmt* statement_;
+		String sql_;
+	};
+}
+
+#endif
@@ -28,7 +28,8 @@ namespace Urho3D
 {
 	DatabaseTable::DatabaseTable(Context* context, const TypeInfo* type) :
 		Object(context),
-		primaryKey_(nullptr)
+		primaryKey_(nullptr),
+		pruneSize_(MIN_PRUNE_SIZE)
 	{
 		if (type == nullptr)
 		{
@@ -56,6 +57,7 @@ namespace Urho3D
 		}
 
 		tableName_ = InitializeTableName(type);
+		InitializeIndices();
 	}
 
 	// TODO: Find a way to alow users to use an attribute to set the table name.
@@ -66,9 +68,113 @@ namespace Urho3D
 		return result;
 	}
 
+	void DatabaseTable::InitializeIndices()
+	{
+		for (auto it = columms_.Begin(); it != columms_.End(); it++)
+		{
+			auto column = it->second_;
+			if (column->IsIndexed())
+			{
+				DatabaseIndex index;
+				index.name_ = tableName_ + "_" + column->GetColumnName();
+				index.columns_.Push(column);
+				index.unique_ = column->IsIndexUnique();
+				indices_.Push(index);
+			}
+
+			if (column->GetIndexName().Empty())
+			{
+				continue;
+			}
+
+			// Columns naming the same index are added to it.
+			String name = tableName_ + "_" + column->GetIndexName();
+			unsigned i = 0;
+			while (i < indices_.Size() && indices_[i].name_ != name)
+			{
+				i++;
+			}
+
+			if (i == indices_.Size())
+			{
+				DatabaseIndex index;
+				index.name_ = name;
+				index.unique_ = false;
+				indices_.Push(index);
+			}
+
+			indices_[i].columns_.Push(column);
+			indices_[i].unique_ |= column->IsIndexUnique();
+		}
+	}
+
 	DatabaseTable::~DatabaseTable()
 	{
 
 	}
+
+	void DatabaseTable::SetSaved(Serializable* item)
+	{
+		if (saved_.Size() >= pruneSize_)
+		{
+			for (auto it = saved_.Begin(); it != saved_.End();)
+			{
+				if (it->second_.item_.Expired())
+				{
+					it = saved_.Erase(it);
+				}
+				else
+				{
+					it++;
+				}
+			}
+
+			pruneSize_ = Max(saved_.Size() * 2, MIN_PRUNE_SIZE);
+		}
+
+		SavedRow& row = saved_[item];
+		row.item_ = item;
+		row.values_.Resize(columms_.Size());
+
+		unsigned i = 0;
+		for (auto it = columms_.Begin(); it != columms_.End(); it++)
+		{
+			row.values_[i++] = it->second_->Get(item);
+		}
+	}
+
+	void DatabaseTable::ResetSaved(Serializable* item)
+	{
+		saved_.Erase(item);
+	}
+
+	void DatabaseTable::ResetSaved()
+	{
+		saved_.Clear();
+		pruneSize_ = MIN_PRUNE_SIZE;
+	}
+
+	bool DatabaseTable::GetChangedColumns(Serializable* item, PODVector<DatabaseColumn*>& changed) const
+	{
+		changed.Clear();
+
+		auto saved = saved_.Find(item);
+		if (saved == saved_.End() || saved->second_.item_.Get() != item)
+		{
+			return false;
+		}
+
+		unsigned i = 0;
+		for (auto it = columms_.Begin(); it != columms_.End(); it++, i++)
+		{
+			auto column = it->second_;
+			if (!column->IsPrimaryKey() && column->Get(item) != saved->second_.values_[i])
+			{
+				changed.Push(column);
+			}
+		}
+
+		return true;
+	}
 }
 #endif
\ No newline at end of file
@@ -34,6 +34,14 @@
 
 namespace Urho3D
 {
+	/// Index over one or more columns, in the order the attributes were registered.
+	struct DatabaseIndex
+	{
+		String name_;
+		PODVector<DatabaseColumn*> columns_;
+		bool unique_;
+	};
+
 	class URHO3D_API DatabaseTable : public Object
 	{
 		URHO3D_OBJECT(DatabaseTable, Object);
@@ -49,6 +57,23 @@ namespace Urho3D
 			return primaryKey_;
 		}
 
+		DatabaseColumn* GetPrimaryKey()
+		{
+			return primaryKey_;
+		}
+
+		/// Indices declared by the metadata of the columns.
+		const Vector<DatabaseIndex>& GetIndices() const { return indices_; }
+
+		/// Column named like the given column of a result, null if there is none.
+		DatabaseColumn* GetColumn(const String& name) const
+		{
+			SharedPtr<DatabaseColumn> column;
+			columms_.TryGetValue(name, column);
+
+			return column;
+		}
+
 		template<class T>
 		void Select(const DbResult& result, T* data, int row)
 		{
@@ -65,12 +90,42 @@ namespace Urho3D
 			}
 		}
 
+		/// Remember the values of the item as they are in the database now.
+		void SetSaved(Serializable* item);
+
+		/// Forget the saved values of the item, or of all items.
+		void ResetSaved(Serializable* item);
+		void ResetSaved();
+
+		/// Columns without the primary key, whose values changed since
+		/// SetSaved. Returns false, if no values are saved for the item.
+		bool GetChangedColumns(Serializable* item, PODVector<DatabaseColumn*>& changed) const;
+
 	private:
 		String InitializeTableName(const TypeInfo* type);
+		void InitializeIndices();
 		String tableName_;
 
 		HashMap<StringHash, SharedPtr<DatabaseColumn>> columms_;
 		SharedPtr<DatabaseColumn> primaryKey_;
+		Vector<DatabaseIndex> indices_;
+
+		struct SavedRow
+		{
+			/// Expired, if the item was destroyed and its address reused.
+			WeakPtr<Serializable> item_;
+
+			/// One value per column, in the order of GetColumns.
+			VariantVector values_;
+		};
+
+		HashMap<Serializable*, SavedRow> saved_;
+
+		/// Saved rows kept at least, before destroyed items are looked for.
+		static const unsigned MIN_PRUNE_SIZE = 1024;
+
+		/// Size, at which rows of destroyed items are removed next.
+		unsigned pruneSize_;
 	};
 }
 #endif
\ No newline at end of file
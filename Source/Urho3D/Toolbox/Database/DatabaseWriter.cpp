@@ -0,0 +1,246 @@
+//
+// Copyright (c) 2019-2019, the Urho3D project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+#if defined(URHO3D_DATABASE) && !defined(URHO3D_DATABASE_ODBC)
+
+#include "DatabaseWriter.h"
+
+#include "../../Core/Timer.h"
+#include "../../IO/Log.h"
+
+namespace Urho3D
+{
+	DatabaseWriter::DatabaseWriter(Context* context, const String& connectionString) :
+		connectionString_(connectionString),
+		nextId_(1),
+		finishedId_(0)
+	{
+		// Not connected through the database subsystem, its bookkeeping is
+		// not meant to be shared with another thread.
+		connection_ = new DbConnection(context, connectionString_);
+	}
+
+	DatabaseWriter::~DatabaseWriter()
+	{
+		Close();
+	}
+
+	bool DatabaseWriter::Open()
+	{
+		if (!connection_ || !connection_->IsConnected())
+		{
+			URHO3D_LOGERROR("Could not open a database connection for the writer: " + connectionString_);
+			return false;
+		}
+
+		sqlite3_busy_timeout(const_cast<sqlite3*>(connection_->GetConnectionImpl()), BUSY_TIMEOUT_MSEC);
+
+		return IsStarted() || Run();
+	}
+
+	void DatabaseWriter::Close()
+	{
+		Stop();
+
+		if (!connection_)
+		{
+			return;
+		}
+
+		// Without a writer thread everything is written here.
+		if (connection_->IsConnected())
+		{
+			while (WritePending())
+			{
+			}
+		}
+
+		statements_.Clear();
+		connection_ = nullptr;
+	}
+
+	void DatabaseWriter::ThreadFunction()
+	{
+		while (shouldRun_)
+		{
+			if (!WritePending())
+			{
+				Time::Sleep(WRITE_INTERVAL_MSEC);
+			}
+		}
+	}
+
+	unsigned long long DatabaseWriter::Queue(const String& sql, const Vector<Variant>& values)
+	{
+		PendingWrite write;
+		write.sql_ = sql;
+		write.values_ = values;
+
+		MutexLock lock(pendingLock_);
+		write.id_ = nextId_++;
+		pending_.Push(write);
+
+		return write.id_;
+	}
+
+	void DatabaseWriter::Flush()
+	{
+		if (!IsStarted())
+		{
+			while (WritePending())
+			{
+			}
+
+			return;
+		}
+
+		while (GetNumPending() > 0)
+		{
+			Time::Sleep(1);
+		}
+	}
+
+	unsigned DatabaseWriter::GetNumPending() const
+	{
+		MutexLock lock(pendingLock_);
+		return pending_.Size() + writing_.Size();
+	}
+
+	unsigned long long DatabaseWriter::GetFinished(PODVector<unsigned long long>& failed)
+	{
+		MutexLock lock(pendingLock_);
+		failed.Push(failed_);
+		failed_.Clear();
+
+		return finishedId_;
+	}
+
+	DatabaseStatement* DatabaseWriter::GetStatement(const String& sql)
+	{
+		SharedPtr<DatabaseStatement> statement;
+		if (statements_.TryGetValue(sql, statement))
+		{
+			return statement;
+		}
+
+		statement = new DatabaseStatement(connection_, sql);
+		if (!statement->IsValid())
+		{
+			return nullptr;
+		}
+
+		statements_[sql] = statement;
+		return statement;
+	}
+
+	bool DatabaseWriter::Execute(const String& sql)
+	{
+		auto statement = GetStatement(sql);
+		return statement && statement->Execute() >= 0;
+	}
+
+	bool DatabaseWriter::WritePending()
+	{
+		{
+			MutexLock lock(pendingLock_);
+			if (pending_.Empty())
+			{
+				return false;
+			}
+
+			writing_.Swap(pending_);
+		}
+
+		// One transaction for the whole batch, instead of one sync per row.
+		PODVector<unsigned long long> failed;
+		if (!WriteRows(0, writing_.Size()))
+		{
+			// A single bad row rolled back all of them. Write them again on
+			// their own, so the other rows are not lost with it.
+			if (writing_.Size() == 1)
+			{
+				failed.Push(writing_[0].id_);
+			}
+			else
+			{
+				for (unsigned i = 0; i < writing_.Size(); i++)
+				{
+					if (!WriteRows(i, i + 1))
+					{
+						failed.Push(writing_[i].id_);
+					}
+				}
+			}
+
+			if (!failed.Empty())
+			{
+				URHO3D_LOGERRORF("Could not write %u rows to the database.", failed.Size());
+			}
+		}
+
+		MutexLock lock(pendingLock_);
+		finishedId_ = writing_.Back().id_;
+		failed_.Push(failed);
+		writing_.Clear();
+
+		return true;
+	}
+
+	bool DatabaseWriter::WriteRows(unsigned begin, unsigned end)
+	{
+		if (!Execute("BEGIN;"))
+		{
+			return false;
+		}
+
+		for (unsigned i = begin; i < end; i++)
+		{
+			const PendingWrite& write = writing_[i];
+			auto statement = GetStatement(write.sql_);
+			if (!statement)
+			{
+				Execute("ROLLBACK;");
+				return false;
+			}
+
+			for (unsigned j = 0; j < write.values_.Size(); j++)
+			{
+				statement->Bind(j + 1, write.values_[j]);
+			}
+
+			if (statement->Execute() < 0)
+			{
+				Execute("ROLLBACK;");
+				return false;
+			}
+		}
+
+		if (!Execute("COMMIT;"))
+		{
+			Execute("ROLLBACK;");
+			return false;
+		}
+
+		return true;
+	}
+}
+
+#endif
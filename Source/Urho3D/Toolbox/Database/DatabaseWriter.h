@@ -0,0 +1,124 @@
+//
+// Copyright (c) 2019-2019, the Urho3D project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+#if defined(URHO3D_DATABASE) && !defined(URHO3D_DATABASE_ODBC)
+
+#pragma once
+
+#include "../../Container/RefCounted.h"
+#include "../../Core/Mutex.h"
+#include "../../Core/Thread.h"
+#include "../../Database/DbConnection.h"
+
+#include "DatabaseStatement.h"
+
+namespace Urho3D
+{
+	/// Writes rows on a background thread with a connection of its own, so
+	/// the game thread only copies the values.
+	///
+	/// Rows are written in the order they were queued. Everything queued
+	/// while the thread was busy is written in one transaction. If that
+	/// fails, the rows are written again one by one and only the rows,
+	/// that fail on their own, are dropped.
+	class URHO3D_API DatabaseWriter : public Thread, public RefCounted
+	{
+	public:
+		/// Time the writer sleeps when there is nothing to write.
+		static const unsigned WRITE_INTERVAL_MSEC = 10;
+
+		/// Time either connection waits for the other one to finish writing.
+		static const int BUSY_TIMEOUT_MSEC = 5000;
+
+		DatabaseWriter(Context* context, const String& connectionString);
+		~DatabaseWriter();
+
+		/// Connect and start the thread.
+		bool Open();
+
+		/// Write everything queued, stop the thread and disconnect.
+		void Close();
+
+		void ThreadFunction() override;
+
+		/// Queue a row, the values are bound to the parameters of the sql in
+		/// order. Returns the id of the write, ids increase with every call.
+		unsigned long long Queue(const String& sql, const Vector<Variant>& values);
+
+		/// Block until everything queued so far is written.
+		void Flush();
+
+		/// Rows queued, that have not been written yet.
+		unsigned GetNumPending() const;
+
+		/// Id of the last write, that is no longer pending. Also moves the
+		/// ids of the writes dropped since the last call to failed, in
+		/// ascending order.
+		unsigned long long GetFinished(PODVector<unsigned long long>& failed);
+
+	private:
+		struct PendingWrite
+		{
+			unsigned long long id_;
+			String sql_;
+			Vector<Variant> values_;
+		};
+
+		String connectionString_;
+		SharedPtr<DbConnection> connection_;
+
+		/// Compiled statements by sql, only used by the thread.
+		HashMap<String, SharedPtr<DatabaseStatement>> statements_;
+
+		/// Guards the queues and ids below.
+		mutable Mutex pendingLock_;
+
+		/// Id of the next queued write.
+		unsigned long long nextId_;
+
+		/// Id of the last write, that was committed or dropped.
+		unsigned long long finishedId_;
+
+		/// Ids of the dropped writes, not yet taken by GetFinished.
+		PODVector<unsigned long long> failed_;
+
+		/// Rows, that have not been picked up by the thread.
+		Vector<PendingWrite> pending_;
+
+		/// Rows the thread is writing. Only cleared by the thread.
+		Vector<PendingWrite> writing_;
+
+		DatabaseStatement* GetStatement(const String& sql);
+
+		/// Run sql without parameters, like BEGIN or COMMIT.
+		bool Execute(const String& sql);
+
+		/// Write rows [begin, end) of writing_ in one transaction, which is
+		/// rolled back if any of them fails.
+		bool WriteRows(unsigned begin, unsigned end);
+
+		/// Write everything pending in one transaction. Returns false, if
+		/// there was nothing to do.
+		bool WritePending();
+	};
+}
+
+#endif
@@ -25,20 +25,28 @@
 
 namespace Urho3D
 {
-	String SqliteSerializer::GetColumnSql(const DatabaseColumn* column)
+	String SqliteSerializer::GetTypeSql(const DatabaseColumn* column)
 	{
-		String type = "";
 		switch (column->GetDatabaseType())
 		{
-		case VAR_BOOL:		type = "INTEGER"; break;
-		case VAR_DOUBLE:	type = "REAL"; break;
-		case VAR_FLOAT:		type = "REAL"; break;
-		case VAR_INT:		type = "INTEGER"; break;
-		case VAR_INT64:		type = "INTEGER"; break;
-		case VAR_STRING:	type = "TEXT"; break;
+		case VAR_BOOL:		return "INTEGER";
+		case VAR_DOUBLE:	return "REAL";
+		case VAR_FLOAT:		return "REAL";
+		case VAR_INT:		return "INTEGER";
+		case VAR_INT64:		return "INTEGER";
+		case VAR_STRING:	return "TEXT";
 
 		default:
-			URHO3D_LOGERROR("Unknown data type."); return ""; break;
+			URHO3D_LOGERROR("Unknown data type."); return "";
+		}
+	}
+
+	String SqliteSerializer::GetColumnSql(const DatabaseColumn* column)
+	{
+		String type = GetTypeSql(column);
+		if (type.Empty())
+		{
+			return "";
 		}
 
 		String constraints = "";
@@ -97,7 +105,7 @@ namespace Urho3D
 		String whereClause = " WHERE ";
 		if (pk)
 		{
-			auto id = pk->Get(data).GetInt();
+			auto id = pk->Get(data).GetInt64();
 			whereClause += pk->GetColumnName() + " = " + String(id) + ";";
 		}
 
@@ -128,7 +136,7 @@ namespace Urho3D
 			}
 		}
 
-		return stmt + "(" + values + "\n) " + whereClause;
+		return stmt + values + "\n" + whereClause;
 	}
 
 	String SqliteSerializer::GetInsertSql(
@@ -172,6 +180,143 @@ namespace Urho3D
 		return stmt + "(" + columnNames + ") VALUES (" + values + ");";
 	}
 
+	String SqliteSerializer::GetInsertStatementSql(const DatabaseTable* table)
+	{
+		String columnNames = "";
+		String values = "";
+
+		auto columns = table->GetColumns();
+		for (auto it = columns.Begin(); it != columns.End(); it++)
+		{
+			auto column = it->second_;
+			if (column->IsPrimaryKey())
+			{
+				continue;
+			}
+
+			if (columnNames.Length() > 0)
+			{
+				columnNames += ", ";
+				values += ", ";
+			}
+
+			columnNames += "'" + column->GetColumnName() + "'";
+			values += "?";
+		}
+
+		auto pk = table->GetPrimaryKey();
+		if (pk)
+		{
+			if (columnNames.Length() > 0)
+			{
+				columnNames += ", ";
+				values += ", ";
+			}
+
+			columnNames += "'" + pk->GetColumnName() + "'";
+			values += "?";
+		}
+
+		return "INSERT INTO '" + table->GetTableName() + "'(" + columnNames + ") VALUES (" + values + ");";
+	}
+
+	String SqliteSerializer::GetUpdateStatementSql(const DatabaseTable* table)
+	{
+		PODVector<DatabaseColumn*> values;
+		auto columns = table->GetColumns();
+		for (auto it = columns.Begin(); it != columns.End(); it++)
+		{
+			if (!it->second_->IsPrimaryKey())
+			{
+				values.Push(it->second_);
+			}
+		}
+
+		return GetUpdateStatementSql(table, values);
+	}
+
+	String SqliteSerializer::GetUpdateStatementSql(const DatabaseTable* table, const PODVector<DatabaseColumn*>& columns)
+	{
+		auto pk = table->GetPrimaryKey();
+		if (!pk)
+		{
+			URHO3D_LOGERROR(table->GetTableName() + " has no primary key, rows cannot be updated.");
+			return "";
+		}
+
+		String values = "";
+		for (unsigned i = 0; i < columns.Size(); i++)
+		{
+			if (values.Length() > 0)
+			{
+				values += ", ";
+			}
+
+			values += "'" + columns[i]->GetColumnName() + "' = ?";
+		}
+
+		return "UPDATE '" + table->GetTableName() + "' SET " + values + " WHERE " + pk->GetColumnName() + " = ?;";
+	}
+
+	String SqliteSerializer::GetMaxIdSql(const DatabaseTable* table)
+	{
+		auto pk = table->GetPrimaryKey();
+		if (!pk)
+		{
+			URHO3D_LOGERROR(table->GetTableName() + " has no primary key.");
+			return "";
+		}
+
+		return "SELECT MAX(" + pk->GetColumnName() + ") FROM '" + table->GetTableName() + "';";
+	}
+
+	String SqliteSerializer::GetIndexSql(const DatabaseTable* table, const DatabaseIndex& index)
+	{
+		String columnNames = "";
+		for (unsigned i = 0; i < index.columns_.Size(); i++)
+		{
+			if (columnNames.Length() > 0)
+			{
+				columnNames += ", ";
+			}
+
+			columnNames += "'" + index.columns_[i]->GetColumnName() + "'";
+		}
+
+		String unique = index.unique_ ? "UNIQUE " : "";
+		return "CREATE " + unique + "INDEX IF NOT EXISTS '" + index.name_ + "' ON '" + table->GetTableName() + "'(" + columnNames + ");";
+	}
+
+	String SqliteSerializer::GetAddColumnSql(const DatabaseTable* table, const DatabaseColumn* column)
+	{
+		String type = GetTypeSql(column);
+		if (type.Empty())
+		{
+			return "";
+		}
+
+		// Columns added to a table with rows cannot be keys or unique and
+		// need a default to be not null.
+		if (column->IsPrimaryKey() || column->IsUnique())
+		{
+			URHO3D_LOGWARNING("The column " + column->GetColumnName() + " is added to " + table->GetTableName() +
+				" without its primary key or unique constraint. Use a unique index instead.");
+		}
+
+		String r = "ALTER TABLE '" + table->GetTableName() + "' ADD COLUMN '" + column->GetColumnName() + "' " + type;
+		if (column->IsNotNull())
+		{
+			r += type == "TEXT" ? " NOT NULL DEFAULT ''" : " NOT NULL DEFAULT 0";
+		}
+
+		return r + ";";
+	}
+
+	String SqliteSerializer::GetTableColumnsSql(const DatabaseTable* table)
+	{
+		return "PRAGMA table_info('" + table->GetTableName() + "');";
+	}
+
 	String SqliteSerializer::GetSelect(const String& whereClause, const DatabaseTable* table)
 	{
 		auto r = "SELECT * FROM '" + table->GetTableName() + "'";
@@ -34,6 +34,9 @@ namespace Urho3D
 	{
 		URHO3D_OBJECT(SqliteSerializer, AbstractDatabaseSerializer);
 
+	private:
+		String GetTypeSql(const DatabaseColumn* column);
+
 	protected:
 		virtual String GetUpdateSql(const DatabaseTable* table, const Serializable* data);
 		virtual String GetInsertSql(const DatabaseTable* table, const Serializable* data);
@@ -48,6 +51,13 @@ namespace Urho3D
 		virtual String GetColumnSql(const DatabaseColumn* column);
 		virtual String GetTableSql(const DatabaseTable* table);
 		virtual String GetSelect(const String& whereClause, const DatabaseTable* table);
+		virtual String GetIndexSql(const DatabaseTable* table, const DatabaseIndex& index);
+		virtual String GetAddColumnSql(const DatabaseTable* table, const DatabaseColumn* column);
+		virtual String GetTableColumnsSql(const DatabaseTable* table);
+		virtual String GetInsertStatementSql(const DatabaseTable* table);
+		virtual String GetUpdateStatementSql(const DatabaseTable* table);
+		virtual String GetUpdateStatementSql(const DatabaseTable* table, const PODVector<DatabaseColumn*>& columns);
+		virtual String GetMaxIdSql(const DatabaseTable* table);
 	};
 }
 #endif
\ No newline at end of file
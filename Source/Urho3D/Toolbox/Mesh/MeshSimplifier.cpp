@@ -0,0 +1,683 @@
+#include "MeshSimplifier.h"
+
+#include <cmath>
+#include <EASTL/heap.h>
+
+#include "../../Core/WorkQueue.h"
+#include "../../Math/BoundingBox.h"
+
+namespace Urho3D
+{
+	/// Collapses, that turn a triangle further than this, are rejected.
+	static const double MIN_NORMAL_DOT = 0.2;
+
+	/// Triangles with nearly parallel edges are degenerate.
+	static const double MAX_EDGE_DOT = 0.999;
+
+	/// Relative determinant below which the quadric is not inverted.
+	static const double MIN_DETERMINANT = 1e-6;
+
+	static double Det(const double* m, int a11, int a12, int a13, int a21, int a22, int a23, int a31, int a32, int a33)
+	{
+		return
+			m[a11] * m[a22] * m[a33] + m[a13] * m[a21] * m[a32] + m[a12] * m[a23] * m[a31] -
+			m[a13] * m[a22] * m[a31] - m[a11] * m[a23] * m[a32] - m[a12] * m[a21] * m[a33];
+	}
+
+	static double QuadricError(const double* q, double x, double y, double z)
+	{
+		return
+			q[0] * x * x + 2 * q[1] * x * y + 2 * q[2] * x * z + 2 * q[3] * x + q[4] * y * y +
+			2 * q[5] * y * z + 2 * q[6] * y + q[7] * z * z + 2 * q[8] * z + q[9];
+	}
+
+	MeshSimplifier::MeshSimplifier() :
+		mLiveTriangles(0),
+		mCenter(Vector3::ZERO),
+		mScale(1.0f)
+	{
+	}
+
+	void MeshSimplifier::SetMesh(const eastl::vector<Vector3>& positions, const eastl::vector<unsigned>& indices)
+	{
+		BoundingBox box;
+		for (unsigned i = 0; i < positions.size(); i++)
+		{
+			box.Merge(positions[i]);
+		}
+
+		Vector3 size = positions.empty() ? Vector3::ONE : box.Size();
+		mCenter = positions.empty() ? Vector3::ZERO : box.Center();
+		mScale = Max(Max(size.x_, size.y_), Max(size.z_, M_EPSILON)) * 0.5f;
+
+		unsigned count = (unsigned) positions.size();
+		mX.resize(count);
+		mY.resize(count);
+		mZ.resize(count);
+		for (unsigned i = 0; i < count; i++)
+		{
+			mX[i] = (positions[i].x_ - mCenter.x_) / mScale;
+			mY[i] = (positions[i].y_ - mCenter.y_) / mScale;
+			mZ[i] = (positions[i].z_ - mCenter.z_) / mScale;
+		}
+
+		mIndices.clear();
+		mIndices.reserve(indices.size());
+		mSourceTriangle.clear();
+		for (unsigned i = 0; i + 2 < indices.size(); i += 3)
+		{
+			unsigned a = indices[i];
+			unsigned b = indices[i + 1];
+			unsigned c = indices[i + 2];
+			if (a >= count || b >= count || c >= count || a == b || b == c || a == c)
+			{
+				continue;
+			}
+
+			mIndices.push_back((int) a);
+			mIndices.push_back((int) b);
+			mIndices.push_back((int) c);
+			mSourceTriangle.push_back(i / 3);
+		}
+
+		mLiveTriangles = (unsigned) mIndices.size() / 3;
+		mDeleted.assign(mLiveTriangles, 0);
+		mTriangleCell.assign(mLiveTriangles, 0);
+
+		mVersion.assign(count, 0);
+		mCell.assign(count, 0);
+		mRemoved.assign(count, 0);
+		mFixed.assign(count, 0);
+		mNext.assign(count, -1);
+		mLast.resize(count);
+		for (unsigned i = 0; i < count; i++)
+		{
+			mLast[i] = (int) i;
+		}
+
+		BuildAdjacency();
+		ComputeQuadrics();
+		FindBorders();
+	}
+
+	void MeshSimplifier::BuildAdjacency()
+	{
+		unsigned count = (unsigned) mX.size();
+		mRefStart.assign(count + 1, 0);
+		for (unsigned i = 0; i < mIndices.size(); i++)
+		{
+			mRefStart[mIndices[i] + 1]++;
+		}
+
+		for (unsigned i = 0; i < count; i++)
+		{
+			mRefStart[i + 1] += mRefStart[i];
+		}
+
+		eastl::vector<int> fill(mRefStart.begin(), mRefStart.end() - 1);
+		mRefs.resize(mIndices.size());
+		for (unsigned i = 0; i < mIndices.size(); i++)
+		{
+			mRefs[fill[mIndices[i]]++] = (int) (i / 3);
+		}
+	}
+
+	void MeshSimplifier::ComputeQuadrics()
+	{
+		unsigned count = (unsigned) mX.size();
+		for (int i = 0; i < 10; i++)
+		{
+			mQuadric[i].assign(count, 0.0f);
+		}
+
+		for (unsigned t = 0; t < mLiveTriangles; t++)
+		{
+			const int* v = &mIndices[t * 3];
+			Vector3 p0(mX[v[0]], mY[v[0]], mZ[v[0]]);
+			Vector3 p1(mX[v[1]], mY[v[1]], mZ[v[1]]);
+			Vector3 p2(mX[v[2]], mY[v[2]], mZ[v[2]]);
+			Vector3 n = (p1 - p0).CrossProduct(p2 - p0);
+			if (n.LengthSquared() <= 0.0f)
+			{
+				continue;
+			}
+
+			n.Normalize();
+			float d = -n.DotProduct(p0);
+			const float plane[10] =
+			{
+				n.x_ * n.x_, n.x_ * n.y_, n.x_ * n.z_, n.x_ * d,
+				n.y_ * n.y_, n.y_ * n.z_, n.y_ * d,
+				n.z_ * n.z_, n.z_ * d,
+				d * d
+			};
+
+			for (int j = 0; j < 3; j++)
+			{
+				for (int k = 0; k < 10; k++)
+				{
+					mQuadric[k][v[j]] += plane[k];
+				}
+			}
+		}
+	}
+
+	void MeshSimplifier::FindBorders()
+	{
+		/// An edge used by a single triangle is open. The other vertex of each
+		/// edge starting at v is counted, open edges are counted once.
+		unsigned count = (unsigned) mX.size();
+		mBorder.assign(count, 0);
+
+		eastl::vector<int> others;
+		eastl::vector<int> uses;
+		for (unsigned v = 0; v < count; v++)
+		{
+			others.clear();
+			uses.clear();
+			for (int r = mRefStart[v]; r < mRefStart[v + 1]; r++)
+			{
+				const int* t = &mIndices[mRefs[r] * 3];
+				for (int j = 0; j < 3; j++)
+				{
+					if (t[j] == (int) v)
+					{
+						continue;
+					}
+
+					unsigned k = 0;
+					while (k < others.size() && others[k] != t[j])
+					{
+						k++;
+					}
+
+					if (k == others.size())
+					{
+						others.push_back(t[j]);
+						uses.push_back(0);
+					}
+
+					uses[k]++;
+				}
+			}
+
+			for (unsigned k = 0; k < uses.size(); k++)
+			{
+				if (uses[k] == 1)
+				{
+					mBorder[v] = 1;
+					mBorder[others[k]] = 1;
+				}
+			}
+		}
+	}
+
+	void MeshSimplifier::SetFixed(unsigned vertex)
+	{
+		if (vertex < mFixed.size())
+		{
+			mFixed[vertex] = 1;
+		}
+	}
+
+	int MeshSimplifier::Partition(eastl::vector<unsigned>& liveTriangles)
+	{
+		int cells = 1;
+		while (cells < MAX_CELLS && (unsigned) (cells * cells * cells) * CELL_TRIANGLES < mLiveTriangles)
+		{
+			cells++;
+		}
+
+		/// Positions are inside the unit box.
+		liveTriangles.assign(cells * cells * cells, 0);
+		for (unsigned t = 0; t < mDeleted.size(); t++)
+		{
+			if (mDeleted[t])
+			{
+				continue;
+			}
+
+			const int* v = &mIndices[t * 3];
+			int cell[3];
+			float center[3] =
+			{
+				(mX[v[0]] + mX[v[1]] + mX[v[2]]) / 3.0f,
+				(mY[v[0]] + mY[v[1]] + mY[v[2]]) / 3.0f,
+				(mZ[v[0]] + mZ[v[1]] + mZ[v[2]]) / 3.0f
+			};
+
+			for (int j = 0; j < 3; j++)
+			{
+				cell[j] = Clamp((int) ((center[j] + 1.0f) * 0.5f * cells), 0, cells - 1);
+			}
+
+			mTriangleCell[t] = (cell[2] * cells + cell[1]) * cells + cell[0];
+			liveTriangles[mTriangleCell[t]]++;
+		}
+
+		/// Bucket once, so a cell does not look at the triangles of all others.
+		int numCells = cells * cells * cells;
+		mCellStart.assign(numCells + 1, 0);
+		for (int i = 0; i < numCells; i++)
+		{
+			mCellStart[i + 1] = mCellStart[i] + liveTriangles[i];
+		}
+
+		eastl::vector<unsigned> next(mCellStart.begin(), mCellStart.end() - 1);
+		mCellTriangles.resize(mCellStart[numCells]);
+		for (unsigned t = 0; t < mDeleted.size(); t++)
+		{
+			if (!mDeleted[t])
+			{
+				mCellTriangles[next[mTriangleCell[t]]++] = (int) t;
+			}
+		}
+
+		for (unsigned v = 0; v < mCell.size(); v++)
+		{
+			int cell = -1;
+			for (int r = mRefStart[v]; r < mRefStart[v + 1]; r++)
+			{
+				int t = mRefs[r];
+				if (cell == -1)
+				{
+					cell = mTriangleCell[t];
+				}
+				else if (cell != mTriangleCell[t])
+				{
+					cell = -1;
+					break;
+				}
+			}
+
+			mCell[v] = cell;
+		}
+
+		return numCells;
+	}
+
+	void MeshSimplifier::Simplify(unsigned target, float maxError, WorkQueue* queue)
+	{
+		if (mLiveTriangles <= target)
+		{
+			return;
+		}
+
+		float error = maxError / (mScale * mScale);
+		if (mLiveTriangles >= MIN_PARALLEL_TRIANGLES)
+		{
+			eastl::vector<unsigned> liveTriangles;
+			int cells = Partition(liveTriangles);
+
+			/// Each cell gets its share of the target, the border pass spends the rest.
+			double ratio = (double) target / mLiveTriangles;
+			eastl::vector<CellJob> jobs;
+			jobs.reserve(cells);
+			for (int i = 0; i < cells; i++)
+			{
+				if (liveTriangles[i] > 0)
+				{
+					jobs.push_back(CellJob{ this, i, (unsigned) (liveTriangles[i] * ratio), liveTriangles[i], error, 0 });
+				}
+			}
+
+			if (queue != nullptr && queue->GetNumThreads() > 0)
+			{
+				TaskCounter counter;
+				for (unsigned i = 0; i < jobs.size(); i++)
+				{
+					queue->AddTask(&MeshSimplifier::RunCell, &jobs[i], &counter, nullptr);
+				}
+
+				queue->WaitForCounter(&counter);
+			}
+			else
+			{
+				for (unsigned i = 0; i < jobs.size(); i++)
+				{
+					RunCell(&jobs[i]);
+				}
+			}
+
+			for (unsigned i = 0; i < jobs.size(); i++)
+			{
+				mLiveTriangles -= jobs[i].mDeleted;
+			}
+		}
+
+		mLiveTriangles -= SimplifyRegion(-1, target, mLiveTriangles, error);
+	}
+
+	void MeshSimplifier::RunCell(void* data)
+	{
+		CellJob* job = reinterpret_cast<CellJob*>(data);
+		job->mDeleted = job->mSimplifier->SimplifyRegion(job->mCell, job->mTarget, job->mLive, job->mMaxError);
+	}
+
+	unsigned MeshSimplifier::SimplifyRegion(int cell, unsigned target, unsigned live, float maxError)
+	{
+		eastl::vector<Collapse> heap;
+		heap.reserve(live * 3 / 2);
+
+		unsigned begin = 0;
+		unsigned end = mDeleted.size();
+		if (cell >= 0)
+		{
+			begin = mCellStart[cell];
+			end = mCellStart[cell + 1];
+		}
+
+		for (unsigned i = begin; i < end; i++)
+		{
+			int t = cell >= 0 ? mCellTriangles[i] : (int) i;
+			if (mDeleted[t])
+			{
+				continue;
+			}
+
+			/// Inner edges are used by two triangles in opposite directions,
+			/// open ones only by one, in either direction.
+			const int* v = &mIndices[t * 3];
+			for (int j = 0; j < 3; j++)
+			{
+				int a = v[j];
+				int b = v[(j + 1) % 3];
+				if (a < b || (mBorder[a] && mBorder[b]))
+				{
+					PushEdge(a, b, cell, heap, false);
+				}
+			}
+		}
+
+		eastl::make_heap(heap.begin(), heap.end());
+
+		unsigned deleted = 0;
+		while (live - deleted > target && !heap.empty())
+		{
+			eastl::pop_heap(heap.begin(), heap.end());
+			Collapse c = heap.back();
+			heap.pop_back();
+
+			if (c.mError > maxError)
+			{
+				break;
+			}
+
+			if (mRemoved[c.mVertex0] || mRemoved[c.mVertex1] ||
+				mVersion[c.mVertex0] != c.mVersion0 || mVersion[c.mVertex1] != c.mVersion1)
+			{
+				continue;
+			}
+
+			float x, y, z;
+			GetError(c.mVertex0, c.mVertex1, x, y, z);
+			if (Flips(c.mVertex0, c.mVertex1, x, y, z) || Flips(c.mVertex1, c.mVertex0, x, y, z))
+			{
+				continue;
+			}
+
+			deleted += CollapseEdge(c.mVertex0, c.mVertex1, x, y, z);
+
+			/// Edges around the merged vertex have a new error.
+			for (int m = c.mVertex0; m >= 0; m = mNext[m])
+			{
+				for (int r = mRefStart[m]; r < mRefStart[m + 1]; r++)
+				{
+					int t = mRefs[r];
+					if (mDeleted[t])
+					{
+						continue;
+					}
+
+					const int* v = &mIndices[t * 3];
+					for (int j = 0; j < 3; j++)
+					{
+						if (v[j] != c.mVertex0)
+						{
+							PushEdge(c.mVertex0, v[j], cell, heap, true);
+						}
+					}
+				}
+			}
+		}
+
+		return deleted;
+	}
+
+	bool MeshSimplifier::CanCollapse(int v0, int v1, int cell) const
+	{
+		if (mRemoved[v0] || mRemoved[v1] || mFixed[v0] || mFixed[v1])
+		{
+			return false;
+		}
+
+		/// Locked vertices wait for the border pass.
+		if (cell >= 0 && (mCell[v0] != cell || mCell[v1] != cell))
+		{
+			return false;
+		}
+
+		/// Open borders only collapse along themselves.
+		return mBorder[v0] == mBorder[v1];
+	}
+
+	void MeshSimplifier::PushEdge(int v0, int v1, int cell, eastl::vector<Collapse>& heap, bool sort) const
+	{
+		if (!CanCollapse(v0, v1, cell))
+		{
+			return;
+		}
+
+		float x, y, z;
+		Collapse c;
+		c.mError = GetError(v0, v1, x, y, z);
+		c.mVertex0 = v0;
+		c.mVertex1 = v1;
+		c.mVersion0 = mVersion[v0];
+		c.mVersion1 = mVersion[v1];
+
+		heap.push_back(c);
+		if (sort)
+		{
+			eastl::push_heap(heap.begin(), heap.end());
+		}
+	}
+
+	float MeshSimplifier::GetError(int v0, int v1, float& x, float& y, float& z) const
+	{
+		double q[10];
+		for (int i = 0; i < 10; i++)
+		{
+			q[i] = (double) mQuadric[i][v0] + mQuadric[i][v1];
+		}
+
+		/// Border vertices stay on the border, one of the ends or the middle.
+		double det = Det(q, 0, 1, 2, 1, 4, 5, 2, 5, 7);
+		double trace = q[0] + q[4] + q[7];
+		if (!(mBorder[v0] && mBorder[v1]) && Abs(det) > MIN_DETERMINANT * trace * trace * trace)
+		{
+			double px = -1.0 / det * Det(q, 1, 2, 3, 4, 5, 6, 5, 7, 8);
+			double py = 1.0 / det * Det(q, 0, 2, 3, 1, 5, 6, 2, 7, 8);
+			double pz = -1.0 / det * Det(q, 0, 1, 3, 1, 4, 6, 2, 5, 8);
+			x = (float) px;
+			y = (float) py;
+			z = (float) pz;
+
+			return (float) Max(QuadricError(q, px, py, pz), 0.0);
+		}
+
+		const double candidates[3][3] =
+		{
+			{ mX[v0], mY[v0], mZ[v0] },
+			{ mX[v1], mY[v1], mZ[v1] },
+			{ (mX[v0] + mX[v1]) * 0.5, (mY[v0] + mY[v1]) * 0.5, (mZ[v0] + mZ[v1]) * 0.5 }
+		};
+
+		double best = M_INFINITY;
+		for (int i = 0; i < 3; i++)
+		{
+			double error = QuadricError(q, candidates[i][0], candidates[i][1], candidates[i][2]);
+			if (error < best)
+			{
+				best = error;
+				x = (float) candidates[i][0];
+				y = (float) candidates[i][1];
+				z = (float) candidates[i][2];
+			}
+		}
+
+		return (float) Max(best, 0.0);
+	}
+
+	bool MeshSimplifier::Flips(int v, int other, float x, float y, float z) const
+	{
+		Vector3 p(x, y, z);
+		for (int m = v; m >= 0; m = mNext[m])
+		{
+			for (int r = mRefStart[m]; r < mRefStart[m + 1]; r++)
+			{
+				int t = mRefs[r];
+				if (mDeleted[t])
+				{
+					continue;
+				}
+
+				const int* idx = &mIndices[t * 3];
+				int s = idx[0] == v ? 0 : (idx[1] == v ? 1 : 2);
+				int id1 = idx[(s + 1) % 3];
+				int id2 = idx[(s + 2) % 3];
+
+				/// Deleted by the collapse.
+				if (id1 == other || id2 == other)
+				{
+					continue;
+				}
+
+				Vector3 p0(mX[v], mY[v], mZ[v]);
+				Vector3 p1(mX[id1], mY[id1], mZ[id1]);
+				Vector3 p2(mX[id2], mY[id2], mZ[id2]);
+
+				Vector3 d1 = (p1 - p).Normalized();
+				Vector3 d2 = (p2 - p).Normalized();
+				if (Abs(d1.DotProduct(d2)) > MAX_EDGE_DOT)
+				{
+					return true;
+				}
+
+				Vector3 before = (p1 - p0).CrossProduct(p2 - p0).Normalized();
+				Vector3 after = d1.CrossProduct(d2).Normalized();
+				if (after.DotProduct(before) < MIN_NORMAL_DOT)
+				{
+					return true;
+				}
+			}
+		}
+
+		return false;
+	}
+
+	unsigned MeshSimplifier::CollapseEdge(int v0, int v1, float x, float y, float z)
+	{
+		mX[v0] = x;
+		mY[v0] = y;
+		mZ[v0] = z;
+		for (int i = 0; i < 10; i++)
+		{
+			mQuadric[i][v0] += mQuadric[i][v1];
+		}
+
+		/// Shared triangles are listed by v1 as well.
+		unsigned deleted = 0;
+		for (int m = v1; m >= 0; m = mNext[m])
+		{
+			for (int r = mRefStart[m]; r < mRefStart[m + 1]; r++)
+			{
+				int t = mRefs[r];
+				if (mDeleted[t])
+				{
+					continue;
+				}
+
+				int* idx = &mIndices[t * 3];
+				if (idx[0] == v0 || idx[1] == v0 || idx[2] == v0)
+				{
+					mDeleted[t] = 1;
+					deleted++;
+					continue;
+				}
+
+				for (int j = 0; j < 3; j++)
+				{
+					if (idx[j] == v1)
+					{
+						idx[j] = v0;
+					}
+				}
+			}
+		}
+
+		mNext[mLast[v0]] = v1;
+		mLast[v0] = mLast[v1];
+		mRemoved[v1] = 1;
+		mVersion[v0]++;
+		mVersion[v1]++;
+
+		return deleted;
+	}
+
+	void MeshSimplifier::GetMesh(eastl::vector<Vector3>& positions, eastl::vector<unsigned>& indices) const
+	{
+		positions.clear();
+		indices.clear();
+
+		eastl::vector<int> remap(mX.size(), -1);
+		for (unsigned t = 0; t < mDeleted.size(); t++)
+		{
+			if (mDeleted[t])
+			{
+				continue;
+			}
+
+			for (int j = 0; j < 3; j++)
+			{
+				int v = mIndices[t * 3 + j];
+				if (remap[v] < 0)
+				{
+					remap[v] = (int) positions.size();
+					positions.push_back(Vector3(
+						mX[v] * mScale + mCenter.x_,
+						mY[v] * mScale + mCenter.y_,
+						mZ[v] * mScale + mCenter.z_));
+				}
+
+				indices.push_back((unsigned) remap[v]);
+			}
+		}
+	}
+
+	void MeshSimplifier::GetTriangles(eastl::vector<unsigned>& indices, eastl::vector<unsigned>& sources) const
+	{
+		indices.clear();
+		sources.clear();
+		for (unsigned t = 0; t < mDeleted.size(); t++)
+		{
+			if (mDeleted[t])
+			{
+				continue;
+			}
+
+			indices.push_back((unsigned) mIndices[t * 3]);
+			indices.push_back((unsigned) mIndices[t * 3 + 1]);
+			indices.push_back((unsigned) mIndices[t * 3 + 2]);
+			sources.push_back(mSourceTriangle[t]);
+		}
+	}
+
+	Vector3 MeshSimplifier::GetPosition(unsigned vertex) const
+	{
+		return Vector3(
+			mX[vertex] * mScale + mCenter.x_,
+			mY[vertex] * mScale + mCenter.y_,
+			mZ[vertex] * mScale + mCenter.z_);
+	}
+}
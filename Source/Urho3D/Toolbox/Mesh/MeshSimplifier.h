@@ -0,0 +1,174 @@
+#pragma once
+
+#include <inttypes.h>
+#include <EASTL/vector.h>
+
+#include "../../Math/Vector3.h"
+
+namespace Urho3D
+{
+	class WorkQueue;
+
+	/// Quadric edge collapse simplification for large meshes.
+	///
+	/// Positions and quadrics are kept in one float array per component,
+	/// relative to the center of the mesh and scaled into a unit box to keep
+	/// the float quadrics precise. Edges are collapsed cheapest first from a
+	/// priority queue, only the edges around a collapse are evaluated again.
+	/// Meshes above MIN_PARALLEL_TRIANGLES are split into a grid of cells,
+	/// which are simplified at the same time on the work queue. Vertices of
+	/// triangles in more than one cell are locked meanwhile, so no two cells
+	/// touch the same data. A final pass over the whole mesh collapses the
+	/// edges along the cell borders.
+	class MeshSimplifier
+	{
+	public:
+		/// Smaller meshes are simplified in one piece.
+		static const unsigned MIN_PARALLEL_TRIANGLES = 16384;
+
+		/// Triangles per cell the split aims for.
+		static const unsigned CELL_TRIANGLES = 8192;
+
+		/// Cells per axis at most.
+		static const int MAX_CELLS = 16;
+
+	private:
+		/// Candidate collapse of vertex 1 into vertex 0. Outdated, once
+		/// either vertex changed after the candidate was queued.
+		struct Collapse
+		{
+			float mError;
+			int mVertex0;
+			int mVertex1;
+			unsigned mVersion0;
+			unsigned mVersion1;
+
+			/// The cheapest collapse is on top of the queue.
+			bool operator <(const Collapse& rhs) const
+			{
+				return mError > rhs.mError;
+			}
+		};
+
+		/// Work of a single cell.
+		struct CellJob
+		{
+			MeshSimplifier* mSimplifier;
+			int mCell;
+			unsigned mTarget;
+			unsigned mLive;
+			float mMaxError;
+			unsigned mDeleted;
+		};
+
+		/// Positions inside the unit box.
+		eastl::vector<float> mX;
+		eastl::vector<float> mY;
+		eastl::vector<float> mZ;
+
+		/// Upper triangle of the symmetric 4x4 quadric of each vertex.
+		eastl::vector<float> mQuadric[10];
+
+		/// Changed with every collapse touching the vertex.
+		eastl::vector<unsigned> mVersion;
+
+		/// Cell owning all triangles of a vertex, -1 if the vertex is locked.
+		eastl::vector<int> mCell;
+
+		/// Vertices on an open edge.
+		eastl::vector<uint8_t> mBorder;
+
+		/// Vertices, that keep their place, see SetFixed.
+		eastl::vector<uint8_t> mFixed;
+		eastl::vector<uint8_t> mRemoved;
+
+		/// Vertices merged into a vertex form a list starting with the
+		/// vertex itself. Its triangles are the ones of all members.
+		eastl::vector<int> mNext;
+		eastl::vector<int> mLast;
+
+		/// Triangles of each vertex as built, see mNext.
+		eastl::vector<int> mRefStart;
+		eastl::vector<int> mRefs;
+
+		/// Three vertices per triangle.
+		eastl::vector<int> mIndices;
+		eastl::vector<uint8_t> mDeleted;
+		eastl::vector<int> mTriangleCell;
+
+		/// Live triangles sorted by cell, see Partition. The ones of cell i
+		/// start at mCellStart[i].
+		eastl::vector<unsigned> mCellStart;
+		eastl::vector<int> mCellTriangles;
+
+		/// Index of each triangle in the mesh given to SetMesh.
+		eastl::vector<unsigned> mSourceTriangle;
+		unsigned mLiveTriangles;
+
+		/// Maps the unit box back to the mesh.
+		Vector3 mCenter;
+		float mScale;
+
+		void BuildAdjacency();
+		void ComputeQuadrics();
+		void FindBorders();
+
+		/// Assign the triangles to a grid of cells, bucket them by cell and
+		/// lock the vertices between cells. Returns the number of cells.
+		int Partition(eastl::vector<unsigned>& liveTriangles);
+
+		/// Collapse the cheapest edges of a cell, or of the whole mesh for
+		/// cell -1, until target triangles are left. Returns the number of
+		/// triangles deleted.
+		unsigned SimplifyRegion(int cell, unsigned target, unsigned live, float maxError);
+
+		bool CanCollapse(int v0, int v1, int cell) const;
+		/// Queue the collapse, sort is false while the heap is built.
+		void PushEdge(int v0, int v1, int cell, eastl::vector<Collapse>& heap, bool sort) const;
+
+		/// Error of the collapse and the position the merged vertex gets.
+		float GetError(int v0, int v1, float& x, float& y, float& z) const;
+
+		/// True, if moving v to the given position flips or degenerates one
+		/// of its triangles, that do not contain other.
+		bool Flips(int v, int other, float x, float y, float z) const;
+
+		/// Merge v1 into v0. Returns the number of triangles deleted.
+		unsigned CollapseEdge(int v0, int v1, float x, float y, float z);
+
+		static void RunCell(void* data);
+
+	public:
+		MeshSimplifier();
+
+		/// Take a triangle list, three indices per triangle. Degenerate
+		/// triangles are dropped.
+		void SetMesh(const eastl::vector<Vector3>& positions, const eastl::vector<unsigned>& indices);
+
+		/// Keep the vertex where it is, it is neither moved nor merged into
+		/// another one. Call after SetMesh.
+		void SetFixed(unsigned vertex);
+
+		/// Collapse edges until at most target triangles are left, or no
+		/// collapse with a lower error than maxError is possible. The error is
+		/// the squared distance to the original surface, in units of the mesh.
+		/// Cells run on the given work queue, or one after the other without one.
+		void Simplify(unsigned target, float maxError = M_INFINITY, WorkQueue* queue = nullptr);
+
+		/// The simplified mesh, unused vertices are removed.
+		void GetMesh(eastl::vector<Vector3>& positions, eastl::vector<unsigned>& indices) const;
+
+		/// The remaining triangles with the vertex indices of SetMesh, and the
+		/// index of the triangle each one started as. Allows to carry vertex
+		/// attributes over, that the simplifier does not know about.
+		void GetTriangles(eastl::vector<unsigned>& indices, eastl::vector<unsigned>& sources) const;
+
+		/// Current position of a vertex given to SetMesh.
+		Vector3 GetPosition(unsigned vertex) const;
+
+		unsigned GetTriangleCount() const
+		{
+			return mLiveTriangles;
+		}
+	};
+}
@@ -1,5 +1,7 @@
 #include "ProceduralMesh.h"
+#include "MeshSimplifier.h"
 
+#include "../../Core/WorkQueue.h"
 #include "../../IO/Log.h"
 #include "../../Resource/ResourceCache.h"
 #include "../../Graphics/GraphicsDefs.h"
@@ -230,21 +232,90 @@ namespace Urho3D
 		vertices[index].p = v;
 	}
 
-	SharedPtr<Model> ProceduralMesh::GetModel()
+	void ProceduralMesh::SetGeometry(const eastl::vector<Vector3>& positions, const eastl::vector<unsigned>& indices)
 	{
-		SharedPtr<Model> model		= SharedPtr<Model>(new Model(context_));
-		SharedPtr<VertexBuffer> vb	= SharedPtr<VertexBuffer>(new VertexBuffer(context_));
-		SharedPtr<IndexBuffer> ib	= SharedPtr<IndexBuffer>(new IndexBuffer(context_));
-		SharedPtr<Geometry> geom	= SharedPtr<Geometry>(new Geometry(context_));
-		BoundingBox boundingBox;
+		Clear();
 
-		PODVector<VertexElement> elements;
+		vertices.resize(positions.size());
+		for (size_t i = 0; i < positions.size(); i++)
+		{
+			vertices[i].p = positions[i];
+			vertices[i].tstart = (int) i;
+		}
+
+		triangles.reserve(indices.size() / 3);
+		for (size_t i = 0; i + 2 < indices.size(); i += 3)
+		{
+			AddTriangleFromIndices(indices[i], indices[i + 1], indices[i + 2], true);
+		}
+	}
+
+	void ProceduralMesh::GetVertexElements(PODVector<VertexElement>& elements)
+	{
+		elements.Clear();
 		elements.Push(VertexElement(TYPE_VECTOR3, SEM_POSITION));
 		elements.Push(VertexElement(TYPE_VECTOR3, SEM_NORMAL));
 		elements.Push(VertexElement(TYPE_VECTOR2, SEM_TEXCOORD));
 		elements.Push(VertexElement(TYPE_VECTOR4, SEM_TANGENT));
+	}
 
-		const int vertexSize = 12;
+	void ProceduralMesh::WriteTriangle(const Vector3& a, const Vector3& b, const Vector3& c, float* dest)
+	{
+		auto normal = calcNormal(a, b, c);
+		const Vector3 positions[3] = { a, b, c };
+		const Vector2 uvs[3] = { ProjectVertex(a, normal), ProjectVertex(b, normal), ProjectVertex(c, normal) };
+
+		/// Vertices are not shared, so the tangent is the one of the triangle.
+		float x1 = b.x_ - a.x_;
+		float x2 = c.x_ - a.x_;
+		float y1 = b.y_ - a.y_;
+		float y2 = c.y_ - a.y_;
+		float z1 = b.z_ - a.z_;
+		float z2 = c.z_ - a.z_;
+		float s1 = uvs[1].x_ - uvs[0].x_;
+		float s2 = uvs[2].x_ - uvs[0].x_;
+		float t1 = uvs[1].y_ - uvs[0].y_;
+		float t2 = uvs[2].y_ - uvs[0].y_;
+		float r = 1.0f / (s1 * t2 - s2 * t1);
+
+		Vector3 sdir((t2 * x1 - t1 * x2) * r, (t2 * y1 - t1 * y2) * r, (t2 * z1 - t1 * z2) * r);
+		Vector3 tdir((s1 * x2 - s2 * x1) * r, (s1 * y2 - s2 * y1) * r, (s1 * z2 - s2 * z1) * r);
+
+		// Gram-Schmidt orthogonalize
+		auto ortho = (sdir - normal * normal.DotProduct(sdir)).Normalized();
+
+		// Calculate handedness
+		float handedness = (normal.CrossProduct(sdir).DotProduct(tdir) < 0.0F) ? -1.0F : 1.0F;
+
+		for (int i = 0; i < 3; i++)
+		{
+			float* v = dest + i * VERTEX_SIZE;
+			v[0] = positions[i].x_;
+			v[1] = positions[i].y_;
+			v[2] = positions[i].z_;
+
+			v[3] = normal.x_;
+			v[4] = normal.y_;
+			v[5] = normal.z_;
+
+			v[6] = uvs[i].x_;
+			v[7] = uvs[i].y_;
+
+			v[8] = ortho.x_;
+			v[9] = ortho.y_;
+			v[10] = ortho.z_;
+			v[11] = handedness;
+		}
+	}
+
+	SharedPtr<Model> ProceduralMesh::GetModel(Model* reuse)
+	{
+		BoundingBox boundingBox;
+
+		PODVector<VertexElement> elements;
+		GetVertexElements(elements);
+
+		const int vertexSize = VERTEX_SIZE;
 		PODVector<float> vertexData; // (vertices.Size() * vertexSize);
 		PODVector<unsigned short> indexData;
 
@@ -260,73 +331,17 @@ namespace Urho3D
 			Vector3 b = vertices[t.v[1]].p;
 			Vector3 c = vertices[t.v[2]].p;
 
-			auto normal = calcNormal(a, b, c);
-			auto uv1 = ProjectVertex(a, normal);
-			auto uv2 = ProjectVertex(b, normal);
-			auto uv3 = ProjectVertex(c, normal);
-
 			boundingBox.Merge(a);
 			boundingBox.Merge(b);
 			boundingBox.Merge(c);
 
-			int ia = (vertexData.Size() / vertexSize) + 0;
-			int ib = (vertexData.Size() / vertexSize) + 1;
-			int ic = (vertexData.Size() / vertexSize) + 2;
-
-			indexData.Push(ia);
-			indexData.Push(ib);
-			indexData.Push(ic);
-
-			/// Vertex 1
-			vertexData.Push(a.x_);
-			vertexData.Push(a.y_);
-			vertexData.Push(a.z_);
-
-			vertexData.Push(normal.x_);
-			vertexData.Push(normal.y_);
-			vertexData.Push(normal.z_);
-
-			vertexData.Push(uv1.x_);
-			vertexData.Push(uv1.y_);
-
-			vertexData.Push(0.0f);
-			vertexData.Push(0.0f);
-			vertexData.Push(0.0f);
-			vertexData.Push(0.0f);
-
-			/// Vertex 2
-			vertexData.Push(b.x_);
-			vertexData.Push(b.y_);
-			vertexData.Push(b.z_);
-
-			vertexData.Push(normal.x_);
-			vertexData.Push(normal.y_);
-			vertexData.Push(normal.z_);
-
-			vertexData.Push(uv2.x_);
-			vertexData.Push(uv2.y_);
+			int first = vertexData.Size() / vertexSize;
+			indexData.Push(first + 0);
+			indexData.Push(first + 1);
+			indexData.Push(first + 2);
 
-			vertexData.Push(0.0f);
-			vertexData.Push(0.0f);
-			vertexData.Push(0.0f);
-			vertexData.Push(0.0f);
-
-			/// Vertex 3
-			vertexData.Push(c.x_);
-			vertexData.Push(c.y_);
-			vertexData.Push(c.z_);
-
-			vertexData.Push(normal.x_);
-			vertexData.Push(normal.y_);
-			vertexData.Push(normal.z_);
-
-			vertexData.Push(uv3.x_);
-			vertexData.Push(uv3.y_);
-
-			vertexData.Push(0.0f);
-			vertexData.Push(0.0f);
-			vertexData.Push(0.0f);
-			vertexData.Push(0.0f);
+			vertexData.Resize(vertexData.Size() + 3 * vertexSize);
+			WriteTriangle(a, b, c, &vertexData[first * vertexSize]);
 		}
 
 		if (vertices.size() < 1 || indexData.Size() < 1)
@@ -334,70 +349,45 @@ namespace Urho3D
 			return nullptr;
 		}
 
-		/// Calculate Tangents
-		Vector<Vector3> tan1(indexData.Size(), Vector3(0.0f, 0.0f, 0.0f));
-		Vector<Vector3> tan2(indexData.Size(), Vector3(0.0f, 0.0f, 0.0f));
-		for (int i = 0; i < indexData.Size(); i += 3)
+		SharedPtr<Model> model;
+		SharedPtr<VertexBuffer> vb;
+		SharedPtr<IndexBuffer> ib;
+		SharedPtr<Geometry> geom;
+		if (reuse != nullptr &&
+			reuse->GetNumGeometries() == 1 &&
+			reuse->GetVertexBuffers().Size() == 1 &&
+			reuse->GetIndexBuffers().Size() == 1)
 		{
-			int i1 = indexData[i + 0];
-			int i2 = indexData[i + 1];
-			int i3 = indexData[i + 2];
-
-			Vector3 v1(vertexData[(i1 * vertexSize) + 0], vertexData[(i1 * vertexSize) + 1], vertexData[(i1 * vertexSize) + 2]);
-			Vector3 v2(vertexData[(i2 * vertexSize) + 0], vertexData[(i2 * vertexSize) + 1], vertexData[(i2 * vertexSize) + 2]);
-			Vector3 v3(vertexData[(i3 * vertexSize) + 0], vertexData[(i3 * vertexSize) + 1], vertexData[(i3 * vertexSize) + 2]);
-
-			Vector2 w1(vertexData[(i1 * vertexSize) + 6], vertexData[(i1 * vertexSize) + 7]);
-			Vector2 w2(vertexData[(i2 * vertexSize) + 6], vertexData[(i2 * vertexSize) + 7]);
-			Vector2 w3(vertexData[(i3 * vertexSize) + 6], vertexData[(i3 * vertexSize) + 7]);
-
-			float x1 = v2.x_ - v1.x_;
-			float x2 = v3.x_ - v1.x_;
-			float y1 = v2.y_ - v1.y_;
-			float y2 = v3.y_ - v1.y_;
-			float z1 = v2.z_ - v1.z_;
-			float z2 = v3.z_ - v1.z_;
-			float s1 = w2.x_ - w1.x_;
-			float s2 = w3.x_ - w1.x_;
-			float t1 = w2.y_ - w1.y_;
-			float t2 = w3.y_ - w1.y_;
-			float r = 1.0f / (s1 * t2 - s2 * t1);
-
-			Vector3 sdir((t2 * x1 - t1 * x2) * r, (t2 * y1 - t1 * y2) * r, (t2 * z1 - t1 * z2) * r);
-			Vector3 tdir((s1 * x2 - s2 * x1) * r, (s1 * y2 - s2 * y1) * r, (s1 * z2 - s2 * z1) * r);
-
-			tan1[i1] += sdir;
-			tan1[i2] += sdir;
-			tan1[i3] += sdir;
-
-			tan2[i1] += tdir;
-			tan2[i2] += tdir;
-			tan2[i3] += tdir;
+			model = reuse;
+			vb = reuse->GetVertexBuffers()[0];
+			ib = reuse->GetIndexBuffers()[0];
+			geom = reuse->GetGeometry(0, 0);
 		}
-
-		for (long i = 0; i < vertexData.Size(); i += vertexSize)
+		else
 		{
-			Vector3 n(vertexData[i + 3], vertexData[i + 4], vertexData[i + 5]);
-			Vector3 t(tan1[i / vertexSize].x_, tan1[i / vertexSize].y_, tan1[i / vertexSize].z_);
-
-			// Gram-Schmidt orthogonalize
-			auto ortho = (t - n * n.DotProduct(t)).Normalized();
-			vertexData[i + 8] = ortho.x_;
-			vertexData[i + 9] = ortho.y_;
-			vertexData[i + 10] = ortho.z_;
-
-			// Calculate handedness
-			vertexData[i + 11] = (n.CrossProduct(t).DotProduct(tan2[i / vertexSize]) < 0.0F) ? -1.0F : 1.0F;
+			model = new Model(context_);
+			vb = new VertexBuffer(context_);
+			ib = new IndexBuffer(context_);
+			geom = new Geometry(context_);
 		}
 
-		vb->SetSize(vertexData.Size() / vertexSize, elements);
-		vb->SetData(vertexData.Buffer());
+		/// Buffers of a reused model are only resized, if the mesh does not fit.
+		unsigned vertexCount = vertexData.Size() / vertexSize;
+		vb->SetShadowed(true);
+		if (vb->GetVertexCount() < vertexCount || vb->GetVertexSize() != vertexSize * sizeof(float))
+		{
+			vb->SetSize(vertexCount, elements);
+		}
 
-		ib->SetSize(indexData.Size(), false);
-		ib->SetData(indexData.Buffer());
+		vb->SetDataRange(vertexData.Buffer(), 0, vertexCount);
 
 		ib->SetShadowed(true);
-		vb->SetShadowed(true);
+		if (ib->GetIndexCount() < indexData.Size() || ib->GetIndexSize() != sizeof(unsigned short))
+		{
+			ib->SetSize(indexData.Size(), false);
+		}
+
+		ib->SetDataRange(indexData.Buffer(), 0, indexData.Size());
 
 		geom->SetNumVertexBuffers(1);
 		geom->SetVertexBuffer(0, vb);
@@ -424,6 +414,290 @@ namespace Urho3D
 		return model;
 	}
 
+	/// True, if the vertices differ in nothing but position, normal and
+	/// tangent. Those are recalculated for a merged vertex.
+	static bool SameAttributes(const unsigned char* a, const unsigned char* b, const PODVector<VertexElement>& elements)
+	{
+		for (unsigned i = 0; i < elements.Size(); i++)
+		{
+			const VertexElement& element = elements[i];
+			if (element.semantic_ == SEM_POSITION ||
+				element.semantic_ == SEM_NORMAL ||
+				element.semantic_ == SEM_TANGENT)
+			{
+				continue;
+			}
+
+			if (memcmp(a + element.offset_, b + element.offset_, ELEMENT_TYPESIZES[element.type_]) != 0)
+			{
+				return false;
+			}
+		}
+
+		return true;
+	}
+
+	bool ProceduralMesh::GenerateLods(Model* model, const PODVector<float>& ratios, const PODVector<float>& distances, bool verbose)
+	{
+		if (!model)
+		{
+			URHO3D_LOGERROR("Model not set.");
+			return false;
+		}
+
+		if (ratios.Size() != distances.Size() || ratios.Empty())
+		{
+			URHO3D_LOGERROR("Each LOD level needs a ratio and a distance.");
+			return false;
+		}
+
+		for (unsigned i = 0; i < model->GetNumGeometries(); i++)
+		{
+			if (model->GetNumGeometryLodLevels(i) > 1)
+			{
+				URHO3D_LOGERROR("Model " + model->GetName() + " already has LOD levels.");
+				return false;
+			}
+		}
+
+		/// Morphs refer to vertex buffers by index, new buffers are appended.
+		Vector<SharedPtr<VertexBuffer>> vertexBuffers = model->GetVertexBuffers();
+		Vector<SharedPtr<IndexBuffer>> indexBuffers = model->GetIndexBuffers();
+		PODVector<unsigned> morphRangeStarts;
+		PODVector<unsigned> morphRangeCounts;
+		for (unsigned i = 0; i < vertexBuffers.Size(); i++)
+		{
+			morphRangeStarts.Push(model->GetMorphRangeStart(i));
+			morphRangeCounts.Push(model->GetMorphRangeCount(i));
+		}
+
+		for (unsigned i = 0; i < model->GetNumGeometries(); i++)
+		{
+			SharedPtr<Geometry> source(model->GetGeometry(i, 0));
+			Vector<SharedPtr<Geometry>> lods;
+			if (!source || !GenerateGeometryLods(source, ratios, distances, lods, verbose) || lods.Empty())
+			{
+				continue;
+			}
+
+			model->SetNumGeometryLodLevels(i, lods.Size() + 1);
+			model->SetGeometry(i, 0, source);
+			for (unsigned j = 0; j < lods.Size(); j++)
+			{
+				model->SetGeometry(i, j + 1, lods[j]);
+				vertexBuffers.Push(SharedPtr<VertexBuffer>(lods[j]->GetVertexBuffer(0)));
+				indexBuffers.Push(SharedPtr<IndexBuffer>(lods[j]->GetIndexBuffer()));
+				morphRangeStarts.Push(0);
+				morphRangeCounts.Push(0);
+			}
+		}
+
+		model->SetVertexBuffers(vertexBuffers, morphRangeStarts, morphRangeCounts);
+		model->SetIndexBuffers(indexBuffers);
+
+		return true;
+	}
+
+	bool ProceduralMesh::GenerateGeometryLods(
+		Geometry* geometry,
+		const PODVector<float>& ratios,
+		const PODVector<float>& distances,
+		Vector<SharedPtr<Geometry>>& lods,
+		bool verbose)
+	{
+		VertexBuffer* vertexBuffer = geometry->GetVertexBuffer(0);
+		IndexBuffer* indexBuffer = geometry->GetIndexBuffer();
+		if (geometry->GetNumVertexBuffers() != 1 ||
+			geometry->GetPrimitiveType() != TRIANGLE_LIST ||
+			!vertexBuffer || !indexBuffer ||
+			!vertexBuffer->GetShadowData() || !indexBuffer->GetShadowData())
+		{
+			URHO3D_LOGWARNING("Geometry skipped, LODs need a shadowed triangle list with one vertex buffer.");
+			return false;
+		}
+
+		const PODVector<VertexElement>& elements = vertexBuffer->GetElements();
+		unsigned positionOffset = vertexBuffer->GetElementOffset(TYPE_VECTOR3, SEM_POSITION);
+		unsigned normalOffset = vertexBuffer->GetElementOffset(TYPE_VECTOR3, SEM_NORMAL);
+		if (positionOffset == M_MAX_UNSIGNED)
+		{
+			URHO3D_LOGWARNING("Geometry skipped, it has no Vector3 positions.");
+			return false;
+		}
+
+		const unsigned char* vertexData = vertexBuffer->GetShadowData();
+		const unsigned char* indexData = indexBuffer->GetShadowData();
+		unsigned vertexSize = vertexBuffer->GetVertexSize();
+		bool largeIndices = indexBuffer->GetIndexSize() == sizeof(unsigned);
+
+		/// Vertices split by normals only are merged, the ones split by
+		/// other attributes, like uvs, are fixed.
+		eastl::vector<unsigned> corners;
+		eastl::vector<unsigned> welded;
+		eastl::vector<unsigned> first;
+		eastl::vector<Vector3> positions;
+		eastl::vector<uint8_t> fixed;
+		eastl::hash_map<Vector3, unsigned> weldedIndices;
+		unsigned indexEnd = geometry->GetIndexStart() + geometry->GetIndexCount();
+		for (unsigned i = geometry->GetIndexStart(); i < indexEnd; i++)
+		{
+			unsigned index = largeIndices ?
+				reinterpret_cast<const unsigned*>(indexData)[i] :
+				reinterpret_cast<const unsigned short*>(indexData)[i];
+
+			const unsigned char* vertex = vertexData + index * vertexSize;
+			Vector3 p = *reinterpret_cast<const Vector3*>(vertex + positionOffset);
+			auto it = weldedIndices.find(p);
+			if (it == weldedIndices.end())
+			{
+				it = weldedIndices.insert(eastl::pair<Vector3, unsigned>(p, (unsigned) positions.size())).first;
+				positions.push_back(p);
+				first.push_back(index);
+				fixed.push_back(0);
+			}
+			else if (first[it->second] != index &&
+				!SameAttributes(vertexData + first[it->second] * vertexSize, vertex, elements))
+			{
+				fixed[it->second] = 1;
+			}
+
+			corners.push_back(index);
+			welded.push_back(it->second);
+		}
+
+		MeshSimplifier simplifier;
+		simplifier.SetMesh(positions, welded);
+		for (unsigned i = 0; i < fixed.size(); i++)
+		{
+			if (fixed[i])
+			{
+				simplifier.SetFixed(i);
+			}
+		}
+
+		auto* queue = GetSubsystem<WorkQueue>();
+		unsigned sourceTriangles = (unsigned) corners.size() / 3;
+		eastl::vector<unsigned> indices;
+		eastl::vector<unsigned> sources;
+		eastl::hash_map<unsigned, unsigned> remap;
+		for (unsigned level = 0; level < ratios.Size(); level++)
+		{
+			simplifier.Simplify((unsigned) (sourceTriangles * Clamp(ratios[level], 0.0f, 1.0f)), M_INFINITY, queue);
+			simplifier.GetTriangles(indices, sources);
+			if (indices.empty())
+			{
+				break;
+			}
+
+			/// Corners on fixed vertices have not been moved, they keep the
+			/// vertex of their source triangle. All other vertices have a
+			/// single source vertex.
+			PODVector<unsigned char> data;
+			PODVector<unsigned> outIndices;
+			eastl::vector<uint8_t> moved;
+			remap.clear();
+			for (unsigned i = 0; i < indices.size(); i++)
+			{
+				unsigned w = indices[i];
+				unsigned index = first[w];
+				if (fixed[w])
+				{
+					unsigned corner = sources[i / 3] * 3;
+					while (welded[corner] != w)
+					{
+						corner++;
+					}
+
+					index = corners[corner];
+				}
+
+				auto it = remap.find(index);
+				if (it == remap.end())
+				{
+					unsigned count = data.Size() / vertexSize;
+					it = remap.insert(eastl::pair<unsigned, unsigned>(index, count)).first;
+					data.Resize(data.Size() + vertexSize);
+					memcpy(&data[count * vertexSize], vertexData + index * vertexSize, vertexSize);
+					moved.push_back(fixed[w] ? 0 : 1);
+					if (!fixed[w])
+					{
+						Vector3 p = simplifier.GetPosition(w);
+						memcpy(&data[count * vertexSize + positionOffset], &p, sizeof(Vector3));
+					}
+				}
+
+				outIndices.Push(it->second);
+			}
+
+			/// Moved vertices get the average normal of their triangles.
+			unsigned vertexCount = data.Size() / vertexSize;
+			if (normalOffset != M_MAX_UNSIGNED)
+			{
+				PODVector<Vector3> normals(vertexCount, Vector3::ZERO);
+				for (unsigned i = 0; i < outIndices.Size(); i += 3)
+				{
+					const Vector3& a = *reinterpret_cast<const Vector3*>(&data[outIndices[i] * vertexSize + positionOffset]);
+					const Vector3& b = *reinterpret_cast<const Vector3*>(&data[outIndices[i + 1] * vertexSize + positionOffset]);
+					const Vector3& c = *reinterpret_cast<const Vector3*>(&data[outIndices[i + 2] * vertexSize + positionOffset]);
+					Vector3 n = (b - a).CrossProduct(c - a);
+					for (unsigned j = 0; j < 3; j++)
+					{
+						normals[outIndices[i + j]] += n;
+					}
+				}
+
+				for (unsigned i = 0; i < vertexCount; i++)
+				{
+					if (moved[i] && normals[i].LengthSquared() > 0.0f)
+					{
+						Vector3 n = normals[i].Normalized();
+						memcpy(&data[i * vertexSize + normalOffset], &n, sizeof(Vector3));
+					}
+				}
+			}
+
+			SharedPtr<VertexBuffer> vb(new VertexBuffer(context_));
+			vb->SetShadowed(true);
+			vb->SetSize(vertexCount, elements);
+			vb->SetData(data.Buffer());
+
+			bool large = vertexCount > 65535;
+			SharedPtr<IndexBuffer> ib(new IndexBuffer(context_));
+			ib->SetShadowed(true);
+			ib->SetSize(outIndices.Size(), large);
+			if (large)
+			{
+				ib->SetData(outIndices.Buffer());
+			}
+			else
+			{
+				PODVector<unsigned short> shortIndices(outIndices.Size());
+				for (unsigned i = 0; i < outIndices.Size(); i++)
+				{
+					shortIndices[i] = (unsigned short) outIndices[i];
+				}
+
+				ib->SetData(shortIndices.Buffer());
+			}
+
+			SharedPtr<Geometry> lod(new Geometry(context_));
+			lod->SetNumVertexBuffers(1);
+			lod->SetVertexBuffer(0, vb);
+			lod->SetIndexBuffer(ib);
+			lod->SetDrawRange(TRIANGLE_LIST, 0, outIndices.Size());
+			lod->SetLodDistance(distances[level]);
+			lods.Push(lod);
+
+			if (verbose)
+			{
+				URHO3D_LOGDEBUGF("LOD %d: Triangles: %d of %d, distance %g",
+					level + 1, outIndices.Size() / 3, sourceTriangles, distances[level]);
+			}
+		}
+
+		return true;
+	}
+
 	Vector2 ProceduralMesh::ProjectVertex(Vector3 point, Vector3 normal)
 	{
 		int plane = 0;
@@ -549,109 +823,46 @@ namespace Urho3D
 
 	void ProceduralMesh::SimplifyMesh(int target_count, double agressiveness, bool verbose)
 	{
-		// init
-		loopi(0, triangles.size())
+		eastl::vector<Vector3> positions;
+		eastl::vector<unsigned> indices;
+		positions.reserve(vertices.size());
+		for (size_t i = 0; i < vertices.size(); i++)
 		{
-			triangles[i].deleted = 0;
+			positions.push_back(vertices[i].p);
 		}
 
-		// main iteration loop
-		int deleted_triangles = 0;
-		eastl::vector<int> deleted0, deleted1;
-		int triangle_count = triangles.size();
-
-		for (int iteration = 0; iteration < 100; iteration++)
+		indices.reserve(triangles.size() * 3);
+		for (size_t i = 0; i < triangles.size(); i++)
 		{
-			if (triangle_count - deleted_triangles <= target_count) break;
-
-			// update mesh once in a while
-			if (iteration % 5 == 0)
-			{
-				UpdateMesh(iteration);
-			}
-
-			// clear dirty flag
-			loopi(0, triangles.size()) triangles[i].dirty = 0;
-
-			//
-			// All triangles with edges below the threshold will be removed
-			//
-			// The following numbers works well for most models.
-			// If it does not, try to adjust the 3 parameters
-			//
-			double threshold = 0.000000001*pow(double(iteration + 3), agressiveness);
-
-			// target number of triangles reached ? Then break
-			if ((verbose) && (iteration % 5 == 0))
+			if (triangles[i].deleted)
 			{
-				URHO3D_LOGDEBUGF("iteration %d - triangles %d threshold %g\n",
-					iteration,
-					triangle_count - deleted_triangles,
-					threshold);
+				continue;
 			}
 
-			// remove vertices & mark deleted triangles
-			loopi(0, triangles.size())
-			{
-				Triangle &t = triangles[i];
-				if (t.err[3] > threshold) continue;
-				if (t.deleted) continue;
-				if (t.dirty) continue;
-
-				loopj(0, 3)if (t.err[j] < threshold)
-				{
-
-					int i0 = t.v[j]; Vertex &v0 = vertices[i0];
-					int i1 = t.v[(j + 1) % 3]; Vertex &v1 = vertices[i1];
-					// Border check
-					if (v0.border != v1.border)  continue;
-
-					// Compute vertex to collapse to
-					Vector3 p;
-					CalculateError(i0, i1, p);
-
-					deleted0.resize(v0.tcount); // normals temporarily
-					deleted1.resize(v1.tcount); // normals temporarily
-												// don't remove if flipped
-					if (Flipped(p, i0, i1, v0, v1, deleted0)) continue;
-
-					if (Flipped(p, i1, i0, v1, v0, deleted1)) continue;
-
-					if ((t.attr & TEXCOORD) == TEXCOORD)
-					{
-						UpdateUvs(i0, v0, p, deleted0);
-						UpdateUvs(i0, v1, p, deleted1);
-					}
-
-					// not flipped, so remove edge
-					v0.p = p;
-					v0.q = v1.q + v0.q;
-					int tstart = refs.size();
-
-					UpdateTriangles(i0, v0, deleted0, deleted_triangles);
-					UpdateTriangles(i0, v1, deleted1, deleted_triangles);
-
-					int tcount = refs.size() - tstart;
+			indices.push_back(triangles[i].v[0]);
+			indices.push_back(triangles[i].v[1]);
+			indices.push_back(triangles[i].v[2]);
+		}
 
-					if (tcount <= v0.tcount)
-					{
-						// save ram
-						if (tcount)memcpy(&refs[v0.tstart], &refs[tstart], tcount * sizeof(VTRef));
-					}
-					else
-						// append
-						v0.tstart = tstart;
+		MeshSimplifier simplifier;
+		simplifier.SetMesh(positions, indices);
+		if (verbose)
+		{
+			URHO3D_LOGDEBUGF("Before. Vertices: %d Triangles: %d", positions.size(), simplifier.GetTriangleCount());
+		}
 
-					v0.tcount = tcount;
-					break;
-				}
+		// The threshold of the last of the 100 iterations the old
+		// simplification ran, collapses with a larger error never happened.
+		double threshold = 0.000000001 * pow(102.0, agressiveness);
+		float maxError = threshold < M_LARGE_VALUE ? (float) threshold : M_INFINITY;
+		simplifier.Simplify((unsigned) Max(target_count, 0), maxError, GetSubsystem<WorkQueue>());
+		simplifier.GetMesh(positions, indices);
+		SetGeometry(positions, indices);
 
-				// done?
-				if (triangle_count - deleted_triangles <= target_count) break;
-			}
+		if (verbose)
+		{
+			URHO3D_LOGDEBUGF("After. Vertices: %d Triangles: %d", vertices.size(), triangles.size());
 		}
-		// clean up mesh
-		CompactMesh();
 	}
 
 	void ProceduralMesh::SimplifyMeshLossless(bool verbose, int maxIterations)
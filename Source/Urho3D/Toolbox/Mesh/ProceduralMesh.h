@@ -102,24 +102,53 @@ namespace Urho3D
 			bool create_normal = false,
 			bool create_uvs = false);
 
-		SharedPtr<Model> GetModel();
+		/// Replace the mesh with the given vertices and triangles, three
+		/// indices per triangle. Skips the vertex lookup of AddTriangle.
+		void SetGeometry(const eastl::vector<Vector3>& positions, const eastl::vector<unsigned>& indices);
+
+		/// Create a model of the mesh, null if it is empty. The buffers of
+		/// the given model are filled instead of creating new ones, if it
+		/// has been created by this function before.
+		SharedPtr<Model> GetModel(Model* reuse = nullptr);
+
+		/// Add LOD levels to every geometry of the model, which has none yet.
+		/// Level i + 1 keeps ratios[i] of the triangles of level 0 and is used
+		/// from distances[i] on. Each level is simplified further from the one
+		/// before and keeps the vertex format of the model, including uvs and
+		/// bone weights. Vertices on uv seams stay in place, so the seams do
+		/// not open. Only triangle lists with a single, shadowed vertex buffer
+		/// are simplified, all other geometries are left as they are.
+		bool GenerateLods(Model* model, const PODVector<float>& ratios, const PODVector<float>& distances, bool verbose = false);
+
+		/// Floats per vertex of the models created by GetModel.
+		static const int VERTEX_SIZE = 12;
+
+		/// Vertex layout of the models created by GetModel.
+		static void GetVertexElements(PODVector<VertexElement>& elements);
+
+		/// Write position, normal, uv and tangent of the three vertices of a
+		/// flat shaded triangle, in the layout GetModel uses.
+		void WriteTriangle(const Vector3& a, const Vector3& b, const Vector3& c, float* dest);
 
 		void FromModel(Model* model, unsigned int index, unsigned int lod, bool verbose = true);
 		void FromGeometry(Geometry* geom, unsigned int index, bool verbose = true);
 		void FromFile(String ressource, unsigned int index, unsigned int lod, bool verbose = true);
 
-		/// Main simplification function
+		/// Main simplification function, see MeshSimplifier. Edges are
+		/// collapsed cheapest first, large meshes are simplified in parallel
+		/// on the work queue.
 		///
 		/// \param target_count target nr. of triangles
-		/// \param agressiveness sharpness to increase the threshold. 5..8 are good numbers more iterations yield higher quality
+		/// \param agressiveness sharpness to increase the threshold. 5..8 are good numbers. Edges, whose
+		///        error is above the threshold the old iterative simplification ended with, are kept.
 		/// \param verbose print extra debug information to the console.
 		void SimplifyMesh(int target_count, double agressiveness = 7, bool verbose = false);
 
 		/// Same as above, the target count is expressed as percentage of current
-		/// triangle count.
+		/// vertex count.
 		///
 		/// \param target_count_percentage must be between 0.0 and 1.0.
-		/// \param agressiveness sharpness to increase the threshold. 5..8 are good numbers more iterations yield higher quality
+		/// \param agressiveness sharpness to increase the threshold. 5..8 are good numbers.
 		/// \param verbose print extra debug information to the console.
 		void SimplifyMesh(float target_count_percentage, double agressiveness = 7, bool verbose = false);
 
@@ -165,6 +194,14 @@ namespace Urho3D
 		/// (using get_index and set_vertex for example)
 		eastl::hash_map<Vector3, size_t> VertexIndices;
 
+		/// Simplified copies of the geometry, one per ratio, see GenerateLods.
+		bool GenerateGeometryLods(
+			Geometry* geometry,
+			const PODVector<float>& ratios,
+			const PODVector<float>& distances,
+			Vector<SharedPtr<Geometry>>& lods,
+			bool verbose);
+
 		/// Check if a triangle flips when this edge is removed
 		bool Flipped(Vector3 p, int i0, int i1, Vertex &v0, Vertex &v1, eastl::vector<int> &deleted);
 
@@ -8,19 +8,14 @@ namespace Urho3D
 {
 	VoxerStatistics* Chunk::Stats = nullptr;
 
-	int Chunk::GetNeighborHash(int x, int y, int z) const
+	void Chunk::ClearNeighbors()
 	{
-		int r = 0;
-
-		r |= x < 0 ? 1 << 0 : 0;
-		r |= y < 0 ? 1 << 1 : 0;
-		r |= z < 0 ? 1 << 2 : 0;
-
-		r |= x > 0 ? 1 << 3 : 0;
-		r |= y > 0 ? 1 << 4 : 0;
-		r |= z > 0 ? 1 << 5 : 0;
+		for (int i = 0; i < 27; i++)
+		{
+			mNeighbors[i].store(nullptr, std::memory_order_relaxed);
+		}
 
-		return r;
+		mNeighborCount = 0;
 	}
 
 	int Chunk::GetIndex(int x, int y, int z, Vector3i& neighborPosition) const
@@ -71,10 +66,37 @@ namespace Urho3D
 		return GetIndexFromVector(mVoxelLayout, x, y, z);
 	}
 
-	void Chunk::Reset(Vector3d pos, Vector3d chunk_dim)
+	Vector3i Chunk::ToNeighborGrid(const Chunk* neighbor, const Vector3i& position) const
+	{
+		if (neighbor->mLod < mLod)
+		{
+			/// Finer neighbor, use the first of the voxels covered by ours.
+			int shift = mLod - neighbor->mLod;
+			return Vector3i(position.x << shift, position.y << shift, position.z << shift);
+		}
+
+		int shift = neighbor->mLod - mLod;
+		return Vector3i(position.x >> shift, position.y >> shift, position.z >> shift);
+	}
+
+	void Chunk::Reset(const Vector3i& index, const Vector3d& pos, const Vector3d& chunk_dim, int lod)
 	{
+		mIndex = index;
 		mWorldPosition = pos;
 
+		if (lod != mLod)
+		{
+			mLod = lod;
+			mVoxelLayout = Vector3i(mBaseLayout.x >> lod, mBaseLayout.y >> lod, mBaseLayout.z >> lod);
+			mVoxelSize = mBaseVoxelSize * (float) (1 << lod);
+			mData.Reset(mVoxelLayout, Voxel::GetAir());
+		}
+
+		mGeometry.Reset();
+		ResetBlocks();
+		mMeshSkipped = false;
+		mCollision = false;
+
 		mInitialized.store(0);
 		mInitializing.store(0);
 
@@ -82,11 +104,18 @@ namespace Urho3D
 		mMeshing.store(0);
 
 		mMeshInGame.store(0);
+		mScheduled.store(0);
+		mCancelled.store(0);
+		mStored.store(0);
 
-		mNeighborhood.clear();
+		ClearNeighbors();
+		SetIsBorderChunk(true);
 		mMesh->Clear();
 
-		Voxel mLastVoxel = Voxel::GetAir();
+		/// Pooled chunks keep only a single voxel.
+		mData.Fill(Voxel::GetAir());
+
+		mLastVoxel = Voxel::GetAir();
 		isAir = true;
 		isSolid = false;
 
@@ -94,30 +123,67 @@ namespace Urho3D
 		mBounds.max_ = Vector3(pos.x + chunk_dim.x, pos.y + chunk_dim.y, pos.z + chunk_dim.z);
 	}
 
-	void Chunk::SetNeighbor(int x, int y, int z, Chunk* c)
+	bool Chunk::SetNeighbor(int x, int y, int z, Chunk* c)
 	{
-		auto hash = GetNeighborHash(x, y, z);
-		if (hash == 0)
+		auto slot = GetNeighborSlot(x, y, z);
+		if (slot == 13)
 		{
 			/// This is us.
-			return;
+			return false;
 		}
 
-		auto it = mNeighborhood.find(hash);
-		if (it == mNeighborhood.end());
+		auto previous = mNeighbors[slot].exchange(c, std::memory_order_acq_rel);
+		if (previous == nullptr && c != nullptr)
+		{
+			mNeighborCount++;
+		}
+		else if (previous != nullptr && c == nullptr)
 		{
-			mNeighborhood[hash] = c;
+			mNeighborCount--;
 		}
 
 		/// Did our status change from border to internal chunk?
 		/// Than make sure we can remesh.
-		if (IsBorderChunk() && mNeighborhood.size() >= 26 && Initialized())
+		bool remesh = false;
+		if (IsBorderChunk() && mNeighborCount >= 26 && Initialized())
 		{
 			mMeshing.store(0);
 			mMeshed.store(0);
+			remesh = true;
+		}
+
+		SetIsBorderChunk(mNeighborCount < 26);
+
+		return remesh;
+	}
+
+	void Chunk::RemoveNeighbor(Chunk* c)
+	{
+		for (int i = 0; i < 27; i++)
+		{
+			if (c != nullptr && mNeighbors[i].load(std::memory_order_relaxed) == c)
+			{
+				mNeighbors[i].store(nullptr, std::memory_order_release);
+				mNeighborCount--;
+			}
+		}
+
+		SetIsBorderChunk(mNeighborCount < 26);
+	}
+
+	void Chunk::Unlink()
+	{
+		for (int i = 0; i < 27; i++)
+		{
+			auto n = mNeighbors[i].load(std::memory_order_relaxed);
+			if (n != nullptr)
+			{
+				n->RemoveNeighbor(this);
+			}
 		}
 
-		SetIsBorderChunk(mNeighborhood.size() < 26);
+		ClearNeighbors();
+		SetIsBorderChunk(true);
 	}
 
 	void Chunk::Initialize()
@@ -129,41 +195,177 @@ namespace Urho3D
 		}
 
 		Stats->AddInitialized();
-		std::clock_t c_start = std::clock();
-		auto t_start = std::chrono::high_resolution_clock::now();
+		auto start = VoxerStatistics::GetTime();
 
-		auto voxelSize = mVoxelSize;
-		const float size = 0.05f;
-		const Vector3i tmp(2, 2, 2);
-		for (int x = 0; x < mVoxelLayout.x; x++)
+		if (Load())
 		{
-			for (int y = 0; y < mVoxelLayout.y; y++)
+			Stats->AddLoaded();
+
+			if (mData.IsUniform())
 			{
-				for (int z = 0; z < mVoxelLayout.z; z++)
+				HandleVoxelUpdate(mData.GetUniform());
+			}
+			else
+			{
+				for (int i = 0; i < mVoxelLayout.GetArrayCount(); i++)
 				{
-					auto voxel_pos = (Vector3d(x, y, z) * voxelSize) + mWorldPosition;
-					auto height = SimplexNoise::noise((float)voxel_pos.x * size, (float)voxel_pos.z * size) * -2.5f;
-					if (voxel_pos.y > height)
-					{
-						Set(Voxel::GetAir(), x, y, z, true);
-					}
-					else
-					{
-						Set(Voxel::GetStone(), x, y, z, true);
-					}
+					HandleVoxelUpdate(mData.Get(i));
 				}
 			}
 		}
+		else
+		{
+			Generate();
+		}
 
 		if (mInitialized.exchange(1) != 0)
 		{
 			URHO3D_LOGERROR("Found a chunk that has been initialized twice.");
 		}
 
-		std::clock_t c_end = std::clock();
-		auto t_end = std::chrono::high_resolution_clock::now();
-		auto time = 1000.0 * (c_end - c_start) / CLOCKS_PER_SEC;
-		Stats->AddInitTime(time);
+		Stats->AddTime(STAGE_INIT, start);
+		Stats->AddChunkMemory(GetMemoryUse());
+	}
+
+	void Chunk::Generate()
+	{
+		/// Plain voxels of the chunk, reused by every chunk of this thread.
+		static thread_local eastl::vector<Voxel> voxels;
+		bool uniform = mGenerator->Generate(mWorldPosition, mVoxelLayout, mVoxelSize, voxels);
+		if (mDeltas != nullptr && ApplyDeltas(voxels))
+		{
+			uniform = false;
+		}
+
+		if (uniform)
+		{
+			/// Uniform chunk, e.g. entirely above or below the surface.
+			mData.Fill(voxels[0]);
+			HandleVoxelUpdate(voxels[0]);
+		}
+		else
+		{
+			for (int i = 0; i < (int) voxels.size(); i++)
+			{
+				mData.Set(i, voxels[i]);
+				HandleVoxelUpdate(voxels[i]);
+			}
+		}
+
+		/// Uniform chunks drop their indices here.
+		mData.Compact(mRunLength);
+	}
+
+	bool Chunk::Load()
+	{
+		if (mStore == nullptr)
+		{
+			return false;
+		}
+
+		if (mLod == 0)
+		{
+			if (!mStore->Load(mWorldPosition, mData))
+			{
+				return false;
+			}
+
+			/// Stored data is compact already.
+			mStored.store(1);
+			RecordDeltas(mData);
+			return true;
+		}
+
+		/// Edits made up close stay visible from afar.
+		static thread_local VoxelStorage stored;
+		stored.Reset(mBaseLayout, Voxel::GetAir());
+		if (!mStore->Load(mWorldPosition, stored))
+		{
+			return false;
+		}
+
+		RecordDeltas(stored);
+
+		int step = 1 << mLod;
+		for (int z = 0; z < mVoxelLayout.z; z++)
+		{
+			for (int y = 0; y < mVoxelLayout.y; y++)
+			{
+				for (int x = 0; x < mVoxelLayout.x; x++)
+				{
+					mData.Set(
+						mVoxelLayout.GetIndex(x, y, z),
+						stored.Get(mBaseLayout.GetIndex(x * step, y * step, z * step)));
+				}
+			}
+		}
+
+		mData.Compact(mRunLength);
+		return true;
+	}
+
+	bool Chunk::ApplyDeltas(eastl::vector<Voxel>& voxels) const
+	{
+		static thread_local eastl::vector<VoxelDelta> deltas;
+		deltas.clear();
+		if (mDeltas->Get(mIndex, 0, deltas) == 0)
+		{
+			return false;
+		}
+
+		int step = 1 << mLod;
+		bool applied = false;
+		for (unsigned i = 0; i < deltas.size(); i++)
+		{
+			int index = (int) deltas[i].mIndex;
+			int x = index % mBaseLayout.x;
+			int y = (index / mBaseLayout.x) % mBaseLayout.y;
+			int z = index / (mBaseLayout.x * mBaseLayout.y);
+			if (z >= mBaseLayout.z || x % step != 0 || y % step != 0 || z % step != 0)
+			{
+				continue;
+			}
+
+			voxels[mVoxelLayout.GetIndex(x / step, y / step, z / step)] = deltas[i].mVoxel;
+			applied = true;
+		}
+
+		return applied;
+	}
+
+	void Chunk::RecordDeltas(const VoxelStorage& data)
+	{
+		if (mDeltas == nullptr || mDeltas->Contains(mIndex))
+		{
+			return;
+		}
+
+		/// Not the buffer of Generate, a chunk is loaded instead of generated.
+		static thread_local eastl::vector<Voxel> generated;
+		mGenerator->Generate(mWorldPosition, mBaseLayout, mBaseVoxelSize, generated);
+
+		eastl::vector<VoxelDelta> deltas;
+		for (int i = 0; i < (int) generated.size(); i++)
+		{
+			Voxel voxel = data.Get(i);
+			if (voxel != generated[i])
+			{
+				deltas.push_back(VoxelDelta{ (uint32_t) i, voxel, 0 });
+			}
+		}
+
+		mDeltas->Merge(mIndex, deltas);
+	}
+
+	void Chunk::Save()
+	{
+		if (!NeedsSaving())
+		{
+			return;
+		}
+
+		mStore->Save(mWorldPosition, mData);
+		mStored.store(1);
 	}
 
 	void Chunk::CreateMesh()
@@ -175,17 +377,17 @@ namespace Urho3D
 		}
 
 		Stats->AddMeshed();
-		std::clock_t c_start = std::clock();
-		auto t_start = std::chrono::high_resolution_clock::now();
+		auto start = VoxerStatistics::GetTime();
 		mMesh->Clear();
 
 		/// If the entire neighborhood is air as well dont bother to create a mesh.
 		bool createMesh = true;
 		if (isAir)
 		{
-			for (auto it = mNeighborhood.begin(); it != mNeighborhood.end(); it++)
+			for (int i = 0; i < 27; i++)
 			{
-				if (!it->second->isAir)
+				auto n = mNeighbors[i].load(std::memory_order_acquire);
+				if (n != nullptr && !n->isAir)
 				{
 					createMesh = false;
 					break;
@@ -207,9 +409,10 @@ namespace Urho3D
 
 		/// If all surrounding chunks are solid, dont bother creating a mesh.
 		createMesh = false;
-		for (auto it = mNeighborhood.begin(); it != mNeighborhood.end(); it++)
+		for (int i = 0; i < 27; i++)
 		{
-			if (!it->second->isSolid)
+			auto n = mNeighbors[i].load(std::memory_order_acquire);
+			if (n != nullptr && !n->isSolid)
 			{
 				createMesh = true;
 				break;
@@ -228,91 +431,287 @@ namespace Urho3D
 			return;
 		}
 
-		int indices[6];
-		int cube_index, move_vertex;
+		/// Buffers are kept per thread, so meshing does not allocate once they have grown.
+		static thread_local ChunkMesher mesher;
+		PrepareMesher(mesher);
 
-		/// By default every vertex is right in the middle of the voxel cube.
-		Vector3 vertexOffset(mVoxelSize * 0.5f, mVoxelSize * 0.5f, mVoxelSize * 0.5f);
+		if (mGeometry != nullptr)
+		{
+			/// Edited chunks stay split into blocks for the next edit.
+			mesher.BuildCubes();
+			for (int i = 0; i < (int) mDirtyBlocks.size(); i++)
+			{
+				BuildBlock(mesher, i);
+			}
 
-		/// Calculate the first row of neighboring chunks as well in order to
-		/// get the node positions right.
-		/// Dont create geometry, if we are working with data from neighboring chunks.
-		for (int x = -1; x < mVoxelLayout.x + 1; x++)
+			mHasDirtyBlocks = false;
+		}
+		else
+		{
+			mesher.Build(mGreedyMeshing);
+			mMesh->SetGeometry(mesher.GetPositions(), mesher.GetIndices());
+		}
+
+		Stats->AddTime(STAGE_MESH, start);
+		start = VoxerStatistics::GetTime();
+
+		/// Greedy meshing merged the flat parts already. Blocks are not
+		/// simplified, they must not change the triangles of each other.
+		if (!mGreedyMeshing && mGeometry == nullptr)
+		{
+			mMesh->SimplifyMeshLossless(false, 100);
+		}
+
+		Stats->AddTime(STAGE_SIMPLIFY, start);
+
+		if (mGeometry != nullptr ? mGeometry->HasTriangles() : mMesh->GetVertexCount() > 0)
+		{
+			VoxerSystem::Get()->SpawnChunk(this);
+		}
+
+		if (mMeshed.exchange(1) != 0)
 		{
-			for (int y = -1; y < mVoxelLayout.y + 1; y++)
+			URHO3D_LOGERROR("Found a chunk that has been meshed twice.");
+		}
+	}
+
+	void Chunk::PrepareMesher(ChunkMesher& mesher)
+	{
+		mesher.Reset(mSurfaceData, mVoxelLayout, mVoxelSize);
+		for (int x = -1; x <= 1; x++)
+		{
+			for (int y = -1; y <= 1; y++)
 			{
-				for (int z = -1; z < mVoxelLayout.z + 1; z++)
+				for (int z = -1; z <= 1; z++)
 				{
-					eastl::tie(cube_index, move_vertex) = GetCube(x, y, z, false);
-
-					/// Create the position, which is used as a key for each vertex and
-					/// the final position in case the vertex of this cube is placed right in the middle.
-					Vector3 position = Vector3(x, y, z) * mVoxelSize;
-					Vector3 pos_as_key = position + vertexOffset;
-
-					/// Then calculate the actual position and update the node position;
-					auto node_position = move_vertex == 0 ? pos_as_key : mSurfaceData->PointTable[cube_index] + position;
-					auto node = mMesh->GetIndex(pos_as_key);
-					mMesh->SetVertex(node, node_position);
-
-					/// Tells us, which edges are being cut by the surface.
-					/// This controlls which planes are being created.
-					int plane_index = cube_index & 15;
-					bool no_geometry = x >= mVoxelLayout.x || y >= mVoxelLayout.y || z >= mVoxelLayout.z || x < 0 || y < 0 || z < 0;
-					if (plane_index == 0 || plane_index == 15 || no_geometry)
+					auto n = GetNeighbor(x, y, z);
+					if (n != nullptr && n->mLod > mLod)
 					{
-						continue;
+						mesher.SetCoarser(x, y, z, true);
 					}
+				}
+			}
+		}
 
-					/// Key of the vertex.
-					Vector3i pos(x, y, z);
+		FillMesherVoxels(mesher);
+	}
 
-					/// For each side we need two triangles, plus one material.
-					for (int i = 0;
-						mSurfaceData->CubeIndexToFaceLookup.Get(plane_index, i) != mSurfaceData->STOP;
-						i += 7)
-					{
-						/// For each vertex of a quad.
-						for (int j = 0; j < 6; j++)
-						{
-							auto item_0 = mSurfaceData->Vertices[mSurfaceData->CubeIndexToFaceLookup.Get(plane_index, i + j)] + pos;
-							indices[j] = mMesh->GetIndex
-							(
-								(Vector3(item_0.x, item_0.y, item_0.z) * mVoxelSize) +
-								vertexOffset
-							);
-						}
+	void Chunk::ResetBlocks()
+	{
+		mBlockLayout = Vector3i(
+			(mVoxelLayout.x + BLOCK_SIZE - 1) / BLOCK_SIZE,
+			(mVoxelLayout.y + BLOCK_SIZE - 1) / BLOCK_SIZE,
+			(mVoxelLayout.z + BLOCK_SIZE - 1) / BLOCK_SIZE);
 
-						mMesh->AddTriangleFromIndices(indices[1], indices[0], indices[2], true);
-						mMesh->AddTriangleFromIndices(indices[4], indices[3], indices[5], true);
-					}
+		mDirtyBlocks.assign(mBlockLayout.GetArrayCount(), 0);
+		mHasDirtyBlocks = false;
+	}
+
+	BoundingBox Chunk::GetLocalBounds() const
+	{
+		/// Cells before the chunk and seam vertices reach two voxels out.
+		return BoundingBox(
+			Vector3(-2.0f, -2.0f, -2.0f) * mVoxelSize,
+			Vector3(
+				(float) (mVoxelLayout.x + 1),
+				(float) (mVoxelLayout.y + 1),
+				(float) (mVoxelLayout.z + 1)) * mVoxelSize);
+	}
+
+	void Chunk::BuildBlock(ChunkMesher& mesher, int block)
+	{
+		int x = block % mBlockLayout.x;
+		int y = (block / mBlockLayout.x) % mBlockLayout.y;
+		int z = block / (mBlockLayout.x * mBlockLayout.y);
+
+		Vector3i min(x * BLOCK_SIZE, y * BLOCK_SIZE, z * BLOCK_SIZE);
+		Vector3i max(
+			Min(min.x + BLOCK_SIZE, mVoxelLayout.x),
+			Min(min.y + BLOCK_SIZE, mVoxelLayout.y),
+			Min(min.z + BLOCK_SIZE, mVoxelLayout.z));
+
+		static thread_local eastl::vector<unsigned> indices;
+		mesher.BuildRange(min, max, indices);
+		mGeometry->SetSegment(block, mesher.GetPositions(), indices);
+		mDirtyBlocks[block] = 0;
+	}
+
+	Vector3i Chunk::GetVoxelIndex(const Vector3d& position) const
+	{
+		return Vector3i(
+			Clamp((int) std::floor((position.x - mWorldPosition.x) / mVoxelSize), 0, mVoxelLayout.x - 1),
+			Clamp((int) std::floor((position.y - mWorldPosition.y) / mVoxelSize), 0, mVoxelLayout.y - 1),
+			Clamp((int) std::floor((position.z - mWorldPosition.z) / mVoxelSize), 0, mVoxelLayout.z - 1));
+	}
+
+	void Chunk::SkipMesh()
+	{
+		mMeshSkipped = true;
+		mMeshing.store(0);
+		mMeshed.store(1);
+	}
+
+	bool Chunk::MarkDirty(const Vector3d& min, const Vector3d& max)
+	{
+		/// Chunks, that have not been meshed yet, get a full mesh anyway.
+		if (!Meshed() || mMeshSkipped)
+		{
+			return false;
+		}
+
+		/// A voxel changes the cubes of the cells before and at it, which
+		/// changes the quads of the cells around those.
+		int x0 = Max((int) std::floor((min.x - mWorldPosition.x) / mVoxelSize) - 2, 0);
+		int y0 = Max((int) std::floor((min.y - mWorldPosition.y) / mVoxelSize) - 2, 0);
+		int z0 = Max((int) std::floor((min.z - mWorldPosition.z) / mVoxelSize) - 2, 0);
+		int x1 = Min((int) std::floor((max.x - mWorldPosition.x) / mVoxelSize) + 1, mVoxelLayout.x - 1);
+		int y1 = Min((int) std::floor((max.y - mWorldPosition.y) / mVoxelSize) + 1, mVoxelLayout.y - 1);
+		int z1 = Min((int) std::floor((max.z - mWorldPosition.z) / mVoxelSize) + 1, mVoxelLayout.z - 1);
+		if (x0 > x1 || y0 > y1 || z0 > z1)
+		{
+			return false;
+		}
+
+		for (int z = z0 / BLOCK_SIZE; z <= z1 / BLOCK_SIZE; z++)
+		{
+			for (int y = y0 / BLOCK_SIZE; y <= y1 / BLOCK_SIZE; y++)
+			{
+				for (int x = x0 / BLOCK_SIZE; x <= x1 / BLOCK_SIZE; x++)
+				{
+					mDirtyBlocks[mBlockLayout.GetIndex(x, y, z)] = 1;
 				}
 			}
 		}
 
-		std::clock_t c_end = std::clock();
-		auto t_end = std::chrono::high_resolution_clock::now();
-		auto time = 1000.0 * (c_end - c_start) / CLOCKS_PER_SEC;
-		Stats->AddMeshTime(time);
+		bool wasClean = !mHasDirtyBlocks;
+		mHasDirtyBlocks = true;
 
-		c_start = std::clock();
-		t_start = std::chrono::high_resolution_clock::now();
+		return wasClean;
+	}
 
-		mMesh->SimplifyMeshLossless(false, 100);
+	bool Chunk::CanEdit() const
+	{
+		if (!Initialized() || IsScheduled())
+		{
+			return false;
+		}
 
-		c_end = std::clock();
-		t_end = std::chrono::high_resolution_clock::now();
-		time = 1000.0 * (c_end - c_start) / CLOCKS_PER_SEC;
-		Stats->AddSimplifyMeshTime(time);
+		for (int i = 0; i < 27; i++)
+		{
+			auto n = mNeighbors[i].load(std::memory_order_acquire);
+			if (n != nullptr && n->IsScheduled())
+			{
+				return false;
+			}
+		}
 
-		if (mMesh->GetVertexCount() > 0)
+		return true;
+	}
+
+	int Chunk::RemeshDirtyBlocks(int budget)
+	{
+		if (!mHasDirtyBlocks)
 		{
-			VoxerSystem::Get()->SpawnChunk(this);
+			return 0;
 		}
 
-		if (mMeshed.exchange(1) != 0)
+		/// The first edit meshes the whole chunk into blocks.
+		bool created = false;
+		if (mGeometry == nullptr)
 		{
-			URHO3D_LOGERROR("Found a chunk that has been meshed twice.");
+			mGeometry = new ChunkGeometry(context_, mMesh);
+			mGeometry->Reset((int) mDirtyBlocks.size(), GetLocalBounds());
+			mDirtyBlocks.assign(mDirtyBlocks.size(), 1);
+			created = true;
+		}
+
+		static thread_local ChunkMesher mesher;
+		PrepareMesher(mesher);
+		mesher.BuildCubes();
+
+		int remeshed = 0;
+		mHasDirtyBlocks = false;
+		for (int i = 0; i < (int) mDirtyBlocks.size(); i++)
+		{
+			if (mDirtyBlocks[i] == 0)
+			{
+				continue;
+			}
+
+			/// Blocks over budget wait for the next update.
+			if (!created && remeshed >= budget)
+			{
+				mHasDirtyBlocks = true;
+				continue;
+			}
+
+			BuildBlock(mesher, i);
+			remeshed++;
+		}
+
+		if (created || !IsMeshInGame())
+		{
+			/// Replaces the node of the old model, if there is one.
+			if (mGeometry->HasTriangles())
+			{
+				VoxerSystem::Get()->SpawnChunk(this);
+			}
+		}
+		else
+		{
+			mGeometry->Commit();
+		}
+
+		return remeshed;
+	}
+
+	void Chunk::FillMesherVoxels(ChunkMesher& mesher)
+	{
+		auto& voxels = mesher.GetVoxels();
+		const int border = ChunkMesher::VOXEL_BORDER;
+		for (int z = -border; z <= mVoxelLayout.z; z++)
+		{
+			for (int y = -border; y <= mVoxelLayout.y; y++)
+			{
+				for (int x = -border; x <= mVoxelLayout.x; x++)
+				{
+					bool inside =
+						x >= 0 && x < mVoxelLayout.x &&
+						y >= 0 && y < mVoxelLayout.y &&
+						z >= 0 && z < mVoxelLayout.z;
+
+					Voxel voxel;
+					bool found = true;
+					if (inside)
+					{
+						voxel = mData.Get(mVoxelLayout.GetIndex(x, y, z));
+					}
+					else
+					{
+						eastl::tie(voxel, found) = Get(x, y, z, false);
+					}
+
+					uint8_t flags = 0;
+					if (!found)
+					{
+						flags = ChunkMesher::VOXEL_MISSING;
+					}
+					else
+					{
+						if (!voxel.IsTransparent() && !voxel.IsAir() && !voxel.IsModel())
+						{
+							flags |= ChunkMesher::VOXEL_SOLID;
+						}
+
+						if (voxel.IsBlock())
+						{
+							flags |= ChunkMesher::VOXEL_BLOCK;
+						}
+					}
+
+					voxels[mesher.GetVoxelIndex(x, y, z)] = flags;
+				}
+			}
 		}
 	}
 
@@ -359,37 +758,42 @@ namespace Urho3D
 			auto index = GetIndex(x, y, z, neighborPos);
 			if (index < 0)
 			{
-				auto x1 = x > 0 ? 0 : 1;
-				x1 = x <= mVoxelLayout.x ? -1 : x1;
+				auto x1 = x < 0 ? -1 : 0;
+				x1 = x >= mVoxelLayout.x ? 1 : x1;
 
-				auto y1 = y > 0 ? 0 : 1;
-				y1 = y <= mVoxelLayout.y ? -1 : y1;
+				auto y1 = y < 0 ? -1 : 0;
+				y1 = y >= mVoxelLayout.y ? 1 : y1;
 
-				auto z1 = z > 0 ? 0 : 1;
-				z1 = z <= mVoxelLayout.z ? -1 : z1;
+				auto z1 = z < 0 ? -1 : 0;
+				z1 = z >= mVoxelLayout.z ? 1 : z1;
 
-				auto hash = GetNeighborHash(x1, y1, z1);
-				auto it = mNeighborhood.find(hash);
-
-				if (it == mNeighborhood.end())
+				auto n = GetNeighbor(x1, y1, z1);
+				if (n == nullptr)
 				{
 					URHO3D_LOGERROR("Could not find a neighboring chunk.");
 					return;
 				}
 
-				it->second->Set(data, neighborPos.x, neighborPos.y, neighborPos.z);
+				if (n->mLod != mLod)
+				{
+					neighborPos = ToNeighborGrid(n, neighborPos);
+				}
+
+				n->Set(data, neighborPos.x, neighborPos.y, neighborPos.z);
 				return;
 			}
 
-			mData[index] = data;
+			mData.Set(index, data);
 			HandleVoxelUpdate(data);
 		}
 		else
 		{
 			auto index = mVoxelLayout.GetIndex(x, y, z);
-			mData[index] = data;
+			mData.Set(index, data);
 			HandleVoxelUpdate(data);
 		}
+
+		mStored.store(0);
 	}
 
 	void Chunk::HandleVoxelUpdate(Voxel v)
@@ -408,14 +812,14 @@ namespace Urho3D
 		mLastVoxel = v;
 	}
 
-	eastl::tuple<Voxel&, bool> Chunk::Get(int x, int y, int z, bool safe)
+	eastl::tuple<Voxel, bool> Chunk::Get(int x, int y, int z, bool safe)
 	{
 		Vector3i pos;
 		auto index = GetIndex(x, y, z, pos);
 
 		if (safe)
 		{
-			return eastl::tuple<Voxel&, bool>(mData[index], true);
+			return eastl::tuple<Voxel, bool>(mData.Get(index), true);
 		}
 
 		if (index < 0)
@@ -429,27 +833,68 @@ namespace Urho3D
 			auto z1 = z < 0 ? -1 : 0;
 			z1 = z >= mVoxelLayout.z ? 1 : z1;
 
-			auto hash = GetNeighborHash(x1, y1, z1);
-			auto it = mNeighborhood.find(hash);
-			if (it == mNeighborhood.end())
+			auto n = GetNeighbor(x1, y1, z1);
+			if (n == nullptr)
 			{
-				return eastl::tuple<Voxel&, bool>(Voxel::GetAir(), false);
+				return eastl::tuple<Voxel, bool>(Voxel::GetAir(), false);
 			}
 
-			if (it->second == nullptr)
+			if (n->mLod != mLod)
 			{
-				return eastl::tuple<Voxel&, bool>(Voxel::GetAir(), false);
+				pos = ToNeighborGrid(n, pos);
 			}
 
-			return it->second->Get(pos.x, pos.y, pos.z, safe);
+			return n->Get(pos.x, pos.y, pos.z, safe);
 		}
 
-		return eastl::tuple<Voxel&, bool>(mData[index], true);
+		return eastl::tuple<Voxel, bool>(mData.Get(index), true);
+	}
+
+	bool Chunk::TryGet(int x, int y, int z, Voxel& voxel) const
+	{
+		Vector3i pos;
+		auto index = GetIndex(x, y, z, pos);
+		if (index >= 0)
+		{
+			voxel = mData.Get(index);
+			return true;
+		}
+
+		auto n = GetNeighbor(
+			x < 0 ? -1 : (x >= mVoxelLayout.x ? 1 : 0),
+			y < 0 ? -1 : (y >= mVoxelLayout.y ? 1 : 0),
+			z < 0 ? -1 : (z >= mVoxelLayout.z ? 1 : 0));
+
+		if (n == nullptr || !n->Initialized())
+		{
+			return false;
+		}
+
+		if (n->mLod != mLod)
+		{
+			pos = ToNeighborGrid(n, pos);
+		}
+
+		Vector3i unused;
+		index = n->GetIndex(pos.x, pos.y, pos.z, unused);
+		if (index < 0)
+		{
+			return false;
+		}
+
+		voxel = n->mData.Get(index);
+		return true;
 	}
 
 	bool Chunk::CanDespawn()
 	{
-		if (!Initialized() || !Meshed())
+		if (IsScheduled())
+		{
+			return false;
+		}
+
+		/// Cancelled chunks are never finished, they can go right away.
+		if (!IsCancelled() && (!Initialized() || !Meshed()))
 		{
 			return false;
 		}
@@ -457,14 +902,20 @@ namespace Urho3D
 		/// Make sure all neighboring chunks are fully initialized as well,
 		/// other wise we might end up with destroyed chunks in our neighborhood,
 		/// when chunks are being removed while this chunk is beeing meshed.
-		for (auto it = mNeighborhood.begin(); it != mNeighborhood.end(); it++)
+		for (int i = 0; i < 27; i++)
 		{
-			if (it->second == nullptr)
+			auto n = mNeighbors[i].load(std::memory_order_acquire);
+			if (n == nullptr)
 			{
 				continue;
 			}
 
-			if (!it->second->Initialized() || !it->second->Meshed())
+			if (n->IsScheduled())
+			{
+				return false;
+			}
+
+			if (!n->IsCancelled() && (!n->Initialized() || !n->Meshed()))
 			{
 				return false;
 			}
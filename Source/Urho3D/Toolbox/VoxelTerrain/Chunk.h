@@ -2,7 +2,6 @@
 
 #include "../../Container/EaStlAllocator.h"
 #include <EASTL/vector.h>
-#include <EASTL/hash_map.h>
 #include <EASTL/tuple.h>
 
 #include "VoxerStatistics.h"
@@ -12,11 +11,15 @@
 #include "../../Toolbox/Mesh/ProceduralMesh.h"
 
 #include "SurfaceData.h"
+#include "VoxelStorage.h"
+#include "VoxelGenerator.h"
+#include "ChunkStore.h"
+#include "VoxelDeltaMap.h"
+#include "ChunkMesher.h"
+#include "ChunkGeometry.h"
 
 #include <tuple>
 #include <atomic>
-#include <chrono>
-#include <ctime>
 
 #include "Voxel.h"
 
@@ -29,13 +32,48 @@ namespace Urho3D
 	public:
 		static VoxerStatistics* Stats;
 
+		/// Cells per axis of the blocks edits are remeshed in.
+		static const int BLOCK_SIZE = 8;
+
 	protected:
 		double mInitMarker;
 		float mVoxelSize;
 		Vector3d mWorldPosition;
 
-		eastl::hash_map<int, Chunk*> mNeighborhood;
-		eastl::vector<Voxel> mData;
+		/// Level of detail, each level doubles the voxel size and halves the
+		/// voxel count along each axis. Level 0 uses the settings as they are.
+		int mLod;
+		Vector3i mBaseLayout;
+		float mBaseVoxelSize;
+
+		/// Index of the chunk in the grid of chunks at level 0.
+		Vector3i mIndex;
+
+		/// Neighbors by direction, see GetNeighborSlot. Slot 13 is this chunk
+		/// and always null. Read by the tasks, changed on the main thread only.
+		std::atomic<Chunk*> mNeighbors[27];
+		int mNeighborCount;
+
+		VoxelStorage mData;
+
+		/// Run length encode the voxel data once the chunk is initialized.
+		bool mRunLength;
+
+		/// Merge flat quads while meshing instead of simplifying afterwards.
+		bool mGreedyMeshing;
+
+		/// Creates the voxels in Initialize. Shared with the settings.
+		SharedPtr<VoxelGenerator> mGenerator;
+
+		/// Stored chunks are loaded instead of generated. Owned by the provider, may be null.
+		ChunkStore* mStore;
+
+		/// Changes against the generated terrain, applied after generating.
+		/// Owned by the provider, may be null.
+		VoxelDeltaMap* mDeltas;
+
+		/// Set, if the store has the current data of this chunk.
+		std::atomic<int> mStored;
 
 		BoundingBox mBounds;
 
@@ -55,12 +93,83 @@ namespace Urho3D
 		std::atomic<int> mBorderChunk;
 		std::atomic<int> mMeshInGame;
 
+		/// Set while tasks of an update cycle work on this chunk. The
+		/// neighborhood must not be changed and the chunk must not be
+		/// despawned until the cycle has finished.
+		std::atomic<int> mScheduled;
+
+		/// Set, if the pending tasks of this chunk should not do any work,
+		/// since the chunk is not needed anymore or not at this time.
+		std::atomic<int> mCancelled;
+
 		SharedPtr<ProceduralMesh> mMesh;
 
-		int GetNeighborHash(int x, int y, int z) const;
+		/// Mesh split into blocks, created by the first edit. Replaces mMesh,
+		/// so later edits only remesh the blocks they touched.
+		SharedPtr<ChunkGeometry> mGeometry;
+
+		/// Blocks per axis and the ones that need a new mesh.
+		Vector3i mBlockLayout;
+		eastl::vector<uint8_t> mDirtyBlocks;
+		bool mHasDirtyBlocks;
+
+		/// Queued in the VoxerSystem, see IsUploadPending.
+		bool mUploadPending;
+
+		/// No mesh has been created, since nobody needs one. Headless only.
+		bool mMeshSkipped;
+
+		/// See HasCollision.
+		bool mCollision;
+
+		/// Slot of the neighbor in the given direction, components are -1, 0 or 1.
+		static int GetNeighborSlot(int x, int y, int z)
+		{
+			return (x + 1) * 9 + (y + 1) * 3 + (z + 1);
+		}
+
+		Chunk* GetNeighbor(int x, int y, int z) const
+		{
+			return mNeighbors[GetNeighborSlot(x, y, z)].load(std::memory_order_acquire);
+		}
+
+		void ClearNeighbors();
 
 		int GetIndex(int x, int y, int z, Vector3i& neighborPosition) const;
 
+		/// Convert a position inside the given neighbor from our voxel grid to its grid.
+		Vector3i ToNeighborGrid(const Chunk* neighbor, const Vector3i& position) const;
+
+		/// Create the voxels with the generator.
+		void Generate();
+
+		/// Read the stored data, coarser levels sample every n-th stored voxel.
+		bool Load();
+
+		/// Overwrite the generated voxels with the recorded changes. Coarser
+		/// levels take the changes of the voxels they sample. Returns true,
+		/// if there were any.
+		bool ApplyDeltas(eastl::vector<Voxel>& voxels) const;
+
+		/// Record, where the given full resolution data differs from the
+		/// generator, unless the chunk has been compared before.
+		void RecordDeltas(const VoxelStorage& data);
+
+		/// Copy the voxel flags the mesher needs, including the first layer of the neighbors.
+		void FillMesherVoxels(ChunkMesher& mesher);
+
+		/// Reset the mesher for this chunk and hand it the voxels and seams.
+		void PrepareMesher(ChunkMesher& mesher);
+
+		/// Mesh the given block into the block geometry. The mesher must be prepared.
+		void BuildBlock(ChunkMesher& mesher, int block);
+
+		/// Block count and dirty flags for the current layout.
+		void ResetBlocks();
+
+		/// Vertices of the chunk mesh lie inside, relative to the chunk.
+		BoundingBox GetLocalBounds() const;
+
 		void SetIsBorderChunk(bool value)
 		{
 			mBorderChunk.store(value ? 1 : 0);
@@ -76,11 +185,23 @@ namespace Urho3D
 			mInitMarker(0),
 			mWorldPosition(0),
 			mVoxelSize(voxelSize),
+			mLod(0),
+			mBaseLayout(voxelLayout),
+			mBaseVoxelSize(voxelSize),
 			mSurfaceData(surfData)
 		{
 			mVoxelLayout = voxelLayout;
-			mData.resize(mVoxelLayout.GetArrayCount(), Voxel::GetAir());
+			mRunLength = false;
+			mGreedyMeshing = false;
+			mStore = nullptr;
+			mDeltas = nullptr;
+			mUploadPending = false;
+			mMeshSkipped = false;
+			mCollision = false;
+			mData.Reset(mVoxelLayout, Voxel::GetAir());
 			mMesh = new ProceduralMesh(context_);
+			ClearNeighbors();
+			ResetBlocks();
 		}
 
 		~Chunk()
@@ -92,6 +213,11 @@ namespace Urho3D
 			return mWorldPosition;
 		}
 
+		const Vector3i& GetChunkIndex() const
+		{
+			return mIndex;
+		}
+
 		bool Initialized() const
 		{
 			return mInitialized.load() > 0;
@@ -137,9 +263,42 @@ namespace Urho3D
 			return mBorderChunk.load() > 0;
 		}
 
-		void Reset(Vector3d pos, Vector3d chunk_dim);
+		bool IsScheduled() const
+		{
+			return mScheduled.load() > 0;
+		}
+
+		void SetScheduled(bool value)
+		{
+			mScheduled.store(value ? 1 : 0);
+		}
+
+		bool IsCancelled() const
+		{
+			return mCancelled.load() > 0;
+		}
+
+		void SetCancelled(bool value)
+		{
+			mCancelled.store(value ? 1 : 0);
+		}
+
+		void Reset(const Vector3i& index, const Vector3d& pos, const Vector3d& chunk_dim, int lod = 0);
+
+		int GetLod() const
+		{
+			return mLod;
+		}
+
+		/// Returns true, if the chunk just got its full neighborhood
+		/// and its mesh has to be created again.
+		bool SetNeighbor(int x, int y, int z, Chunk* c);
+
+		/// Remove every link to the given chunk.
+		void RemoveNeighbor(Chunk* c);
 
-		void SetNeighbor(int x, int y, int z, Chunk* c);
+		/// Remove this chunk from the neighborhood of all its neighbors.
+		void Unlink();
 
 		void Initialize();
 		void CreateMesh();
@@ -153,18 +312,133 @@ namespace Urho3D
 		void Despawn();
 
 		void Set(const Voxel& data, int x, int y, int z, bool safe = false);
-		eastl::tuple<Voxel&, bool> Get(int x, int y, int z, bool safe = true);
+		eastl::tuple<Voxel, bool> Get(int x, int y, int z, bool safe = true);
 
 		void HandleVoxelUpdate(Voxel v);
 
-		SharedPtr<Model> GetModel()
+		/// Main thread only. The buffers of the given model, if any, are
+		/// reused. Edited chunks always return the model of their blocks.
+		SharedPtr<Model> GetModel(Model* reuse = nullptr)
 		{
-			return mMesh->GetModel();
+			if (mGeometry != nullptr)
+			{
+				mGeometry->Commit();
+				return SharedPtr<Model>(mGeometry->GetModel());
+			}
+
+			return mMesh->GetModel(reuse);
+		}
+
+		/// Waiting for its model to be put into the scene. Main thread only.
+		bool IsUploadPending() const
+		{
+			return mUploadPending;
+		}
+
+		void SetUploadPending(bool value)
+		{
+			mUploadPending = value;
+		}
+
+		/// Mark the blocks, whose mesh depends on the voxels inside the given
+		/// world space box. Returns true, if the chunk was clean before.
+		bool MarkDirty(const Vector3d& min, const Vector3d& max);
+
+		bool HasDirtyBlocks() const
+		{
+			return mHasDirtyBlocks;
+		}
+
+		/// The chunk keeps its voxels only and counts as meshed. Main thread
+		/// only, while the chunk has no mesh task.
+		void SkipMesh();
+
+		bool IsMeshSkipped() const
+		{
+			return mMeshSkipped;
+		}
+
+		/// Has a collision node in the VoxerSystem. Main thread only.
+		bool HasCollision() const
+		{
+			return mCollision;
+		}
+
+		void SetCollision(bool value)
+		{
+			mCollision = value;
+		}
+
+		/// Read a voxel, positions outside the chunk are read from the
+		/// neighbors. Fails for neighbors, that are missing or not yet
+		/// initialized. Main thread only.
+		bool TryGet(int x, int y, int z, Voxel& voxel) const;
+
+		/// True, if neither the chunk nor its neighbors are used by any task,
+		/// so voxels can be changed and read on the main thread.
+		bool CanEdit() const;
+
+		/// Remesh up to budget dirty blocks and patch them into the model.
+		/// Returns the number of blocks remeshed. Main thread only.
+		int RemeshDirtyBlocks(int budget);
+
+		/// Index of the voxel containing the given world position.
+		Vector3i GetVoxelIndex(const Vector3d& position) const;
+
+		const Vector3i& GetVoxelLayout() const
+		{
+			return mVoxelLayout;
+		}
+
+		float GetVoxelSize() const
+		{
+			return mVoxelSize;
 		}
 
 		BoundingBox& GetBounds()
 		{
 			return mBounds;
 		}
+
+		void SetRunLengthEncoding(bool value)
+		{
+			mRunLength = value;
+		}
+
+		void SetGreedyMeshing(bool value)
+		{
+			mGreedyMeshing = value;
+		}
+
+		void SetGenerator(VoxelGenerator* value)
+		{
+			mGenerator = value;
+		}
+
+		void SetStore(ChunkStore* value)
+		{
+			mStore = value;
+		}
+
+		void SetDeltas(VoxelDeltaMap* value)
+		{
+			mDeltas = value;
+		}
+
+		/// True, if the chunk has been changed or generated since it was last stored.
+		bool NeedsSaving() const
+		{
+			/// Coarser levels are never stored, they would lose the details.
+			return mStore != nullptr && mLod == 0 && Initialized() && mStored.load() == 0;
+		}
+
+		/// Queue the voxel data for saving. Main thread only.
+		void Save();
+
+		/// Bytes used by the voxel data.
+		unsigned GetMemoryUse() const
+		{
+			return mData.GetMemoryUse();
+		}
 	};
 }
\ No newline at end of file
@@ -0,0 +1,188 @@
+#include "ChunkGeometry.h"
+
+namespace Urho3D
+{
+	ChunkGeometry::ChunkGeometry(Context* ctx, ProceduralMesh* format) :
+		Object(ctx),
+		mFormat(format)
+	{
+	}
+
+	void ChunkGeometry::Reset(int segmentCount, const BoundingBox& bounds)
+	{
+		mSegments.clear();
+		mSegments.resize(segmentCount);
+		for (int i = 0; i < segmentCount; i++)
+		{
+			mSegments[i].mStart = 0;
+			mSegments[i].mCapacity = 0;
+			mSegments[i].mDirty = true;
+		}
+
+		mBounds = bounds;
+		mModel.Reset();
+	}
+
+	void ChunkGeometry::SetSegment(int index, const eastl::vector<Vector3>& positions, const eastl::vector<unsigned>& indices)
+	{
+		const int triangleSize = 3 * ProceduralMesh::VERTEX_SIZE;
+		Segment& segment = mSegments[index];
+
+		unsigned triangles = (unsigned) indices.size() / 3;
+		segment.mVertexData.resize(triangles * triangleSize);
+		for (unsigned i = 0; i < triangles; i++)
+		{
+			mFormat->WriteTriangle(
+				positions[indices[i * 3 + 0]],
+				positions[indices[i * 3 + 1]],
+				positions[indices[i * 3 + 2]],
+				&segment.mVertexData[i * triangleSize]);
+		}
+
+		segment.mDirty = true;
+	}
+
+	bool ChunkGeometry::HasTriangles() const
+	{
+		for (unsigned i = 0; i < mSegments.size(); i++)
+		{
+			if (!mSegments[i].mVertexData.empty())
+			{
+				return true;
+			}
+		}
+
+		return false;
+	}
+
+	void ChunkGeometry::Commit()
+	{
+		const unsigned triangleSize = 3 * ProceduralMesh::VERTEX_SIZE;
+
+		bool rebuild = mModel == nullptr;
+		for (unsigned i = 0; i < mSegments.size() && !rebuild; i++)
+		{
+			rebuild = mSegments[i].mVertexData.size() / triangleSize > mSegments[i].mCapacity;
+		}
+
+		if (rebuild)
+		{
+			Rebuild();
+			return;
+		}
+
+		for (unsigned i = 0; i < mSegments.size(); i++)
+		{
+			if (mSegments[i].mDirty)
+			{
+				WriteSegment(mSegments[i]);
+			}
+		}
+	}
+
+	void ChunkGeometry::WriteSegment(Segment& segment)
+	{
+		if (segment.mCapacity == 0)
+		{
+			segment.mDirty = false;
+			return;
+		}
+
+		/// Zeroed vertices make degenerate triangles, which are not rasterized.
+		static thread_local PODVector<float> data;
+		data.Resize(segment.mCapacity * 3 * ProceduralMesh::VERTEX_SIZE);
+		memset(data.Buffer(), 0, data.Size() * sizeof(float));
+		if (!segment.mVertexData.empty())
+		{
+			memcpy(data.Buffer(), segment.mVertexData.data(), segment.mVertexData.size() * sizeof(float));
+		}
+
+		mVertexBuffer->SetDataRange(data.Buffer(), segment.mStart * 3, segment.mCapacity * 3);
+		segment.mDirty = false;
+	}
+
+	void ChunkGeometry::Rebuild()
+	{
+		const unsigned triangleSize = 3 * ProceduralMesh::VERTEX_SIZE;
+
+		/// Half as much room again, so a segment grows a while before
+		/// everything has to be moved.
+		unsigned triangles = 0;
+		for (unsigned i = 0; i < mSegments.size(); i++)
+		{
+			Segment& segment = mSegments[i];
+			unsigned count = (unsigned) segment.mVertexData.size() / triangleSize;
+
+			segment.mStart = triangles;
+			segment.mCapacity = count + count / 2 + MIN_SPARE_TRIANGLES;
+			triangles += segment.mCapacity;
+		}
+
+		unsigned vertexCount = triangles * 3;
+		if (mModel == nullptr)
+		{
+			mModel = new Model(context_);
+			mVertexBuffer = new VertexBuffer(context_);
+			mIndexBuffer = new IndexBuffer(context_);
+			mGeometry = new Geometry(context_);
+
+			mVertexBuffer->SetShadowed(true);
+			mIndexBuffer->SetShadowed(true);
+		}
+
+		PODVector<VertexElement> elements;
+		ProceduralMesh::GetVertexElements(elements);
+		mVertexBuffer->SetSize(vertexCount, elements, true);
+
+		for (unsigned i = 0; i < mSegments.size(); i++)
+		{
+			WriteSegment(mSegments[i]);
+		}
+
+		/// Vertices are not shared, the index buffer simply counts up.
+		bool largeIndices = vertexCount > 0xffff;
+		mIndexBuffer->SetSize(vertexCount, largeIndices);
+		if (largeIndices)
+		{
+			PODVector<unsigned> indexData(vertexCount);
+			for (unsigned i = 0; i < vertexCount; i++)
+			{
+				indexData[i] = i;
+			}
+
+			mIndexBuffer->SetData(indexData.Buffer());
+		}
+		else
+		{
+			PODVector<unsigned short> indexData(vertexCount);
+			for (unsigned i = 0; i < vertexCount; i++)
+			{
+				indexData[i] = (unsigned short) i;
+			}
+
+			mIndexBuffer->SetData(indexData.Buffer());
+		}
+
+		mGeometry->SetNumVertexBuffers(1);
+		mGeometry->SetVertexBuffer(0, mVertexBuffer);
+		mGeometry->SetIndexBuffer(mIndexBuffer);
+		mGeometry->SetDrawRange(TRIANGLE_LIST, 0, vertexCount);
+
+		mModel->SetNumGeometries(1);
+		mModel->SetGeometry(0, 0, mGeometry);
+		mModel->SetBoundingBox(mBounds);
+
+		Vector<SharedPtr<VertexBuffer>> vertexBuffers;
+		Vector<SharedPtr<IndexBuffer>> indexBuffers;
+		vertexBuffers.Push(mVertexBuffer);
+		indexBuffers.Push(mIndexBuffer);
+
+		PODVector<unsigned> morphRangeStarts;
+		PODVector<unsigned> morphRangeCounts;
+		morphRangeStarts.Push(0);
+		morphRangeCounts.Push(0);
+
+		mModel->SetVertexBuffers(vertexBuffers, morphRangeStarts, morphRangeCounts);
+		mModel->SetIndexBuffers(indexBuffers);
+	}
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <EASTL/vector.h>
+
+#include "../../Core/Object.h"
+#include "../../Graphics/Geometry.h"
+#include "../../Graphics/IndexBuffer.h"
+#include "../../Graphics/Model.h"
+#include "../../Graphics/VertexBuffer.h"
+#include "../../Math/BoundingBox.h"
+#include "../../Math/Vector3.h"
+#include "../../Toolbox/Mesh/ProceduralMesh.h"
+
+namespace Urho3D
+{
+	/// Model of an edited chunk, split into segments, one per block of cells.
+	///
+	/// Every segment owns a range of triangles in the vertex buffer with some
+	/// room to grow. Changed segments are written into their range, unused
+	/// triangles of a range are degenerate. The buffers are only recreated,
+	/// if a segment outgrows its range.
+	class ChunkGeometry : public Object
+	{
+		URHO3D_OBJECT(ChunkGeometry, Object)
+
+	public:
+		/// Triangles each segment can grow by, before the buffers are recreated.
+		static const unsigned MIN_SPARE_TRIANGLES = 32;
+
+	private:
+		struct Segment
+		{
+			/// Vertex data of the triangles, three vertices each.
+			eastl::vector<float> mVertexData;
+
+			/// First triangle and number of triangles in the vertex buffer.
+			unsigned mStart;
+			unsigned mCapacity;
+
+			bool mDirty;
+		};
+
+		/// Writes the vertices in the layout of all chunk models.
+		ProceduralMesh* mFormat;
+
+		eastl::vector<Segment> mSegments;
+		BoundingBox mBounds;
+
+		SharedPtr<Model> mModel;
+		SharedPtr<VertexBuffer> mVertexBuffer;
+		SharedPtr<IndexBuffer> mIndexBuffer;
+		SharedPtr<Geometry> mGeometry;
+
+		/// Reserve new ranges for all segments and write everything.
+		void Rebuild();
+
+		/// Write the triangles of a segment and clear the rest of its range.
+		void WriteSegment(Segment& segment);
+
+	public:
+		ChunkGeometry(Context* ctx, ProceduralMesh* format);
+
+		/// Drop all segments. Bounds must cover every vertex of the chunk.
+		void Reset(int segmentCount, const BoundingBox& bounds);
+
+		/// Replace the triangles of a segment, three indices per triangle.
+		/// Does not touch the GPU, can be called from a worker thread.
+		void SetSegment(int index, const eastl::vector<Vector3>& positions, const eastl::vector<unsigned>& indices);
+
+		bool HasTriangles() const;
+
+		/// Upload the changed segments. Main thread only.
+		void Commit();
+
+		Model* GetModel() const
+		{
+			return mModel;
+		}
+	};
+}
@@ -0,0 +1,206 @@
+#include "ChunkMap.h"
+
+#include "../../IO/Log.h"
+#include "../../Math/MathDefs.h"
+
+namespace Urho3D
+{
+	ChunkMap::ChunkMap() :
+		mEpoch(0),
+		mSize(0),
+		mUsed(0)
+	{
+		mTable.store(CreateTable(MIN_CAPACITY));
+	}
+
+	ChunkMap::~ChunkMap()
+	{
+		Reclaim();
+		DestroyTable(mTable.load());
+	}
+
+	uint64_t ChunkMap::GetKey(const Vector3i& index)
+	{
+		/// 21 bits per axis, the top bit is never set, so no key equals EMPTY_KEY.
+		const uint64_t mask = (1ULL << 21) - 1;
+		return
+			((uint64_t) (index.x + MAX_INDEX + 1) & mask) |
+			(((uint64_t) (index.y + MAX_INDEX + 1) & mask) << 21) |
+			(((uint64_t) (index.z + MAX_INDEX + 1) & mask) << 42);
+	}
+
+	unsigned ChunkMap::GetHash(uint64_t key)
+	{
+		/// Neighboring chunks have similar keys, mix them well.
+		key ^= key >> 33;
+		key *= 0xff51afd7ed558ccdULL;
+		key ^= key >> 33;
+		key *= 0xc4ceb9fe1a85ec53ULL;
+		key ^= key >> 33;
+
+		return (unsigned) key;
+	}
+
+	ChunkMap::Table* ChunkMap::CreateTable(unsigned capacity)
+	{
+		Table* table = new Table();
+		table->mCapacity = capacity;
+		table->mSlots = new Slot[capacity];
+		for (unsigned i = 0; i < capacity; i++)
+		{
+			table->mSlots[i].mKey.store(EMPTY_KEY, std::memory_order_relaxed);
+			table->mSlots[i].mChunk.store(nullptr, std::memory_order_relaxed);
+		}
+
+		return table;
+	}
+
+	void ChunkMap::DestroyTable(Table* table)
+	{
+		delete[] table->mSlots;
+		delete table;
+	}
+
+	ChunkMap::Slot& ChunkMap::FindSlot(const Table* table, uint64_t key)
+	{
+		/// There are always empty slots, since the table is at most half full.
+		unsigned mask = table->mCapacity - 1;
+		for (unsigned i = GetHash(key) & mask;; i = (i + 1) & mask)
+		{
+			uint64_t k = table->mSlots[i].mKey.load(std::memory_order_acquire);
+			if (k == key || k == EMPTY_KEY)
+			{
+				return table->mSlots[i];
+			}
+		}
+	}
+
+	Chunk* ChunkMap::Find(const Vector3i& index) const
+	{
+		const Table* table = mTable.load(std::memory_order_acquire);
+		Slot& slot = FindSlot(table, GetKey(index));
+
+		return slot.mChunk.load(std::memory_order_acquire);
+	}
+
+	void ChunkMap::Insert(const Vector3i& index, Chunk* chunk)
+	{
+		if (Abs(index.x) > MAX_INDEX || Abs(index.y) > MAX_INDEX || Abs(index.z) > MAX_INDEX)
+		{
+			URHO3D_LOGERROR("Chunk index out of range, the chunk is not added.");
+			return;
+		}
+
+		uint64_t key = GetKey(index);
+		Slot* slot = &FindSlot(mTable.load(std::memory_order_relaxed), key);
+		if (slot->mKey.load(std::memory_order_relaxed) == key)
+		{
+			if (slot->mChunk.load(std::memory_order_relaxed) == nullptr)
+			{
+				mSize++;
+			}
+
+			slot->mChunk.store(chunk, std::memory_order_release);
+			return;
+		}
+
+		/// Keep at least half of the slots empty, removed entries count as used.
+		if ((mUsed + 1) * 2 > mTable.load(std::memory_order_relaxed)->mCapacity)
+		{
+			Rehash(mSize + 1);
+			slot = &FindSlot(mTable.load(std::memory_order_relaxed), key);
+		}
+
+		/// Readers only see the key once the chunk is in place.
+		slot->mChunk.store(chunk, std::memory_order_relaxed);
+		slot->mKey.store(key, std::memory_order_release);
+		mSize++;
+		mUsed++;
+	}
+
+	bool ChunkMap::Remove(const Vector3i& index)
+	{
+		Slot& slot = FindSlot(mTable.load(std::memory_order_relaxed), GetKey(index));
+		if (slot.mChunk.load(std::memory_order_relaxed) == nullptr)
+		{
+			return false;
+		}
+
+		slot.mChunk.store(nullptr, std::memory_order_release);
+		mSize--;
+
+		return true;
+	}
+
+	void ChunkMap::Rehash(unsigned count)
+	{
+		/// Grows, when the map is full of live entries, otherwise it just
+		/// drops the removed ones.
+		unsigned capacity = MIN_CAPACITY;
+		while (capacity < count * 4)
+		{
+			capacity *= 2;
+		}
+
+		Table* old = mTable.load(std::memory_order_relaxed);
+		Table* table = CreateTable(capacity);
+		for (unsigned i = 0; i < old->mCapacity; i++)
+		{
+			Chunk* chunk = old->mSlots[i].mChunk.load(std::memory_order_relaxed);
+			if (chunk == nullptr)
+			{
+				continue;
+			}
+
+			uint64_t key = old->mSlots[i].mKey.load(std::memory_order_relaxed);
+			Slot& slot = FindSlot(table, key);
+			slot.mChunk.store(chunk, std::memory_order_relaxed);
+			slot.mKey.store(key, std::memory_order_relaxed);
+		}
+
+		mUsed = mSize;
+		mTable.store(table, std::memory_order_release);
+		Retire(old);
+	}
+
+	void ChunkMap::Clear()
+	{
+		Table* old = mTable.load(std::memory_order_relaxed);
+		mTable.store(CreateTable(MIN_CAPACITY), std::memory_order_release);
+		Retire(old);
+		mSize = 0;
+		mUsed = 0;
+	}
+
+	void ChunkMap::Retire(Table* table)
+	{
+		/// Readers of the current epoch or older might still hold the table.
+		RetiredTable retired;
+		retired.mTable = table;
+		retired.mEpoch = mEpoch;
+		mRetired.push_back(retired);
+	}
+
+	void ChunkMap::Reclaim(unsigned long long oldestEpoch)
+	{
+		/// Tables are retired in epoch order.
+		unsigned count = 0;
+		while (count < mRetired.size() && mRetired[count].mEpoch < oldestEpoch)
+		{
+			DestroyTable(mRetired[count].mTable);
+			count++;
+		}
+
+		mRetired.erase(mRetired.begin(), mRetired.begin() + count);
+	}
+
+	void ChunkMap::Reclaim()
+	{
+		for (unsigned i = 0; i < mRetired.size(); i++)
+		{
+			DestroyTable(mRetired[i].mTable);
+		}
+
+		mRetired.clear();
+	}
+}
@@ -0,0 +1,131 @@
+#pragma once
+
+#include <inttypes.h>
+#include <atomic>
+#include <EASTL/vector.h>
+
+#include "../../Math/Vector3i.h"
+
+namespace Urho3D
+{
+	class Chunk;
+
+	/// Chunks by their integer index, open addressing with linear probing.
+	///
+	/// Only one thread, the main thread, changes the map. Any thread can look
+	/// up chunks at the same time without taking a lock. Removed entries keep
+	/// their key and get a null chunk, so a key never moves inside a table.
+	/// Tables, that were replaced by a larger one, are kept until every reader
+	/// that might still see them is done. Readers are tracked by epoch, see
+	/// SetEpoch and Reclaim.
+	class ChunkMap
+	{
+	public:
+		/// Chunk indices must be within +-MAX_INDEX along each axis.
+		static const int MAX_INDEX = (1 << 20) - 1;
+
+	private:
+		static const uint64_t EMPTY_KEY = ~0ULL;
+		static const unsigned MIN_CAPACITY = 256;
+
+		struct Slot
+		{
+			std::atomic<uint64_t> mKey;
+			std::atomic<Chunk*> mChunk;
+		};
+
+		struct Table
+		{
+			unsigned mCapacity;
+			Slot* mSlots;
+		};
+
+		struct RetiredTable
+		{
+			Table* mTable;
+
+			/// Newest epoch, whose readers might still see the table.
+			unsigned long long mEpoch;
+		};
+
+		std::atomic<Table*> mTable;
+		eastl::vector<RetiredTable> mRetired;
+		unsigned long long mEpoch;
+
+		/// Live entries and slots with a key, including removed ones.
+		unsigned mSize;
+		unsigned mUsed;
+
+		static uint64_t GetKey(const Vector3i& index);
+		static unsigned GetHash(uint64_t key);
+
+		static Table* CreateTable(unsigned capacity);
+		static void DestroyTable(Table* table);
+
+		/// Slot holding the key or the empty slot where it would go.
+		static Slot& FindSlot(const Table* table, uint64_t key);
+
+		/// Move the live entries into a new table with room for the given count.
+		void Rehash(unsigned count);
+
+		void Retire(Table* table);
+
+	public:
+		ChunkMap();
+		~ChunkMap();
+
+		ChunkMap(const ChunkMap&) = delete;
+		ChunkMap& operator =(const ChunkMap&) = delete;
+
+		/// Null, if there is no chunk at the given index. Thread safe.
+		Chunk* Find(const Vector3i& index) const;
+
+		/// Add or replace the chunk at the given index. Main thread only.
+		void Insert(const Vector3i& index, Chunk* chunk);
+
+		/// Returns false, if there was no chunk at the given index. Main thread only.
+		bool Remove(const Vector3i& index);
+
+		/// Remove all chunks. Main thread only.
+		void Clear();
+
+		/// Readers started from now on belong to the given epoch. Epochs only
+		/// grow. Main thread only.
+		void SetEpoch(unsigned long long epoch)
+		{
+			mEpoch = epoch;
+		}
+
+		/// Free the tables, that no reader of an epoch before the given one
+		/// can see anymore. Main thread only.
+		void Reclaim(unsigned long long oldestEpoch);
+
+		/// Free all replaced tables. Main thread only, while no other thread
+		/// reads the map.
+		void Reclaim();
+
+		unsigned Size() const
+		{
+			return mSize;
+		}
+
+		bool Empty() const
+		{
+			return mSize == 0;
+		}
+
+		/// Call func for every chunk. The map must not be changed meanwhile.
+		template <class T> void ForEach(T func) const
+		{
+			const Table* table = mTable.load(std::memory_order_acquire);
+			for (unsigned i = 0; i < table->mCapacity; i++)
+			{
+				Chunk* chunk = table->mSlots[i].mChunk.load(std::memory_order_relaxed);
+				if (chunk != nullptr)
+				{
+					func(chunk);
+				}
+			}
+		}
+	};
+}
@@ -0,0 +1,379 @@
+#include "ChunkMesher.h"
+
+namespace Urho3D
+{
+	static int GetAxis(const Vector3i& v, int axis)
+	{
+		return axis == 0 ? v.x : (axis == 1 ? v.y : v.z);
+	}
+
+	static void SetAxis(Vector3i& v, int axis, int value)
+	{
+		if (axis == 0)
+		{
+			v.x = value;
+		}
+		else if (axis == 1)
+		{
+			v.y = value;
+		}
+		else
+		{
+			v.z = value;
+		}
+	}
+
+	static int FloorHalf(int value)
+	{
+		return value >= 0 ? value / 2 : (value - 1) / 2;
+	}
+
+	ChunkMesher::ChunkMesher() :
+		mSurfaceData(nullptr),
+		mVoxelSize(0.0f),
+		mHasSeams(false)
+	{
+	}
+
+	void ChunkMesher::Reset(const SurfaceData* surfaceData, const Vector3i& layout, float voxelSize)
+	{
+		mSurfaceData = surfaceData;
+		mVoxelSize = voxelSize;
+
+		if (!(layout == mLayout) || mVoxels.empty())
+		{
+			mLayout = layout;
+			mVoxelLayout = layout + Vector3i(VOXEL_BORDER + 1);
+			mCellLayout = layout + Vector3i(1);
+
+			mVoxels.resize(mVoxelLayout.GetArrayCount());
+			mCubes.resize(mCellLayout.GetArrayCount());
+			mCellFlags.resize(mCellLayout.GetArrayCount());
+			mCellVertices.resize(mCellLayout.GetArrayCount());
+			mFlatFaces.resize(mLayout.GetArrayCount());
+		}
+
+		/// The corners of a quad differ along the two axes of its plane only.
+		for (int face = 0; face < 6; face++)
+		{
+			FaceLayout& f = mFaceLayouts[face];
+			for (int j = 0; j < 6; j++)
+			{
+				f.mCorners[j] = mSurfaceData->Vertices[mSurfaceData->Faces.Get(face, j)];
+			}
+
+			f.mNormal = 0;
+			for (int axis = 0; axis < 3; axis++)
+			{
+				bool flat = true;
+				for (int j = 0; j < 6; j++)
+				{
+					flat &= GetAxis(f.mCorners[j], axis) == 0;
+				}
+
+				if (flat)
+				{
+					f.mNormal = axis;
+					break;
+				}
+			}
+
+			f.mAxisA = (f.mNormal + 1) % 3;
+			f.mAxisB = (f.mNormal + 2) % 3;
+		}
+
+		for (int i = 0; i < 27; i++)
+		{
+			mCoarser[i] = false;
+		}
+
+		mHasSeams = false;
+		mPositions.clear();
+		mIndices.clear();
+	}
+
+	bool ChunkMesher::IsSeamCell(int x, int y, int z) const
+	{
+		/// Boundary cells reach into the neighbors before or after the chunk.
+		int dx = x < 0 ? -1 : (x == mLayout.x - 1 ? 1 : 0);
+		int dy = y < 0 ? -1 : (y == mLayout.y - 1 ? 1 : 0);
+		int dz = z < 0 ? -1 : (z == mLayout.z - 1 ? 1 : 0);
+		if (dx == 0 && dy == 0 && dz == 0)
+		{
+			return false;
+		}
+
+		/// Every chunk, that shares the cell, must agree on its vertex.
+		for (int i = 1; i < 8; i++)
+		{
+			int nx = (i & 1) != 0 ? dx : 0;
+			int ny = (i & 2) != 0 ? dy : 0;
+			int nz = (i & 4) != 0 ? dz : 0;
+			if (mCoarser[(nx + 1) * 9 + (ny + 1) * 3 + nz + 1])
+			{
+				return true;
+			}
+		}
+
+		return false;
+	}
+
+	void ChunkMesher::BuildCubes()
+	{
+		int offsets[8];
+		for (int i = 0; i < mSurfaceData->VoxelCubeSize; i++)
+		{
+			const Vector3i& v = mSurfaceData->VoxelCube[i];
+			offsets[i] = GetVoxelIndex(v.x, v.y, v.z) - GetVoxelIndex(0, 0, 0);
+		}
+
+		for (int z = -1; z < mLayout.z; z++)
+		{
+			for (int y = -1; y < mLayout.y; y++)
+			{
+				int voxel = GetVoxelIndex(-1, y, z);
+				int cell = GetCellIndex(-1, y, z);
+				for (int x = -1; x < mLayout.x; x++, voxel++, cell++)
+				{
+					int cube = 0;
+					int flags = 0;
+					for (int i = 0; i < 8; i++)
+					{
+						uint8_t v = mVoxels[voxel + offsets[i]];
+						cube |= (v & VOXEL_SOLID) != 0 ? 1 << i : 0;
+						flags |= v;
+					}
+
+					/// Cubes reaching into missing chunks stay empty, just like
+					/// GetCube reports them.
+					if ((flags & VOXEL_MISSING) != 0)
+					{
+						cube = 0;
+					}
+
+					mCubes[cell] = (uint8_t) cube;
+					mCellFlags[cell] = (flags & (VOXEL_MISSING | VOXEL_BLOCK)) == 0 ? CELL_MOVED : 0;
+					mCellVertices[cell] = -1;
+
+					if (mHasSeams && IsSeamCell(x, y, z))
+					{
+						mCellFlags[cell] |= CELL_SEAM;
+					}
+				}
+			}
+		}
+	}
+
+	unsigned ChunkMesher::GetVertex(int x, int y, int z)
+	{
+		int cell = GetCellIndex(x, y, z);
+		if (mCellVertices[cell] < 0)
+		{
+			mCellVertices[cell] = (int) mPositions.size();
+			if ((mCellFlags[cell] & CELL_SEAM) != 0)
+			{
+				mPositions.push_back(GetSeamPosition(x, y, z));
+				return (unsigned) mCellVertices[cell];
+			}
+
+			/// By default every vertex is right in the middle of the voxel cube.
+			Vector3 position = Vector3((float) x, (float) y, (float) z) * mVoxelSize;
+			float half = mVoxelSize * 0.5f;
+
+			/// The point table is made for the finest level.
+			mPositions.push_back((mCellFlags[cell] & CELL_MOVED) != 0 ?
+				mSurfaceData->PointTable[mCubes[cell]] * (mVoxelSize / mSurfaceData->mVoxelSize) + position :
+				position + Vector3(half, half, half));
+		}
+
+		return (unsigned) mCellVertices[cell];
+	}
+
+	Vector3 ChunkMesher::GetSeamPosition(int x, int y, int z) const
+	{
+		/// Coarse voxel c is the voxel 2 * c of this chunk, the same one the
+		/// coarser neighbor samples from us.
+		Vector3i origin(FloorHalf(x) * 2, FloorHalf(y) * 2, FloorHalf(z) * 2);
+
+		int cube = 0;
+		int flags = 0;
+		for (int i = 0; i < mSurfaceData->VoxelCubeSize; i++)
+		{
+			Vector3i v = origin + mSurfaceData->VoxelCube[i] * 2;
+			uint8_t voxel = mVoxels[GetVoxelIndex(v.x, v.y, v.z)];
+			cube |= (voxel & VOXEL_SOLID) != 0 ? 1 << i : 0;
+			flags |= voxel;
+		}
+
+		float coarseSize = mVoxelSize * 2.0f;
+		Vector3 position = Vector3((float) origin.x, (float) origin.y, (float) origin.z) * mVoxelSize;
+		if ((flags & (VOXEL_MISSING | VOXEL_BLOCK)) != 0)
+		{
+			float half = coarseSize * 0.5f;
+			return position + Vector3(half, half, half);
+		}
+
+		return mSurfaceData->PointTable[cube] * (coarseSize / mSurfaceData->mVoxelSize) + position;
+	}
+
+	void ChunkMesher::AddQuad(const Vector3i* corners, eastl::vector<unsigned>& out)
+	{
+		unsigned indices[6];
+		for (int j = 0; j < 6; j++)
+		{
+			indices[j] = GetVertex(corners[j].x, corners[j].y, corners[j].z);
+		}
+
+		out.push_back(indices[1]);
+		out.push_back(indices[0]);
+		out.push_back(indices[2]);
+
+		out.push_back(indices[4]);
+		out.push_back(indices[3]);
+		out.push_back(indices[5]);
+	}
+
+	void ChunkMesher::Build(bool greedy)
+	{
+		BuildCubes();
+
+		if (greedy)
+		{
+			mFlatFaces.assign(mFlatFaces.size(), 0);
+		}
+
+		AddQuads(Vector3i(0), mLayout, greedy, mIndices);
+
+		if (greedy)
+		{
+			for (int face = 0; face < 6; face++)
+			{
+				MergeFlatFaces(face);
+			}
+		}
+	}
+
+	void ChunkMesher::BuildRange(const Vector3i& min, const Vector3i& max, eastl::vector<unsigned>& indices)
+	{
+		indices.clear();
+		AddQuads(min, max, false, indices);
+	}
+
+	void ChunkMesher::AddQuads(const Vector3i& min, const Vector3i& max, bool greedy, eastl::vector<unsigned>& indices)
+	{
+		Vector3i corners[6];
+		for (int z = min.z; z < max.z; z++)
+		{
+			for (int y = min.y; y < max.y; y++)
+			{
+				for (int x = min.x; x < max.x; x++)
+				{
+					/// Tells us, which edges are being cut by the surface.
+					/// This controlls which planes are being created.
+					int plane = mCubes[GetCellIndex(x, y, z)] & 15;
+					if (plane == 0 || plane == 15)
+					{
+						continue;
+					}
+
+					for (int q = 0; mSurfaceData->CubeIndexToFace[plane][q] != mSurfaceData->STOP; q++)
+					{
+						int face = mSurfaceData->CubeIndexToFace[plane][q];
+						const FaceLayout& f = mFaceLayouts[face];
+
+						bool flat = true;
+						for (int j = 0; j < 6; j++)
+						{
+							corners[j] = Vector3i(x, y, z) + f.mCorners[j];
+							flat &= mCellFlags[GetCellIndex(corners[j].x, corners[j].y, corners[j].z)] == 0;
+						}
+
+						if (greedy && flat)
+						{
+							mFlatFaces[mLayout.GetIndex(x, y, z)] |= (uint8_t) (1 << face);
+							continue;
+						}
+
+						AddQuad(corners, indices);
+					}
+				}
+			}
+		}
+	}
+
+	void ChunkMesher::MergeFlatFaces(int face)
+	{
+		const FaceLayout& f = mFaceLayouts[face];
+		const uint8_t bit = (uint8_t) (1 << face);
+
+		int slices = GetAxis(mLayout, f.mNormal);
+		int sizeA = GetAxis(mLayout, f.mAxisA);
+		int sizeB = GetAxis(mLayout, f.mAxisB);
+
+		Vector3i p;
+		auto at = [&](int s, int a, int b) -> uint8_t&
+		{
+			SetAxis(p, f.mNormal, s);
+			SetAxis(p, f.mAxisA, a);
+			SetAxis(p, f.mAxisB, b);
+			return mFlatFaces[mLayout.GetIndex(p)];
+		};
+
+		Vector3i corners[6];
+		for (int s = 0; s < slices; s++)
+		{
+			for (int b = 0; b < sizeB; b++)
+			{
+				for (int a = 0; a < sizeA; a++)
+				{
+					if ((at(s, a, b) & bit) == 0)
+					{
+						continue;
+					}
+
+					/// Grow along the first axis, then add rows as long as they are complete.
+					int a1 = a;
+					while (a1 + 1 < sizeA && (at(s, a1 + 1, b) & bit) != 0)
+					{
+						a1++;
+					}
+
+					int b1 = b;
+					bool grow = true;
+					while (grow && b1 + 1 < sizeB)
+					{
+						for (int i = a; i <= a1 && grow; i++)
+						{
+							grow = (at(s, i, b1 + 1) & bit) != 0;
+						}
+
+						if (grow)
+						{
+							b1++;
+						}
+					}
+
+					for (int j = b; j <= b1; j++)
+					{
+						for (int i = a; i <= a1; i++)
+						{
+							at(s, i, j) &= (uint8_t) ~bit;
+						}
+					}
+
+					/// A single quad spans from the cell before to the cell itself,
+					/// the merged one from the cell before the first to the last.
+					for (int j = 0; j < 6; j++)
+					{
+						Vector3i& c = corners[j];
+						SetAxis(c, f.mNormal, s + GetAxis(f.mCorners[j], f.mNormal));
+						SetAxis(c, f.mAxisA, GetAxis(f.mCorners[j], f.mAxisA) == 0 ? a1 : a - 1);
+						SetAxis(c, f.mAxisB, GetAxis(f.mCorners[j], f.mAxisB) == 0 ? b1 : b - 1);
+					}
+
+					AddQuad(corners, mIndices);
+				}
+			}
+		}
+	}
+}
@@ -0,0 +1,152 @@
+#pragma once
+
+#include <inttypes.h>
+#include <EASTL/vector.h>
+
+#include "../../Math/Vector3.h"
+#include "../../Math/Vector3i.h"
+
+#include "SurfaceData.h"
+
+namespace Urho3D
+{
+	/// Builds the surface of a chunk into flat vertex and index arrays.
+	///
+	/// Every cell of the chunk owns at most one vertex, so vertices are
+	/// indexed by cell id instead of by position. The tables of SurfaceData
+	/// tell which quads a cell creates and which cells provide their corners.
+	/// Instances keep their buffers between chunks, use one per thread.
+	///
+	/// Next to a coarser neighbor the vertices of the shared boundary cells
+	/// are placed on the grid of that neighbor, which creates the very same
+	/// vertices for its side of the boundary. This closes the seams between
+	/// chunks of different levels of detail.
+	class ChunkMesher
+	{
+	public:
+		/// Voxel is drawn.
+		static const uint8_t VOXEL_SOLID = 1 << 0;
+
+		/// Voxel keeps the vertices around it in the cell centers.
+		static const uint8_t VOXEL_BLOCK = 1 << 1;
+
+		/// Voxel belongs to a chunk that is not loaded. Cells touching it create no geometry.
+		static const uint8_t VOXEL_MISSING = 1 << 2;
+
+		/// Voxels before the first one of the chunk along each axis. The
+		/// coarse grid of a seam reaches one voxel further than the cells.
+		static const int VOXEL_BORDER = 2;
+
+	private:
+		/// Offsets of a quad corner along the normal and the two axes in its plane.
+		struct FaceLayout
+		{
+			int mNormal;
+			int mAxisA;
+			int mAxisB;
+			Vector3i mCorners[6];
+		};
+
+		const SurfaceData* mSurfaceData;
+		Vector3i mLayout;
+		float mVoxelSize;
+
+		/// Voxels from -VOXEL_BORDER to layout along each axis.
+		Vector3i mVoxelLayout;
+		eastl::vector<uint8_t> mVoxels;
+
+		/// Cells from -1 to layout - 1 along each axis. Cell c is the cube of
+		/// voxels c to c + 1, its vertex is shared by the quads around it.
+		Vector3i mCellLayout;
+		eastl::vector<uint8_t> mCubes;
+		eastl::vector<uint8_t> mCellFlags;
+		eastl::vector<int> mCellVertices;
+
+		/// Neighbors with a coarser level of detail, by direction.
+		bool mCoarser[27];
+		bool mHasSeams;
+
+		/// Flat quads, one bit per face, collected for greedy merging.
+		eastl::vector<uint8_t> mFlatFaces;
+
+		FaceLayout mFaceLayouts[6];
+
+		eastl::vector<Vector3> mPositions;
+		eastl::vector<unsigned> mIndices;
+
+		/// Vertex is moved inside its cell, instead of sitting in the center.
+		static const uint8_t CELL_MOVED = 1 << 0;
+
+		/// Vertex is shared with a coarser neighbor and placed on its grid.
+		static const uint8_t CELL_SEAM = 1 << 1;
+
+		int GetCellIndex(int x, int y, int z) const
+		{
+			return ((z + 1) * mCellLayout.y + (y + 1)) * mCellLayout.x + (x + 1);
+		}
+
+		/// True, if one of the chunks sharing the given cell is coarser.
+		bool IsSeamCell(int x, int y, int z) const;
+
+		/// Vertex of the given cell, created on first use.
+		unsigned GetVertex(int x, int y, int z);
+
+		/// Vertex of the coarse cell containing the given cell.
+		Vector3 GetSeamPosition(int x, int y, int z) const;
+
+		void AddQuad(const Vector3i* corners, eastl::vector<unsigned>& indices);
+		void MergeFlatFaces(int face);
+
+		/// Add the quads of the given cells, collect flat ones when merging.
+		void AddQuads(const Vector3i& min, const Vector3i& max, bool greedy, eastl::vector<unsigned>& indices);
+
+	public:
+		ChunkMesher();
+
+		/// Prepare for a chunk with the given layout. The voxel size may be a
+		/// multiple of the one the surface data has been created with.
+		void Reset(const SurfaceData* surfaceData, const Vector3i& layout, float voxelSize);
+
+		/// Mark the neighbor in the given direction as coarser by one level,
+		/// components are -1, 0 or 1. Call after Reset.
+		void SetCoarser(int x, int y, int z, bool value)
+		{
+			mCoarser[(x + 1) * 9 + (y + 1) * 3 + z + 1] = value;
+			mHasSeams |= value;
+		}
+
+		int GetVoxelIndex(int x, int y, int z) const
+		{
+			return ((z + VOXEL_BORDER) * mVoxelLayout.y + (y + VOXEL_BORDER)) * mVoxelLayout.x + (x + VOXEL_BORDER);
+		}
+
+		/// Flags of the voxels from -VOXEL_BORDER to layout, fill before calling Build.
+		eastl::vector<uint8_t>& GetVoxels()
+		{
+			return mVoxels;
+		}
+
+		/// Create the surface. With greedy merging, coplanar quads between
+		/// block voxels are combined into larger rectangles.
+		void Build(bool greedy);
+
+		/// Compute the cubes of all cells from the voxels. Called by Build,
+		/// call it yourself before building ranges.
+		void BuildCubes();
+
+		/// Create the surface of the cells from min to max, exclusive. Indices
+		/// are written to the given array, vertices are shared by all ranges.
+		void BuildRange(const Vector3i& min, const Vector3i& max, eastl::vector<unsigned>& indices);
+
+		const eastl::vector<Vector3>& GetPositions() const
+		{
+			return mPositions;
+		}
+
+		/// Three indices per triangle.
+		const eastl::vector<unsigned>& GetIndices() const
+		{
+			return mIndices;
+		}
+	};
+}
@@ -2,35 +2,65 @@
 
 #include <array>
 #include <EASTL/vector.h>
+#include <EASTL/algorithm.h>
 
 #include "../../Core/Timer.h"
 #include "../../Core/Profiler.h"
 #include "../../Engine/Console.h"
 #include "../../Core/CoreEvents.h"
 #include "../../Engine/EngineEvents.h"
+#include "../../IO/FileSystem.h"
 #include "VoxerSystem.h"
 
 namespace Urho3D
 {
+	/// Cycles allowed in flight at once. Chunks exposed while all slots
+	/// are in use wait for the next free one.
+	static const unsigned MAX_PENDING_CYCLES = 4;
+
+	/// Chunks started per cycle. The rest waits and is prioritized again
+	/// for the next cycle, so a fast moving player is served first.
+	static const unsigned MAX_CHUNKS_PER_CYCLE = 128;
+
+	/// Seconds the player position is extrapolated ahead.
+	static const double LOOKAHEAD_TIME = 0.5;
+
+	/// Priority multiplier for chunks outside the view frustum.
+	static const double OUT_OF_VIEW_PENALTY = 4.0;
+
+	/// Cosine of the angle the camera must turn to re-evaluate the chunks in flight.
+	static const float VIEW_TURN_THRESHOLD = 0.866f;
+
+	/// Blocks remeshed per update after edits, the rest waits for the next one.
+	static const int MAX_REMESHED_BLOCKS = 64;
+
 	bool chunkOrder(const Chunk* lhs, const Chunk* rhs)
 	{
 		return lhs->GetInitializationMarker() < rhs->GetInitializationMarker();
 	}
 
+	bool spawnOrder(const ChunkSpawnRequest& lhs, const ChunkSpawnRequest& rhs)
+	{
+		return lhs.mPriority < rhs.mPriority;
+	}
+
 	ChunkProvider::ChunkProvider(Context* ctx, VoxerSettings* settings) :
 		Object(ctx)
 	{
 		mSettings = settings;
 		mTaskSystem = GetSubsystem<WorkQueue>();
 
-		mInitialing = nullptr;
-		mMeshing = nullptr;
+		mHasViewFrustum = false;
+		mViewDirection = Vector3::FORWARD;
+		mCycleEpoch = 0;
 
 		mSurfaceData = new SurfaceData(context_, mSettings->GetVoxelSize(), settings->GetVoxelCount());
 
 		Chunk::Stats = new VoxerStatistics();
 
 		mDrawDebugGeometry = false;
+		mLodChanged = false;
+		mCollisionChanged = false;
 
 		SubscribeToEvents();
 		AddAutoComplete();
@@ -75,35 +105,91 @@ namespace Urho3D
 
 	void ChunkProvider::Update(const Vector<Vector3d>& playerPositions)
 	{
+		OpenStore();
+		OpenDeltas();
+		CollectFinishedCycles();
+
+		/// Only tasks of cycles in flight look up chunks. Cycles are kept in
+		/// the order they were started, so the first one is the oldest.
+		mActiveChunks.Reclaim(mCycles.Empty() ? mCycleEpoch + 1 : mCycles[0]->mEpoch);
+
+		ApplyEdits();
+		RemeshDirtyChunks();
+		UpdateCollision();
+		UpdateStreamingRegions(playerPositions);
+		UpdateLods();
+		CancelStaleChunks(UpdateView(playerPositions));
 		SpawnChunks(playerPositions);
 		DespawnChunks(playerPositions);
+
+		Chunk::Stats->SampleTasksInFlight();
 	}
 
-	void ChunkProvider::Shutdown()
+	void ChunkProvider::OpenStore()
 	{
-		/// Wait for all tasks to finish
-		URHO3D_LOGDEBUG("Waiting for all pending tasks to finish.");
-		while (mInitialing != nullptr)
+		const String& path = mSettings->GetRegionPath();
+		if (mStore != nullptr || path.Empty())
 		{
-			Time::Sleep(0);
+			return;
 		}
 
-		while (mMeshing != nullptr)
+		auto fileSystem = GetSubsystem<FileSystem>();
+		if (!fileSystem->DirExists(path) && !fileSystem->CreateDir(path))
 		{
-			Time::Sleep(0);
+			URHO3D_LOGERROR("Could not create the region directory " + path + ", chunks will not be saved.");
+			mSettings->SetRegionPath(String::EMPTY);
+			return;
 		}
 
+		mStore = new ChunkStore(path, mSettings->GetChunkDimension());
+		if (!mStore->Run())
+		{
+			URHO3D_LOGWARNING("Could not start the chunk writer, saving chunks on the main thread.");
+		}
+	}
+
+	void ChunkProvider::OpenDeltas()
+	{
+		if (mDeltas == nullptr && mSettings->IsReplication())
+		{
+			mDeltas = new VoxelDeltaMap();
+		}
+	}
+
+	void ChunkProvider::Shutdown()
+	{
+		/// Wait for all tasks to finish
+		URHO3D_LOGDEBUG("Waiting for all pending tasks to finish.");
+		mTaskSystem->WaitForCounter(&mFinishing);
+		CollectFinishedCycles();
+
+		mSpawnQueue.clear();
+		mDespawnCandidates.clear();
+		mRemeshQueue.Clear();
+		mPendingEdits.clear();
+		mDirtyChunks.clear();
+		mPlayerCenters.clear();
+		mCollisionCenters.clear();
+		mLastPlayerPositions.clear();
+		mPredictedPositions.clear();
+
 		/// Remove all Chunks
 		URHO3D_LOGDEBUG("Destroying active chunks");
-		for (auto it = mActiveChunks.begin();
-			it != mActiveChunks.end();
-			++it)
+		mActiveChunks.ForEach([](Chunk* c)
 		{
-			auto c = it->second;
+			c->Save();
 			delete c;
-		}
+		});
 
-		mActiveChunks.clear();
+		mActiveChunks.Clear();
+		mActiveChunks.Reclaim();
+
+		if (mStore != nullptr)
+		{
+			URHO3D_LOGDEBUG("Writing pending chunks to disk");
+			mStore->Close();
+			mStore.Reset();
+		}
 
 		URHO3D_LOGDEBUG("Cleaning up object pool");
 		while (mObjectPool.size() > 0)
@@ -120,149 +206,776 @@ namespace Urho3D
 		URHO3D_LOGDEBUG("Chunk provider out!");
 	}
 
-	void ChunkProvider::SpawnChunks(const Vector<Vector3d>& playerPositions)
+	int ChunkProvider::GetStreamingPositions(const Vector<Vector3d>& playerPositions) const
 	{
-		URHO3D_PROFILE(SpawnChunks);
-		if (playerPositions.Size() < 1)
+		return mSettings->IsServer() ? playerPositions.Size() : Min(playerPositions.Size(), 1U);
+	}
+
+	void ChunkProvider::UpdateStreamingRegions(const Vector<Vector3d>& playerPositions)
+	{
+		URHO3D_PROFILE(UpdateStreamingRegions);
+		int positions = GetStreamingPositions(playerPositions);
+
+		/// Players, that are gone, leave their whole region behind.
+		for (int i = positions; i < (int) mPlayerCenters.size(); i++)
 		{
-			return;
+			CollectRegion(mPlayerCenters[i], nullptr, mDespawnCandidates);
+			mLodChanged = true;
 		}
 
-		if (mInitialing != nullptr || mMeshing != nullptr)
+		for (int i = 0; i < positions; i++)
 		{
-			return;
+			auto center = GetChunkIndex(playerPositions[i]);
+			if (i >= (int) mPlayerCenters.size())
+			{
+				/// New player, everything around is exposed.
+				CollectRegion(center, nullptr, mSpawnQueue);
+				mPlayerCenters.push_back(center);
+				mLodChanged = true;
+				continue;
+			}
+
+			auto last = mPlayerCenters[i];
+			if (last == center)
+			{
+				continue;
+			}
+
+			/// Crossed a chunk boundary. Only the slab in front of the player
+			/// is new, only the slab behind may be despawned. A teleport simply
+			/// exposes the whole region.
+			CollectRegion(center, &last, mSpawnQueue);
+			CollectRegion(last, &center, mDespawnCandidates);
+			mPlayerCenters[i] = center;
+			mLodChanged = true;
 		}
 
-		mInitialing = new std::atomic<int>();
-		mMeshing = new std::atomic<int>();
+		mPlayerCenters.resize(positions);
+	}
 
-		int positions = mSettings->IsServer() ? playerPositions.Size() : 1;
-		Vector3d cd = mSettings->GetChunkDimension();
+	void ChunkProvider::CollectRegion(const Vector3i& center, const Vector3i* exclude, eastl::vector<Vector3i>& result) const
+	{
 		Vector3i vr = mSettings->GetViewRange();
-		Vector<Chunk*> Workload;
+		for (int x = -vr.x; x < vr.x; x++)
+		{
+			for (int y = -vr.y; y < vr.y; y++)
+			{
+				for (int z = -vr.z; z < vr.z; z++)
+				{
+					auto chunk = center + Vector3i(x, y, z);
+					if (exclude != nullptr && IsInRegion(chunk, *exclude))
+					{
+						continue;
+					}
 
-		for (int i = 0; i < positions; i++)
+					result.push_back(chunk);
+				}
+			}
+		}
+	}
+
+	bool ChunkProvider::IsInRegion(const Vector3i& chunk, const Vector3i& center) const
+	{
+		Vector3i vr = mSettings->GetViewRange();
+		auto d = chunk - center;
+
+		return
+			d.x >= -vr.x && d.x < vr.x &&
+			d.y >= -vr.y && d.y < vr.y &&
+			d.z >= -vr.z && d.z < vr.z;
+	}
+
+	bool ChunkProvider::IsInViewRange(const Vector3i& chunk) const
+	{
+		for (int i = 0; i < (int) mPlayerCenters.size(); i++)
 		{
-			auto np = NormalizeChunkPosition(playerPositions[i]);
+			if (IsInRegion(chunk, mPlayerCenters[i]))
+			{
+				return true;
+			}
+		}
 
-			double startx = np.x - (cd.x * vr.x);
-			double starty = np.y - (cd.y * vr.y);
-			double startz = np.z - (cd.z * vr.z);
+		return false;
+	}
 
-			double stopx = np.x + (cd.x * (float) vr.x);
-			double stopy = np.y + (cd.y * (float) vr.y);
-			double stopz = np.z + (cd.z * (float) vr.z);
+	int ChunkProvider::GetLod(const Vector3i& chunk) const
+	{
+		int levels = mSettings->GetLodLevels();
+		if (levels == 0 || mPlayerCenters.empty())
+		{
+			return 0;
+		}
 
-			for (double x2 = startx; x2 < stopx; x2 += cd.x)
+		/// Distance in chunks along the furthest axis, which changes by at
+		/// most one between neighbors.
+		int distance = M_MAX_INT;
+		for (int i = 0; i < (int) mPlayerCenters.size(); i++)
+		{
+			auto d = chunk - mPlayerCenters[i];
+			distance = Min(distance, Max(Abs(d.x), Max(Abs(d.y), Abs(d.z))));
+		}
+
+		return Min(distance / mSettings->GetLodDistance(), levels);
+	}
+
+	void ChunkProvider::UpdateLods()
+	{
+		if (!mLodChanged)
+		{
+			return;
+		}
+
+		URHO3D_PROFILE(UpdateLods);
+		mLodChanged = false;
+
+		/// Collect first, destroying chunks changes the map.
+		PODVector<Chunk*> changed;
+		mActiveChunks.ForEach([this, &changed](Chunk* c)
+		{
+			auto& index = c->GetChunkIndex();
+			if (!IsInViewRange(index) || c->GetLod() == GetLod(index))
+			{
+				return;
+			}
+
+			/// Busy chunks are checked again with the next update.
+			if (!c->CanDespawn())
 			{
-				for (double y2 = starty; y2 < stopy; y2 += cd.y)
+				mLodChanged = true;
+				return;
+			}
+
+			changed.Push(c);
+		});
+
+		/// Rebuilt like newly exposed chunks, stored edits are kept.
+		for (int i = 0; i < changed.Size(); i++)
+		{
+			auto index = changed[i]->GetChunkIndex();
+			DestroyChunk(index);
+			mSpawnQueue.push_back(index);
+		}
+	}
+
+	bool ChunkProvider::NeedsCollision(const Vector3i& chunk) const
+	{
+		if (!mSettings->IsCollision())
+		{
+			return false;
+		}
+
+		int range = mSettings->GetCollisionRange();
+		for (int i = 0; i < (int) mCollisionCenters.size(); i++)
+		{
+			auto d = chunk - mCollisionCenters[i];
+			if (Abs(d.x) <= range && Abs(d.y) <= range && Abs(d.z) <= range)
+			{
+				return true;
+			}
+		}
+
+		return false;
+	}
+
+	void ChunkProvider::SetCollisionPositions(const Vector<Vector3d>& positions)
+	{
+		eastl::vector<Vector3i> centers;
+		for (int i = 0; i < (int) positions.Size(); i++)
+		{
+			auto index = GetChunkIndex(positions[i]);
+			if (eastl::find(centers.begin(), centers.end(), index) == centers.end())
+			{
+				centers.push_back(index);
+			}
+		}
+
+		if (centers != mCollisionCenters)
+		{
+			mCollisionCenters = centers;
+			mCollisionChanged = true;
+		}
+	}
+
+	void ChunkProvider::UpdateCollision()
+	{
+		if (!mCollisionChanged)
+		{
+			return;
+		}
+
+		URHO3D_PROFILE(UpdateCollision);
+		mCollisionChanged = false;
+
+		/// Drop what is not needed anymore.
+		auto system = VoxerSystem::Get();
+		mActiveChunks.ForEach([this, system](Chunk* c)
+		{
+			if (c->HasCollision() && !NeedsCollision(c->GetChunkIndex()))
+			{
+				system->RemoveCollision(c);
+			}
+		});
+
+		if (!mSettings->IsCollision())
+		{
+			return;
+		}
+
+		int range = mSettings->GetCollisionRange();
+		for (int i = 0; i < (int) mCollisionCenters.size(); i++)
+		{
+			auto& center = mCollisionCenters[i];
+			for (int x = -range; x <= range; x++)
+			{
+				for (int y = -range; y <= range; y++)
 				{
-					for (double z2 = startz; z2 < stopz; z2 += cd.z)
+					for (int z = -range; z <= range; z++)
 					{
-						auto position = NormalizeChunkPosition(Vector3d(x2, y2, z2));
-						auto dist = (position - playerPositions[i]).SqrMagnitude();
-						auto ch = CreateChunk(position);
-
-						if (ch == nullptr)
+						auto c = GetChunk(center + Vector3i(x, y, z));
+						if (c == nullptr || c->HasCollision())
 						{
 							continue;
 						}
 
-						ch->SetInitializationMarker(dist);
+						/// Checked again, when its cycle is collected.
+						if (!c->Initialized())
+						{
+							continue;
+						}
 
-						auto dir = position - np;
-						auto key = dir.SqrMagnitude();
-						Workload.Push(ch);
+						system->AddCollision(c);
 					}
 				}
 			}
 		}
+	}
 
-		Sort(Workload.Begin(), Workload.End(), chunkOrder);
-		eastl::vector<Chunk*> init_tasks;
-		for (int i = 0; i < Workload.Size(); i++)
+	bool ChunkProvider::UpdateView(const Vector<Vector3d>& playerPositions)
+	{
+		int positions = GetStreamingPositions(playerPositions);
+		auto time = GetSubsystem<Time>();
+		double timeStep = time != nullptr ? time->GetTimeStep() : 0.0;
+
+		Vector3d cd = mSettings->GetChunkDimension();
+		Vector3i vr = mSettings->GetViewRange();
+		double maxLookahead = 0.5 * GetMax(vr.x * cd.x, vr.y * cd.y, vr.z * cd.z);
+
+		mLastPlayerPositions.resize(positions);
+		mPredictedPositions.resize(positions);
+		for (int i = 0; i < positions; i++)
 		{
-			/// Setup neighborhood for each chunk
-			auto c = Workload[i];
-			for (int x = -1; x <= 1; x++)
+			Vector3d position = playerPositions[i];
+			Vector3d moved = position - mLastPlayerPositions[i];
+			mLastPlayerPositions[i] = position;
+
+			/// Standing still, just joined or teleported.
+			double dist = moved.Magnitude();
+			if (timeStep <= 0.0 || dist <= 0.0 || dist > maxLookahead)
 			{
-				for (int y = -1; y <= 1; y++)
+				mPredictedPositions[i] = position;
+				continue;
+			}
+
+			/// Look ahead, but never further than half the view range.
+			double ahead = Min(dist / timeStep * LOOKAHEAD_TIME, maxLookahead);
+			mPredictedPositions[i] = position + moved * (ahead / dist);
+		}
+
+		mHasViewFrustum = mViewCamera != nullptr && !mSettings->IsServer();
+		if (!mHasViewFrustum)
+		{
+			return false;
+		}
+
+		mViewFrustum = mViewCamera->GetFrustum();
+
+		auto direction = mViewCamera->GetNode()->GetWorldDirection();
+		if (direction.DotProduct(mViewDirection) > VIEW_TURN_THRESHOLD)
+		{
+			return false;
+		}
+
+		mViewDirection = direction;
+		return true;
+	}
+
+	double ChunkProvider::GetSpawnPriority(const Vector3i& index) const
+	{
+		Vector3d cd = mSettings->GetChunkDimension();
+		Vector3d center = GetChunkPosition(index) + cd * 0.5;
+
+		double priority = M_INFINITY;
+		for (int i = 0; i < (int) mPredictedPositions.size(); i++)
+		{
+			Vector3d predicted = mPredictedPositions[i];
+			priority = Min(priority, (center - predicted).SqrMagnitude());
+		}
+
+		if (mHasViewFrustum)
+		{
+			auto min = GetChunkPosition(index);
+			auto max = min + cd;
+			BoundingBox bounds(Vector3(min.x, min.y, min.z), Vector3(max.x, max.y, max.z));
+			if (mViewFrustum.IsInsideFast(bounds) == OUTSIDE)
+			{
+				priority *= OUT_OF_VIEW_PENALTY;
+			}
+		}
+
+		return priority;
+	}
+
+	void ChunkProvider::CancelStaleChunks(bool turned)
+	{
+		if (mCycles.Empty())
+		{
+			return;
+		}
+
+		Vector3d cd = mSettings->GetChunkDimension();
+		Vector3i vr = mSettings->GetViewRange();
+		double farDist = 0.5 * GetMax(vr.x * cd.x, vr.y * cd.y, vr.z * cd.z);
+		farDist *= farDist;
+
+		for (int i = 0; i < mCycles.Size(); i++)
+		{
+			auto& chunks = mCycles[i]->mChunks;
+			for (int j = 0; j < chunks.Size(); j++)
+			{
+				auto c = chunks[j];
+				if (c->IsCancelled())
 				{
-					for (int z = -1; z <= 1; z++)
+					continue;
+				}
+
+				auto position = c->GetWorldPosition();
+				if (!IsInViewRange(c->GetChunkIndex()))
+				{
+					c->SetCancelled(true);
+					continue;
+				}
+
+				/// Only re-evaluate on a turn, otherwise chunks behind the
+				/// camera would be cancelled over and over again.
+				if (!turned || !mHasViewFrustum || mViewFrustum.IsInsideFast(c->GetBounds()) != OUTSIDE)
+				{
+					continue;
+				}
+
+				Vector3d predicted = mPredictedPositions[0];
+				if ((position - predicted).SqrMagnitude() > farDist)
+				{
+					c->SetCancelled(true);
+				}
+			}
+		}
+	}
+
+	void ChunkProvider::LinkNeighbors(Chunk* c)
+	{
+		for (int x = -1; x <= 1; x++)
+		{
+			for (int y = -1; y <= 1; y++)
+			{
+				for (int z = -1; z <= 1; z++)
+				{
+					if (x == 0 && y == 0 && z == 0)
 					{
-						auto px = (double) x * cd.x;
-						auto py = (double) y * cd.y;
-						auto pz = (double) z * cd.z;
-						auto pos = Vector3d(px, py, pz) + c->GetWorldPosition();
-						auto neighbor = GetChunk(pos);
+						continue;
+					}
 
-						if (neighbor == nullptr)
-						{
-							continue;
-						}
+					auto neighbor = GetChunk(c->GetChunkIndex() + Vector3i(x, y, z));
+
+					/// Chunks in flight are linked once their cycle is collected.
+					if (neighbor == nullptr || neighbor->IsScheduled())
+					{
+						continue;
+					}
 
-						c->SetNeighbor(x, y, z, neighbor);
+					if (c->SetNeighbor(x, y, z, neighbor))
+					{
+						mRemeshQueue.Push(c);
 					}
+
+					if (neighbor->SetNeighbor(-x, -y, -z, c))
+					{
+						mRemeshQueue.Push(neighbor);
+					}
+				}
+			}
+		}
+	}
+
+	void ChunkProvider::SpawnChunks(const Vector<Vector3d>& playerPositions)
+	{
+		URHO3D_PROFILE(SpawnChunks);
+		if (playerPositions.Size() < 1)
+		{
+			return;
+		}
+
+		if (mSpawnQueue.empty() && mRemeshQueue.Empty())
+		{
+			return;
+		}
+
+		/// Keep spawning while earlier cycles are still meshing, but do not
+		/// flood the workers.
+		if (mCycles.Size() >= MAX_PENDING_CYCLES)
+		{
+			return;
+		}
+
+		/// Prioritize everything still waiting. Entries, that the player
+		/// moved away from before we got here, are dropped.
+		mSpawnOrder.Clear();
+		for (int i = 0; i < (int) mSpawnQueue.size(); i++)
+		{
+			auto index = mSpawnQueue[i];
+			if (!IsInViewRange(index))
+			{
+				continue;
+			}
+
+			auto existing = GetChunk(index);
+			if (existing != nullptr && (!existing->IsCancelled() || existing->IsScheduled()))
+			{
+				continue;
+			}
+
+			ChunkSpawnRequest request;
+			request.mIndex = index;
+			request.mPriority = GetSpawnPriority(index);
+			mSpawnOrder.Push(request);
+		}
+
+		mSpawnQueue.clear();
+		Sort(mSpawnOrder.Begin(), mSpawnOrder.End(), spawnOrder);
+
+		PODVector<Chunk*> Workload;
+		for (int i = 0; i < mSpawnOrder.Size(); i++)
+		{
+			auto index = mSpawnOrder[i].mIndex;
+			if (Workload.Size() >= MAX_CHUNKS_PER_CYCLE)
+			{
+				/// Wait for the next cycle.
+				mSpawnQueue.push_back(index);
+				continue;
+			}
+
+			auto ch = GetChunk(index);
+			if (ch != nullptr)
+			{
+				/// A chunk cancelled earlier, that is needed again. Initialize
+				/// and CreateMesh skip whatever has been done already.
+				if (!ch->IsCancelled() || ch->IsScheduled())
+				{
+					continue;
+				}
+
+				/// Cancelled before its level of detail changed.
+				int lod = GetLod(index);
+				if (ch->GetLod() != lod && ch->CanDespawn())
+				{
+					DestroyChunk(index);
+					ch = CreateChunk(index, lod);
+				}
+				else
+				{
+					mLodChanged |= ch->GetLod() != lod;
+					ch->SetCancelled(false);
 				}
 			}
+			else
+			{
+				ch = CreateChunk(index, GetLod(index));
+			}
+
+			if (ch == nullptr)
+			{
+				continue;
+			}
 
+			ch->SetInitializationMarker(mSpawnOrder[i].mPriority);
+			Workload.Push(ch);
+		}
+
+		/// Setup neighborhood for each chunk. Chunks of this cycle have not
+		/// been scheduled yet, so they are linked with each other as well.
+		Sort(Workload.Begin(), Workload.End(), chunkOrder);
+		for (int i = 0; i < Workload.Size(); i++)
+		{
+			LinkNeighbors(Workload[i]);
+		}
+
+		if (Workload.Empty() && mRemeshQueue.Empty())
+		{
+			return;
+		}
+
+		auto cycle = new ChunkUpdateCycle();
+		cycle->mEpoch = ++mCycleEpoch;
+		mActiveChunks.SetEpoch(cycle->mEpoch);
+		mCycles.Push(cycle);
+
+		/// Create all tasks of this cycle first and submit them in one go.
+		/// Every init task is counted before any of them runs, so the mesh
+		/// tasks cannot be released while initializers are still being added.
+		PODVector<Task*> init_tasks;
+		PODVector<Task*> mesh_tasks;
+		init_tasks.Reserve(Workload.Size());
+		mesh_tasks.Reserve(Workload.Size() + mRemeshQueue.Size());
+
+		for (int i = 0; i < Workload.Size(); i++)
+		{
 			/// Add initializer task
-			mTaskSystem->AddTask(
+			init_tasks.Push(mTaskSystem->CreateTask(
 				[](void* data)
 				{
 					auto chunk = reinterpret_cast<Chunk*>(data);
-					chunk->Initialize();
+					if (!chunk->IsCancelled())
+					{
+						chunk->Initialize();
+					}
+
+					Chunk::Stats->FinishTask();
 				},
-				c,
-				mInitialing,
-				nullptr);
+				Workload[i],
+				&cycle->mInitialing));
+		}
 
-			init_tasks.push_back(c);
+		/// Chunks, that were already initialized, but just got their full neighborhood.
+		for (int i = 0; i < mRemeshQueue.Size(); i++)
+		{
+			if (!mRemeshQueue[i]->IsScheduled())
+			{
+				Workload.Push(mRemeshQueue[i]);
+				mRemeshQueue[i]->SetScheduled(true);
+			}
 		}
 
+		mRemeshQueue.Clear();
 
 		///extract the surface.
 		/// Use task dependencies to make sure all chunks have been initialized
-		/// before we try to extract the surface.
-		for (int i = 0; i < init_tasks.size(); i++)
+		/// before we try to extract the surface. The mesh tasks are parked on
+		/// the init counter and released all at once, when it reaches zero.
+		for (int i = 0; i < Workload.Size(); i++)
 		{
-			auto c = init_tasks[i];
+			auto c = Workload[i];
+			c->SetScheduled(true);
 			if (c->Meshing())
 			{
 				continue;
 			}
 
-			mTaskSystem->AddTask(
+			/// Headless chunks keep their voxels only.
+			if (mSettings->IsHeadless())
+			{
+				c->SkipMesh();
+				continue;
+			}
+
+			auto t = mTaskSystem->CreateTask(
 				[](void* data)
 				{
 					auto chunk = reinterpret_cast<Chunk*>(data);
-					chunk->CreateMesh();
+					if (!chunk->IsCancelled())
+					{
+						chunk->CreateMesh();
+					}
+
+					Chunk::Stats->FinishTask();
 				},
 				c,
-				mMeshing,
-				mInitialing);
+				&cycle->mMeshing);
+
+			t->DependsOn(&cycle->mInitialing);
+			mesh_tasks.Push(t);
 		}
 
-		/// Finally clean up, otherwise this metho runs only once
-		mTaskSystem->AddTask(
-			[](void* data)
+		cycle->mChunks = Workload;
+
+		/// Finally hand the cycle back to the main thread.
+		auto finish = mTaskSystem->CreateTask(
+			[this](void* data)
 			{
-				auto cp = reinterpret_cast<ChunkProvider*>(data);
-				cp->FinishUpdateCycle();
+				FinishUpdateCycle(reinterpret_cast<ChunkUpdateCycle*>(data));
 			},
-			this,
-			nullptr,
-			mMeshing);
+			cycle,
+			&mFinishing);
+
+		/// Cycles without mesh tasks, like all headless ones, would finish
+		/// right away otherwise and be deleted under their init tasks.
+		finish->DependsOn(&cycle->mInitialing);
+		finish->DependsOn(&cycle->mMeshing);
+
+		Chunk::Stats->AddTasks((int) (init_tasks.Size() + mesh_tasks.Size()));
+		mTaskSystem->SubmitTasks(mesh_tasks);
+		mTaskSystem->SubmitTasks(init_tasks);
+		mTaskSystem->SubmitTask(finish);
+	}
 
+	void ChunkProvider::FinishUpdateCycle(ChunkUpdateCycle* cycle)
+	{
+		mFinishedCycles.enqueue(cycle);
 	}
 
-	void ChunkProvider::FinishUpdateCycle()
+	void ChunkProvider::CollectFinishedCycles()
 	{
-		delete mInitialing;
-		delete mMeshing;
+		ChunkUpdateCycle* cycle = nullptr;
+		while (mFinishedCycles.try_dequeue(cycle))
+		{
+			for (int i = 0; i < cycle->mChunks.Size(); i++)
+			{
+				cycle->mChunks[i]->SetScheduled(false);
+			}
 
-		mInitialing = nullptr;
-		mMeshing = nullptr;
+			for (int i = 0; i < cycle->mChunks.Size(); i++)
+			{
+				auto c = cycle->mChunks[i];
+				if (c->IsCancelled())
+				{
+					/// Try again later or get rid of it.
+					auto& index = c->GetChunkIndex();
+					if (IsInViewRange(index))
+					{
+						mSpawnQueue.push_back(index);
+					}
+					else
+					{
+						mDespawnCandidates.push_back(index);
+					}
+
+					continue;
+				}
+
+				/// Neighbors, that were in flight when the cycle was started.
+				LinkNeighbors(c);
+			}
+
+			/// Chunks near simulated bodies might be ready for collision now.
+			mCollisionChanged |= mSettings->IsCollision() && !cycle->mChunks.Empty();
+
+			mCycles.Remove(cycle);
+			delete cycle;
+		}
+	}
+
+	void ChunkProvider::SetVoxel(const Vector3d& position, const Voxel& voxel)
+	{
+		VoxelEdit edit;
+		edit.mPosition = position;
+		edit.mVoxel = voxel;
+
+		mPendingEdits[GetChunkIndex(position)].push_back(edit);
+	}
+
+	void ChunkProvider::ApplyEdits()
+	{
+		if (mPendingEdits.empty())
+		{
+			return;
+		}
+
+		URHO3D_PROFILE(ApplyEdits);
+		for (auto it = mPendingEdits.begin(); it != mPendingEdits.end();)
+		{
+			auto c = GetChunk(it->first);
+			if (c == nullptr)
+			{
+				it = mPendingEdits.erase(it);
+				continue;
+			}
+
+			/// Tasks might read the voxels, try again with the next update.
+			if (!c->CanEdit())
+			{
+				++it;
+				continue;
+			}
+
+			/// Edits are applied in order, so the last one of a voxel wins.
+			auto& edits = it->second;
+			double size = c->GetVoxelSize();
+			Vector3d min(M_INFINITY, M_INFINITY, M_INFINITY);
+			Vector3d max(-M_INFINITY, -M_INFINITY, -M_INFINITY);
+			for (int i = 0; i < (int) edits.size(); i++)
+			{
+				auto index = c->GetVoxelIndex(edits[i].mPosition);
+				c->Set(edits[i].mVoxel, index.x, index.y, index.z);
+
+				/// Like saving, only full resolution chunks keep their edits.
+				if (mDeltas != nullptr && c->GetLod() == 0)
+				{
+					mDeltas->Set(it->first, c->GetVoxelLayout().GetIndex(index), edits[i].mVoxel);
+				}
+
+				Vector3d corner = Vector3d(index.x * size, index.y * size, index.z * size) + c->GetWorldPosition();
+				min = Vector3d(Min(min.x, corner.x), Min(min.y, corner.y), Min(min.z, corner.z));
+				max = Vector3d(Max(max.x, corner.x + size), Max(max.y, corner.y + size), Max(max.z, corner.z + size));
+			}
+
+			/// Bodies resting on changed voxels have to notice.
+			if (mSettings->IsCollision())
+			{
+				VoxerSystem::Get()->RefreshCollision(min, max);
+			}
+
+			/// Voxels near the border change the meshes of the neighbors as well.
+			for (int x = -1; x <= 1; x++)
+			{
+				for (int y = -1; y <= 1; y++)
+				{
+					for (int z = -1; z <= 1; z++)
+					{
+						auto index = it->first + Vector3i(x, y, z);
+						auto n = GetChunk(index);
+						if (n != nullptr && n->MarkDirty(min, max))
+						{
+							mDirtyChunks.push_back(index);
+						}
+					}
+				}
+			}
+
+			it = mPendingEdits.erase(it);
+		}
+	}
+
+	void ChunkProvider::RemeshDirtyChunks()
+	{
+		if (mDirtyChunks.empty())
+		{
+			return;
+		}
+
+		URHO3D_PROFILE(RemeshDirtyChunks);
+		int budget = MAX_REMESHED_BLOCKS;
+		int kept = 0;
+		for (int i = 0; i < (int) mDirtyChunks.size(); i++)
+		{
+			auto index = mDirtyChunks[i];
+			auto c = GetChunk(index);
+
+			/// Despawned or rebuilt in the meantime.
+			if (c == nullptr || !c->HasDirtyBlocks())
+			{
+				continue;
+			}
+
+			if (budget > 0 && c->CanEdit())
+			{
+				budget -= c->RemeshDirtyBlocks(budget);
+			}
+
+			if (c->HasDirtyBlocks())
+			{
+				mDirtyChunks[kept++] = index;
+			}
+		}
+
+		mDirtyChunks.resize(kept);
 	}
 
 	void ChunkProvider::DespawnChunks(const Vector<Vector3d>& playerPositions)
@@ -272,40 +985,42 @@ namespace Urho3D
 		/// Placed inside Settings since it depends on voxel size, voxel count and
 		/// the view range.
 		double maxDist = mSettings->GetDistToDestroy();
+		int positions = GetStreamingPositions(playerPositions);
 
-		eastl::vector<Vector3d> keys;
-		for (auto it = mActiveChunks.begin(); it != mActiveChunks.end(); it++)
+		/// Only chunks, that left the view range of a player, are checked.
+		/// Those that cannot be removed yet stay candidates.
+		int kept = 0;
+		for (int i = 0; i < (int) mDespawnCandidates.size(); i++)
 		{
-			bool destroy = true;
-			auto c = it->second;
-			Vector3d pos = it->second->GetWorldPosition();
-			for (int i = 0; i < playerPositions.Size(); i++)
+			auto index = mDespawnCandidates[i];
+			auto c = GetChunk(index);
+			if (c == nullptr || IsInViewRange(index))
 			{
-				if (!c->CanDespawn())
-				{
-					destroy = false;
-					break;
-				}
+				continue;
+			}
 
+			bool destroy = c->CanDespawn();
+			Vector3d pos = c->GetWorldPosition();
+			for (int p = 0; destroy && p < positions; p++)
+			{
 				/// Remove everything that is further away than max distance.
-				auto dist = (pos - playerPositions[i]).SqrMagnitude();
+				auto dist = (pos - playerPositions[p]).SqrMagnitude();
 				if (dist < maxDist)
 				{
 					destroy = false;
-					break;
 				}
 			}
 
 			if (destroy)
 			{
-				keys.push_back(c->GetWorldPosition());
+				DestroyChunk(index);
+				continue;
 			}
-		}
 
-		for (int i = 0; i < keys.size(); i++)
-		{
-			DestroyChunk(keys[i]);
+			mDespawnCandidates[kept++] = index;
 		}
+
+		mDespawnCandidates.resize(kept);
 	}
 
 	Vector3d ChunkProvider::NormalizeChunkPosition(const Vector3d& position) const
@@ -329,17 +1044,35 @@ namespace Urho3D
 		return Vector3d(x, y, z);
 	}
 
-	Chunk* ChunkProvider::CreateChunk(Vector3d pos)
+	Vector3i ChunkProvider::GetChunkIndex(const Vector3d& position) const
 	{
-		Chunk* r = nullptr;
-		auto it = mActiveChunks.find(pos);
-		if (it != mActiveChunks.end())
+		auto ChunkDimension = mSettings->GetChunkDimension();
+
+		return Vector3i(
+			(int) std::floor(position.x / ChunkDimension.x),
+			(int) std::floor(position.y / ChunkDimension.y),
+			(int) std::floor(position.z / ChunkDimension.z));
+	}
+
+	Vector3d ChunkProvider::GetChunkPosition(const Vector3i& index) const
+	{
+		auto ChunkDimension = mSettings->GetChunkDimension();
+
+		return Vector3d(
+			index.x * ChunkDimension.x,
+			index.y * ChunkDimension.y,
+			index.z * ChunkDimension.z);
+	}
+
+	Chunk* ChunkProvider::CreateChunk(const Vector3i& index, int lod)
+	{
+		Chunk* r = mActiveChunks.Find(index);
+		if (r != nullptr)
 		{
 			/// Is it a former border chunk?
 			/// We will know after all chunks of this batch have been collected
 			/// and the neighbors have been set up. So return all border chunks here
 			/// to make sure meshing can take place again
-			r = it->second;
 			if (r->IsBorderChunk())
 			{
 				return r;
@@ -349,47 +1082,56 @@ namespace Urho3D
 		}
 
 		r = NewChunk();
-		r->Reset(pos, mSettings->GetChunkDimension());
-		mActiveChunks.insert(eastl::pair<Vector3d, Chunk*>(pos, r));
+		r->Reset(index, GetChunkPosition(index), mSettings->GetChunkDimension(), lod);
+		mActiveChunks.Insert(index, r);
 
 		return r;
 	}
 
-	Chunk* ChunkProvider::GetChunk(Vector3d pos)
+	Chunk* ChunkProvider::GetChunk(const Vector3i& index) const
 	{
-		auto it = mActiveChunks.find(pos);
-		if (it != mActiveChunks.end())
-		{
-			return it->second;
-		}
-
-		return nullptr;
+		return mActiveChunks.Find(index);
 	}
 
 	Chunk* ChunkProvider::NewChunk()
 	{
+		Chunk* r = nullptr;
 		if (mObjectPool.empty())
 		{
-			return new Chunk(
+			r = new Chunk(
 				context_,
 				mSettings->GetVoxelCount(),
 				mSettings->GetVoxelSize(),
 				mSurfaceData);
 		}
+		else
+		{
+			r = mObjectPool.front();
+			mObjectPool.pop();
+		}
 
-		auto r = mObjectPool.front();
-		mObjectPool.pop();
+		r->SetRunLengthEncoding(mSettings->IsRunLengthEncoding());
+		r->SetGreedyMeshing(mSettings->IsGreedyMeshing());
+		r->SetGenerator(mSettings->GetGenerator());
+		r->SetStore(mStore);
+		r->SetDeltas(mDeltas);
 
 		return r;
 	}
 
-	void ChunkProvider::DestroyChunk(const Vector3d pos)
+	void ChunkProvider::DestroyChunk(const Vector3i& index)
 	{
-		auto it = mActiveChunks.find(pos);
-		auto c = it->second;
+		auto c = mActiveChunks.Find(index);
+		if (c == nullptr)
+		{
+			return;
+		}
+
+		c->Save();
+		c->Unlink();
 		c->Despawn();
 		mObjectPool.push(c);
-		mActiveChunks.erase(it);
+		mActiveChunks.Remove(index);
 	}
 
 	void ChunkProvider::DrawChunkBounds(SharedPtr<DebugRenderer> renderer) const
@@ -404,10 +1146,9 @@ namespace Urho3D
 			return;
 		}
 
-		for (auto it = mActiveChunks.begin(); it != mActiveChunks.end(); it++)
+		mActiveChunks.ForEach([&renderer](Chunk* c)
 		{
-			auto pos = it->second->GetWorldPosition();
-			renderer->AddBoundingBox(it->second->GetBounds(), Color::BLUE);
-		}
+			renderer->AddBoundingBox(c->GetBounds(), Color::BLUE);
+		});
 	}
 }
\ No newline at end of file
@@ -4,19 +4,53 @@
 
 #include <EASTL/unordered_map.h>
 #include <EASTL/queue.h>
+#include <EASTL/vector.h>
 
+#include "../../Container/ConcurentQueue.h"
 #include "../../Math/Vector3d.h"
 #include "../../Math/Vector3i.h"
 #include "../../Core/Object.h"
 #include "../../Core/WorkQueue.h"
 #include "../../Graphics/DebugRenderer.h"
+#include "../../Graphics/Camera.h"
 #include "../../Math/Color.h"
+#include "../../Math/Frustum.h"
 
 #include "VoxerSettings.h"
 #include "Chunk.h"
+#include "ChunkMap.h"
 
 namespace Urho3D
 {
+	/// Tasks and chunks of a single update cycle. Several cycles can be
+	/// in flight at once, each one is collected on its own.
+	struct ChunkUpdateCycle
+	{
+		/// Meshing depends on initialization.
+		TaskCounter mInitialing;
+		TaskCounter mMeshing;
+
+		/// Chunks this cycle works on.
+		PODVector<Chunk*> mChunks;
+
+		/// Epoch of the chunk map lookups done by the tasks of this cycle.
+		unsigned long long mEpoch;
+	};
+
+	/// A voxel change, that has not been applied yet.
+	struct VoxelEdit
+	{
+		Vector3d mPosition;
+		Voxel mVoxel;
+	};
+
+	/// A chunk waiting to be scheduled. Lower priority values go first.
+	struct ChunkSpawnRequest
+	{
+		Vector3i mIndex;
+		double mPriority;
+	};
+
 	class ChunkProvider : public Object
 	{
 		URHO3D_OBJECT(ChunkProvider, Object)
@@ -25,26 +59,142 @@ namespace Urho3D
 		SharedPtr<VoxerSettings> mSettings;
 		SharedPtr<SurfaceData> mSurfaceData;
 
-		eastl::unordered_map<Vector3d, Chunk*> mActiveChunks;
+		/// Spawned chunks by index. Lookups are safe from any thread.
+		ChunkMap mActiveChunks;
 		eastl::queue<Chunk*> mObjectPool;
 
-		std::atomic<int>* mInitialing;
-		std::atomic<int>* mMeshing;
+		/// Submitted cycles, that have not been collected yet.
+		PODVector<ChunkUpdateCycle*> mCycles;
+
+		/// Filled by FinishUpdateCycle on the worker threads, emptied on the main thread.
+		moodycamel::ConcurrentQueue<ChunkUpdateCycle*> mFinishedCycles;
+
+		/// Counts the finish tasks of all cycles in flight.
+		TaskCounter mFinishing;
+
+		/// Epoch of the newest cycle started.
+		unsigned long long mCycleEpoch;
+
+		/// Chunk each player has been standing in during the last update.
+		eastl::vector<Vector3i> mPlayerCenters;
+
+		/// Newly exposed chunks, that have not been scheduled yet.
+		eastl::vector<Vector3i> mSpawnQueue;
+
+		/// Chunks, that left the view range of a player. They are destroyed
+		/// as soon as they are far enough away from all players.
+		eastl::vector<Vector3i> mDespawnCandidates;
+
+		/// Chunks, that need a new mesh since their neighborhood is complete now.
+		PODVector<Chunk*> mRemeshQueue;
+
+		/// Spawn queue ordered by priority. Rebuilt whenever a cycle is started.
+		Vector<ChunkSpawnRequest> mSpawnOrder;
+
+		/// Camera of the local player. Chunks inside its frustum are spawned first.
+		WeakPtr<Camera> mViewCamera;
+		Frustum mViewFrustum;
+		bool mHasViewFrustum;
+
+		/// View direction during the last check for stale chunks.
+		Vector3 mViewDirection;
+
+		/// Position of each player during the last update and where it is
+		/// expected to be shortly, based on its velocity.
+		eastl::vector<Vector3d> mLastPlayerPositions;
+		eastl::vector<Vector3d> mPredictedPositions;
 
 		SharedPtr<WorkQueue> mTaskSystem;
 
+		/// Saved chunks, null if persistence is disabled.
+		SharedPtr<ChunkStore> mStore;
+
+		/// Changes against the generated terrain, null if replication is disabled.
+		SharedPtr<VoxelDeltaMap> mDeltas;
+
 		bool mDrawDebugGeometry;
 
+		/// Edits per chunk, applied once the chunk and its neighbors are idle.
+		eastl::unordered_map<Vector3i, eastl::vector<VoxelEdit>> mPendingEdits;
+
+		/// Chunks with dirty blocks, remeshed on the main thread.
+		eastl::vector<Vector3i> mDirtyChunks;
+
+		/// Set, when a player crossed a chunk boundary and chunks may need
+		/// another level of detail. Stays set until all of them are rebuilt.
+		bool mLodChanged;
+
+		/// Chunks of the simulated bodies, their surroundings get collision.
+		/// Set, when they moved or chunks have been initialized.
+		eastl::vector<Vector3i> mCollisionCenters;
+		bool mCollisionChanged;
+
 		/// Console Commands
 		void SubscribeToEvents();
 		void HandleConsoleCommand(StringHash eventType, VariantMap& eventData);
 		void AddAutoComplete();
 
+		/// Number of players chunks are maintained for.
+		int GetStreamingPositions(const Vector<Vector3d>& playerPositions) const;
+
+		/// Compare the chunk each player is standing in with the last update
+		/// and queue the chunks that became visible or left the view range.
+		void UpdateStreamingRegions(const Vector<Vector3d>& playerPositions);
+
+		bool IsInViewRange(const Vector3i& chunk) const;
+
+		/// Level of detail for the given chunk, based on the closest player.
+		/// Neighboring chunks never differ by more than one level.
+		int GetLod(const Vector3i& chunk) const;
+
+		/// Rebuild the chunks in view range, whose level of detail changed.
+		/// Their neighbors are remeshed once they are linked again.
+		void UpdateLods();
+
+		/// True, if the chunk is in collision range of a simulated body.
+		bool NeedsCollision(const Vector3i& chunk) const;
+
+		/// Add collision to the chunks simulated bodies moved close to and
+		/// remove it from those they left.
+		void UpdateCollision();
+
+		/// Update frustum and predicted player positions. Returns true, if the
+		/// camera turned far enough to re-evaluate the chunks in flight.
+		bool UpdateView(const Vector<Vector3d>& playerPositions);
+
+		/// Lower values are spawned first. Takes the distance to the predicted
+		/// player positions and the view frustum into account.
+		double GetSpawnPriority(const Vector3i& index) const;
+
+		/// Cancel the chunks in flight, that left the view range or, after the
+		/// camera turned, are far away behind it. Cancelled chunks still in view
+		/// range are queued again once their cycle is collected.
+		void CancelStaleChunks(bool turned);
+
+		/// Link a chunk with all neighbors that are not in flight. Neighbors
+		/// that got their full neighborhood this way are queued for remeshing.
+		void LinkNeighbors(Chunk* c);
+
+		/// Apply the edits of all idle chunks and mark the blocks they touch.
+		void ApplyEdits();
+
+		/// Remesh dirty blocks up to the budget of this update.
+		void RemeshDirtyChunks();
+
+		/// Create the chunk store, once a region path has been set.
+		void OpenStore();
+
+		/// Create the delta map, once replication has been enabled.
+		void OpenDeltas();
+
+		/// Release the chunks of all finished cycles. Main thread only.
+		void CollectFinishedCycles();
+
 	public:
 		ChunkProvider(Context* ctx, VoxerSettings* settings);
 
 		void Update(const Vector<Vector3d>& playerPositions);
-		void FinishUpdateCycle();
+		void FinishUpdateCycle(ChunkUpdateCycle* cycle);
 		void Shutdown();
 
 		void SpawnChunks(const Vector<Vector3d>& playerPositions);
@@ -59,24 +209,54 @@ namespace Urho3D
 		Vector3d NormalizeChunkPosition(const Vector3d& position) const;
 		Vector3d NormalizeVoxelPosition(const Vector3d& position) const;
 
+		/// Add all chunks in view range of center, which are not in view range of exclude.
+		void CollectRegion(const Vector3i& center, const Vector3i* exclude, eastl::vector<Vector3i>& result) const;
+
+		bool IsInRegion(const Vector3i& chunk, const Vector3i& center) const;
+
+		/// Index of the chunk containing the given position.
+		Vector3i GetChunkIndex(const Vector3d& position) const;
+
+		/// World position of the chunk with the given index.
+		Vector3d GetChunkPosition(const Vector3i& index) const;
+
 		/// <summary>
 		/// Create a visible chunk or pull one from the list of buffered chunks.
 		/// Newly created chunks are always marked as not buffered.
 		/// </summary>
-		/// <param name="pos"></param>
+		/// <param name="index"></param>
 		/// <returns></returns>
-		Chunk* CreateChunk(Vector3d pos);
+		Chunk* CreateChunk(const Vector3i& index, int lod = 0);
 
 		/// <summary>
 		/// Just return a chunk, do not create new ones.
 		/// </summary>
-		/// <param name="pos"></param>
+		/// <param name="index"></param>
 		/// <returns></returns>
-		Chunk* GetChunk(Vector3d pos);
+		Chunk* GetChunk(const Vector3i& index) const;
 
 		Chunk* NewChunk();
 
-		void DestroyChunk(const Vector3d pos);
+		void DestroyChunk(const Vector3i& index);
+
+		/// Change the voxel at the given world position. Edits are collected
+		/// and applied with the next update, each changed block of a chunk
+		/// is remeshed once no matter how many edits it got. Edits of chunks,
+		/// that are not spawned, are dropped. Only full resolution chunks
+		/// keep their edits, once they are despawned, if they are saved or
+		/// replication is enabled.
+		void SetVoxel(const Vector3d& position, const Voxel& voxel);
+
+		/// Changes against the generated terrain, null unless replication
+		/// is enabled.
+		VoxelDeltaMap* GetDeltas() const
+		{
+			return mDeltas;
+		}
+
+		/// Positions of the simulated bodies, that need collision with the
+		/// terrain.
+		void SetCollisionPositions(const Vector<Vector3d>& positions);
 
 		void ToggleDrawChunkBounds()
 		{
@@ -84,5 +264,12 @@ namespace Urho3D
 		}
 
 		void DrawChunkBounds(SharedPtr<DebugRenderer> renderer) const;
+
+		/// Set the camera of the local player. Without a camera chunks are
+		/// prioritized by distance only, which is what a server does.
+		void SetViewCamera(Camera* camera)
+		{
+			mViewCamera = camera;
+		}
 	};
 }
\ No newline at end of file
@@ -0,0 +1,270 @@
+#include "ChunkStore.h"
+
+#include <cmath>
+
+#include "../../Core/Timer.h"
+#include "../../IO/Compression.h"
+#include "../../IO/FileSystem.h"
+#include "../../IO/Log.h"
+#include "../../IO/MemoryBuffer.h"
+#include "../../IO/VectorBuffer.h"
+
+namespace Urho3D
+{
+	static int FloorDiv(int value, int divisor)
+	{
+		return value >= 0 ? value / divisor : (value - divisor + 1) / divisor;
+	}
+
+	ChunkStore::ChunkStore(const String& path, const Vector3d& chunkDimension) :
+		mPath(AddTrailingSlash(path)),
+		mChunkDimension(chunkDimension),
+		mRetryDelay(0)
+	{
+	}
+
+	ChunkStore::~ChunkStore()
+	{
+		Close();
+	}
+
+	void ChunkStore::Close()
+	{
+		Stop();
+
+		/// Without a writer thread everything is written here.
+		unsigned attempts = 0;
+		while (WritePending())
+		{
+			if (mRetryDelay > 0 && ++attempts >= CLOSE_ATTEMPTS)
+			{
+				MutexLock lock(mPendingLock);
+				URHO3D_LOGERRORF("Could not save %u chunks, they will be generated again.", (unsigned) mPending.size());
+				mPending.clear();
+				break;
+			}
+		}
+
+		MutexLock lock(mRegionLock);
+		for (auto it = mRegions.begin(); it != mRegions.end(); it++)
+		{
+			delete it->second;
+		}
+
+		mRegions.clear();
+	}
+
+	void ChunkStore::ThreadFunction()
+	{
+		while (shouldRun_)
+		{
+			if (!WritePending())
+			{
+				Time::Sleep(SAVE_INTERVAL_MSEC);
+				continue;
+			}
+
+			/// Back off after a failed write, but keep stopping quickly.
+			for (unsigned waited = 0; waited < mRetryDelay && shouldRun_; waited += SAVE_INTERVAL_MSEC)
+			{
+				Time::Sleep(SAVE_INTERVAL_MSEC);
+			}
+		}
+	}
+
+	Vector3i ChunkStore::GetChunkIndex(const Vector3d& position) const
+	{
+		/// Chunk positions are multiples of the chunk dimension, round
+		/// instead of floor to be safe from precision errors.
+		return Vector3i(
+			(int) std::floor(position.x / mChunkDimension.x + 0.5),
+			(int) std::floor(position.y / mChunkDimension.y + 0.5),
+			(int) std::floor(position.z / mChunkDimension.z + 0.5));
+	}
+
+	Vector3i ChunkStore::GetRegionIndex(const Vector3i& chunk, int& slot) const
+	{
+		const int size = RegionFile::REGION_SIZE;
+		Vector3i region(FloorDiv(chunk.x, size), FloorDiv(chunk.y, size), FloorDiv(chunk.z, size));
+		slot = RegionFile::GetSlot(chunk.x - region.x * size, chunk.y - region.y * size, chunk.z - region.z * size);
+
+		return region;
+	}
+
+	RegionFile* ChunkStore::GetRegion(const Vector3i& region, bool create)
+	{
+		MutexLock lock(mRegionLock);
+		auto it = mRegions.find(region);
+		if (it != mRegions.end())
+		{
+			return it->second;
+		}
+
+		String fileName = mPath + "r." +
+			String(region.x) + "." +
+			String(region.y) + "." +
+			String(region.z) + ".vxr";
+
+		/// Do not create empty regions, just because a chunk was looked up.
+		if (!create && !RegionFile::Exists(fileName))
+		{
+			return nullptr;
+		}
+
+		RegionFile* r = new RegionFile();
+		if (!r->Open(fileName))
+		{
+			delete r;
+			return nullptr;
+		}
+
+		mRegions.insert(eastl::pair<Vector3i, RegionFile*>(region, r));
+		return r;
+	}
+
+	void ChunkStore::Save(const Vector3d& position, const VoxelStorage& storage)
+	{
+		VectorBuffer buffer;
+		storage.Save(buffer);
+
+		{
+			MutexLock lock(mPendingLock);
+			mPending[GetChunkIndex(position)] = buffer.GetBuffer();
+		}
+
+		if (!IsStarted())
+		{
+			WritePending();
+		}
+	}
+
+	bool ChunkStore::Load(const Vector3d& position, VoxelStorage& storage)
+	{
+		Vector3i index = GetChunkIndex(position);
+
+		/// Data, that is not on disk yet, is the most recent one.
+		{
+			MutexLock lock(mPendingLock);
+			const PODVector<unsigned char>* pending = nullptr;
+			auto it = mPending.find(index);
+			if (it != mPending.end())
+			{
+				pending = &it->second;
+			}
+			else
+			{
+				it = mWriting.find(index);
+				if (it != mWriting.end())
+				{
+					pending = &it->second;
+				}
+			}
+
+			if (pending != nullptr)
+			{
+				MemoryBuffer buffer(*pending);
+				return storage.Load(buffer);
+			}
+		}
+
+		int slot = 0;
+		RegionFile* region = GetRegion(GetRegionIndex(index, slot), false);
+		if (region == nullptr)
+		{
+			return false;
+		}
+
+		static thread_local PODVector<unsigned char> compressed;
+		static thread_local PODVector<unsigned char> raw;
+
+		unsigned rawSize = 0;
+		if (!region->Read(slot, compressed, rawSize))
+		{
+			return false;
+		}
+
+		raw.Resize(rawSize);
+		if (DecompressData(raw.Buffer(), compressed.Buffer(), rawSize) != compressed.Size())
+		{
+			URHO3D_LOGERROR("Could not decompress stored chunk data.");
+			return false;
+		}
+
+		MemoryBuffer buffer(raw);
+		if (!storage.Load(buffer))
+		{
+			URHO3D_LOGERROR("Could not read stored chunk data.");
+			return false;
+		}
+
+		return true;
+	}
+
+	bool ChunkStore::WritePending()
+	{
+		{
+			MutexLock lock(mPendingLock);
+			if (mPending.empty())
+			{
+				return false;
+			}
+
+			mWriting.swap(mPending);
+		}
+
+		/// Group by region, so each region syncs once per batch.
+		eastl::unordered_map<Vector3i, eastl::vector<RegionWrite>> regions;
+		eastl::unordered_map<Vector3i, eastl::vector<Vector3i>> regionChunks;
+		for (auto it = mWriting.begin(); it != mWriting.end(); it++)
+		{
+			int slot = 0;
+			Vector3i region = GetRegionIndex(it->first, slot);
+
+			const PODVector<unsigned char>& raw = it->second;
+			RegionWrite w;
+			w.mSlot = slot;
+			w.mRawSize = raw.Size();
+			w.mData.Resize(EstimateCompressBound(raw.Size()));
+			w.mData.Resize(CompressData(w.mData.Buffer(), raw.Buffer(), raw.Size()));
+
+			regions[region].push_back(w);
+			regionChunks[region].push_back(it->first);
+		}
+
+		eastl::vector<Vector3i> failed;
+		for (auto it = regions.begin(); it != regions.end(); it++)
+		{
+			RegionFile* region = GetRegion(it->first, true);
+			if (region == nullptr || !region->Write(it->second))
+			{
+				const eastl::vector<Vector3i>& chunks = regionChunks[it->first];
+				failed.insert(failed.end(), chunks.begin(), chunks.end());
+			}
+		}
+
+		if (failed.empty())
+		{
+			mRetryDelay = 0;
+		}
+		else
+		{
+			mRetryDelay = mRetryDelay == 0 ? MIN_RETRY_MSEC : Min(mRetryDelay * 2, MAX_RETRY_MSEC);
+			URHO3D_LOGERRORF("Could not save %u chunks, retrying in %u ms.", (unsigned) failed.size(), mRetryDelay);
+		}
+
+		MutexLock lock(mPendingLock);
+
+		/// Chunks saved again meanwhile have newer data pending already.
+		for (unsigned i = 0; i < failed.size(); i++)
+		{
+			if (mPending.find(failed[i]) == mPending.end())
+			{
+				mPending[failed[i]].Swap(mWriting[failed[i]]);
+			}
+		}
+
+		mWriting.clear();
+
+		return true;
+	}
+}
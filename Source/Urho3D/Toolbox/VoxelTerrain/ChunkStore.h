@@ -0,0 +1,88 @@
+#pragma once
+
+#include <EASTL/unordered_map.h>
+
+#include "../../Container/RefCounted.h"
+#include "../../Container/Str.h"
+#include "../../Core/Mutex.h"
+#include "../../Core/Thread.h"
+#include "../../Math/Vector3d.h"
+#include "../../Math/Vector3i.h"
+
+#include "RegionFile.h"
+#include "VoxelStorage.h"
+
+namespace Urho3D
+{
+	/// Keeps the voxel data of despawned chunks on disk, so they are loaded
+	/// instead of generated when they come back into view.
+	///
+	/// Chunks are grouped into region files. Saving only copies the data,
+	/// compression and writing is done by a background thread. Loading is
+	/// thread safe and also finds chunks that have not been written yet.
+	/// Chunks of a region, that could not be written, stay pending and are
+	/// written again later.
+	class ChunkStore : public Thread, public RefCounted
+	{
+	public:
+		/// Time the writer sleeps when there is nothing to save.
+		static const unsigned SAVE_INTERVAL_MSEC = 10;
+
+		/// Time the writer waits after the first failed write. Doubled with
+		/// every failure in a row, up to the maximum.
+		static const unsigned MIN_RETRY_MSEC = 100;
+		static const unsigned MAX_RETRY_MSEC = 5000;
+
+		/// Attempts to write the remaining chunks when closing.
+		static const unsigned CLOSE_ATTEMPTS = 3;
+
+	private:
+		String mPath;
+		Vector3d mChunkDimension;
+
+		Mutex mRegionLock;
+		eastl::unordered_map<Vector3i, RegionFile*> mRegions;
+
+		/// Guards both maps below.
+		Mutex mPendingLock;
+
+		/// Uncompressed data of saved chunks, that has not been picked up by the writer.
+		eastl::unordered_map<Vector3i, PODVector<unsigned char>> mPending;
+
+		/// Data the writer is working on. Only cleared by the writer.
+		eastl::unordered_map<Vector3i, PODVector<unsigned char>> mWriting;
+
+		/// Time to wait before writing again, 0 if the last write succeeded.
+		unsigned mRetryDelay;
+
+		Vector3i GetChunkIndex(const Vector3d& position) const;
+
+		/// Region containing the given chunk and the slot of the chunk in there.
+		Vector3i GetRegionIndex(const Vector3i& chunk, int& slot) const;
+
+		/// Returns nullptr, if the region does not exist and create is false.
+		RegionFile* GetRegion(const Vector3i& region, bool create);
+
+		/// Compress and write everything pending. Chunks, that could not be
+		/// written, are pending again afterwards. Returns false, if there was
+		/// nothing to do.
+		bool WritePending();
+
+	public:
+		/// Region files are kept in the given directory.
+		ChunkStore(const String& path, const Vector3d& chunkDimension);
+		~ChunkStore();
+
+		/// Write everything pending, stop the writer and close all regions.
+		void Close();
+
+		void ThreadFunction() override;
+
+		/// Queue the data of the chunk at the given position for saving. Main thread only.
+		void Save(const Vector3d& position, const VoxelStorage& storage);
+
+		/// Read the stored data of the chunk at the given position.
+		/// Returns false, if the chunk has never been saved.
+		bool Load(const Vector3d& position, VoxelStorage& storage);
+	};
+}
@@ -0,0 +1,554 @@
+#include "RegionFile.h"
+
+#include <cstddef>
+#include <cstring>
+
+#include "../../Container/Sort.h"
+#include "../../IO/Log.h"
+#include "../../Math/MathDefs.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace Urho3D
+{
+	/// "VXRG"
+	static const uint32_t REGION_MAGIC = 0x47525856;
+	static const uint32_t REGION_VERSION = 1;
+
+	struct RegionHeader
+	{
+		uint32_t mMagic;
+		uint32_t mVersion;
+		uint32_t mRegionSize;
+		uint32_t mSlotCount;
+	};
+
+	RegionFile::RegionFile() :
+		mEnd(0),
+#ifdef _WIN32
+		mFile(INVALID_HANDLE_VALUE),
+		mMapping(nullptr),
+#else
+		mFile(-1),
+#endif
+		mView(nullptr),
+		mMappedSize(0)
+	{
+	}
+
+	RegionFile::~RegionFile()
+	{
+		Close();
+	}
+
+	uint32_t RegionFile::GetHeaderSize()
+	{
+		return sizeof(RegionHeader) + SLOT_COUNT * sizeof(RegionEntry);
+	}
+
+	uint32_t RegionFile::GetChecksum(const RegionEntry& entry, const unsigned char* data)
+	{
+		uint32_t hash = 0;
+		const unsigned char* fields = reinterpret_cast<const unsigned char*>(&entry);
+		for (unsigned i = 0; i < offsetof(RegionEntry, mChecksum); i++)
+		{
+			hash = SDBMHash(hash, fields[i]);
+		}
+
+		for (uint32_t i = 0; i < entry.mSize; i++)
+		{
+			hash = SDBMHash(hash, data[i]);
+		}
+
+		return hash;
+	}
+
+	bool RegionFile::Open(const String& fileName)
+	{
+		Close();
+		mFileName = fileName;
+
+#ifdef _WIN32
+		mFile = CreateFileW(WString(fileName).CString(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, nullptr,
+			OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+		if (mFile == INVALID_HANDLE_VALUE)
+#else
+		mFile = open(fileName.CString(), O_RDWR | O_CREAT, 0644);
+		if (mFile < 0)
+#endif
+		{
+			URHO3D_LOGERROR("Could not open region file " + fileName);
+			return false;
+		}
+
+		mEntries.assign(SLOT_COUNT, RegionEntry{ 0, 0, 0, 0 });
+		mFree.clear();
+		mEnd = GetHeaderSize();
+
+		uint32_t fileSize = GetFileSize();
+		if (fileSize < GetHeaderSize())
+		{
+			/// New region, write an empty index.
+			RegionHeader header{ REGION_MAGIC, REGION_VERSION, REGION_SIZE, SLOT_COUNT };
+			if (!WriteAt(&header, sizeof(header), 0) ||
+				!WriteAt(mEntries.data(), SLOT_COUNT * sizeof(RegionEntry), sizeof(header)) ||
+				!Sync())
+			{
+				URHO3D_LOGERROR("Could not create region file " + fileName);
+				Close();
+				return false;
+			}
+
+			return true;
+		}
+
+		RegionHeader header;
+		if (!ReadAt(&header, sizeof(header), 0) ||
+			header.mMagic != REGION_MAGIC ||
+			header.mVersion != REGION_VERSION ||
+			header.mRegionSize != REGION_SIZE ||
+			header.mSlotCount != SLOT_COUNT)
+		{
+			URHO3D_LOGERROR("Invalid region file " + fileName);
+			Close();
+			return false;
+		}
+
+		if (!ReadAt(mEntries.data(), SLOT_COUNT * sizeof(RegionEntry), sizeof(header)))
+		{
+			URHO3D_LOGERROR("Could not read the index of region file " + fileName);
+			Close();
+			return false;
+		}
+
+		/// Everything not used by a valid entry is free space.
+		struct UsedExtent
+		{
+			uint32_t mOffset;
+			uint32_t mSize;
+			int mSlot;
+		};
+
+		PODVector<UsedExtent> used;
+		bool dropped = false;
+		for (int i = 0; i < SLOT_COUNT; i++)
+		{
+			RegionEntry& e = mEntries[i];
+			if (e.mSize == 0)
+			{
+				continue;
+			}
+
+			if (e.mOffset < GetHeaderSize() || e.mOffset + e.mSize > fileSize || e.mOffset + e.mSize < e.mOffset)
+			{
+				URHO3D_LOGWARNING("Dropping a damaged chunk entry of region file " + fileName);
+				e = RegionEntry{ 0, 0, 0, 0 };
+				dropped = true;
+				continue;
+			}
+
+			used.Push(UsedExtent{ e.mOffset, e.mSize, i });
+		}
+
+		Sort(used.Begin(), used.End(), [](const UsedExtent& lhs, const UsedExtent& rhs)
+		{
+			return lhs.mOffset < rhs.mOffset;
+		});
+
+		uint32_t position = GetHeaderSize();
+		for (unsigned i = 0; i < used.Size(); i++)
+		{
+			/// Entries sharing space would free each other's data on the
+			/// next write, keep only the first one.
+			if (used[i].mOffset < position)
+			{
+				URHO3D_LOGWARNING("Dropping an overlapping chunk entry of region file " + fileName);
+				mEntries[used[i].mSlot] = RegionEntry{ 0, 0, 0, 0 };
+				dropped = true;
+				continue;
+			}
+
+			if (used[i].mOffset > position)
+			{
+				mFree.push_back(Extent{ position, used[i].mOffset - position });
+			}
+
+			position = used[i].mOffset + used[i].mSize;
+		}
+
+		mEnd = position;
+
+		/// The space of dropped entries is reused, they must not come back
+		/// with the next open.
+		if (dropped && (!WriteAt(mEntries.data(), SLOT_COUNT * sizeof(RegionEntry), sizeof(header)) || !Sync()))
+		{
+			URHO3D_LOGWARNING("Could not remove the dropped chunk entries from region file " + fileName);
+		}
+
+		return true;
+	}
+
+	void RegionFile::Close()
+	{
+		Unmap();
+
+#ifdef _WIN32
+		if (mFile != INVALID_HANDLE_VALUE)
+		{
+			CloseHandle(mFile);
+			mFile = INVALID_HANDLE_VALUE;
+		}
+#else
+		if (mFile >= 0)
+		{
+			close(mFile);
+			mFile = -1;
+		}
+#endif
+	}
+
+	bool RegionFile::Exists(const String& fileName)
+	{
+#ifdef _WIN32
+		DWORD attributes = GetFileAttributesW(WString(fileName).CString());
+		return attributes != INVALID_FILE_ATTRIBUTES && (attributes & FILE_ATTRIBUTE_DIRECTORY) == 0;
+#else
+		struct stat info;
+		return stat(fileName.CString(), &info) == 0 && S_ISREG(info.st_mode);
+#endif
+	}
+
+	bool RegionFile::Read(int slot, PODVector<unsigned char>& data, unsigned& rawSize)
+	{
+		RegionEntry entry;
+		{
+			MutexLock lock(mLock);
+			entry = mEntries[slot];
+			if (entry.mSize == 0)
+			{
+				return false;
+			}
+
+			if (entry.mOffset + entry.mSize > mMappedSize && !Map(entry.mOffset + entry.mSize))
+			{
+				return false;
+			}
+
+			/// Copy under the lock, the mapping may be replaced once it is released.
+			data.Resize(entry.mSize);
+			memcpy(data.Buffer(), mView + entry.mOffset, entry.mSize);
+		}
+
+		if (GetChecksum(entry, data.Buffer()) != entry.mChecksum)
+		{
+			URHO3D_LOGERROR("Damaged chunk data in region file " + mFileName);
+			return false;
+		}
+
+		rawSize = entry.mRawSize;
+		return true;
+	}
+
+	bool RegionFile::Write(const eastl::vector<RegionWrite>& writes)
+	{
+		eastl::vector<RegionEntry> entries(writes.size());
+		{
+			MutexLock lock(mLock);
+			for (unsigned i = 0; i < writes.size(); i++)
+			{
+				entries[i].mSize = writes[i].mData.Size();
+				entries[i].mRawSize = writes[i].mRawSize;
+				entries[i].mOffset = Allocate(entries[i].mSize);
+			}
+		}
+
+		/// The new data has to be on disk, before any entry points to it.
+		bool ok = true;
+		for (unsigned i = 0; i < writes.size() && ok; i++)
+		{
+			entries[i].mChecksum = GetChecksum(entries[i], writes[i].mData.Buffer());
+			ok = WriteAt(writes[i].mData.Buffer(), entries[i].mSize, entries[i].mOffset);
+		}
+
+		if (!ok || !Sync())
+		{
+			URHO3D_LOGERROR("Could not write chunk data to region file " + mFileName);
+
+			MutexLock lock(mLock);
+			for (unsigned i = 0; i < entries.size(); i++)
+			{
+				Free(entries[i].mOffset, entries[i].mSize);
+			}
+
+			return false;
+		}
+
+		for (unsigned i = 0; i < writes.size() && ok; i++)
+		{
+			uint32_t position = sizeof(RegionHeader) + writes[i].mSlot * sizeof(RegionEntry);
+			ok = WriteAt(&entries[i], sizeof(RegionEntry), position);
+		}
+
+		if (!ok || !Sync())
+		{
+			/// Some entries might point to the new data already, so it is
+			/// neither freed nor published. Reopening the file sorts it out.
+			URHO3D_LOGERROR("Could not update the index of region file " + mFileName);
+			return false;
+		}
+
+		/// Only now the old data is not referenced anymore.
+		MutexLock lock(mLock);
+		for (unsigned i = 0; i < writes.size(); i++)
+		{
+			RegionEntry& e = mEntries[writes[i].mSlot];
+			if (e.mSize > 0)
+			{
+				Free(e.mOffset, e.mSize);
+			}
+
+			e = entries[i];
+		}
+
+		return true;
+	}
+
+	uint32_t RegionFile::Allocate(uint32_t size)
+	{
+		for (unsigned i = 0; i < mFree.size(); i++)
+		{
+			Extent& e = mFree[i];
+			if (e.mSize < size)
+			{
+				continue;
+			}
+
+			uint32_t offset = e.mOffset;
+			e.mOffset += size;
+			e.mSize -= size;
+			if (e.mSize == 0)
+			{
+				mFree.erase(mFree.begin() + i);
+			}
+
+			return offset;
+		}
+
+		uint32_t offset = mEnd;
+		mEnd += size;
+		return offset;
+	}
+
+	void RegionFile::Free(uint32_t offset, uint32_t size)
+	{
+		if (size == 0)
+		{
+			return;
+		}
+
+		unsigned i = 0;
+		while (i < mFree.size() && mFree[i].mOffset < offset)
+		{
+			i++;
+		}
+
+		mFree.insert(mFree.begin() + i, Extent{ offset, size });
+
+		/// Merge with the following and the previous extent.
+		if (i + 1 < mFree.size() && mFree[i].mOffset + mFree[i].mSize == mFree[i + 1].mOffset)
+		{
+			mFree[i].mSize += mFree[i + 1].mSize;
+			mFree.erase(mFree.begin() + i + 1);
+		}
+
+		if (i > 0 && mFree[i - 1].mOffset + mFree[i - 1].mSize == mFree[i].mOffset)
+		{
+			mFree[i - 1].mSize += mFree[i].mSize;
+			mFree.erase(mFree.begin() + i);
+			i--;
+		}
+
+		/// Space at the end is simply appended to again.
+		if (mFree[i].mOffset + mFree[i].mSize == mEnd)
+		{
+			mEnd = mFree[i].mOffset;
+			mFree.erase(mFree.begin() + i);
+		}
+	}
+
+#ifdef _WIN32
+	bool RegionFile::Map(uint32_t size)
+	{
+		Unmap();
+
+		uint32_t fileSize = GetFileSize();
+		if (fileSize < size)
+		{
+			return false;
+		}
+
+		mMapping = CreateFileMappingW(mFile, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		if (mMapping == nullptr)
+		{
+			URHO3D_LOGERROR("Could not map region file " + mFileName);
+			return false;
+		}
+
+		mView = (unsigned char*) MapViewOfFile(mMapping, FILE_MAP_READ, 0, 0, 0);
+		if (mView == nullptr)
+		{
+			URHO3D_LOGERROR("Could not map region file " + mFileName);
+			Unmap();
+			return false;
+		}
+
+		mMappedSize = fileSize;
+		return true;
+	}
+
+	void RegionFile::Unmap()
+	{
+		if (mView != nullptr)
+		{
+			UnmapViewOfFile(mView);
+			mView = nullptr;
+		}
+
+		if (mMapping != nullptr)
+		{
+			CloseHandle(mMapping);
+			mMapping = nullptr;
+		}
+
+		mMappedSize = 0;
+	}
+
+	bool RegionFile::ReadAt(void* data, uint32_t size, uint32_t offset)
+	{
+		OVERLAPPED overlapped = {};
+		overlapped.Offset = offset;
+
+		DWORD read = 0;
+		return ReadFile(mFile, data, size, &read, &overlapped) && read == size;
+	}
+
+	bool RegionFile::WriteAt(const void* data, uint32_t size, uint32_t offset)
+	{
+		OVERLAPPED overlapped = {};
+		overlapped.Offset = offset;
+
+		DWORD written = 0;
+		return WriteFile(mFile, data, size, &written, &overlapped) && written == size;
+	}
+
+	bool RegionFile::Sync()
+	{
+		return FlushFileBuffers(mFile) != 0;
+	}
+
+	uint32_t RegionFile::GetFileSize()
+	{
+		LARGE_INTEGER size;
+		if (!GetFileSizeEx(mFile, &size))
+		{
+			return 0;
+		}
+
+		return (uint32_t) size.QuadPart;
+	}
+#else
+	bool RegionFile::Map(uint32_t size)
+	{
+		Unmap();
+
+		uint32_t fileSize = GetFileSize();
+		if (fileSize < size)
+		{
+			return false;
+		}
+
+		void* view = mmap(nullptr, fileSize, PROT_READ, MAP_SHARED, mFile, 0);
+		if (view == MAP_FAILED)
+		{
+			URHO3D_LOGERROR("Could not map region file " + mFileName);
+			return false;
+		}
+
+		mView = (unsigned char*) view;
+		mMappedSize = fileSize;
+		return true;
+	}
+
+	void RegionFile::Unmap()
+	{
+		if (mView != nullptr)
+		{
+			munmap(mView, mMappedSize);
+			mView = nullptr;
+		}
+
+		mMappedSize = 0;
+	}
+
+	bool RegionFile::ReadAt(void* data, uint32_t size, uint32_t offset)
+	{
+		unsigned char* bytes = (unsigned char*) data;
+		while (size > 0)
+		{
+			ssize_t read = pread(mFile, bytes, size, offset);
+			if (read <= 0)
+			{
+				return false;
+			}
+
+			bytes += read;
+			size -= (uint32_t) read;
+			offset += (uint32_t) read;
+		}
+
+		return true;
+	}
+
+	bool RegionFile::WriteAt(const void* data, uint32_t size, uint32_t offset)
+	{
+		const unsigned char* bytes = (const unsigned char*) data;
+		while (size > 0)
+		{
+			ssize_t written = pwrite(mFile, bytes, size, offset);
+			if (written <= 0)
+			{
+				return false;
+			}
+
+			bytes += written;
+			size -= (uint32_t) written;
+			offset += (uint32_t) written;
+		}
+
+		return true;
+	}
+
+	bool RegionFile::Sync()
+	{
+		return fsync(mFile) == 0;
+	}
+
+	uint32_t RegionFile::GetFileSize()
+	{
+		struct stat info;
+		if (fstat(mFile, &info) != 0)
+		{
+			return 0;
+		}
+
+		return (uint32_t) info.st_size;
+	}
+#endif
+}
@@ -0,0 +1,115 @@
+#pragma once
+
+#include <inttypes.h>
+#include <EASTL/vector.h>
+
+#include "../../Container/Str.h"
+#include "../../Container/Vector.h"
+#include "../../Core/Mutex.h"
+
+namespace Urho3D
+{
+	/// Location of a single chunk inside a region file.
+	struct RegionEntry
+	{
+		uint32_t mOffset;
+		uint32_t mSize;
+
+		/// Size of the data after decompression.
+		uint32_t mRawSize;
+
+		/// Covers the fields above and the data, a torn write never passes.
+		uint32_t mChecksum;
+	};
+
+	/// Chunk data to be written to a region file.
+	struct RegionWrite
+	{
+		int mSlot;
+		PODVector<unsigned char> mData;
+		unsigned mRawSize;
+	};
+
+	/// A file holding the chunks of a REGION_SIZE^3 block.
+	///
+	/// The file starts with an index of all slots, followed by the chunk data.
+	/// Data is read through a memory mapping of the file. Writes never touch
+	/// data an entry points to: new data goes into free space, which is made
+	/// durable before the entry is updated. The old space is freed afterwards.
+	/// After a crash each slot either has its old or its new data.
+	class RegionFile
+	{
+	public:
+		static const int REGION_SIZE = 16;
+		static const int SLOT_COUNT = REGION_SIZE * REGION_SIZE * REGION_SIZE;
+
+	private:
+		struct Extent
+		{
+			uint32_t mOffset;
+			uint32_t mSize;
+		};
+
+		/// Guards the entries, the free space and the mapping.
+		Mutex mLock;
+
+		String mFileName;
+		eastl::vector<RegionEntry> mEntries;
+
+		/// Unused space between the chunks, ordered by offset.
+		eastl::vector<Extent> mFree;
+
+		/// End of the used part of the file.
+		uint32_t mEnd;
+
+#ifdef _WIN32
+		void* mFile;
+		void* mMapping;
+#else
+		int mFile;
+#endif
+		unsigned char* mView;
+		uint32_t mMappedSize;
+
+		uint32_t Allocate(uint32_t size);
+		void Free(uint32_t offset, uint32_t size);
+
+		/// Map at least the given number of bytes. Requires mLock.
+		bool Map(uint32_t size);
+		void Unmap();
+
+		bool ReadAt(void* data, uint32_t size, uint32_t offset);
+		bool WriteAt(const void* data, uint32_t size, uint32_t offset);
+		bool Sync();
+		uint32_t GetFileSize();
+
+		static uint32_t GetHeaderSize();
+		static uint32_t GetChecksum(const RegionEntry& entry, const unsigned char* data);
+
+	public:
+		RegionFile();
+		~RegionFile();
+
+		RegionFile(const RegionFile&) = delete;
+		RegionFile& operator =(const RegionFile&) = delete;
+
+		/// Open the file or create an empty region.
+		bool Open(const String& fileName);
+		void Close();
+
+		/// Copy the compressed data of a slot. Thread safe.
+		bool Read(int slot, PODVector<unsigned char>& data, unsigned& rawSize);
+
+		/// Store the given chunks. Syncs twice per batch, not per chunk.
+		/// Must only be called from one thread at a time.
+		bool Write(const eastl::vector<RegionWrite>& writes);
+
+		/// True, if the given region file exists. Opening would create it.
+		static bool Exists(const String& fileName);
+
+		static int GetSlot(int x, int y, int z)
+		{
+			return (z * REGION_SIZE + y) * REGION_SIZE + x;
+		}
+	};
+}
@@ -1,76 +1,379 @@
 #pragma once
 
 #include <atomic>
-#include <functional>
+#include <new>
+#include <type_traits>
+#include <utility>
 
-#include "../Core/Timer.h"
-#include "../IO/Log.h"
+#include "../../Container/Ptr.h"
+#include "../../Container/Vector.h"
+#include "../../Core/Mutex.h"
 
 namespace Urho3D
 {
+	struct Task;
+
+	/// Type erased void(void*) callable, that is stored inside the task
+	/// itself. Never allocates, captures must fit into STORAGE_SIZE bytes.
+	class TaskFunction
+	{
+	public:
+		static const unsigned STORAGE_SIZE = 48;
+
+	private:
+		alignas(16) unsigned char mStorage[STORAGE_SIZE];
+		void(*mInvoke)(void* storage, void* data);
+		void(*mDestroy)(void* storage);
+
+		template<class F>
+		static void InvokeImpl(void* storage, void* data)
+		{
+			(*reinterpret_cast<F*>(storage))(data);
+		}
+
+		template<class F>
+		static void DestroyImpl(void* storage)
+		{
+			reinterpret_cast<F*>(storage)->~F();
+		}
+
+	public:
+		TaskFunction() :
+			mInvoke(nullptr),
+			mDestroy(nullptr)
+		{
+		}
+
+		~TaskFunction()
+		{
+			Reset();
+		}
+
+		TaskFunction(const TaskFunction&) = delete;
+		TaskFunction& operator =(const TaskFunction&) = delete;
+
+		template<class F>
+		void Set(F&& func)
+		{
+			using Fn = typename std::decay<F>::type;
+			static_assert(sizeof(Fn) <= STORAGE_SIZE, "Task closure too large, pass the captured state through the data pointer instead.");
+			static_assert(alignof(Fn) <= 16, "Task closure alignment not supported.");
+
+			Reset();
+			new (mStorage) Fn(std::forward<F>(func));
+			mInvoke = &InvokeImpl<Fn>;
+			mDestroy = &DestroyImpl<Fn>;
+		}
+
+		void Reset()
+		{
+			if (mDestroy != nullptr)
+			{
+				mDestroy(mStorage);
+			}
+
+			mInvoke = nullptr;
+			mDestroy = nullptr;
+		}
+
+		void operator()(void* data)
+		{
+			mInvoke(mStorage, data);
+		}
+
+		explicit operator bool() const
+		{
+			return mInvoke != nullptr;
+		}
+	};
+
+	/// Counts the unfinished tasks of a batch. Tasks can declare a counter
+	/// as their parent, in which case they are kept aside until the counter
+	/// drops to zero and are only then handed to the workers.
+	class TaskCounter
+	{
+	private:
+		/// Number of unfinished tasks in this batch.
+		std::atomic<int> mCount;
+
+		/// Guards the list of waiting tasks.
+		Mutex mLock;
+
+		/// Tasks waiting for this counter to reach zero.
+		PODVector<Task*> mWaiting;
+
+	public:
+		TaskCounter()
+		{
+			mCount.store(0);
+		}
+
+		/// Called whenever a task is added to this batch.
+		void Increment()
+		{
+			++mCount;
+		}
+
+		/// Called by the task system once a task of this batch has finished.
+		/// If this was the last one, the waiting tasks are moved to released.
+		/// Returns true if the counter reached zero.
+		bool Decrement(PODVector<Task*>& released)
+		{
+			if (--mCount > 0)
+			{
+				return false;
+			}
+
+			MutexLock lock(mLock);
+			released.Push(mWaiting);
+			mWaiting.Clear();
+
+			return true;
+		}
+
+		/// Register a task that must not run before this counter is zero.
+		/// Returns false, if the counter is already zero and the task need not wait.
+		bool AddWaiting(Task* t)
+		{
+			MutexLock lock(mLock);
+			if (mCount.load() < 1)
+			{
+				return false;
+			}
+
+			mWaiting.Push(t);
+			return true;
+		}
+
+		int GetCount() const
+		{
+			return mCount.load();
+		}
+
+		/// True, if every task of this batch has been executed.
+		bool IsDone() const
+		{
+			return mCount.load() < 1;
+		}
+	};
+
 	struct Task
 	{
 	protected:
 		/// Counter this task should update
-		std::atomic<int>* mCounter;
+		TaskCounter* mCounter;
 
-		/// This should only start if the counter is zero.
-		std::atomic<int>* mDependency;
-
-		/// True, if the task has finished
-		std::atomic<bool> mFinished;
+		/// Number of parents that have not finished yet plus one,
+		/// which is released when the task gets submitted.
+		std::atomic<int> mPending;
 
 	public:
 		/// Code to execute
-		std::function<void(void*)> Function;
+		TaskFunction Function;
 		void* Data;
 
-		Task(std::atomic<int>* counter, std::atomic<int>* dependency)
+		Task()
+		{
+			mCounter = nullptr;
+			mPending.store(0);
+			Data = nullptr;
+		}
+
+		/// Prepare a pooled task for its next use.
+		void Reset(TaskCounter* counter)
 		{
 			mCounter = counter;
-			if(mCounter != nullptr) ++mCounter;
+			if (mCounter != nullptr)
+			{
+				mCounter->Increment();
+			}
 
-			mDependency = dependency;
-			mFinished.store(false);
-			Function = nullptr;
+			mPending.store(1);
+			Function.Reset();
 			Data = nullptr;
 		}
 
-		bool CanExecute()
+		TaskCounter* GetCounter() const
 		{
-			/*if (mDependency != nullptr)
+			return mCounter;
+		}
+
+		/// Declare a parent. Must be called before the task is submitted.
+		void DependsOn(TaskCounter* parent)
+		{
+			if (parent == nullptr)
 			{
-				int tasks = mDependency->load();
-				URHO3D_LOGDEBUGF("Dependencies: %d", tasks);
+				return;
 			}
-			if (mCounter != nullptr)
+
+			++mPending;
+			if (!parent->AddWaiting(this))
 			{
-				int count = mCounter->load();
-				URHO3D_LOGDEBUGF("Bulk Count: %d", count);
-			}*/
-			return
-				mDependency == nullptr ||
-				mDependency->load() < 1;
+				--mPending;
+			}
+		}
+
+		/// Release one pending parent (or the submission itself).
+		/// Returns true if the task just became runnable.
+		bool Release()
+		{
+			return --mPending == 0;
 		}
 
 		void Execute()
 		{
 			Function(Data);
-			if (mCounter != nullptr)
+		}
+	};
+
+	/// Runnable tasks owned by a single thread. The owner pushes and pops
+	/// at the back, idle threads steal from the front. Implemented as a
+	/// ring buffer, which only grows and never frees while in use.
+	class TaskDeque : public RefCounted
+	{
+	private:
+		Mutex mLock;
+		PODVector<Task*> mBuffer;
+		unsigned mHead;
+		unsigned mCount;
+
+		void Grow()
+		{
+			unsigned capacity = mBuffer.Size();
+			PODVector<Task*> buffer(capacity > 0 ? capacity * 2 : 64);
+			for (unsigned i = 0; i < mCount; i++)
+			{
+				buffer[i] = mBuffer[(mHead + i) % capacity];
+			}
+
+			mBuffer.Swap(buffer);
+			mHead = 0;
+		}
+
+	public:
+		TaskDeque() :
+			mHead(0),
+			mCount(0)
+		{
+		}
+
+		void Push(Task* t)
+		{
+			MutexLock lock(mLock);
+			if (mCount == mBuffer.Size())
 			{
-				--mCounter;
+				Grow();
 			}
 
-			mFinished.store(true);
+			mBuffer[(mHead + mCount) % mBuffer.Size()] = t;
+			mCount++;
 		}
 
-		/// Make sure the task has been finished.
-		void Complete()
+		/// Push a number of tasks under a single lock.
+		void Push(Task* const* tasks, unsigned count)
 		{
-			while (!mFinished.load())
+			MutexLock lock(mLock);
+			while (mCount + count > mBuffer.Size())
 			{
-				Time::Sleep(0);
+				Grow();
 			}
+
+			for (unsigned i = 0; i < count; i++)
+			{
+				mBuffer[(mHead + mCount) % mBuffer.Size()] = tasks[i];
+				mCount++;
+			}
+		}
+
+		/// Take the most recently added task. Used by the owning thread.
+		Task* Pop()
+		{
+			MutexLock lock(mLock);
+			if (mCount == 0)
+			{
+				return nullptr;
+			}
+
+			mCount--;
+			return mBuffer[(mHead + mCount) % mBuffer.Size()];
+		}
+
+		/// Take the oldest task. Used by other threads.
+		Task* Steal()
+		{
+			MutexLock lock(mLock);
+			if (mCount == 0)
+			{
+				return nullptr;
+			}
+
+			Task* t = mBuffer[mHead];
+			mHead = (mHead + 1) % mBuffer.Size();
+			mCount--;
+			return t;
+		}
+	};
+
+	/// Recycles task objects, so submitting a task does not allocate once
+	/// the pool has grown to the number of tasks in flight. Tasks are
+	/// allocated in blocks, which are only freed with the pool.
+	class TaskPool
+	{
+	public:
+		static const unsigned BLOCK_SIZE = 256;
+
+	private:
+		Mutex mLock;
+		PODVector<Task*> mFree;
+		PODVector<Task*> mBlocks;
+
+	public:
+		TaskPool() = default;
+
+		~TaskPool()
+		{
+			for (unsigned i = 0; i < mBlocks.Size(); i++)
+			{
+				delete[] mBlocks[i];
+			}
+		}
+
+		TaskPool(const TaskPool&) = delete;
+		TaskPool& operator =(const TaskPool&) = delete;
+
+		Task* Acquire()
+		{
+			MutexLock lock(mLock);
+			if (mFree.Empty())
+			{
+				Task* block = new Task[BLOCK_SIZE];
+				mBlocks.Push(block);
+				mFree.Reserve(mBlocks.Size() * BLOCK_SIZE);
+				for (unsigned i = 0; i < BLOCK_SIZE; i++)
+				{
+					mFree.Push(&block[i]);
+				}
+			}
+
+			Task* t = mFree.Back();
+			mFree.Pop();
+			return t;
+		}
+
+		void Release(Task* t)
+		{
+			/// Destroy the captures right away, not when the task is reused.
+			t->Function.Reset();
+			t->Data = nullptr;
+
+			MutexLock lock(mLock);
+			mFree.Push(t);
+		}
+
+		/// Number of tasks the pool has allocated so far.
+		unsigned GetCapacity() const
+		{
+			return mBlocks.Size() * BLOCK_SIZE;
 		}
 	};
-}
\ No newline at end of file
+}
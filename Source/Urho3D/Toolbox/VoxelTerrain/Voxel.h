@@ -7,11 +7,21 @@ namespace Urho3D
 {
 	struct Voxel
 	{
-		int16_t mId;
-		int8_t mHitpoints;
-		int mAttributes;
+		int16_t mId = 0;
+		int8_t mHitpoints = 0;
+		int mAttributes = 0;
 
 	public:
+		bool operator ==(const Voxel& rhs) const
+		{
+			return mId == rhs.mId && mHitpoints == rhs.mHitpoints && mAttributes == rhs.mAttributes;
+		}
+
+		bool operator !=(const Voxel& rhs) const
+		{
+			return !(*this == rhs);
+		}
+
 		int GetId()
 		{
 			return mId;
@@ -54,7 +64,7 @@ namespace Urho3D
 		void SetTransparent(bool value)
 		{
 			if (value)
-				mAttributes ^= 1 << 0;
+				mAttributes |= 1 << 0;
 			else
 				mAttributes &= ~(1 << 0);
 		}
@@ -67,7 +77,7 @@ namespace Urho3D
 		void SetBlock(bool value)
 		{
 			if (value)
-				mAttributes ^= 1 << 1;
+				mAttributes |= 1 << 1;
 			else
 				mAttributes &= ~(1 << 1);
 		}
@@ -80,7 +90,7 @@ namespace Urho3D
 		void SetModel(bool value)
 		{
 			if (value)
-				mAttributes ^= 1 << 2;
+				mAttributes |= 1 << 2;
 			else
 				mAttributes &= ~(1 << 2);
 		}
@@ -0,0 +1,212 @@
+#ifdef URHO3D_PHYSICS
+
+#include "VoxelCollisionShape.h"
+
+#include "../../Core/Context.h"
+#include "../../Physics/PhysicsUtils.h"
+
+#include <Bullet/BulletCollision/CollisionShapes/btConcaveShape.h>
+#include <Bullet/BulletCollision/CollisionShapes/btTriangleCallback.h>
+#include <Bullet/LinearMath/btAabbUtil2.h>
+
+namespace Urho3D
+{
+	/// Outward direction of the six faces of a voxel box.
+	static const int FACE_NORMALS[6][3] =
+	{
+		{ 1, 0, 0 }, { -1, 0, 0 },
+		{ 0, 1, 0 }, { 0, -1, 0 },
+		{ 0, 0, 1 }, { 0, 0, -1 }
+	};
+
+	/// Corners of the faces in half voxels from the center of the box.
+	static const int FACE_CORNERS[6][4][3] =
+	{
+		{ { 1, -1, -1 }, { 1, 1, -1 }, { 1, 1, 1 }, { 1, -1, 1 } },
+		{ { -1, -1, -1 }, { -1, -1, 1 }, { -1, 1, 1 }, { -1, 1, -1 } },
+		{ { -1, 1, -1 }, { -1, 1, 1 }, { 1, 1, 1 }, { 1, 1, -1 } },
+		{ { -1, -1, -1 }, { 1, -1, -1 }, { 1, -1, 1 }, { -1, -1, 1 } },
+		{ { -1, -1, 1 }, { 1, -1, 1 }, { 1, 1, 1 }, { -1, 1, 1 } },
+		{ { -1, -1, -1 }, { -1, 1, -1 }, { 1, 1, -1 }, { 1, -1, -1 } }
+	};
+
+	/// Same voxels the mesher treats as solid.
+	static bool IsSolidVoxel(Voxel voxel)
+	{
+		return !voxel.IsTransparent() && !voxel.IsAir() && !voxel.IsModel();
+	}
+
+	/// Voxel i is a box of one voxel size around i * voxel size, which is
+	/// where the mesher puts the surface between a solid and an empty voxel.
+	ATTRIBUTE_ALIGNED16(class) VoxelConcaveShape : public btConcaveShape
+	{
+	public:
+		BT_DECLARE_ALIGNED_ALLOCATOR();
+
+		VoxelConcaveShape(Chunk* chunk) :
+			mScaling(1.0f, 1.0f, 1.0f)
+		{
+			m_shapeType = CUSTOM_CONCAVE_SHAPE_TYPE;
+			SetChunk(chunk);
+		}
+
+		void SetChunk(Chunk* chunk)
+		{
+			mChunk = chunk;
+			if (chunk != nullptr)
+			{
+				mIndex = chunk->GetChunkIndex();
+			}
+		}
+
+		void getAabb(const btTransform& t, btVector3& aabbMin, btVector3& aabbMax) const override
+		{
+			btVector3 localMin(0.0f, 0.0f, 0.0f);
+			btVector3 localMax(0.0f, 0.0f, 0.0f);
+			if (mChunk != nullptr)
+			{
+				auto& layout = mChunk->GetVoxelLayout();
+				btVector3 size = mScaling * mChunk->GetVoxelSize();
+				localMin = size * -0.5f;
+				localMax = btVector3(layout.x - 0.5f, layout.y - 0.5f, layout.z - 0.5f) * size;
+			}
+
+			btTransformAabb(localMin, localMax, getMargin(), t, aabbMin, aabbMax);
+		}
+
+		void processAllTriangles(btTriangleCallback* callback, const btVector3& aabbMin, const btVector3& aabbMax) const override
+		{
+			/// Reset for another position or not ready yet.
+			if (mChunk == nullptr || !mChunk->Initialized() || mChunk->GetChunkIndex() != mIndex)
+			{
+				return;
+			}
+
+			auto& layout = mChunk->GetVoxelLayout();
+			btVector3 size = mScaling * mChunk->GetVoxelSize();
+
+			/// Clamped as floats, debug drawing queries everything.
+			int x0 = (int) Max(std::ceil(aabbMin.x() / size.x() - 0.5f), 0.0f);
+			int y0 = (int) Max(std::ceil(aabbMin.y() / size.y() - 0.5f), 0.0f);
+			int z0 = (int) Max(std::ceil(aabbMin.z() / size.z() - 0.5f), 0.0f);
+			int x1 = (int) Min(std::floor(aabbMax.x() / size.x() + 0.5f), (float) (layout.x - 1));
+			int y1 = (int) Min(std::floor(aabbMax.y() / size.y() + 0.5f), (float) (layout.y - 1));
+			int z1 = (int) Min(std::floor(aabbMax.z() / size.z() + 0.5f), (float) (layout.z - 1));
+
+			btVector3 corners[4];
+			btVector3 triangle[3];
+			for (int z = z0; z <= z1; z++)
+			{
+				for (int y = y0; y <= y1; y++)
+				{
+					for (int x = x0; x <= x1; x++)
+					{
+						Voxel voxel;
+						if (!mChunk->TryGet(x, y, z, voxel) || !IsSolidVoxel(voxel))
+						{
+							continue;
+						}
+
+						btVector3 center = btVector3((float) x, (float) y, (float) z) * size;
+						int id = ((z * layout.y + y) * layout.x + x) * 12;
+						for (int f = 0; f < 6; f++)
+						{
+							/// Faces towards chunks, that are not loaded, are left out.
+							Voxel next;
+							if (!mChunk->TryGet(x + FACE_NORMALS[f][0], y + FACE_NORMALS[f][1], z + FACE_NORMALS[f][2], next) ||
+								IsSolidVoxel(next))
+							{
+								continue;
+							}
+
+							for (int c = 0; c < 4; c++)
+							{
+								corners[c] = center + btVector3(
+									FACE_CORNERS[f][c][0] * 0.5f,
+									FACE_CORNERS[f][c][1] * 0.5f,
+									FACE_CORNERS[f][c][2] * 0.5f) * size;
+							}
+
+							triangle[0] = corners[0];
+							triangle[1] = corners[1];
+							triangle[2] = corners[2];
+							callback->processTriangle(triangle, 0, id + f * 2);
+
+							triangle[1] = corners[2];
+							triangle[2] = corners[3];
+							callback->processTriangle(triangle, 0, id + f * 2 + 1);
+						}
+					}
+				}
+			}
+		}
+
+		void calculateLocalInertia(btScalar mass, btVector3& inertia) const override
+		{
+			/// Static only.
+			inertia.setValue(0.0f, 0.0f, 0.0f);
+		}
+
+		void setLocalScaling(const btVector3& scaling) override
+		{
+			mScaling = scaling;
+		}
+
+		const btVector3& getLocalScaling() const override
+		{
+			return mScaling;
+		}
+
+		const char* getName() const override
+		{
+			return "Voxels";
+		}
+
+	private:
+		btVector3 mScaling;
+		Chunk* mChunk;
+		Vector3i mIndex;
+	};
+
+	VoxelCollisionShape::VoxelCollisionShape(Context* ctx) :
+		CollisionShape(ctx),
+		mChunk(nullptr)
+	{
+	}
+
+	void VoxelCollisionShape::RegisterObject(Context* ctx)
+	{
+		/// No attributes, the shape is created at runtime and never saved.
+		ctx->RegisterFactory<VoxelCollisionShape>();
+	}
+
+	void VoxelCollisionShape::SetChunk(Chunk* chunk)
+	{
+		mChunk = chunk;
+
+		auto shape = static_cast<VoxelConcaveShape*>(GetCollisionShape());
+		if (GetShapeType() == SHAPE_VOXELS && shape != nullptr)
+		{
+			shape->SetChunk(chunk);
+			NotifyRigidBody();
+			return;
+		}
+
+		SetShapeType((ShapeType) SHAPE_VOXELS);
+	}
+
+	btCollisionShape* VoxelCollisionShape::UpdateDerivedShape(int shapeType, const Vector3& newWorldScale)
+	{
+		if (shapeType != SHAPE_VOXELS)
+		{
+			return nullptr;
+		}
+
+		auto shape = new VoxelConcaveShape(mChunk);
+		shape->setLocalScaling(ToBtVector3(newWorldScale));
+
+		return shape;
+	}
+}
+
+#endif
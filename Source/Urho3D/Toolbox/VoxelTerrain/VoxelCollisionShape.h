@@ -0,0 +1,46 @@
+#pragma once
+
+#ifdef URHO3D_PHYSICS
+
+#include "../../Physics/CollisionShape.h"
+
+#include "Chunk.h"
+
+namespace Urho3D
+{
+	/// Collision shape reading the voxels of a chunk directly.
+	///
+	/// The Bullet shape creates the faces between solid and empty voxels
+	/// only for the region a query asks for, nothing is cached. Edits are
+	/// seen right away, there is no triangle mesh to rebuild. The node must
+	/// sit at the world position of the chunk.
+	class VoxelCollisionShape : public CollisionShape
+	{
+		URHO3D_OBJECT(VoxelCollisionShape, CollisionShape)
+
+	public:
+		/// Shape type handed to CollisionShape, after the built in ones.
+		static const int SHAPE_VOXELS = 100;
+
+		VoxelCollisionShape(Context* ctx);
+
+		static void RegisterObject(Context* ctx);
+
+		/// Collide with the given chunk. Queries fail silently, once the
+		/// chunk has been reset for another position.
+		void SetChunk(Chunk* chunk);
+
+		Chunk* GetChunk() const
+		{
+			return mChunk;
+		}
+
+	protected:
+		btCollisionShape* UpdateDerivedShape(int shapeType, const Vector3& newWorldScale) override;
+
+	private:
+		Chunk* mChunk;
+	};
+}
+
+#endif
@@ -0,0 +1,168 @@
+#include "VoxelDeltaMap.h"
+
+namespace Urho3D
+{
+	VoxelDeltaMap::VoxelDeltaMap() :
+		mRevision(0),
+		mTrackChanges(false)
+	{
+	}
+
+	void VoxelDeltaMap::SetLocked(ChunkDeltas& chunk, uint32_t index, const Voxel& voxel)
+	{
+		auto it = chunk.mSlots.find(index);
+		if (it != chunk.mSlots.end())
+		{
+			VoxelDelta& delta = chunk.mDeltas[it->second];
+			if (delta.mVoxel == voxel)
+			{
+				return;
+			}
+
+			delta.mVoxel = voxel;
+			delta.mRevision = ++mRevision;
+		}
+		else
+		{
+			chunk.mSlots[index] = (unsigned) chunk.mDeltas.size();
+			chunk.mDeltas.push_back(VoxelDelta{ index, voxel, ++mRevision });
+		}
+
+		chunk.mRevision = mRevision;
+	}
+
+	void VoxelDeltaMap::MarkChanged(const Vector3i& index, ChunkDeltas& chunk)
+	{
+		if (mTrackChanges && !chunk.mChanged)
+		{
+			chunk.mChanged = true;
+			mChanged.push_back(index);
+		}
+	}
+
+	void VoxelDeltaMap::Set(const Vector3i& chunk, uint32_t index, const Voxel& voxel)
+	{
+		MutexLock lock(mLock);
+		auto it = mChunks.find(chunk);
+		if (it == mChunks.end())
+		{
+			it = mChunks.insert(eastl::pair<Vector3i, ChunkDeltas>(chunk, ChunkDeltas{ {}, {}, 0, false })).first;
+		}
+
+		unsigned revision = it->second.mRevision;
+		SetLocked(it->second, index, voxel);
+		if (it->second.mRevision != revision)
+		{
+			MarkChanged(chunk, it->second);
+		}
+	}
+
+	void VoxelDeltaMap::Merge(const Vector3i& chunk, const eastl::vector<VoxelDelta>& deltas)
+	{
+		MutexLock lock(mLock);
+		auto it = mChunks.find(chunk);
+		if (it == mChunks.end())
+		{
+			it = mChunks.insert(eastl::pair<Vector3i, ChunkDeltas>(chunk, ChunkDeltas{ {}, {}, 0, false })).first;
+		}
+
+		unsigned revision = it->second.mRevision;
+		for (unsigned i = 0; i < deltas.size(); i++)
+		{
+			SetLocked(it->second, deltas[i].mIndex, deltas[i].mVoxel);
+		}
+
+		if (it->second.mRevision != revision)
+		{
+			MarkChanged(chunk, it->second);
+		}
+	}
+
+	bool VoxelDeltaMap::Contains(const Vector3i& chunk) const
+	{
+		MutexLock lock(mLock);
+		return mChunks.find(chunk) != mChunks.end();
+	}
+
+	unsigned VoxelDeltaMap::Get(const Vector3i& chunk, unsigned since, eastl::vector<VoxelDelta>& result) const
+	{
+		MutexLock lock(mLock);
+		auto it = mChunks.find(chunk);
+		if (it == mChunks.end())
+		{
+			return 0;
+		}
+
+		const eastl::vector<VoxelDelta>& deltas = it->second.mDeltas;
+		for (unsigned i = 0; i < deltas.size(); i++)
+		{
+			if (deltas[i].mRevision > since)
+			{
+				result.push_back(deltas[i]);
+			}
+		}
+
+		return it->second.mRevision;
+	}
+
+	unsigned VoxelDeltaMap::GetRevision(const Vector3i& chunk) const
+	{
+		MutexLock lock(mLock);
+		auto it = mChunks.find(chunk);
+
+		return it != mChunks.end() ? it->second.mRevision : 0;
+	}
+
+	unsigned VoxelDeltaMap::GetRevision() const
+	{
+		MutexLock lock(mLock);
+		return mRevision;
+	}
+
+	void VoxelDeltaMap::SetTrackChanges(bool value)
+	{
+		MutexLock lock(mLock);
+		mTrackChanges = value;
+	}
+
+	void VoxelDeltaMap::TakeChanged(eastl::vector<Vector3i>& result)
+	{
+		MutexLock lock(mLock);
+		for (unsigned i = 0; i < mChanged.size(); i++)
+		{
+			auto it = mChunks.find(mChanged[i]);
+			if (it != mChunks.end())
+			{
+				it->second.mChanged = false;
+			}
+
+			result.push_back(mChanged[i]);
+		}
+
+		mChanged.clear();
+	}
+
+	void VoxelDeltaMap::Clear()
+	{
+		MutexLock lock(mLock);
+		mChunks.clear();
+		mChanged.clear();
+	}
+
+	void VoxelDeltaMap::WriteVoxel(Serializer& dest, const Voxel& voxel)
+	{
+		dest.WriteShort(voxel.mId);
+		dest.WriteByte(voxel.mHitpoints);
+		dest.WriteInt(voxel.mAttributes);
+	}
+
+	Voxel VoxelDeltaMap::ReadVoxel(Deserializer& source)
+	{
+		Voxel voxel;
+		voxel.mId = source.ReadShort();
+		voxel.mHitpoints = source.ReadByte();
+		voxel.mAttributes = source.ReadInt();
+
+		return voxel;
+	}
+}
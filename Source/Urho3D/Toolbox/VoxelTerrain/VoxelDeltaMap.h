@@ -0,0 +1,103 @@
+#pragma once
+
+#include <inttypes.h>
+#include <EASTL/vector.h>
+#include <EASTL/unordered_map.h>
+
+#include "../../Container/RefCounted.h"
+#include "../../Core/Mutex.h"
+#include "../../IO/Deserializer.h"
+#include "../../IO/Serializer.h"
+#include "../../Math/Vector3i.h"
+
+#include "Voxel.h"
+
+namespace Urho3D
+{
+	/// A voxel, that differs from the generated terrain.
+	struct VoxelDelta
+	{
+		/// Index of the voxel in the full resolution layout of its chunk.
+		uint32_t mIndex;
+		Voxel mVoxel;
+
+		/// Revision of the map, when the voxel was last changed.
+		unsigned mRevision;
+	};
+
+	/// Changes against the generated terrain, per chunk.
+	///
+	/// Generation is deterministic, so the generator and these differences
+	/// reproduce the current voxels of any chunk. Chunks apply them after
+	/// generating, edits survive despawning this way. A server sends them to
+	/// its clients, which generate the terrain on their own. Every change gets
+	/// a new revision, so only the voxels changed since a given revision need
+	/// to be sent. Thread safe, the initialization tasks read the map.
+	class VoxelDeltaMap : public RefCounted
+	{
+	private:
+		struct ChunkDeltas
+		{
+			/// Position in mDeltas by voxel index.
+			eastl::unordered_map<uint32_t, unsigned> mSlots;
+			eastl::vector<VoxelDelta> mDeltas;
+			unsigned mRevision;
+
+			/// Listed in mChanged.
+			bool mChanged;
+		};
+
+		mutable Mutex mLock;
+		eastl::unordered_map<Vector3i, ChunkDeltas> mChunks;
+		unsigned mRevision;
+
+		/// Chunks changed since the last call to TakeChanged, if tracked.
+		eastl::vector<Vector3i> mChanged;
+		bool mTrackChanges;
+
+		/// Requires mLock.
+		void SetLocked(ChunkDeltas& chunk, uint32_t index, const Voxel& voxel);
+		void MarkChanged(const Vector3i& index, ChunkDeltas& chunk);
+
+	public:
+		VoxelDeltaMap();
+
+		VoxelDeltaMap(const VoxelDeltaMap&) = delete;
+		VoxelDeltaMap& operator =(const VoxelDeltaMap&) = delete;
+
+		/// Record the voxel at the given full resolution index of a chunk.
+		void Set(const Vector3i& chunk, uint32_t index, const Voxel& voxel);
+
+		/// Record the given differences of a chunk, e.g. found by comparing
+		/// stored data with the generator. Creates the entry even for an empty
+		/// list, so the chunk counts as compared. Voxels, that did not change,
+		/// keep their revision.
+		void Merge(const Vector3i& chunk, const eastl::vector<VoxelDelta>& deltas);
+
+		/// True, if the chunk has an entry, even one without differences.
+		bool Contains(const Vector3i& chunk) const;
+
+		/// Append the differences changed after the given revision. Returns
+		/// the revision of the chunk, zero if it has none.
+		unsigned Get(const Vector3i& chunk, unsigned since, eastl::vector<VoxelDelta>& result) const;
+
+		/// Revision of the last change of a chunk, zero if it has none.
+		unsigned GetRevision(const Vector3i& chunk) const;
+
+		/// Latest revision of the whole map.
+		unsigned GetRevision() const;
+
+		/// Collect the chunks changed from now on, see TakeChanged.
+		void SetTrackChanges(bool value);
+
+		/// Move the chunks changed since the last call into result. Each
+		/// chunk is listed once.
+		void TakeChanged(eastl::vector<Vector3i>& result);
+
+		void Clear();
+
+		/// Voxels as stored by VoxelStorage.
+		static void WriteVoxel(Serializer& dest, const Voxel& voxel);
+		static Voxel ReadVoxel(Deserializer& source);
+	};
+}
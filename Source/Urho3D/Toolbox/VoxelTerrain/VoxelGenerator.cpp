@@ -0,0 +1,410 @@
+#include "VoxelGenerator.h"
+
+#include "../../Container/Sort.h"
+#include "../../Math/MathDefs.h"
+#include "../../Math/SimplexNoise.h"
+
+namespace Urho3D
+{
+	/// Distance between the noise fields of different seeds.
+	static const float SEED_OFFSET = 1000.0f;
+
+	static bool leastRecentlyUsed(const GeneratorColumn* lhs, const GeneratorColumn* rhs)
+	{
+		return lhs->mLastUse < rhs->mLastUse;
+	}
+
+	void HeightmapStage::GenerateColumn(GeneratorColumn& column) const
+	{
+		static thread_local eastl::vector<float> octave;
+		octave.resize(column.mHeights.size());
+
+		float frequency = mFrequency;
+		float amplitude = mAmplitude;
+		for (int i = 0; i < (int) column.mHeights.size(); i++)
+		{
+			column.mHeights[i] += mBaseHeight;
+		}
+
+		for (int o = 0; o < mOctaves; o++)
+		{
+			SimplexNoise::noiseGrid(
+				octave.data(),
+				(float) column.mPosition.x * frequency,
+				(float) column.mPosition.z * frequency,
+				column.mVoxelSize * frequency,
+				column.mSizeX,
+				column.mSizeZ);
+
+			for (int i = 0; i < (int) octave.size(); i++)
+			{
+				column.mHeights[i] += octave[i] * amplitude;
+			}
+
+			frequency *= mLacunarity;
+			amplitude *= mPersistence;
+		}
+	}
+
+	void HeightmapStage::GenerateBlock(GeneratorBlock& block) const
+	{
+		const GeneratorColumn& column = *block.mColumn;
+		const Voxel air = Voxel::GetAir();
+		double bottom = block.mPosition.y;
+		double top = block.GetWorldY(block.mLayout.y - 1);
+
+		if (bottom > column.mMaxHeight)
+		{
+			block.mVoxels.assign(block.mVoxels.size(), air);
+			return;
+		}
+
+		if (top <= column.mMinHeight)
+		{
+			block.mVoxels.assign(block.mVoxels.size(), mGround);
+			return;
+		}
+
+		for (int z = 0; z < block.mLayout.z; z++)
+		{
+			for (int x = 0; x < block.mLayout.x; x++)
+			{
+				auto height = column.GetHeight(x, z);
+				for (int y = 0; y < block.mLayout.y; y++)
+				{
+					block.Set(block.GetWorldY(y) > height ? air : mGround, x, y, z);
+				}
+			}
+		}
+	}
+
+	void BiomeStage::GenerateColumn(GeneratorColumn& column) const
+	{
+		if (mBiomes.empty())
+		{
+			return;
+		}
+
+		static thread_local eastl::vector<float> selection;
+		selection.resize(column.mBiomes.size());
+
+		SimplexNoise::noiseGrid(
+			selection.data(),
+			(float) column.mPosition.x * mFrequency + mSeed * SEED_OFFSET,
+			(float) column.mPosition.z * mFrequency,
+			column.mVoxelSize * mFrequency,
+			column.mSizeX,
+			column.mSizeZ);
+
+		int count = (int) mBiomes.size();
+		for (int i = 0; i < (int) selection.size(); i++)
+		{
+			int biome = (int) ((selection[i] + 1.0f) * 0.5f * count);
+			column.mBiomes[i] = (uint8_t) Clamp(biome, 0, count - 1);
+		}
+	}
+
+	void BiomeStage::GenerateBlock(GeneratorBlock& block) const
+	{
+		if (mBiomes.empty() || block.IsAboveSurface())
+		{
+			return;
+		}
+
+		const GeneratorColumn& column = *block.mColumn;
+		for (int z = 0; z < block.mLayout.z; z++)
+		{
+			for (int x = 0; x < block.mLayout.x; x++)
+			{
+				const Biome& biome = mBiomes[column.mBiomes[column.GetIndex(x, z)]];
+				auto height = column.GetHeight(x, z);
+				auto floor = height - biome.mDepth * block.mVoxelSize;
+
+				for (int y = 0; y < block.mLayout.y; y++)
+				{
+					auto worldY = block.GetWorldY(y);
+					if (worldY > height || worldY <= floor)
+					{
+						continue;
+					}
+
+					Voxel v = block.Get(x, y, z);
+					if (!v.IsAir())
+					{
+						block.Set(biome.mSurface, x, y, z);
+					}
+				}
+			}
+		}
+	}
+
+	void CaveStage::GenerateBlock(GeneratorBlock& block) const
+	{
+		const GeneratorColumn& column = *block.mColumn;
+		float margin = mSurfaceMargin * block.mVoxelSize;
+		if (block.mPosition.y > column.mMaxHeight - margin)
+		{
+			/// Nothing to carve, skip the 3D noise.
+			return;
+		}
+
+		static thread_local eastl::vector<float> density;
+		density.resize(block.mVoxels.size());
+
+		SimplexNoise::noiseBlock(
+			density.data(),
+			(float) block.mPosition.x * mFrequency + mSeed * SEED_OFFSET,
+			(float) block.mPosition.y * mFrequency,
+			(float) block.mPosition.z * mFrequency,
+			block.mVoxelSize * mFrequency,
+			block.mLayout.x,
+			block.mLayout.y,
+			block.mLayout.z);
+
+		const Voxel air = Voxel::GetAir();
+		for (int z = 0; z < block.mLayout.z; z++)
+		{
+			for (int x = 0; x < block.mLayout.x; x++)
+			{
+				auto ceiling = column.GetHeight(x, z) - margin;
+				for (int y = 0; y < block.mLayout.y; y++)
+				{
+					int index = block.mLayout.GetIndex(x, y, z);
+					if (density[index] > mThreshold && block.GetWorldY(y) <= ceiling)
+					{
+						block.mVoxels[index] = air;
+					}
+				}
+			}
+		}
+	}
+
+	void OreStage::GenerateBlock(GeneratorBlock& block) const
+	{
+		const GeneratorColumn& column = *block.mColumn;
+		if (block.mPosition.y > column.mMaxHeight - mMinDepth)
+		{
+			return;
+		}
+
+		static thread_local eastl::vector<float> density;
+		density.resize(block.mVoxels.size());
+
+		SimplexNoise::noiseBlock(
+			density.data(),
+			(float) block.mPosition.x * mFrequency + mSeed * SEED_OFFSET,
+			(float) block.mPosition.y * mFrequency,
+			(float) block.mPosition.z * mFrequency,
+			block.mVoxelSize * mFrequency,
+			block.mLayout.x,
+			block.mLayout.y,
+			block.mLayout.z);
+
+		for (int z = 0; z < block.mLayout.z; z++)
+		{
+			for (int x = 0; x < block.mLayout.x; x++)
+			{
+				auto ceiling = column.GetHeight(x, z) - mMinDepth;
+				for (int y = 0; y < block.mLayout.y; y++)
+				{
+					int index = block.mLayout.GetIndex(x, y, z);
+					if (density[index] > mThreshold &&
+						block.GetWorldY(y) <= ceiling &&
+						block.mVoxels[index] == mHost)
+					{
+						block.mVoxels[index] = mOre;
+					}
+				}
+			}
+		}
+	}
+
+	VoxelGenerator::VoxelGenerator() :
+		mColumnCacheSize(DEFAULT_COLUMN_CACHE_SIZE),
+		mClock(0)
+	{
+	}
+
+	VoxelGenerator::~VoxelGenerator()
+	{
+		ClearCache();
+	}
+
+	SharedPtr<VoxelGenerator> VoxelGenerator::CreateDefault()
+	{
+		SharedPtr<VoxelGenerator> r(new VoxelGenerator());
+
+		/// Single octave, pointing downwards, like the terrain before the generator existed.
+		r->AddStage(new HeightmapStage(0.05f, -2.5f, 1));
+
+		return r;
+	}
+
+	void VoxelGenerator::AddStage(VoxelGeneratorStage* stage)
+	{
+		if (stage == nullptr)
+		{
+			URHO3D_LOGERROR("Can not add an empty generator stage.");
+			return;
+		}
+
+		mStages.Push(SharedPtr<VoxelGeneratorStage>(stage));
+
+		/// Cached columns were made by the old stages.
+		ClearCache();
+	}
+
+	void VoxelGenerator::ClearStages()
+	{
+		mStages.Clear();
+		ClearCache();
+	}
+
+	void VoxelGenerator::SetColumnCacheSize(unsigned value)
+	{
+		MutexLock lock(mCacheLock);
+		mColumnCacheSize = Max(value, 1u);
+		EvictColumns();
+	}
+
+	void VoxelGenerator::ClearCache()
+	{
+		MutexLock lock(mCacheLock);
+		for (auto it = mColumns.begin(); it != mColumns.end(); it++)
+		{
+			delete it->second;
+		}
+
+		mColumns.clear();
+	}
+
+	GeneratorColumn* VoxelGenerator::AcquireColumn(const Vector3d& position, const Vector3i& layout, float voxelSize)
+	{
+		/// Columns of different levels of detail differ in resolution, y is
+		/// free to tell them apart.
+		Vector3d key(position.x, voxelSize, position.z);
+
+		MutexLock lock(mCacheLock);
+		mClock++;
+
+		GeneratorColumn* column = nullptr;
+		auto it = mColumns.find(key);
+		if (it != mColumns.end())
+		{
+			column = it->second;
+		}
+		else
+		{
+			if (mColumns.size() >= mColumnCacheSize)
+			{
+				EvictColumns();
+			}
+
+			column = new GeneratorColumn();
+			column->mPosition = Vector3d(position.x, 0.0, position.z);
+			column->mSizeX = layout.x;
+			column->mSizeZ = layout.z;
+			column->mVoxelSize = voxelSize;
+			mColumns.insert(eastl::pair<Vector3d, GeneratorColumn*>(key, column));
+		}
+
+		column->mUsers++;
+		column->mLastUse = mClock;
+
+		return column;
+	}
+
+	void VoxelGenerator::ReleaseColumn(GeneratorColumn* column)
+	{
+		/// Only ever drops to zero outside the cache lock, which is safe,
+		/// since eviction checks for users under the lock.
+		column->mUsers--;
+	}
+
+	void VoxelGenerator::EvictColumns()
+	{
+		/// Evict a quarter at once, so a full cache is not sorted per new column.
+		if (mColumns.size() < mColumnCacheSize)
+		{
+			return;
+		}
+
+		unsigned target = mColumnCacheSize - mColumnCacheSize / 4;
+
+		PODVector<GeneratorColumn*> unused;
+		for (auto it = mColumns.begin(); it != mColumns.end(); it++)
+		{
+			if (it->second->mUsers.load() == 0)
+			{
+				unused.Push(it->second);
+			}
+		}
+
+		Sort(unused.Begin(), unused.End(), leastRecentlyUsed);
+
+		for (unsigned i = 0; i < unused.Size() && mColumns.size() > target; i++)
+		{
+			const Vector3d& position = unused[i]->mPosition;
+			mColumns.erase(Vector3d(position.x, unused[i]->mVoxelSize, position.z));
+			delete unused[i];
+		}
+	}
+
+	bool VoxelGenerator::Generate(const Vector3d& position, const Vector3i& layout, float voxelSize, eastl::vector<Voxel>& voxels)
+	{
+		voxels.assign(layout.GetArrayCount(), Voxel::GetAir());
+		if (mStages.Empty())
+		{
+			return true;
+		}
+
+		GeneratorColumn* column = AcquireColumn(position, layout, voxelSize);
+		{
+			MutexLock lock(column->mLock);
+			if (!column->mReady)
+			{
+				int cells = column->mSizeX * column->mSizeZ;
+				column->mHeights.assign(cells, 0.0f);
+				column->mBiomes.assign(cells, 0);
+
+				for (unsigned i = 0; i < mStages.Size(); i++)
+				{
+					mStages[i]->GenerateColumn(*column);
+				}
+
+				column->mMinHeight = M_INFINITY;
+				column->mMaxHeight = -M_INFINITY;
+				for (int i = 0; i < cells; i++)
+				{
+					column->mMinHeight = Min(column->mMinHeight, column->mHeights[i]);
+					column->mMaxHeight = Max(column->mMaxHeight, column->mHeights[i]);
+				}
+
+				column->mReady = true;
+			}
+		}
+
+		GeneratorBlock block(voxels);
+		block.mPosition = position;
+		block.mLayout = layout;
+		block.mVoxelSize = voxelSize;
+		block.mColumn = column;
+
+		for (unsigned i = 0; i < mStages.Size(); i++)
+		{
+			mStages[i]->GenerateBlock(block);
+		}
+
+		ReleaseColumn(column);
+
+		for (unsigned i = 1; i < voxels.size(); i++)
+		{
+			if (voxels[i] != voxels[0])
+			{
+				return false;
+			}
+		}
+
+		return true;
+	}
+}
@@ -0,0 +1,331 @@
+#pragma once
+
+#include <atomic>
+#include <EASTL/vector.h>
+#include <EASTL/unordered_map.h>
+
+#include "../../Container/Ptr.h"
+#include "../../Container/RefCounted.h"
+#include "../../Core/Mutex.h"
+#include "../../Math/Vector3d.h"
+#include "../../Math/Vector3i.h"
+
+#include "Voxel.h"
+
+namespace Urho3D
+{
+	/// 2D results of a single x/z column of chunks. Computed once and shared
+	/// by all chunks stacked on top of each other.
+	struct GeneratorColumn
+	{
+		/// World position of the column, y is always zero.
+		Vector3d mPosition;
+		int mSizeX;
+		int mSizeZ;
+		float mVoxelSize;
+
+		/// Surface height per x/z cell, x varies fastest.
+		eastl::vector<float> mHeights;
+
+		/// Biome per x/z cell, zero if no biome stage is used.
+		eastl::vector<uint8_t> mBiomes;
+
+		float mMinHeight;
+		float mMaxHeight;
+
+		/// Guards the computation, the first chunk of a column does the work
+		/// and all other chunks of that column wait for it.
+		Mutex mLock;
+		bool mReady;
+
+		/// Chunks currently reading this column. Columns in use are never evicted.
+		std::atomic<int> mUsers;
+
+		/// Value of the cache clock at the last lookup.
+		unsigned mLastUse;
+
+		GeneratorColumn() :
+			mSizeX(0),
+			mSizeZ(0),
+			mVoxelSize(0.0f),
+			mMinHeight(0.0f),
+			mMaxHeight(0.0f),
+			mReady(false),
+			mLastUse(0)
+		{
+			mUsers.store(0);
+		}
+
+		int GetIndex(int x, int z) const
+		{
+			return z * mSizeX + x;
+		}
+
+		float GetHeight(int x, int z) const
+		{
+			return mHeights[GetIndex(x, z)];
+		}
+	};
+
+	/// Voxels of a single chunk while its stages run. Plain voxels instead of
+	/// the compressed storage, since every stage reads and writes most cells.
+	struct GeneratorBlock
+	{
+		Vector3d mPosition;
+		Vector3i mLayout;
+		float mVoxelSize;
+
+		const GeneratorColumn* mColumn;
+		eastl::vector<Voxel>& mVoxels;
+
+		GeneratorBlock(eastl::vector<Voxel>& voxels) :
+			mVoxelSize(0.0f),
+			mColumn(nullptr),
+			mVoxels(voxels)
+		{
+		}
+
+		const Voxel& Get(int x, int y, int z) const
+		{
+			return mVoxels[mLayout.GetIndex(x, y, z)];
+		}
+
+		void Set(const Voxel& v, int x, int y, int z)
+		{
+			mVoxels[mLayout.GetIndex(x, y, z)] = v;
+		}
+
+		/// World height of the given voxel layer.
+		double GetWorldY(int y) const
+		{
+			return mPosition.y + y * mVoxelSize;
+		}
+
+		/// True, if the whole block lies above the highest surface point of its column.
+		bool IsAboveSurface() const
+		{
+			return mPosition.y > mColumn->mMaxHeight;
+		}
+	};
+
+	/// A single step of the terrain generation. Stages are shared by all
+	/// worker threads and must not change their own state while generating.
+	class VoxelGeneratorStage : public RefCounted
+	{
+	public:
+		virtual ~VoxelGeneratorStage() = default;
+
+		/// 2D pass, runs once per column before any of its chunks.
+		virtual void GenerateColumn(GeneratorColumn& column) const
+		{
+		}
+
+		/// 3D pass, runs once per chunk in the order the stages were added.
+		virtual void GenerateBlock(GeneratorBlock& block) const
+		{
+		}
+	};
+
+	/// Multi octave height field. Fills everything below the surface with
+	/// the ground voxel and everything above with air.
+	class HeightmapStage : public VoxelGeneratorStage
+	{
+	protected:
+		float mFrequency;
+		float mAmplitude;
+		int mOctaves;
+		float mLacunarity;
+		float mPersistence;
+		float mBaseHeight;
+		Voxel mGround;
+
+	public:
+		HeightmapStage(
+			float frequency = 0.05f,
+			float amplitude = 2.5f,
+			int octaves = 1,
+			float lacunarity = 2.0f,
+			float persistence = 0.5f) :
+			mFrequency(frequency),
+			mAmplitude(amplitude),
+			mOctaves(octaves),
+			mLacunarity(lacunarity),
+			mPersistence(persistence),
+			mBaseHeight(0.0f),
+			mGround(Voxel::GetStone())
+		{
+		}
+
+		void SetBaseHeight(float value)
+		{
+			mBaseHeight = value;
+		}
+
+		void SetGround(const Voxel& value)
+		{
+			mGround = value;
+		}
+
+		void GenerateColumn(GeneratorColumn& column) const override;
+		void GenerateBlock(GeneratorBlock& block) const override;
+	};
+
+	/// Picks a biome per cell from low frequency noise and replaces the
+	/// top layers of the ground with the surface voxel of that biome.
+	class BiomeStage : public VoxelGeneratorStage
+	{
+	public:
+		struct Biome
+		{
+			Voxel mSurface;
+			int mDepth;
+		};
+
+	protected:
+		float mFrequency;
+		float mSeed;
+		eastl::vector<Biome> mBiomes;
+
+	public:
+		BiomeStage(float frequency = 0.005f, float seed = 1.0f) :
+			mFrequency(frequency),
+			mSeed(seed)
+		{
+		}
+
+		/// Add a biome, whose top depth voxels are replaced by the surface voxel.
+		void AddBiome(const Voxel& surface, int depth)
+		{
+			mBiomes.push_back(Biome{ surface, depth });
+		}
+
+		void GenerateColumn(GeneratorColumn& column) const override;
+		void GenerateBlock(GeneratorBlock& block) const override;
+	};
+
+	/// Carves caves into solid ground, wherever 3D noise exceeds the threshold.
+	class CaveStage : public VoxelGeneratorStage
+	{
+	protected:
+		float mFrequency;
+		float mThreshold;
+		float mSeed;
+
+		/// Caves stay this many voxels below the surface.
+		int mSurfaceMargin;
+
+	public:
+		CaveStage(float frequency = 0.08f, float threshold = 0.6f, float seed = 2.0f) :
+			mFrequency(frequency),
+			mThreshold(threshold),
+			mSeed(seed),
+			mSurfaceMargin(2)
+		{
+		}
+
+		void SetSurfaceMargin(int value)
+		{
+			mSurfaceMargin = value;
+		}
+
+		void GenerateBlock(GeneratorBlock& block) const override;
+	};
+
+	/// Replaces the host voxel with ore, wherever 3D noise exceeds the threshold.
+	class OreStage : public VoxelGeneratorStage
+	{
+	protected:
+		Voxel mOre;
+		Voxel mHost;
+		float mFrequency;
+		float mThreshold;
+		float mSeed;
+
+		/// Ore is only placed this far below the surface, in world units.
+		float mMinDepth;
+
+	public:
+		OreStage(const Voxel& ore, float frequency = 0.2f, float threshold = 0.8f, float seed = 3.0f) :
+			mOre(ore),
+			mHost(Voxel::GetStone()),
+			mFrequency(frequency),
+			mThreshold(threshold),
+			mSeed(seed),
+			mMinDepth(4.0f)
+		{
+		}
+
+		void SetHost(const Voxel& value)
+		{
+			mHost = value;
+		}
+
+		void SetMinDepth(float value)
+		{
+			mMinDepth = value;
+		}
+
+		void GenerateBlock(GeneratorBlock& block) const override;
+	};
+
+	/// Creates the voxels of new chunks by running a list of stages.
+	///
+	/// Generation runs inside the initialization tasks of the chunks, so
+	/// the stages are executed on the worker threads. 2D results only depend
+	/// on x and z and are cached per column, vertically stacked chunks
+	/// compute them only once.
+	class VoxelGenerator : public RefCounted
+	{
+	public:
+		static const unsigned DEFAULT_COLUMN_CACHE_SIZE = 4096;
+
+	protected:
+		Vector<SharedPtr<VoxelGeneratorStage>> mStages;
+
+		Mutex mCacheLock;
+		eastl::unordered_map<Vector3d, GeneratorColumn*> mColumns;
+		unsigned mColumnCacheSize;
+		unsigned mClock;
+
+		/// Find or create the column of the given chunk and mark it as used.
+		GeneratorColumn* AcquireColumn(const Vector3d& position, const Vector3i& layout, float voxelSize);
+		void ReleaseColumn(GeneratorColumn* column);
+
+		/// Drop the least recently used columns, that are not in use. Requires mCacheLock.
+		void EvictColumns();
+
+	public:
+		VoxelGenerator();
+		~VoxelGenerator();
+
+		VoxelGenerator(const VoxelGenerator&) = delete;
+		VoxelGenerator& operator =(const VoxelGenerator&) = delete;
+
+		/// Plain height field of stone, the terrain Voxer always had.
+		static SharedPtr<VoxelGenerator> CreateDefault();
+
+		/// Append a stage. Must not be called while chunks are generated.
+		void AddStage(VoxelGeneratorStage* stage);
+		void ClearStages();
+
+		const Vector<SharedPtr<VoxelGeneratorStage>>& GetStages() const
+		{
+			return mStages;
+		}
+
+		/// Maximum number of cached columns.
+		void SetColumnCacheSize(unsigned value);
+
+		unsigned GetColumnCacheSize() const
+		{
+			return mColumnCacheSize;
+		}
+
+		/// Drop all cached columns. Must not be called while chunks are generated.
+		void ClearCache();
+
+		/// Fill voxels with the chunk at the given position, x varies fastest,
+		/// then y, then z. Returns true, if all voxels are the same.
+		bool Generate(const Vector3d& position, const Vector3i& layout, float voxelSize, eastl::vector<Voxel>& voxels);
+	};
+}
@@ -0,0 +1,268 @@
+#ifdef URHO3D_NETWORK
+
+#include "VoxelReplicator.h"
+
+#include "../../Core/Profiler.h"
+#include "../../IO/Compression.h"
+#include "../../IO/Log.h"
+#include "../../IO/VectorBuffer.h"
+#include "../../Network/Network.h"
+#include "../../Network/NetworkEvents.h"
+
+namespace Urho3D
+{
+	static bool closerChunk(const ChunkSpawnRequest& lhs, const ChunkSpawnRequest& rhs)
+	{
+		return lhs.mPriority < rhs.mPriority;
+	}
+
+	VoxelReplicator::VoxelReplicator(Context* ctx, VoxerSettings* settings, ChunkProvider* provider) :
+		Object(ctx),
+		mSettings(settings),
+		mChunkProvider(provider)
+	{
+		SubscribeToEvent(E_NETWORKUPDATE, URHO3D_HANDLER(VoxelReplicator, HandleNetworkUpdate));
+		SubscribeToEvent(E_NETWORKMESSAGE, URHO3D_HANDLER(VoxelReplicator, HandleNetworkMessage));
+		SubscribeToEvent(E_CLIENTDISCONNECTED, URHO3D_HANDLER(VoxelReplicator, HandleClientDisconnected));
+	}
+
+	void VoxelReplicator::Enqueue(ClientState& client, const Vector3i& chunk, VoxelDeltaMap* deltas)
+	{
+		/// Chunks without changes are generated by the client.
+		unsigned revision = deltas->GetRevision(chunk);
+		if (revision == 0)
+		{
+			return;
+		}
+
+		ClientChunk& state = client.mChunks[chunk];
+		if (state.mQueued || state.mRevision >= revision)
+		{
+			return;
+		}
+
+		state.mQueued = true;
+		client.mQueue.push_back(chunk);
+	}
+
+	void VoxelReplicator::UpdateClient(Connection* connection, ClientState& client, const eastl::vector<Vector3i>& changed, VoxelDeltaMap* deltas)
+	{
+		auto p = connection->GetPosition();
+		auto center = mChunkProvider->GetChunkIndex(Vector3d(p.x_, p.y_, p.z_));
+
+		/// Only the chunks, that just came into view range, are looked at.
+		if (!client.mHasCenter || !(center == client.mCenter))
+		{
+			eastl::vector<Vector3i> entered;
+			mChunkProvider->CollectRegion(center, client.mHasCenter ? &client.mCenter : nullptr, entered);
+			for (unsigned i = 0; i < entered.size(); i++)
+			{
+				Enqueue(client, entered[i], deltas);
+			}
+
+			client.mCenter = center;
+			client.mHasCenter = true;
+		}
+
+		for (unsigned i = 0; i < changed.size(); i++)
+		{
+			if (mChunkProvider->IsInRegion(changed[i], center))
+			{
+				Enqueue(client, changed[i], deltas);
+			}
+		}
+	}
+
+	void VoxelReplicator::SendChanges(Connection* connection, ClientState& client, VoxelDeltaMap* deltas)
+	{
+		if (client.mQueue.empty())
+		{
+			return;
+		}
+
+		auto p = connection->GetPosition();
+		auto dim = mSettings->GetChunkDimension();
+
+		/// Chunks, that left the view range, are queued again on return.
+		Vector<ChunkSpawnRequest> order;
+		for (unsigned i = 0; i < client.mQueue.size(); i++)
+		{
+			auto index = client.mQueue[i];
+			if (!mChunkProvider->IsInRegion(index, client.mCenter))
+			{
+				client.mChunks[index].mQueued = false;
+				continue;
+			}
+
+			auto pos = mChunkProvider->GetChunkPosition(index);
+			double dx = pos.x + dim.x * 0.5 - p.x_;
+			double dy = pos.y + dim.y * 0.5 - p.y_;
+			double dz = pos.z + dim.z * 0.5 - p.z_;
+
+			ChunkSpawnRequest request;
+			request.mIndex = index;
+			request.mPriority = dx * dx + dy * dy + dz * dz;
+			order.Push(request);
+		}
+
+		Sort(order.Begin(), order.End(), closerChunk);
+		client.mQueue.clear();
+
+		unsigned budget = mSettings->GetReplicationBudget();
+		VectorBuffer raw;
+		eastl::vector<VoxelDelta> changes;
+		for (unsigned i = 0; i < order.Size(); i++)
+		{
+			auto index = order[i].mIndex;
+			if (budget > 0 && raw.GetSize() >= budget)
+			{
+				client.mQueue.push_back(index);
+				continue;
+			}
+
+			ClientChunk& state = client.mChunks[index];
+			changes.clear();
+			unsigned revision = deltas->Get(index, state.mRevision, changes);
+			state.mRevision = revision;
+			state.mQueued = false;
+			if (changes.empty())
+			{
+				continue;
+			}
+
+			raw.WriteInt(index.x);
+			raw.WriteInt(index.y);
+			raw.WriteInt(index.z);
+			raw.WriteVLE((unsigned) changes.size());
+			for (unsigned j = 0; j < changes.size(); j++)
+			{
+				raw.WriteVLE(changes[j].mIndex);
+				VoxelDeltaMap::WriteVoxel(raw, changes[j].mVoxel);
+			}
+		}
+
+		if (raw.GetSize() == 0)
+		{
+			return;
+		}
+
+		VectorBuffer message = CompressVectorBuffer(raw);
+		connection->SendMessage(MSG_VOXELDELTAS, true, true, message);
+	}
+
+	void VoxelReplicator::ReceiveChanges(MemoryBuffer& message)
+	{
+		auto deltas = mChunkProvider->GetDeltas();
+		if (deltas == nullptr)
+		{
+			URHO3D_LOGERROR("Received voxel changes, but replication is disabled. Enable it before connecting.");
+			return;
+		}
+
+		const Vector3i& layout = mSettings->GetVoxelCount();
+		double size = mSettings->GetVoxelSize();
+		while (!message.IsEof())
+		{
+			Vector3i index;
+			index.x = message.ReadInt();
+			index.y = message.ReadInt();
+			index.z = message.ReadInt();
+			unsigned count = message.ReadVLE();
+
+			auto chunk = mChunkProvider->GetChunk(index);
+			int step = chunk != nullptr ? 1 << chunk->GetLod() : 1;
+			auto origin = mChunkProvider->GetChunkPosition(index);
+			for (unsigned i = 0; i < count; i++)
+			{
+				unsigned voxelIndex = message.ReadVLE();
+				Voxel voxel = VoxelDeltaMap::ReadVoxel(message);
+				if (voxelIndex >= (unsigned) layout.GetArrayCount())
+				{
+					URHO3D_LOGERROR("Received a voxel change outside of its chunk, the voxel settings of server and client differ.");
+					return;
+				}
+
+				deltas->Set(index, voxelIndex, voxel);
+
+				/// Spawned chunks take the change as an edit, all others
+				/// apply it, once they are generated.
+				int x = (int) voxelIndex % layout.x;
+				int y = ((int) voxelIndex / layout.x) % layout.y;
+				int z = (int) voxelIndex / (layout.x * layout.y);
+				if (chunk == nullptr || x % step != 0 || y % step != 0 || z % step != 0)
+				{
+					continue;
+				}
+
+				mChunkProvider->SetVoxel(Vector3d(
+					origin.x + (x + 0.5) * size,
+					origin.y + (y + 0.5) * size,
+					origin.z + (z + 0.5) * size), voxel);
+			}
+		}
+	}
+
+	void VoxelReplicator::HandleNetworkUpdate(StringHash eventType, VariantMap& eventData)
+	{
+		auto network = GetSubsystem<Network>();
+		auto deltas = mChunkProvider != nullptr ? mChunkProvider->GetDeltas() : nullptr;
+		if (network == nullptr || !network->IsServerRunning() || deltas == nullptr)
+		{
+			return;
+		}
+
+		URHO3D_PROFILE(ReplicateVoxels);
+
+		/// Chunks changed before are found by the region of each client.
+		deltas->SetTrackChanges(true);
+
+		eastl::vector<Vector3i> changed;
+		deltas->TakeChanged(changed);
+
+		auto connections = network->GetClientConnections();
+		for (unsigned i = 0; i < connections.Size(); i++)
+		{
+			Connection* connection = connections[i];
+			ClientState& client = mClients[connection];
+			UpdateClient(connection, client, changed, deltas);
+			SendChanges(connection, client, deltas);
+		}
+	}
+
+	void VoxelReplicator::HandleNetworkMessage(StringHash eventType, VariantMap& eventData)
+	{
+		using namespace NetworkMessage;
+
+		if (eventData[P_MESSAGEID].GetInt() != MSG_VOXELDELTAS || mChunkProvider == nullptr)
+		{
+			return;
+		}
+
+		/// Only the server sends voxel changes.
+		auto connection = static_cast<Connection*>(eventData[P_CONNECTION].GetPtr());
+		if (connection == nullptr || connection->IsClient())
+		{
+			return;
+		}
+
+		MemoryBuffer compressed(eventData[P_DATA].GetBuffer());
+		VectorBuffer raw;
+		if (!DecompressStream(raw, compressed))
+		{
+			URHO3D_LOGERROR("Could not decompress voxel changes.");
+			return;
+		}
+
+		MemoryBuffer message(raw.GetData(), raw.GetSize());
+		ReceiveChanges(message);
+	}
+
+	void VoxelReplicator::HandleClientDisconnected(StringHash eventType, VariantMap& eventData)
+	{
+		using namespace ClientDisconnected;
+
+		mClients.erase(static_cast<Connection*>(eventData[P_CONNECTION].GetPtr()));
+	}
+}
+
+#endif
@@ -0,0 +1,91 @@
+#pragma once
+
+#ifdef URHO3D_NETWORK
+
+#include <EASTL/hash_map.h>
+#include <EASTL/unordered_map.h>
+#include <EASTL/vector.h>
+
+#include "../../Core/Object.h"
+#include "../../IO/MemoryBuffer.h"
+#include "../../Network/Connection.h"
+#include "../../Math/Vector3i.h"
+
+#include "VoxerSettings.h"
+#include "ChunkProvider.h"
+#include "VoxelDeltaMap.h"
+
+namespace Urho3D
+{
+	/// Sends the voxel changes of a server to its clients.
+	///
+	/// Clients generate the terrain on their own, only the differences to
+	/// the generated terrain are sent, see VoxelDeltaMap. Once a client
+	/// enters a region, the changed chunks of its view range are sent closest
+	/// first. Later edits follow with the next network update. Everything a
+	/// client gets during one update goes into a single LZ4 compressed
+	/// message. Clients must set their position on the server connection and
+	/// enable replication in their settings as well.
+	class VoxelReplicator : public Object
+	{
+		URHO3D_OBJECT(VoxelReplicator, Object)
+
+	public:
+		/// Server to client: voxel changes of one network update.
+		static const int MSG_VOXELDELTAS = 0xA0;
+
+	private:
+		/// A chunk as seen by a single client.
+		struct ClientChunk
+		{
+			/// Revision of the delta map the client is up to date with.
+			unsigned mRevision;
+
+			/// Listed in the queue of the client.
+			bool mQueued;
+		};
+
+		struct ClientState
+		{
+			/// Chunk the connection has been in during the last update.
+			Vector3i mCenter;
+			bool mHasCenter;
+
+			eastl::unordered_map<Vector3i, ClientChunk> mChunks;
+
+			/// Chunks with changes, the client has not received yet.
+			eastl::vector<Vector3i> mQueue;
+
+			ClientState() :
+				mHasCenter(false)
+			{
+			}
+		};
+
+		SharedPtr<VoxerSettings> mSettings;
+		WeakPtr<ChunkProvider> mChunkProvider;
+
+		eastl::hash_map<Connection*, ClientState> mClients;
+
+		/// Queue the chunk, if the client is behind.
+		void Enqueue(ClientState& client, const Vector3i& chunk, VoxelDeltaMap* deltas);
+
+		/// Queue the changed chunks, the client has in view range.
+		void UpdateClient(Connection* connection, ClientState& client, const eastl::vector<Vector3i>& changed, VoxelDeltaMap* deltas);
+
+		/// Send the closest queued chunks until the budget is spent.
+		void SendChanges(Connection* connection, ClientState& client, VoxelDeltaMap* deltas);
+
+		/// Apply the changes of a message on the client.
+		void ReceiveChanges(MemoryBuffer& message);
+
+		void HandleNetworkUpdate(StringHash eventType, VariantMap& eventData);
+		void HandleNetworkMessage(StringHash eventType, VariantMap& eventData);
+		void HandleClientDisconnected(StringHash eventType, VariantMap& eventData);
+
+	public:
+		VoxelReplicator(Context* ctx, VoxerSettings* settings, ChunkProvider* provider);
+	};
+}
+
+#endif
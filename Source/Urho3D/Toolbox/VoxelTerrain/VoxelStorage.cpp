@@ -0,0 +1,480 @@
+#include "VoxelStorage.h"
+
+namespace Urho3D
+{
+	VoxelStorage::VoxelStorage() :
+		mBitsPerIndex(0),
+		mLastPaletteIndex(0)
+	{
+		mPalette.push_back(Voxel::GetAir());
+		mReferences.push_back(0);
+	}
+
+	void VoxelStorage::Reset(const Vector3i& layout, const Voxel& voxel)
+	{
+		mLayout = layout;
+		Fill(voxel);
+	}
+
+	void VoxelStorage::Fill(const Voxel& voxel)
+	{
+		mPalette.clear();
+		mReferences.clear();
+		mPalette.push_back(voxel);
+		mReferences.push_back(mLayout.GetArrayCount());
+
+		/// Give the memory back, pooled chunks should not hold on to it.
+		eastl::vector<uint32_t>().swap(mBits);
+		eastl::vector<uint16_t>().swap(mRuns);
+		eastl::vector<uint32_t>().swap(mColumnStart);
+
+		mBitsPerIndex = 0;
+		mLastPaletteIndex = 0;
+	}
+
+	int VoxelStorage::GetRequiredBits(int paletteSize)
+	{
+		/// Only sizes that divide 32, so an index never spans two words.
+		if (paletteSize <= 1)
+		{
+			return 0;
+		}
+
+		if (paletteSize <= 2)
+		{
+			return 1;
+		}
+
+		if (paletteSize <= 4)
+		{
+			return 2;
+		}
+
+		if (paletteSize <= 16)
+		{
+			return 4;
+		}
+
+		if (paletteSize <= 256)
+		{
+			return 8;
+		}
+
+		return 16;
+	}
+
+	int VoxelStorage::ReadIndex(int index) const
+	{
+		int perWord = 32 / mBitsPerIndex;
+		int shift = (index % perWord) * mBitsPerIndex;
+		uint32_t mask = (1u << mBitsPerIndex) - 1;
+
+		return (int) ((mBits[index / perWord] >> shift) & mask);
+	}
+
+	void VoxelStorage::WriteIndex(int index, int paletteIndex)
+	{
+		int perWord = 32 / mBitsPerIndex;
+		int shift = (index % perWord) * mBitsPerIndex;
+		uint32_t mask = ((1u << mBitsPerIndex) - 1) << shift;
+
+		uint32_t& word = mBits[index / perWord];
+		word = (word & ~mask) | (((uint32_t) paletteIndex << shift) & mask);
+	}
+
+	int VoxelStorage::ReadRun(int index) const
+	{
+		/// Cells of a column differ in y only.
+		int x = index % mLayout.x;
+		int y = (index / mLayout.x) % mLayout.y;
+		int z = index / (mLayout.x * mLayout.y);
+		int column = z * mLayout.x + x;
+
+		for (uint32_t i = mColumnStart[column]; i < mColumnStart[column + 1]; i += 2)
+		{
+			y -= mRuns[i + 1];
+			if (y < 0)
+			{
+				return mRuns[i];
+			}
+		}
+
+		return 0;
+	}
+
+	void VoxelStorage::Repack(int bitsPerIndex)
+	{
+		int count = mLayout.GetArrayCount();
+		eastl::vector<uint32_t> bits;
+		if (bitsPerIndex > 0)
+		{
+			int perWord = 32 / bitsPerIndex;
+			bits.resize((count + perWord - 1) / perWord, 0);
+		}
+
+		eastl::vector<uint32_t> old;
+		old.swap(mBits);
+		int oldBits = mBitsPerIndex;
+
+		mBits.swap(bits);
+		mBitsPerIndex = bitsPerIndex;
+
+		if (oldBits == 0 || bitsPerIndex == 0)
+		{
+			/// Everything used palette entry zero before, which is all zero bits.
+			return;
+		}
+
+		int perWord = 32 / oldBits;
+		uint32_t mask = (1u << oldBits) - 1;
+		for (int i = 0; i < count; i++)
+		{
+			int value = (int) ((old[i / perWord] >> ((i % perWord) * oldBits)) & mask);
+			WriteIndex(i, value);
+		}
+	}
+
+	void VoxelStorage::Unpack()
+	{
+		eastl::vector<uint16_t> runs;
+		eastl::vector<uint32_t> columns;
+		runs.swap(mRuns);
+		columns.swap(mColumnStart);
+
+		int bitsPerIndex = mBitsPerIndex;
+		mBitsPerIndex = 0;
+		Repack(bitsPerIndex);
+
+		for (int z = 0; z < mLayout.z; z++)
+		{
+			for (int x = 0; x < mLayout.x; x++)
+			{
+				int column = z * mLayout.x + x;
+				int y = 0;
+				for (uint32_t i = columns[column]; i < columns[column + 1]; i += 2)
+				{
+					for (int j = 0; j < runs[i + 1]; j++, y++)
+					{
+						WriteIndex(mLayout.GetIndex(x, y, z), runs[i]);
+					}
+				}
+			}
+		}
+	}
+
+	int VoxelStorage::FindOrAdd(const Voxel& voxel)
+	{
+		if (mPalette[mLastPaletteIndex] == voxel)
+		{
+			return mLastPaletteIndex;
+		}
+
+		int unused = -1;
+		for (int i = 0; i < (int) mPalette.size(); i++)
+		{
+			if (mPalette[i] == voxel)
+			{
+				mLastPaletteIndex = i;
+				return i;
+			}
+
+			if (unused < 0 && mReferences[i] == 0)
+			{
+				unused = i;
+			}
+		}
+
+		/// Recycle an entry nobody uses anymore, before the palette grows.
+		if (unused >= 0)
+		{
+			mPalette[unused] = voxel;
+			mLastPaletteIndex = unused;
+			return unused;
+		}
+
+		if (mPalette.size() >= 65536)
+		{
+			URHO3D_LOGERROR("Voxel palette is full.");
+			return 0;
+		}
+
+		mPalette.push_back(voxel);
+		mReferences.push_back(0);
+
+		int required = GetRequiredBits((int) mPalette.size());
+		if (required > mBitsPerIndex)
+		{
+			Repack(required);
+		}
+
+		mLastPaletteIndex = (int) mPalette.size() - 1;
+		return mLastPaletteIndex;
+	}
+
+	void VoxelStorage::Set(int index, const Voxel& voxel)
+	{
+		if (!mRuns.empty())
+		{
+			Unpack();
+		}
+
+		/// Setting what is already there must not allocate the indices.
+		int old = mBitsPerIndex == 0 ? 0 : ReadIndex(index);
+		if (mPalette[old] == voxel)
+		{
+			return;
+		}
+
+		int paletteIndex = FindOrAdd(voxel);
+		mReferences[old]--;
+		mReferences[paletteIndex]++;
+		WriteIndex(index, paletteIndex);
+	}
+
+	void VoxelStorage::Compact(bool runLength)
+	{
+		if (!mRuns.empty())
+		{
+			Unpack();
+		}
+
+		/// Drop unused palette entries.
+		eastl::vector<int> remap(mPalette.size(), 0);
+		eastl::vector<Voxel> palette;
+		eastl::vector<int> references;
+		for (int i = 0; i < (int) mPalette.size(); i++)
+		{
+			if (mReferences[i] > 0)
+			{
+				remap[i] = (int) palette.size();
+				palette.push_back(mPalette[i]);
+				references.push_back(mReferences[i]);
+			}
+		}
+
+		if (palette.size() <= 1)
+		{
+			Fill(palette.empty() ? mPalette[0] : palette[0]);
+			return;
+		}
+
+		int count = mLayout.GetArrayCount();
+		eastl::vector<int> indices(count, 0);
+		for (int i = 0; i < count; i++)
+		{
+			indices[i] = remap[ReadIndex(i)];
+		}
+
+		mPalette.swap(palette);
+		mReferences.swap(references);
+		mLastPaletteIndex = 0;
+
+		mBitsPerIndex = 0;
+		Repack(GetRequiredBits((int) mPalette.size()));
+		for (int i = 0; i < count; i++)
+		{
+			WriteIndex(i, indices[i]);
+		}
+
+		if (!runLength)
+		{
+			return;
+		}
+
+		/// Encode each column and keep the result only if it is smaller.
+		eastl::vector<uint16_t> runs;
+		eastl::vector<uint32_t> columns;
+		columns.reserve(mLayout.x * mLayout.z + 1);
+		for (int z = 0; z < mLayout.z; z++)
+		{
+			for (int x = 0; x < mLayout.x; x++)
+			{
+				columns.push_back((uint32_t) runs.size());
+				for (int y = 0; y < mLayout.y; y++)
+				{
+					int value = ReadIndex(mLayout.GetIndex(x, y, z));
+					if (y > 0 && runs[runs.size() - 2] == value)
+					{
+						runs[runs.size() - 1]++;
+						continue;
+					}
+
+					runs.push_back((uint16_t) value);
+					runs.push_back(1);
+				}
+			}
+		}
+
+		columns.push_back((uint32_t) runs.size());
+
+		unsigned encoded = runs.size() * sizeof(uint16_t) + columns.size() * sizeof(uint32_t);
+		if (encoded >= mBits.size() * sizeof(uint32_t))
+		{
+			return;
+		}
+
+		mRuns.swap(runs);
+		mColumnStart.swap(columns);
+		eastl::vector<uint32_t>().swap(mBits);
+	}
+
+	unsigned VoxelStorage::GetMemoryUse() const
+	{
+		return
+			sizeof(VoxelStorage) +
+			mPalette.capacity() * sizeof(Voxel) +
+			mReferences.capacity() * sizeof(int) +
+			mBits.capacity() * sizeof(uint32_t) +
+			mRuns.capacity() * sizeof(uint16_t) +
+			mColumnStart.capacity() * sizeof(uint32_t);
+	}
+
+	void VoxelStorage::Save(Serializer& dest) const
+	{
+		dest.WriteInt(mLayout.x);
+		dest.WriteInt(mLayout.y);
+		dest.WriteInt(mLayout.z);
+
+		dest.WriteUInt(mPalette.size());
+		for (unsigned i = 0; i < mPalette.size(); i++)
+		{
+			dest.WriteShort(mPalette[i].mId);
+			dest.WriteByte(mPalette[i].mHitpoints);
+			dest.WriteInt(mPalette[i].mAttributes);
+		}
+
+		dest.WriteUByte((unsigned char) mBitsPerIndex);
+
+		dest.WriteUInt(mBits.size());
+		dest.Write(mBits.data(), mBits.size() * sizeof(uint32_t));
+
+		dest.WriteUInt(mRuns.size());
+		dest.Write(mRuns.data(), mRuns.size() * sizeof(uint16_t));
+
+		dest.WriteUInt(mColumnStart.size());
+		dest.Write(mColumnStart.data(), mColumnStart.size() * sizeof(uint32_t));
+	}
+
+	bool VoxelStorage::Load(Deserializer& source)
+	{
+		Vector3i layout;
+		layout.x = source.ReadInt();
+		layout.y = source.ReadInt();
+		layout.z = source.ReadInt();
+		if (!(layout == mLayout))
+		{
+			URHO3D_LOGERROR("Stored voxel data has a different chunk layout.");
+			return false;
+		}
+
+		unsigned paletteSize = source.ReadUInt();
+		if (paletteSize == 0 || paletteSize > 65536)
+		{
+			return false;
+		}
+
+		eastl::vector<Voxel> palette(paletteSize);
+		for (unsigned i = 0; i < paletteSize; i++)
+		{
+			palette[i].mId = source.ReadShort();
+			palette[i].mHitpoints = source.ReadByte();
+			palette[i].mAttributes = source.ReadInt();
+		}
+
+		int bitsPerIndex = source.ReadUByte();
+		if (bitsPerIndex != 0 && GetRequiredBits(paletteSize) != bitsPerIndex)
+		{
+			return false;
+		}
+
+		eastl::vector<uint32_t> bits(source.ReadUInt());
+		if (source.Read(bits.data(), bits.size() * sizeof(uint32_t)) != bits.size() * sizeof(uint32_t))
+		{
+			return false;
+		}
+
+		eastl::vector<uint16_t> runs(source.ReadUInt());
+		if (source.Read(runs.data(), runs.size() * sizeof(uint16_t)) != runs.size() * sizeof(uint16_t))
+		{
+			return false;
+		}
+
+		eastl::vector<uint32_t> columns(source.ReadUInt());
+		if (source.Read(columns.data(), columns.size() * sizeof(uint32_t)) != columns.size() * sizeof(uint32_t))
+		{
+			return false;
+		}
+
+		/// The references are not stored, count them again.
+		int count = mLayout.GetArrayCount();
+		eastl::vector<int> references(paletteSize, 0);
+		if (!runs.empty())
+		{
+			if (columns.size() != (unsigned) (mLayout.x * mLayout.z + 1) || columns.front() != 0 || columns.back() != runs.size() || (runs.size() & 1) != 0)
+			{
+				return false;
+			}
+
+			/// Unpack writes each column run by run, so every column has to
+			/// start at a pair and fill exactly the height of the chunk.
+			for (unsigned c = 0; c + 1 < columns.size(); c++)
+			{
+				if (columns[c] > columns[c + 1] || (columns[c] & 1) != 0)
+				{
+					return false;
+				}
+
+				int height = 0;
+				for (uint32_t i = columns[c]; i < columns[c + 1]; i += 2)
+				{
+					if (runs[i] >= paletteSize)
+					{
+						return false;
+					}
+
+					references[runs[i]] += runs[i + 1];
+					height += runs[i + 1];
+				}
+
+				if (height != mLayout.y)
+				{
+					return false;
+				}
+			}
+		}
+		else if (bitsPerIndex > 0)
+		{
+			int perWord = 32 / bitsPerIndex;
+			uint32_t mask = (1u << bitsPerIndex) - 1;
+			if (bits.size() != (unsigned) ((count + perWord - 1) / perWord))
+			{
+				return false;
+			}
+
+			for (int i = 0; i < count; i++)
+			{
+				unsigned value = (bits[i / perWord] >> ((i % perWord) * bitsPerIndex)) & mask;
+				if (value >= paletteSize)
+				{
+					return false;
+				}
+
+				references[value]++;
+			}
+		}
+		else
+		{
+			references[0] = count;
+		}
+
+		mPalette.swap(palette);
+		mReferences.swap(references);
+		mBits.swap(bits);
+		mRuns.swap(runs);
+		mColumnStart.swap(columns);
+		mBitsPerIndex = bitsPerIndex;
+		mLastPaletteIndex = 0;
+
+		return true;
+	}
+}
@@ -0,0 +1,122 @@
+#pragma once
+
+#include <inttypes.h>
+#include <EASTL/vector.h>
+
+#include "../../Math/Vector3i.h"
+#include "../../IO/Deserializer.h"
+#include "../../IO/Serializer.h"
+#include "Voxel.h"
+
+namespace Urho3D
+{
+	/// Compressed voxel data of a single chunk.
+	///
+	/// A uniform chunk, e.g. all air or all stone, stores a single voxel and
+	/// nothing else. All other chunks keep a palette of their distinct voxels
+	/// and bit packed indices into it, using only as many bits per cell as the
+	/// palette needs. Chunks, that are not edited anymore, can additionally be
+	/// run length encoded along the y axis. Setting a voxel unpacks them again.
+	class VoxelStorage
+	{
+	private:
+		Vector3i mLayout;
+
+		/// Distinct voxels of this chunk.
+		eastl::vector<Voxel> mPalette;
+
+		/// Number of cells using each palette entry. Unused entries are recycled.
+		eastl::vector<int> mReferences;
+
+		/// Palette indices, packed into words. Empty for uniform chunks.
+		eastl::vector<uint32_t> mBits;
+		int mBitsPerIndex;
+
+		/// Run length encoded columns, pairs of palette index and run length.
+		/// Only used while compressed, mBits is empty then.
+		eastl::vector<uint16_t> mRuns;
+
+		/// First run of each x/z column, plus one entry for the end.
+		eastl::vector<uint32_t> mColumnStart;
+
+		/// Palette entry found by the last lookup. Generation sets long runs
+		/// of the same voxel, so this saves most of the palette searches.
+		int mLastPaletteIndex;
+
+		int FindOrAdd(const Voxel& voxel);
+
+		int ReadIndex(int index) const;
+		void WriteIndex(int index, int paletteIndex);
+		int ReadRun(int index) const;
+
+		/// Repack the indices using the given number of bits.
+		void Repack(int bitsPerIndex);
+
+		/// Turn run length encoded columns back into packed indices.
+		void Unpack();
+
+		static int GetRequiredBits(int paletteSize);
+
+	public:
+		VoxelStorage();
+
+		/// Resize to the given layout and fill with a single voxel.
+		void Reset(const Vector3i& layout, const Voxel& voxel);
+
+		/// Fill the whole chunk with a single voxel and release the indices.
+		void Fill(const Voxel& voxel);
+
+		Voxel Get(int index) const
+		{
+			if (!mRuns.empty())
+			{
+				return mPalette[ReadRun(index)];
+			}
+
+			if (mBitsPerIndex == 0)
+			{
+				return mPalette[0];
+			}
+
+			return mPalette[ReadIndex(index)];
+		}
+
+		void Set(int index, const Voxel& voxel);
+
+		/// Drop unused palette entries and use as few bits as possible.
+		/// Optionally run length encode the columns, if that takes less memory.
+		void Compact(bool runLength = false);
+
+		/// True, if every cell holds the same voxel.
+		bool IsUniform() const
+		{
+			return mBitsPerIndex == 0 && mRuns.empty();
+		}
+
+		/// Voxel of a uniform chunk.
+		const Voxel& GetUniform() const
+		{
+			return mPalette[0];
+		}
+
+		bool IsRunLengthEncoded() const
+		{
+			return !mRuns.empty();
+		}
+
+		int GetPaletteSize() const
+		{
+			return (int) mPalette.size();
+		}
+
+		/// Bytes allocated for the voxel data.
+		unsigned GetMemoryUse() const;
+
+		/// Write the data as it is, compressed or not.
+		void Save(Serializer& dest) const;
+
+		/// Read data written by Save. Returns false and leaves the storage
+		/// unchanged, if the data is damaged or has a different layout.
+		bool Load(Deserializer& source);
+	};
+}
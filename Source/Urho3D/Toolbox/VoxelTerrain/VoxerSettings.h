@@ -6,6 +6,7 @@
 #include "../../Core/Object.h"
 #include "../../Container/Str.h"
 #include "../../Math/Vector3d.h"
+#include "VoxelGenerator.h"
 
 namespace Urho3D
 {
@@ -16,13 +17,28 @@ namespace Urho3D
 		URHO3D_OBJECT(VoxerSettings, Object)
 
 	public:
+		/// Coarsest level of detail, chunks use 8x the voxel size there.
+		static const int MAX_LOD_LEVELS = 3;
+
 		VoxerSettings(Context* ctx) :
 			Object(ctx),
 			mVoxelSize(0.5f),
 			mVoxelCount(16, 16, 16),
 			mViewRange(5, 3, 5),
+			mChunkDimension(0.0f),
 			mServer(false),
-			mChunkDimension(0.0f)
+			mHeadless(false),
+			mCollision(false),
+			mCollisionRange(1),
+			mRunLengthEncoding(false),
+			mGreedyMeshing(false),
+			mLodLevels(0),
+			mLodDistance(2),
+			mUploadBudget(4 * 1024 * 1024),
+			mUploadTimeBudget(2.0f),
+			mReplication(false),
+			mReplicationBudget(16 * 1024),
+			mGenerator(VoxelGenerator::CreateDefault())
 		{
 			UpdateCunkDimension();
 			UpdateMaxDistanceToDestroy();
@@ -87,16 +103,224 @@ namespace Urho3D
 			return mChunkDimension;
 		}
 
+		/// Servers stream chunks around every player, clients around the first one.
 		bool IsServer() const
 		{
 			return mServer;
 		}
 
+		void SetServer(bool value)
+		{
+			mServer = value;
+		}
+
+		/// Keep voxel data only and create no meshes for rendering. Chunks
+		/// near simulated bodies still get collision, if enabled. Must be
+		/// set before the first update.
+		bool IsHeadless() const
+		{
+			return mHeadless;
+		}
+
+		void SetHeadless(bool value)
+		{
+			mHeadless = value;
+		}
+
+		/// Give the chunks around dynamic rigid bodies a collision shape,
+		/// that reads their voxels directly. Needs the physics subsystem.
+		bool IsCollision() const
+		{
+			return mCollision;
+		}
+
+		void SetCollision(bool value)
+		{
+			mCollision = value;
+		}
+
+		/// Chunks around the chunk of a simulated body, that get collision.
+		int GetCollisionRange() const
+		{
+			return mCollisionRange;
+		}
+
+		void SetCollisionRange(int value)
+		{
+			if (value < 0)
+			{
+				URHO3D_LOGDEBUG("Invalid collision range given. Use zero for the chunk of the body only.");
+				return;
+			}
+
+			mCollisionRange = value;
+		}
+
 		double GetDistToDestroy() const
 		{
 			return mDistToDestroy;
 		}
 
+		/// Run length encode the voxel data of initialized chunks. Saves
+		/// memory on layered terrain, but makes reading voxels slower.
+		bool IsRunLengthEncoding() const
+		{
+			return mRunLengthEncoding;
+		}
+
+		void SetRunLengthEncoding(bool value)
+		{
+			mRunLengthEncoding = value;
+		}
+
+		/// Merge coplanar quads between block voxels while meshing. Replaces
+		/// the lossless simplification, which is slow on blocky terrain.
+		bool IsGreedyMeshing() const
+		{
+			return mGreedyMeshing;
+		}
+
+		void SetGreedyMeshing(bool value)
+		{
+			mGreedyMeshing = value;
+		}
+
+		/// Number of coarser levels of detail for far chunks. Each level
+		/// doubles the voxel size, zero meshes everything at full resolution.
+		/// Levels the voxel count cannot be divided into are not used.
+		int GetLodLevels() const
+		{
+			int levels = 0;
+			while (levels < mLodLevels)
+			{
+				int step = 2 << levels;
+				if (mVoxelCount.x % step != 0 || mVoxelCount.y % step != 0 || mVoxelCount.z % step != 0 ||
+					mVoxelCount.x / step < 2 || mVoxelCount.y / step < 2 || mVoxelCount.z / step < 2)
+				{
+					break;
+				}
+
+				levels++;
+			}
+
+			return levels;
+		}
+
+		void SetLodLevels(int value)
+		{
+			if (value < 0 || value > MAX_LOD_LEVELS)
+			{
+				URHO3D_LOGDEBUG("Invalid number of LOD levels given. The maximum is " + String(MAX_LOD_LEVELS) + ".");
+				return;
+			}
+
+			mLodLevels = value;
+		}
+
+		/// Number of chunks, counted from the player, each level of detail spans.
+		int GetLodDistance() const
+		{
+			return mLodDistance;
+		}
+
+		void SetLodDistance(int value)
+		{
+			if (value < 1)
+			{
+				URHO3D_LOGDEBUG("Invalid LOD distance given. Each level must span at least one chunk.");
+				return;
+			}
+
+			mLodDistance = value;
+		}
+
+		/// Bytes of vertex data uploaded per frame, when chunk meshes are put
+		/// into the scene. The rest waits for the next frame, at least one
+		/// chunk is uploaded each frame. Zero disables the limit.
+		unsigned GetUploadBudget() const
+		{
+			return mUploadBudget;
+		}
+
+		void SetUploadBudget(unsigned value)
+		{
+			mUploadBudget = value;
+		}
+
+		/// Milliseconds per frame spent putting chunk meshes into the scene.
+		/// Zero disables the limit.
+		float GetUploadTimeBudget() const
+		{
+			return mUploadTimeBudget;
+		}
+
+		void SetUploadTimeBudget(float value)
+		{
+			if (value < 0.0f)
+			{
+				URHO3D_LOGDEBUG("Invalid upload time budget given. Use zero to disable it.");
+				return;
+			}
+
+			mUploadTimeBudget = value;
+		}
+
+		/// Record the changes against the generated terrain, so a server can
+		/// send them to its clients, which generate the rest on their own.
+		/// Edits also survive despawning without a region path this way.
+		/// Must be set before the first update.
+		bool IsReplication() const
+		{
+			return mReplication;
+		}
+
+		void SetReplication(bool value)
+		{
+			mReplication = value;
+		}
+
+		/// Bytes of voxel changes sent to each client per network update,
+		/// before compression. Closer chunks are sent first, at least one
+		/// chunk is sent each update. Zero disables the limit.
+		unsigned GetReplicationBudget() const
+		{
+			return mReplicationBudget;
+		}
+
+		void SetReplicationBudget(unsigned value)
+		{
+			mReplicationBudget = value;
+		}
+
+		/// Directory, despawned chunks are saved to and loaded from.
+		/// Empty disables saving, which is the default. Must be set
+		/// before the first update.
+		const String& GetRegionPath() const
+		{
+			return mRegionPath;
+		}
+
+		void SetRegionPath(const String& value)
+		{
+			mRegionPath = value;
+		}
+
+		/// Creates the voxels of new chunks. Chunks already spawned keep theirs.
+		VoxelGenerator* GetGenerator() const
+		{
+			return mGenerator;
+		}
+
+		void SetGenerator(VoxelGenerator* value)
+		{
+			if (value == nullptr)
+			{
+				URHO3D_LOGERROR("Voxer needs a generator, keeping the current one.");
+				return;
+			}
+
+			mGenerator = value;
+		}
 
 		void UpdateCunkDimension()
 		{
@@ -126,6 +350,19 @@ namespace Urho3D
 			Vector3i mViewRange;
 			Vector3d mChunkDimension;
 			bool mServer;
+			bool mHeadless;
+			bool mCollision;
+			int mCollisionRange;
+			bool mRunLengthEncoding;
+			bool mGreedyMeshing;
+			int mLodLevels;
+			int mLodDistance;
+			unsigned mUploadBudget;
+			float mUploadTimeBudget;
+			bool mReplication;
+			unsigned mReplicationBudget;
 			double mDistToDestroy;
+			SharedPtr<VoxelGenerator> mGenerator;
+			String mRegionPath;
 	};
 }
\ No newline at end of file
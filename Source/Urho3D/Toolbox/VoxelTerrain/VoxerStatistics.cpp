@@ -1,16 +1,131 @@
 #include "VoxerStatistics.h"
 
+#include <chrono>
+
 namespace Urho3D
 {
+	static const char* stageNames[] =
+	{
+		"init",
+		"mesh",
+		"simplify",
+		"upload"
+	};
+
+	VoxerHistogram::VoxerHistogram()
+	{
+		Reset();
+	}
+
+	int VoxerHistogram::GetBucket(unsigned value)
+	{
+		if (value < SUB_BUCKETS)
+		{
+			return (int) value;
+		}
+
+		/// Index of the highest bit, at least 3, and the three bits below it.
+		int exponent = 31;
+		while ((value & (1u << exponent)) == 0)
+		{
+			exponent--;
+		}
+
+		int mantissa = (int) (value >> (exponent - 3)) & (SUB_BUCKETS - 1);
+		return Min((exponent - 2) * SUB_BUCKETS + mantissa, NUM_BUCKETS - 1);
+	}
+
+	unsigned VoxerHistogram::GetBucketLimit(int bucket)
+	{
+		if (bucket < SUB_BUCKETS)
+		{
+			return (unsigned) bucket;
+		}
+
+		int exponent = bucket / SUB_BUCKETS + 2;
+		unsigned long long mantissa = SUB_BUCKETS + bucket % SUB_BUCKETS;
+		unsigned long long limit = ((mantissa + 1) << (exponent - 3)) - 1;
+
+		return (unsigned) Min(limit, (unsigned long long) M_MAX_UNSIGNED);
+	}
+
+	void VoxerHistogram::Add(unsigned value)
+	{
+		mBuckets[GetBucket(value)].fetch_add(1, std::memory_order_relaxed);
+		mCount.fetch_add(1, std::memory_order_relaxed);
+		mSum.fetch_add(value, std::memory_order_relaxed);
+
+		unsigned max = mMax.load(std::memory_order_relaxed);
+		while (value > max && !mMax.compare_exchange_weak(max, value, std::memory_order_relaxed))
+		{
+		}
+	}
+
+	void VoxerHistogram::Reset()
+	{
+		for (int i = 0; i < NUM_BUCKETS; i++)
+		{
+			mBuckets[i].store(0);
+		}
+
+		mCount.store(0);
+		mSum.store(0);
+		mMax.store(0);
+	}
+
+	double VoxerHistogram::GetMean() const
+	{
+		unsigned count = GetCount();
+		return count > 0 ? (double) GetSum() / count : 0.0;
+	}
+
+	unsigned VoxerHistogram::GetPercentile(float share) const
+	{
+		unsigned count = GetCount();
+		if (count == 0)
+		{
+			return 0;
+		}
+
+		/// The bucket limit can exceed the largest value recorded.
+		unsigned long long rank = (unsigned long long) Ceil(Clamp(share, 0.0f, 1.0f) * count);
+		unsigned long long seen = 0;
+		for (int i = 0; i < NUM_BUCKETS; i++)
+		{
+			seen += mBuckets[i].load(std::memory_order_relaxed);
+			if (seen >= rank && seen > 0)
+			{
+				return Min(GetBucketLimit(i), GetMax());
+			}
+		}
+
+		return GetMax();
+	}
+
+	void VoxerHistogram::ToJSON(JSONValue& dest) const
+	{
+		dest["count"] = GetCount();
+		dest["mean"] = GetMean();
+		dest["p50"] = GetPercentile(0.5f);
+		dest["p99"] = GetPercentile(0.99f);
+		dest["max"] = GetMax();
+	}
+
 	VoxerStatistics::VoxerStatistics()
 	{
 		mInitializedChunks.store(0);
 		mMeshedChunks.store(0);
-		mInitTime.store(0);
-		mMeshTime.store(0);
-		mSimplifyMeshTime.store(0);
 		mEmptyChunksSkipped.store(0);
 		mSolidChunksSkipped.store(0);
+		mLoadedChunks.store(0);
+		mTasksInFlight.store(0);
+	}
+
+	unsigned long long VoxerStatistics::GetTime()
+	{
+		/// Process time, like std::clock, adds up the time of all threads.
+		auto now = std::chrono::steady_clock::now().time_since_epoch();
+		return (unsigned long long) std::chrono::duration_cast<std::chrono::microseconds>(now).count();
 	}
 
 	void VoxerStatistics::AddInitialized()
@@ -23,54 +138,60 @@ namespace Urho3D
 		++mMeshedChunks;
 	}
 
-	void VoxerStatistics::AddInitTime(double time)
+	void VoxerStatistics::AddTime(VoxerStage stage, unsigned long long start)
 	{
-		mInitTime.fetch_add((long)time);
+		unsigned long long time = GetTime() - start;
+		mStages[stage].Add((unsigned) Min(time, (unsigned long long) M_MAX_UNSIGNED));
 	}
 
-	void VoxerStatistics::AddMeshTime(double time)
+	void VoxerStatistics::AddEmptyChunksSkipped()
 	{
-		mMeshTime.fetch_add((long)time);
+		++mEmptyChunksSkipped;
 	}
 
-	void VoxerStatistics::AddSimplifyMeshTime(double time)
+	void VoxerStatistics::AddSolidChunksSkipped()
 	{
-		mSimplifyMeshTime.fetch_add((long) time);
+		++mSolidChunksSkipped;
 	}
 
-	void VoxerStatistics::AddEmptyChunksSkipped()
+	void VoxerStatistics::AddLoaded()
 	{
-		++mEmptyChunksSkipped;
+		++mLoadedChunks;
 	}
 
-	void VoxerStatistics::AddSolidChunksSkipped()
+	void VoxerStatistics::AddChunkMemory(unsigned bytes)
 	{
-		++mSolidChunksSkipped;
+		mChunkMemory.Add(bytes);
 	}
 
-	int VoxerStatistics::GetInitialized() const
+	void VoxerStatistics::AddTasks(int count)
 	{
-		return mInitializedChunks.load();
+		mTasksInFlight.fetch_add(count);
 	}
 
-	int VoxerStatistics::GetMeshed() const
+	void VoxerStatistics::FinishTask()
 	{
-		return mMeshedChunks.load();
+		--mTasksInFlight;
 	}
 
-	long VoxerStatistics::GetInitTime() const
+	int VoxerStatistics::GetTasksInFlight() const
 	{
-		return mInitTime.load();
+		return mTasksInFlight.load();
 	}
 
-	long VoxerStatistics::GetMeshTime() const
+	void VoxerStatistics::SampleTasksInFlight()
 	{
-		return mMeshTime.load();
+		mTaskSamples.Add((unsigned) Max(GetTasksInFlight(), 0));
 	}
 
-	long VoxerStatistics::GetSimplifyMeshTime() const
+	int VoxerStatistics::GetInitialized() const
 	{
-		return mSimplifyMeshTime.load();
+		return mInitializedChunks.load();
+	}
+
+	int VoxerStatistics::GetMeshed() const
+	{
+		return mMeshedChunks.load();
 	}
 
 	long VoxerStatistics::GetEmptyChunksSkipped() const
@@ -83,6 +204,27 @@ namespace Urho3D
 		return mSolidChunksSkipped.load();
 	}
 
+	int VoxerStatistics::GetLoaded() const
+	{
+		return mLoadedChunks.load();
+	}
+
+	void VoxerStatistics::Reset()
+	{
+		mInitializedChunks.store(0);
+		mMeshedChunks.store(0);
+		mEmptyChunksSkipped.store(0);
+		mSolidChunksSkipped.store(0);
+		mLoadedChunks.store(0);
+		for (int i = 0; i < MAX_VOXER_STAGES; i++)
+		{
+			mStages[i].Reset();
+		}
+
+		mChunkMemory.Reset();
+		mTaskSamples.Reset();
+	}
+
 	void VoxerStatistics::Log()
 	{
 		URHO3D_LOGDEBUG(GetStats());
@@ -90,19 +232,50 @@ namespace Urho3D
 
 	String VoxerStatistics::GetStats() const
 	{
+		const VoxerHistogram& init = mStages[STAGE_INIT];
+		const VoxerHistogram& mesh = mStages[STAGE_MESH];
+		const VoxerHistogram& simplify = mStages[STAGE_SIMPLIFY];
+		const VoxerHistogram& upload = mStages[STAGE_UPLOAD];
+
 		String stats;
-		stats.AppendWithFormat("Chunk Statistics:\n\tInitialized: %d Init Time: %d Average: %d \n\tMeshed: %d Mesh Time: %d Average: %d\n Empty Skipped: %d Solid Skipped: %d\n\tSimplify Time: %d Average: %d",
+		stats.AppendWithFormat("Chunk Statistics (ms, p50/p99):\n\tInitialized: %d Loaded: %d Init: %.2f/%.2f\n\tMeshed: %d Mesh: %.2f/%.2f Simplify: %.2f/%.2f\n\tEmpty Skipped: %d Solid Skipped: %d\n\tUpload: %.2f/%.2f Tasks: %d Memory: %.1f KB",
 			GetInitialized(),
-			GetInitTime(),
-			GetInitTime() / GetInitialized(),
+			GetLoaded(),
+			init.GetPercentile(0.5f) / 1000.0f,
+			init.GetPercentile(0.99f) / 1000.0f,
 			GetMeshed(),
-			GetMeshTime(),
-			GetMeshTime() / GetMeshed(),
-			GetEmptyChunksSkipped(),
-			GetSolidChunksSkipped(),
-			GetSimplifyMeshTime(),
-			GetSimplifyMeshTime() / GetMeshed());
+			mesh.GetPercentile(0.5f) / 1000.0f,
+			mesh.GetPercentile(0.99f) / 1000.0f,
+			simplify.GetPercentile(0.5f) / 1000.0f,
+			simplify.GetPercentile(0.99f) / 1000.0f,
+			(int) GetEmptyChunksSkipped(),
+			(int) GetSolidChunksSkipped(),
+			upload.GetPercentile(0.5f) / 1000.0f,
+			upload.GetPercentile(0.99f) / 1000.0f,
+			GetTasksInFlight(),
+			mChunkMemory.GetMean() / 1024.0);
 
 		return stats;
 	}
-}
\ No newline at end of file
+
+	void VoxerStatistics::ToJSON(JSONValue& dest) const
+	{
+		JSONValue& chunks = dest["chunks"];
+		chunks["initialized"] = GetInitialized();
+		chunks["loaded"] = GetLoaded();
+		chunks["meshed"] = GetMeshed();
+		chunks["emptySkipped"] = (int) GetEmptyChunksSkipped();
+		chunks["solidSkipped"] = (int) GetSolidChunksSkipped();
+
+		JSONValue& stages = dest["stages"];
+		for (int i = 0; i < MAX_VOXER_STAGES; i++)
+		{
+			JSONValue& stage = stages[stageNames[i]];
+			mStages[i].ToJSON(stage);
+			stage["total"] = (double) mStages[i].GetSum();
+		}
+
+		mChunkMemory.ToJSON(dest["chunkMemory"]);
+		mTaskSamples.ToJSON(dest["tasksInFlight"]);
+	}
+}
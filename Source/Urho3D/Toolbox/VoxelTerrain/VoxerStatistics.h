@@ -2,37 +2,120 @@
 
 #include <atomic>
 #include "../../IO/Log.h"
+#include "../../Resource/JSONValue.h"
 
 namespace Urho3D
 {
+	/// Steps a chunk goes through, their wall time is recorded.
+	enum VoxerStage
+	{
+		/// Generate or load the voxels.
+		STAGE_INIT = 0,
+
+		/// Extract the surface.
+		STAGE_MESH,
+
+		/// Lossless simplification of the surface.
+		STAGE_SIMPLIFY,
+
+		/// Fill the model of the chunk on the main thread.
+		STAGE_UPLOAD,
+
+		MAX_VOXER_STAGES
+	};
+
+	/// Distribution of unsigned values, safe to fill from any thread.
+	///
+	/// Values below 8 are counted exactly, larger ones in 8 buckets per
+	/// power of two. Percentiles are at most 12.5% above the real value.
+	class VoxerHistogram
+	{
+	public:
+		static const int SUB_BUCKETS = 8;
+		static const int NUM_BUCKETS = 30 * SUB_BUCKETS;
+
+	private:
+		std::atomic<unsigned> mBuckets[NUM_BUCKETS];
+		std::atomic<unsigned> mCount;
+		std::atomic<unsigned long long> mSum;
+		std::atomic<unsigned> mMax;
+
+		static int GetBucket(unsigned value);
+
+		/// Largest value counted by the bucket.
+		static unsigned GetBucketLimit(int bucket);
+
+	public:
+		VoxerHistogram();
+
+		void Add(unsigned value);
+		void Reset();
+
+		unsigned GetCount() const
+		{
+			return mCount.load();
+		}
+
+		unsigned long long GetSum() const
+		{
+			return mSum.load();
+		}
+
+		unsigned GetMax() const
+		{
+			return mMax.load();
+		}
+
+		double GetMean() const;
+
+		/// Value, that the given share of all values does not exceed, 0.5
+		/// for the median.
+		unsigned GetPercentile(float share) const;
+
+		/// Count, mean, p50, p99 and max as a JSON object.
+		void ToJSON(JSONValue& dest) const;
+	};
+
 	class VoxerStatistics
 	{
 	private:
 		std::atomic<int> mInitializedChunks;
 		std::atomic<int> mMeshedChunks;
-		std::atomic<long> mInitTime;
-		std::atomic<long> mMeshTime;
-		std::atomic<long> mSimplifyMeshTime;
 		std::atomic<long> mEmptyChunksSkipped;
 		std::atomic<long> mSolidChunksSkipped;
+		std::atomic<int> mLoadedChunks;
+
+		/// Wall time of each stage, in microseconds.
+		VoxerHistogram mStages[MAX_VOXER_STAGES];
+
+		/// Voxel memory of each initialized chunk, in bytes.
+		VoxerHistogram mChunkMemory;
+
+		/// Chunk tasks submitted, that have not finished yet.
+		std::atomic<int> mTasksInFlight;
+
+		/// Tasks in flight, sampled once per update.
+		VoxerHistogram mTaskSamples;
 
 	public:
 		VoxerStatistics();
 
+		/// Wall clock in microseconds, to measure stages with.
+		static unsigned long long GetTime();
+
 		void AddInitialized();
 		int GetInitialized() const;
 
 		void AddMeshed();
 		int GetMeshed() const;
 
-		void AddInitTime(double time);
-		long GetInitTime() const;
+		/// Record the time passed since start, taken from GetTime.
+		void AddTime(VoxerStage stage, unsigned long long start);
 
-		void AddMeshTime(double time);
-		long GetMeshTime() const;
-
-		void AddSimplifyMeshTime(double time);
-		long GetSimplifyMeshTime() const;
+		const VoxerHistogram& GetStage(VoxerStage stage) const
+		{
+			return mStages[stage];
+		}
 
 		long GetEmptyChunksSkipped() const;
 		void AddEmptyChunksSkipped();
@@ -40,8 +123,39 @@ namespace Urho3D
 		long GetSolidChunksSkipped() const;
 		void AddSolidChunksSkipped();
 
+		/// Chunks loaded from disk instead of generated.
+		int GetLoaded() const;
+		void AddLoaded();
+
+		void AddChunkMemory(unsigned bytes);
+
+		const VoxerHistogram& GetChunkMemory() const
+		{
+			return mChunkMemory;
+		}
+
+		/// Count tasks handed to the work queue and finished ones.
+		void AddTasks(int count);
+		void FinishTask();
+		int GetTasksInFlight() const;
+
+		/// Record the tasks currently in flight. Called once per update.
+		void SampleTasksInFlight();
+
+		const VoxerHistogram& GetTaskSamples() const
+		{
+			return mTaskSamples;
+		}
+
+		/// Start over, the tasks in flight are kept.
+		void Reset();
+
 		void Log();
 
 		String GetStats() const;
+
+		/// All counters and distributions as a JSON object. Times are in
+		/// microseconds, memory in bytes.
+		void ToJSON(JSONValue& dest) const;
 	};
-}
\ No newline at end of file
+}
@@ -6,9 +6,16 @@
 #include "../../Graphics/StaticModel.h"
 #include "../../Graphics/Material.h"
 #include "../../Core/Profiler.h"
+#include "../../Core/Timer.h"
 #include "../../Engine/EngineEvents.h"
 #include "../../Core/CoreEvents.h"
 
+#ifdef URHO3D_PHYSICS
+#include "../../Physics/PhysicsWorld.h"
+#include "../../Physics/RigidBody.h"
+#include "VoxelCollisionShape.h"
+#endif
+
 namespace Urho3D
 {
 	VoxerSystem* VoxerSystem::mInstance = nullptr;
@@ -20,10 +27,17 @@ namespace Urho3D
 		mSettings = new VoxerSettings(ctx);
 		mTaskSystem = GetSubsystem<WorkQueue>();
 		mChunkProvider = new ChunkProvider(ctx, mSettings);
+#ifdef URHO3D_NETWORK
+		mReplicator = new VoxelReplicator(ctx, mSettings, mChunkProvider);
+#endif
 
 		CreateCamera();
 		mResourceCache = GetSubsystem<ResourceCache>();
 
+#ifdef URHO3D_PHYSICS
+		VoxelCollisionShape::RegisterObject(ctx);
+#endif
+
 		SubscribeToEvent(E_ENGINE_QUIT, URHO3D_HANDLER(VoxerSystem, Shutdown));
 		SubscribeToEvent(E_POSTRENDERUPDATE, URHO3D_HANDLER(VoxerSystem, HandlePostRenderUpdate));
 	}
@@ -45,56 +59,214 @@ namespace Urho3D
 
 	void VoxerSystem::Update(const Vector<Vector3d>& playerPositions)
 	{
+		if (mSettings->IsCollision())
+		{
+			UpdateCollisionPositions();
+		}
+
 		mChunkProvider->Update(playerPositions);
 
 		URHO3D_PROFILE(UpdateVoxerSystem);
 
 		Chunk* chunk;
-		auto dim = mSettings->GetChunkDimension();
 		while (mChunksToSpawn.try_dequeue(chunk))
 		{
-			auto model = chunk->GetModel();
-			if (model == nullptr)
+			if (!chunk->IsUploadPending())
+			{
+				chunk->SetUploadPending(true);
+				mPendingUploads.push_back(chunk);
+			}
+		}
+
+		Vector3d v(0.0, 0.0, 0.0);
+		while (mChunksToDespawn.try_dequeue(v))
+		{
+			auto it = mSpawnedChunks.find(v);
+			if (it != mSpawnedChunks.end())
+			{
+				RemoveChunkNode(it->second);
+				mSpawnedChunks.erase(it);
+			}
+		}
+
+		UploadChunks();
+	}
+
+	void VoxerSystem::UploadChunks()
+	{
+		if (mPendingUploads.empty())
+		{
+			return;
+		}
+
+		URHO3D_PROFILE(UploadChunks);
+
+		HiresTimer timer;
+		unsigned budget = mSettings->GetUploadBudget();
+		long long timeBudget = (long long) (mSettings->GetUploadTimeBudget() * 1000.0f);
+		unsigned bytes = 0;
+		int uploaded = 0;
+
+		/// Chunks put back are not looked at again this frame.
+		int count = (int) mPendingUploads.size();
+		for (int i = 0; i < count; i++)
+		{
+			if (uploaded > 0)
 			{
+				if ((budget > 0 && bytes >= budget) || (timeBudget > 0 && timer.GetUSec(false) >= timeBudget))
+				{
+					break;
+				}
+			}
+
+			auto c = mPendingUploads.front();
+			mPendingUploads.pop_front();
+
+			/// Despawned meanwhile, the chunk might be in use for another position.
+			if (mChunkProvider->GetChunk(c->GetChunkIndex()) != c)
+			{
+				c->SetUploadPending(false);
 				continue;
 			}
 
-			auto pos = chunk->GetWorldPosition();
-			auto name = pos.ToString();
+			/// Reused and meshed again right now, wait for the mesh.
+			if (c->IsScheduled() && !c->Meshed())
+			{
+				mPendingUploads.push_back(c);
+				continue;
+			}
 
-			auto planeNode = mScene->CreateChild();
-			planeNode->SetName(name);
+			c->SetUploadPending(false);
+			auto start = VoxerStatistics::GetTime();
+			bytes += SpawnChunkNode(c);
+			Chunk::Stats->AddTime(STAGE_UPLOAD, start);
+			uploaded++;
+		}
+	}
 
-			auto* planeObject = planeNode->CreateComponent<StaticModel>();
+	unsigned VoxerSystem::SpawnChunkNode(Chunk* c)
+	{
+		auto pos = c->GetWorldPosition();
 
-			planeObject->SetModel(model);
-			planeObject->SetMaterial(mResourceCache->GetResource<Material>("Materials/StoneTiled.xml"));
+		Node* node = nullptr;
+		StaticModel* object = nullptr;
+		auto it = mSpawnedChunks.find(pos);
+		if (it != mSpawnedChunks.end())
+		{
+			node = it->second;
+			object = node->GetComponent<StaticModel>();
+		}
 
-			planeNode->SetPosition(Vector3(pos.x, pos.y, pos.z));
-			planeNode->SetRotation(Quaternion::IDENTITY);
+		SharedPtr<Model> old(object != nullptr ? object->GetModel() : nullptr);
+		SharedPtr<Model> pooled = TakePooledModel();
+		SharedPtr<Model> model = c->GetModel(pooled);
+		if (model != pooled)
+		{
+			PoolModel(pooled);
+		}
 
-			/// Already spawned?
-			auto it = mSpawnedChunks.find(pos);
-			if (it != mSpawnedChunks.end())
+		if (model == nullptr)
+		{
+			if (node != nullptr)
 			{
-				mScene->RemoveChild(it->second);
+				RemoveChunkNode(node);
 				mSpawnedChunks.erase(it);
 			}
 
-			mSpawnedChunks[pos] = planeNode;
-			chunk->SetMeshInGame(true);
+			return 0;
 		}
 
-		Vector3d v(0.0, 0.0, 0.0);
-		while (mChunksToDespawn.try_dequeue(v))
+		if (object == nullptr)
 		{
-			auto it = mSpawnedChunks.find(v);
-			if (it != mSpawnedChunks.end())
+			node = mScene->CreateChild();
+			node->SetName(pos.ToString());
+			node->SetPosition(Vector3(pos.x, pos.y, pos.z));
+			node->SetRotation(Quaternion::IDENTITY);
+
+			object = node->CreateComponent<StaticModel>();
+			object->SetModel(model);
+			object->SetMaterial(mResourceCache->GetResource<Material>("Materials/StoneTiled.xml"));
+
+			mSpawnedChunks[pos] = node;
+		}
+		else if (model != old)
+		{
+			/// The old model is not drawn anymore, its buffers are filled
+			/// by one of the next chunks.
+			object->SetModel(model);
+			PoolModel(old);
+		}
+
+		c->SetMeshInGame(true);
+
+		auto geometry = model->GetGeometry(0, 0);
+		auto& buffers = model->GetVertexBuffers();
+		if (geometry == nullptr || buffers.Empty())
+		{
+			return 0;
+		}
+
+		return geometry->GetVertexCount() * buffers[0]->GetVertexSize();
+	}
+
+	void VoxerSystem::UpdateCollisionPositions()
+	{
+#ifdef URHO3D_PHYSICS
+		URHO3D_PROFILE(UpdateCollisionPositions);
+
+		PODVector<RigidBody*> bodies;
+		mScene->GetComponents<RigidBody>(bodies, true);
+
+		/// Sleeping bodies keep their collision, something might wake them.
+		Vector<Vector3d> positions;
+		for (unsigned i = 0; i < bodies.Size(); i++)
+		{
+			auto body = bodies[i];
+			if (body->GetMass() <= 0.0f || !body->IsEnabledEffective())
 			{
-				mScene->RemoveChild(it->second);
-				mSpawnedChunks.erase(it);
+				continue;
 			}
+
+			auto p = body->GetPosition();
+			positions.Push(Vector3d(p.x_, p.y_, p.z_));
+		}
+
+		mChunkProvider->SetCollisionPositions(positions);
+#endif
+	}
+
+	void VoxerSystem::RemoveChunkNode(Node* node)
+	{
+		auto object = node->GetComponent<StaticModel>();
+		SharedPtr<Model> model(object != nullptr ? object->GetModel() : nullptr);
+
+		mScene->RemoveChild(node);
+		PoolModel(model);
+	}
+
+	SharedPtr<Model> VoxerSystem::TakePooledModel()
+	{
+		if (mModelPool.empty())
+		{
+			return SharedPtr<Model>();
+		}
+
+		SharedPtr<Model> model = mModelPool.back();
+		mModelPool.pop_back();
+
+		return model;
+	}
+
+	void VoxerSystem::PoolModel(Model* model)
+	{
+		/// Models of edited chunks stay with their chunk, the caller holds
+		/// the only other reference of a free one.
+		if (model == nullptr || model->Refs() > 1 || mModelPool.size() >= MAX_POOLED_MODELS)
+		{
+			return;
 		}
+
+		mModelPool.push_back(SharedPtr<Model>(model));
 	}
 
 	ChunkProvider* VoxerSystem::GetChunkProvider()
@@ -111,9 +283,69 @@ namespace Urho3D
 
 	void VoxerSystem::DestroyChunk(Chunk* c)
 	{
+		/// The chunk is reused right away, the shape must not read it anymore.
+		if (c->HasCollision())
+		{
+			RemoveCollision(c);
+		}
+
 		mChunksToDespawn.enqueue(c->GetWorldPosition());
 	}
 
+	void VoxerSystem::AddCollision(Chunk* c)
+	{
+#ifdef URHO3D_PHYSICS
+		auto pos = c->GetWorldPosition();
+		auto node = mScene->CreateChild();
+		node->SetName(pos.ToString());
+		node->SetPosition(Vector3(pos.x, pos.y, pos.z));
+		node->SetRotation(Quaternion::IDENTITY);
+
+		/// Static, the default mass is zero.
+		node->CreateComponent<RigidBody>();
+		node->CreateComponent<VoxelCollisionShape>()->SetChunk(c);
+
+		mCollisionNodes[c->GetChunkIndex()] = node;
+		c->SetCollision(true);
+#endif
+	}
+
+	void VoxerSystem::RemoveCollision(Chunk* c)
+	{
+		auto it = mCollisionNodes.find(c->GetChunkIndex());
+		if (it != mCollisionNodes.end())
+		{
+			mScene->RemoveChild(it->second);
+			mCollisionNodes.erase(it);
+		}
+
+		c->SetCollision(false);
+	}
+
+	void VoxerSystem::RefreshCollision(const Vector3d& min, const Vector3d& max)
+	{
+#ifdef URHO3D_PHYSICS
+		auto world = mScene->GetComponent<PhysicsWorld>();
+		if (world == nullptr)
+		{
+			return;
+		}
+
+		/// Bodies resting on the changed voxels sit just outside the box.
+		float margin = mSettings->GetVoxelSize();
+		BoundingBox box(
+			Vector3((float) min.x - margin, (float) min.y - margin, (float) min.z - margin),
+			Vector3((float) max.x + margin, (float) max.y + margin, (float) max.z + margin));
+
+		PODVector<RigidBody*> bodies;
+		world->GetRigidBodies(bodies, box);
+		for (unsigned i = 0; i < bodies.Size(); i++)
+		{
+			bodies[i]->Activate();
+		}
+#endif
+	}
+
 	void VoxerSystem::HandlePostRenderUpdate(StringHash eventType, VariantMap& eventData)
 	{
 		mChunkProvider->DrawChunkBounds(mDebugRenderer);
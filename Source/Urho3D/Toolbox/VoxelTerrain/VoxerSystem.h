@@ -9,11 +9,17 @@
 #include "../../Graphics/DebugRenderer.h"
 
 #include <EASTL/hash_map.h>
+#include <EASTL/deque.h>
+#include <EASTL/vector.h>
 
 #include "VoxerSettings.h"
 #include "ChunkProvider.h"
 #include "Chunk.h"
 
+#ifdef URHO3D_NETWORK
+#include "VoxelReplicator.h"
+#endif
+
 
 namespace Urho3D
 {
@@ -26,6 +32,10 @@ namespace Urho3D
 
 		SharedPtr<VoxerSettings> mSettings;
 		SharedPtr<ChunkProvider> mChunkProvider;
+#ifdef URHO3D_NETWORK
+		/// Sends voxel changes to clients, if replication is enabled.
+		SharedPtr<VoxelReplicator> mReplicator;
+#endif
 		SharedPtr<WorkQueue> mTaskSystem;
 		moodycamel::ConcurrentQueue<Chunk*> mChunksToSpawn;
 		moodycamel::ConcurrentQueue<Vector3d> mChunksToDespawn;
@@ -38,9 +48,38 @@ namespace Urho3D
 
 		eastl::hash_map<Vector3d, Node*> mSpawnedChunks;
 
+		/// Nodes with the collision of chunks near simulated bodies.
+		eastl::hash_map<Vector3i, Node*> mCollisionNodes;
+
+		/// Chunks with a new mesh, put into the scene as the upload budget allows.
+		eastl::deque<Chunk*> mPendingUploads;
+
+		/// Models of removed chunk nodes, their buffers are filled again
+		/// instead of creating new ones.
+		eastl::vector<SharedPtr<Model>> mModelPool;
+
 		void CreateCamera();
 
+		/// Put pending chunks into the scene until the budget of this frame is spent.
+		void UploadChunks();
+
+		/// Create or update the node of the given chunk. Returns the bytes of
+		/// vertex data uploaded.
+		unsigned SpawnChunkNode(Chunk* c);
+
+		/// Hand the positions of all dynamic rigid bodies to the provider.
+		void UpdateCollisionPositions();
+
+		/// Remove the node and keep its model, if nothing else uses it.
+		void RemoveChunkNode(Node* node);
+
+		SharedPtr<Model> TakePooledModel();
+		void PoolModel(Model* model);
+
 	public:
+		/// Models kept for reuse at most.
+		static const unsigned MAX_POOLED_MODELS = 64;
+
 		VoxerSystem(Context* ctx);
 		~VoxerSystem();
 
@@ -58,6 +97,12 @@ namespace Urho3D
 
 		ChunkProvider* GetChunkProvider();
 
+		/// Chunks in view of this camera are spawned first.
+		void SetViewCamera(Camera* camera)
+		{
+			mChunkProvider->SetViewCamera(camera);
+		}
+
 		/// TODO: Subscribe to shutdown event in order clean up properly.
 		void Shutdown(StringHash eventType, VariantMap& eventData);
 
@@ -67,6 +112,14 @@ namespace Urho3D
 		/// Destroy a single chunk.
 		void DestroyChunk(Chunk* c);
 
+		/// Create the collision node of a chunk. Main thread only.
+		void AddCollision(Chunk* c);
+
+		void RemoveCollision(Chunk* c);
+
+		/// Wake the bodies around changed voxels, so they notice the change.
+		void RefreshCollision(const Vector3d& min, const Vector3d& max);
+
 		void SpawnChunk(Chunk* c)
 		{
 			mChunksToSpawn.enqueue(c);